@@ -0,0 +1,45 @@
+/*
+ * 2013+ Copyright (c) Evgeniy Polyakov <zbr@ioremap.net>
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef __DNET_BENCH_H
+#define __DNET_BENCH_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+
+/*
+ * Helpers shared by microbenchmarks, every benchmark prints one line per case:
+ * case name, number of operations, nanoseconds per operation and operations per second
+ */
+
+static inline uint64_t dnet_bench_now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static inline void dnet_bench_report(const char *name, uint64_t ops, uint64_t ns)
+{
+	if (!ns)
+		ns = 1;
+
+	printf("%-40s %12llu ops %10.1f ns/op %14.0f ops/sec\n", name,
+			(unsigned long long)ops, (double)ns / ops, ops * 1000000000.0 / ns);
+}
+
+#endif /* __DNET_BENCH_H */
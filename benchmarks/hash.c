@@ -0,0 +1,136 @@
+/*
+ * 2013+ Copyright (c) Evgeniy Polyakov <zbr@ioremap.net>
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "elliptics.h"
+
+#include "bench.h"
+
+/*
+ * Hashes used to pick lock stripes and buckets: speed of dnet_id_hash() over whole ID
+ * and of dnet_trans_hash(), and how evenly they spread keys which differ only in a few
+ * bytes. Spread is the ratio of the most loaded bucket to the average load, 1.0 is perfect.
+ */
+
+#define HASH_BENCH_BITS		10
+
+static volatile uint64_t hash_bench_sink;
+
+static void hash_bench_report_spread(const char *name, unsigned int *buckets, uint64_t num)
+{
+	unsigned int i, max = 0;
+
+	for (i = 0; i < (1U << HASH_BENCH_BITS); ++i) {
+		if (buckets[i] > max)
+			max = buckets[i];
+	}
+
+	printf("%-40s %12llu keys %10.2f max/avg bucket load\n", name, (unsigned long long)num,
+			(double)max * (1U << HASH_BENCH_BITS) / num);
+}
+
+/*
+ * @pos is the first byte of ID which differs between keys, bytes before it are the same,
+ * so that the keys look like IDs of a single object's parts or of objects in one namespace
+ */
+static void hash_bench_id(uint64_t num, int pos)
+{
+	unsigned int buckets[1U << HASH_BENCH_BITS];
+	struct dnet_raw_id id;
+	uint64_t i, hash = 0, start;
+	size_t size = DNET_ID_SIZE - pos;
+	char name[64];
+
+	if (size > sizeof(i))
+		size = sizeof(i);
+
+	memset(buckets, 0, sizeof(buckets));
+	memset(&id, 0xab, sizeof(id));
+
+	start = dnet_bench_now_ns();
+	for (i = 0; i < num; ++i) {
+		memcpy(&id.id[pos], &i, size);
+
+		hash = dnet_id_hash(id.id);
+		buckets[hash & ((1U << HASH_BENCH_BITS) - 1)]++;
+	}
+	hash_bench_sink += hash;
+
+	snprintf(name, sizeof(name), "id hash, keys differ from byte %d", pos);
+	dnet_bench_report(name, num, dnet_bench_now_ns() - start);
+	hash_bench_report_spread("", buckets, num);
+}
+
+static void hash_bench_trans(uint64_t num, uint64_t stride)
+{
+	unsigned int buckets[1U << HASH_BENCH_BITS];
+	uint64_t i, start;
+	unsigned int hash = 0;
+	char name[64];
+
+	memset(buckets, 0, sizeof(buckets));
+
+	start = dnet_bench_now_ns();
+	for (i = 0; i < num; ++i) {
+		hash = dnet_trans_hash(i * stride, HASH_BENCH_BITS);
+		buckets[hash]++;
+	}
+	hash_bench_sink += hash;
+
+	snprintf(name, sizeof(name), "trans hash, stride %llu", (unsigned long long)stride);
+	dnet_bench_report(name, num, dnet_bench_now_ns() - start);
+	hash_bench_report_spread("", buckets, num);
+}
+
+static void hash_usage(char *p)
+{
+	fprintf(stderr, "Usage: %s <options>\n"
+			"  -n ops                    - number of hashed keys (default: 10000000)\n"
+			"  -h                        - this help\n"
+			, p);
+	exit(-1);
+}
+
+int main(int argc, char *argv[])
+{
+	uint64_t ops = 10000000;
+	int ch;
+
+	while ((ch = getopt(argc, argv, "n:h")) != -1) {
+		switch (ch) {
+			case 'n':
+				ops = strtoull(optarg, NULL, 0);
+				break;
+			case 'h':
+			default:
+				hash_usage(argv[0]);
+		}
+	}
+
+	hash_bench_id(ops, 0);
+	hash_bench_id(ops, DNET_ID_SIZE / 2);
+	hash_bench_id(ops, DNET_ID_SIZE - 8);
+	hash_bench_id(ops, DNET_ID_SIZE - 2);
+
+	hash_bench_trans(ops, 1);
+	hash_bench_trans(ops, 16);
+	hash_bench_trans(ops, 1024);
+
+	return 0;
+}
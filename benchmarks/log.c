@@ -0,0 +1,196 @@
+/*
+ * 2013+ Copyright (c) Evgeniy Polyakov <zbr@ioremap.net>
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "elliptics.h"
+
+#include "bench.h"
+
+/*
+ * Logging calls per second seen by the calling threads for every message level
+ * with synchronous logging and with DNET_CFG_ASYNC_LOG. Messages above node's
+ * log level are filtered out, the rest are written into the file (/dev/null by default).
+ */
+
+struct log_bench_thread {
+	struct dnet_node	*n;
+	int			level;
+	uint64_t		ops;
+	pthread_t		tid;
+};
+
+static const char *log_bench_levels[] = {
+	[DNET_LOG_DATA] = "data",
+	[DNET_LOG_ERROR] = "error",
+	[DNET_LOG_INFO] = "info",
+	[DNET_LOG_NOTICE] = "notice",
+	[DNET_LOG_DEBUG] = "debug",
+};
+
+static void log_bench_log(void *priv, int level __unused, const char *msg)
+{
+	fputs(msg, priv);
+}
+
+static void *log_bench_process(void *data)
+{
+	struct log_bench_thread *t = data;
+	uint64_t i;
+
+	for (i = 0; i < t->ops; ++i)
+		dnet_log(t->n, t->level, "log benchmark message: thread: %p, level: %d, op: %llu\n",
+				t, t->level, (unsigned long long)i);
+
+	return NULL;
+}
+
+static int log_bench_run(struct dnet_node *n, int level, int thread_num, uint64_t ops)
+{
+	struct log_bench_thread *threads;
+	struct dnet_stat_count before, after;
+	uint64_t start, ns;
+	char name[64];
+	int i, err = 0;
+
+	threads = calloc(thread_num, sizeof(struct log_bench_thread));
+	if (!threads)
+		return -ENOMEM;
+
+	dnet_node_get_counter(n, DNET_CNTR_LOG_DROPPED, &before);
+
+	start = dnet_bench_now_ns();
+	for (i = 0; i < thread_num; ++i) {
+		threads[i].n = n;
+		threads[i].level = level;
+		threads[i].ops = ops;
+
+		err = -pthread_create(&threads[i].tid, NULL, log_bench_process, &threads[i]);
+		if (err)
+			break;
+	}
+
+	thread_num = i;
+	for (i = 0; i < thread_num; ++i)
+		pthread_join(threads[i].tid, NULL);
+	ns = dnet_bench_now_ns() - start;
+
+	/* queued messages are written before the next case starts */
+	dnet_log_flush(n);
+	dnet_node_get_counter(n, DNET_CNTR_LOG_DROPPED, &after);
+
+	if (!err) {
+		snprintf(name, sizeof(name), "log %s %s, threads: %d",
+				(n->flags & DNET_CFG_ASYNC_LOG) ? "async" : "sync", log_bench_levels[level], thread_num);
+		dnet_bench_report(name, ops * thread_num, ns);
+
+		if (after.count != before.count)
+			printf("%-40s %12llu dropped\n", "", (unsigned long long)(after.count - before.count));
+	}
+
+	free(threads);
+	return err;
+}
+
+static void log_usage(char *p)
+{
+	fprintf(stderr, "Usage: %s <options>\n"
+			"  -l log_level              - node's log level, messages above it are filtered (default: 2)\n"
+			"  -f file                   - file to write messages to (default: /dev/null)\n"
+			"  -n ops                    - number of messages per thread (default: 1000000)\n"
+			"  -t threads                - maximum number of logging threads (default: 4)\n"
+			"  -h                        - this help\n"
+			, p);
+	exit(-1);
+}
+
+int main(int argc, char *argv[])
+{
+	struct dnet_node *nodes[2] = { NULL, NULL };
+	struct dnet_config cfg;
+	struct dnet_log log;
+	char *file = "/dev/null";
+	FILE *out;
+	int log_level = DNET_LOG_INFO, thread_num = 4;
+	uint64_t ops = 1000000;
+	int ch, i, level, threads, err = -ENOMEM;
+
+	while ((ch = getopt(argc, argv, "l:f:n:t:h")) != -1) {
+		switch (ch) {
+			case 'l':
+				log_level = atoi(optarg);
+				break;
+			case 'f':
+				file = optarg;
+				break;
+			case 'n':
+				ops = strtoull(optarg, NULL, 0);
+				break;
+			case 't':
+				thread_num = atoi(optarg);
+				break;
+			case 'h':
+			default:
+				log_usage(argv[0]);
+		}
+	}
+
+	out = fopen(file, "a");
+	if (!out) {
+		err = -errno;
+		goto err_out_exit;
+	}
+
+	memset(&log, 0, sizeof(log));
+	log.log_level = log_level;
+	log.log = log_bench_log;
+	log.log_private = out;
+
+	for (i = 0; i < 2; ++i) {
+		memset(&cfg, 0, sizeof(cfg));
+		cfg.log = &log;
+		cfg.wait_timeout = 60;
+		cfg.flags = DNET_CFG_NO_ROUTE_LIST | (i ? DNET_CFG_ASYNC_LOG : 0);
+
+		nodes[i] = dnet_node_create(&cfg);
+		if (!nodes[i])
+			goto err_out_destroy;
+	}
+
+	for (level = DNET_LOG_ERROR; level <= DNET_LOG_DEBUG; ++level) {
+		for (threads = 1; threads <= thread_num; threads *= 2) {
+			for (i = 0; i < 2; ++i) {
+				err = log_bench_run(nodes[i], level, threads, ops);
+				if (err)
+					goto err_out_destroy;
+			}
+		}
+	}
+
+err_out_destroy:
+	for (i = 0; i < 2; ++i) {
+		if (nodes[i])
+			dnet_node_destroy(nodes[i]);
+	}
+	fclose(out);
+err_out_exit:
+	if (err)
+		fprintf(stderr, "log benchmark failed: %s [%d]\n", strerror(-err), err);
+	return err;
+}
@@ -0,0 +1,197 @@
+/*
+ * 2013+ Copyright (c) Evgeniy Polyakov <zbr@ioremap.net>
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "elliptics.h"
+
+#include "bench.h"
+
+/*
+ * Operation lock and unlock pairs per second taken by several threads in read
+ * or write mode, either all on the same key or every thread on its own keys.
+ * Contention on stripe mutexes is reported from DNET_CNTR_OPLOCK_STRIPE.
+ */
+
+/* keys of every thread are taken round-robin from its own pool */
+#define OPLOCK_BENCH_KEYS	1024
+
+struct oplock_bench_thread {
+	struct dnet_node	*n;
+	struct dnet_id		*keys;
+	int			key_num;
+	int			mode;
+	uint64_t		ops;
+	pthread_t		tid;
+};
+
+static void oplock_bench_log(void *priv __unused, int level __unused, const char *msg)
+{
+	fputs(msg, stderr);
+}
+
+static void *oplock_bench_process(void *data)
+{
+	struct oplock_bench_thread *t = data;
+	struct dnet_id *key;
+	uint64_t i;
+
+	for (i = 0; i < t->ops; ++i) {
+		key = &t->keys[i % t->key_num];
+
+		dnet_oplock_mode(t->n, key, t->mode);
+		dnet_opunlock(t->n, key);
+	}
+
+	return NULL;
+}
+
+static int oplock_bench(struct dnet_node *n, struct dnet_id *keys, int thread_num, int mode, int shared_key, uint64_t ops)
+{
+	struct dnet_stat_count before[__DNET_CNTR_MAX], after[__DNET_CNTR_MAX];
+	struct oplock_bench_thread *threads;
+	uint64_t start, ns;
+	char name[64];
+	int i, err = 0;
+
+	threads = calloc(thread_num, sizeof(struct oplock_bench_thread));
+	if (!threads)
+		return -ENOMEM;
+
+	memset(before, 0, sizeof(before));
+	memset(after, 0, sizeof(after));
+	dnet_locks_stat(n, before);
+
+	start = dnet_bench_now_ns();
+	for (i = 0; i < thread_num; ++i) {
+		threads[i].n = n;
+		threads[i].keys = shared_key ? keys : keys + i * OPLOCK_BENCH_KEYS;
+		threads[i].key_num = shared_key ? 1 : OPLOCK_BENCH_KEYS;
+		threads[i].mode = mode;
+		threads[i].ops = ops;
+
+		err = -pthread_create(&threads[i].tid, NULL, oplock_bench_process, &threads[i]);
+		if (err)
+			break;
+	}
+
+	thread_num = i;
+	for (i = 0; i < thread_num; ++i)
+		pthread_join(threads[i].tid, NULL);
+	ns = dnet_bench_now_ns() - start;
+
+	dnet_locks_stat(n, after);
+
+	if (!err) {
+		snprintf(name, sizeof(name), "oplock %s, %s key, threads: %d", mode == DNET_OPLOCK_READ ? "read" : "write",
+				shared_key ? "same" : "own", thread_num);
+		dnet_bench_report(name, ops * thread_num, ns);
+		printf("%-40s %12llu waited %10llu contended stripe locks\n", "",
+				(unsigned long long)(after[DNET_CNTR_OPLOCK].err - before[DNET_CNTR_OPLOCK].err),
+				(unsigned long long)(after[DNET_CNTR_OPLOCK_STRIPE].err - before[DNET_CNTR_OPLOCK_STRIPE].err));
+	}
+
+	free(threads);
+	return err;
+}
+
+static void oplock_usage(char *p)
+{
+	fprintf(stderr, "Usage: %s <options>\n"
+			"  -s stripes                - number of lock stripes, 0 - derived from number of CPUs (default: 0)\n"
+			"  -n ops                    - number of lock/unlock pairs per thread (default: 1000000)\n"
+			"  -t threads                - maximum number of locking threads (default: 4)\n"
+			"  -h                        - this help\n"
+			, p);
+	exit(-1);
+}
+
+int main(int argc, char *argv[])
+{
+	struct dnet_config cfg;
+	struct dnet_log log;
+	struct dnet_node *n;
+	struct dnet_id *keys;
+	unsigned int seed = 0;
+	uint64_t ops = 1000000;
+	int stripes = 0, thread_num = 4;
+	int ch, i, j, threads, err = -ENOMEM;
+
+	while ((ch = getopt(argc, argv, "s:n:t:h")) != -1) {
+		switch (ch) {
+			case 's':
+				stripes = atoi(optarg);
+				break;
+			case 'n':
+				ops = strtoull(optarg, NULL, 0);
+				break;
+			case 't':
+				thread_num = atoi(optarg);
+				break;
+			case 'h':
+			default:
+				oplock_usage(argv[0]);
+		}
+	}
+
+	memset(&log, 0, sizeof(log));
+	log.log_level = DNET_LOG_ERROR;
+	log.log = oplock_bench_log;
+
+	memset(&cfg, 0, sizeof(cfg));
+	cfg.log = &log;
+	cfg.wait_timeout = 60;
+	cfg.flags = DNET_CFG_NO_ROUTE_LIST;
+
+	n = dnet_node_create(&cfg);
+	if (!n)
+		goto err_out_exit;
+
+	keys = calloc(thread_num * OPLOCK_BENCH_KEYS, sizeof(struct dnet_id));
+	if (!keys)
+		goto err_out_destroy;
+
+	for (i = 0; i < thread_num * OPLOCK_BENCH_KEYS; ++i) {
+		for (j = 0; j < DNET_ID_SIZE; ++j)
+			keys[i].id[j] = rand_r(&seed);
+	}
+
+	err = dnet_locks_init(n, stripes);
+	if (err)
+		goto err_out_free;
+
+	for (threads = 1; threads <= thread_num; threads *= 2) {
+		for (i = 0; i < 4; ++i) {
+			err = oplock_bench(n, keys, threads, (i & 1) ? DNET_OPLOCK_READ : DNET_OPLOCK_WRITE, i >> 1, ops);
+			if (err)
+				goto err_out_locks_destroy;
+		}
+	}
+
+err_out_locks_destroy:
+	dnet_locks_destroy(n);
+err_out_free:
+	free(keys);
+err_out_destroy:
+	dnet_node_destroy(n);
+err_out_exit:
+	if (err)
+		fprintf(stderr, "oplock benchmark failed: %s [%d]\n", strerror(-err), err);
+	return err;
+}
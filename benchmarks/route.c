@@ -0,0 +1,238 @@
+/*
+ * 2013+ Copyright (c) Evgeniy Polyakov <zbr@ioremap.net>
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "elliptics.h"
+
+#include "bench.h"
+
+/*
+ * Key to state lookup in the routing table of a client node which knows
+ * @nodes fake states with @ids ids each: lock-free search in the route snapshot
+ * against search in groups under node's state lock, with several threads.
+ */
+
+/* lookup keys are taken from the pool of random ids, so that their generation is not measured */
+#define ROUTE_BENCH_KEYS	(64 * 1024)
+
+struct route_bench_thread {
+	struct dnet_node	*n;
+	struct dnet_raw_id	*keys;
+	uint64_t		ops;
+	int			locked;
+	int			group_id;
+	pthread_t		tid;
+};
+
+static void route_bench_log(void *priv __unused, int level __unused, const char *msg)
+{
+	fputs(msg, stderr);
+}
+
+static void route_bench_random_id(unsigned char *id, unsigned int *seed)
+{
+	int i;
+
+	for (i = 0; i < DNET_ID_SIZE; ++i)
+		id[i] = rand_r(seed);
+}
+
+static void *route_bench_process(void *data)
+{
+	struct route_bench_thread *t = data;
+	struct dnet_net_state *st;
+	struct dnet_id id;
+	uint64_t i;
+
+	memset(&id, 0, sizeof(id));
+	id.group_id = t->group_id;
+
+	for (i = 0; i < t->ops; ++i) {
+		memcpy(id.id, t->keys[i % ROUTE_BENCH_KEYS].id, DNET_ID_SIZE);
+
+		if (t->locked) {
+			pthread_mutex_lock(&t->n->state_lock);
+			st = dnet_state_search_nolock(t->n, &id);
+			pthread_mutex_unlock(&t->n->state_lock);
+		} else {
+			st = dnet_state_get_first(t->n, &id);
+		}
+
+		dnet_state_put(st);
+	}
+
+	return NULL;
+}
+
+static int route_bench_lookup(struct dnet_node *n, struct dnet_raw_id *keys, int group_id, int thread_num, int locked, uint64_t ops)
+{
+	struct route_bench_thread *threads;
+	uint64_t start;
+	char name[64];
+	int i, err = 0;
+
+	threads = calloc(thread_num, sizeof(struct route_bench_thread));
+	if (!threads)
+		return -ENOMEM;
+
+	start = dnet_bench_now_ns();
+	for (i = 0; i < thread_num; ++i) {
+		threads[i].n = n;
+		threads[i].keys = keys + i;
+		threads[i].ops = ops;
+		threads[i].locked = locked;
+		threads[i].group_id = group_id;
+
+		err = -pthread_create(&threads[i].tid, NULL, route_bench_process, &threads[i]);
+		if (err)
+			break;
+	}
+
+	thread_num = i;
+	for (i = 0; i < thread_num; ++i)
+		pthread_join(threads[i].tid, NULL);
+
+	if (!err) {
+		snprintf(name, sizeof(name), "route %s lookup, threads: %d", locked ? "locked" : "snapshot", thread_num);
+		dnet_bench_report(name, ops * thread_num, dnet_bench_now_ns() - start);
+	}
+
+	free(threads);
+	return err;
+}
+
+static void route_usage(char *p)
+{
+	fprintf(stderr, "Usage: %s <options>\n"
+			"  -N nodes                  - number of nodes (default: 1000)\n"
+			"  -I ids                    - number of ids per node (default: 100)\n"
+			"  -n ops                    - number of lookups per thread (default: 1000000)\n"
+			"  -t threads                - maximum number of lookup threads (default: 4)\n"
+			"  -h                        - this help\n"
+			, p);
+	exit(-1);
+}
+
+int main(int argc, char *argv[])
+{
+	struct dnet_net_state **states;
+	struct dnet_raw_id *ids, *keys;
+	struct dnet_config cfg;
+	struct dnet_log log;
+	struct dnet_node *n;
+	int node_num = 1000, id_num = 100, thread_num = 4, group_id = 1;
+	unsigned int seed = 0;
+	uint64_t ops = 1000000, start;
+	int ch, i, j, err = -ENOMEM;
+
+	while ((ch = getopt(argc, argv, "N:I:n:t:h")) != -1) {
+		switch (ch) {
+			case 'N':
+				node_num = atoi(optarg);
+				break;
+			case 'I':
+				id_num = atoi(optarg);
+				break;
+			case 'n':
+				ops = strtoull(optarg, NULL, 0);
+				break;
+			case 't':
+				thread_num = atoi(optarg);
+				break;
+			case 'h':
+			default:
+				route_usage(argv[0]);
+		}
+	}
+
+	memset(&log, 0, sizeof(log));
+	log.log_level = DNET_LOG_ERROR;
+	log.log = route_bench_log;
+
+	memset(&cfg, 0, sizeof(cfg));
+	cfg.log = &log;
+	cfg.wait_timeout = 60;
+	/* fake states can not send anything, the first periodic route table request is sent after 2 * 30 seconds */
+	cfg.check_timeout = 30;
+	cfg.flags = DNET_CFG_NO_ROUTE_LIST;
+
+	n = dnet_node_create(&cfg);
+	if (!n)
+		goto err_out_exit;
+
+	states = calloc(node_num, sizeof(struct dnet_net_state *));
+	ids = calloc(id_num, sizeof(struct dnet_raw_id));
+	keys = calloc(ROUTE_BENCH_KEYS + thread_num, sizeof(struct dnet_raw_id));
+	if (!states || !ids || !keys)
+		goto err_out_free;
+
+	for (i = 0; i < ROUTE_BENCH_KEYS + thread_num; ++i)
+		route_bench_random_id(keys[i].id, &seed);
+
+	start = dnet_bench_now_ns();
+	for (i = 0; i < node_num; ++i) {
+		struct dnet_net_state *st;
+
+		st = calloc(1, sizeof(struct dnet_net_state));
+		if (!st)
+			goto err_out_free;
+
+		st->n = n;
+		atomic_init(&st->refcnt, 1);
+		INIT_LIST_HEAD(&st->state_entry);
+		INIT_LIST_HEAD(&st->storage_state_entry);
+		states[i] = st;
+
+		for (j = 0; j < id_num; ++j)
+			route_bench_random_id(ids[j].id, &seed);
+
+		err = dnet_idc_create(st, group_id, ids, id_num);
+		if (err)
+			goto err_out_free;
+	}
+	dnet_route_update(n);
+	dnet_bench_report("route: add node and rebuild snapshot", node_num, dnet_bench_now_ns() - start);
+
+	for (i = 1; i <= thread_num; i *= 2) {
+		err = route_bench_lookup(n, keys, group_id, i, 0, ops);
+		if (err)
+			goto err_out_free;
+
+		err = route_bench_lookup(n, keys, group_id, i, 1, ops);
+		if (err)
+			goto err_out_free;
+	}
+
+err_out_free:
+	for (i = 0; states && i < node_num && states[i]; ++i) {
+		pthread_mutex_lock(&n->state_lock);
+		dnet_state_remove_nolock(states[i]);
+		pthread_mutex_unlock(&n->state_lock);
+		free(states[i]);
+	}
+	free(keys);
+	free(ids);
+	free(states);
+	dnet_node_destroy(n);
+err_out_exit:
+	if (err)
+		fprintf(stderr, "route benchmark failed: %s [%d]\n", strerror(-err), err);
+	return err;
+}
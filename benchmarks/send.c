@@ -0,0 +1,214 @@
+/*
+ * 2013+ Copyright (c) Evgeniy Polyakov <zbr@ioremap.net>
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <sys/socket.h>
+#include <sys/syscall.h>
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "elliptics.h"
+
+#include "bench.h"
+
+/*
+ * Send path of replies: dnet_send_request() pushes replies of a given size into
+ * unix socket drained by another thread, either DNET_SEND_BATCH queued replies
+ * at once or one by one. Reports replies and bytes per second and number of
+ * sendmsg() calls per reply.
+ */
+
+static volatile uint64_t send_bench_calls;
+
+/* library calls sendmsg() through PLT, so every call made by dnet_send_request() is counted here */
+ssize_t sendmsg(int fd, const struct msghdr *msg, int flags)
+{
+	__sync_fetch_and_add(&send_bench_calls, 1);
+	return syscall(SYS_sendmsg, fd, msg, flags);
+}
+
+static void send_bench_log(void *priv __unused, int level __unused, const char *msg)
+{
+	fputs(msg, stderr);
+}
+
+struct send_bench_reader {
+	int			fd;
+	uint64_t		bytes;
+	pthread_t		tid;
+};
+
+static void *send_bench_read(void *data)
+{
+	struct send_bench_reader *r = data;
+	char buf[64 * 1024];
+	ssize_t err;
+
+	while ((err = read(r->fd, buf, sizeof(buf))) > 0)
+		r->bytes += err;
+
+	return NULL;
+}
+
+static int send_bench(struct dnet_node *n, size_t size, int batch, uint64_t ops)
+{
+	struct dnet_io_req reqs[DNET_SEND_BATCH], *ptrs[DNET_SEND_BATCH];
+	struct send_bench_reader reader;
+	struct dnet_net_state *st;
+	struct dnet_cmd cmd;
+	uint64_t i, calls, start, ns;
+	void *data;
+	char name[64];
+	int sv[2], completed, j, err;
+
+	st = calloc(1, sizeof(struct dnet_net_state));
+	data = calloc(1, size + 1);
+	if (!st || !data) {
+		err = -ENOMEM;
+		goto err_out_free;
+	}
+
+	err = socketpair(AF_UNIX, SOCK_STREAM, 0, sv);
+	if (err) {
+		err = -errno;
+		goto err_out_free;
+	}
+
+	st->n = n;
+	st->write_s = st->read_s = sv[0];
+
+	memset(&cmd, 0, sizeof(cmd));
+	cmd.cmd = DNET_CMD_READ;
+	cmd.size = size;
+	cmd.trans = DNET_TRANS_REPLY;
+
+	memset(reqs, 0, sizeof(reqs));
+	for (j = 0; j < DNET_SEND_BATCH; ++j) {
+		reqs[j].header = &cmd;
+		reqs[j].hsize = sizeof(struct dnet_cmd);
+		reqs[j].data = data;
+		reqs[j].dsize = size;
+		reqs[j].fd = -1;
+		ptrs[j] = &reqs[j];
+	}
+
+	memset(&reader, 0, sizeof(reader));
+	reader.fd = sv[1];
+
+	err = -pthread_create(&reader.tid, NULL, send_bench_read, &reader);
+	if (err)
+		goto err_out_close;
+
+	calls = send_bench_calls;
+	start = dnet_bench_now_ns();
+	for (i = 0; i < ops; i += batch) {
+		err = dnet_send_request(st, ptrs, batch, &completed);
+		if (err)
+			break;
+	}
+	calls = send_bench_calls - calls;
+
+	shutdown(sv[0], SHUT_WR);
+	pthread_join(reader.tid, NULL);
+	ns = dnet_bench_now_ns() - start;
+
+	if (!err) {
+		snprintf(name, sizeof(name), "send %zu bytes, %s", size, batch > 1 ? "batched" : "one by one");
+		dnet_bench_report(name, i, ns);
+		printf("%-40s %12.3f sendmsg/reply %10.1f MB/sec\n", "",
+				(double)calls / i, reader.bytes * 1000.0 / ns);
+	}
+
+err_out_close:
+	close(sv[0]);
+	close(sv[1]);
+err_out_free:
+	free(data);
+	free(st);
+	return err;
+}
+
+static void send_usage(char *p)
+{
+	fprintf(stderr, "Usage: %s <options>\n"
+			"  -s size                   - size of large reply (default: 1048576)\n"
+			"  -n ops                    - number of small replies (default: 1000000), large ones are 100 times less\n"
+			"  -h                        - this help\n"
+			, p);
+	exit(-1);
+}
+
+int main(int argc, char *argv[])
+{
+	struct dnet_config cfg;
+	struct dnet_log log;
+	struct dnet_node *n;
+	size_t large = 1024 * 1024;
+	uint64_t ops = 1000000;
+	size_t sizes[3];
+	int ch, i, err = -ENOMEM;
+
+	while ((ch = getopt(argc, argv, "s:n:h")) != -1) {
+		switch (ch) {
+			case 's':
+				large = strtoull(optarg, NULL, 0);
+				break;
+			case 'n':
+				ops = strtoull(optarg, NULL, 0);
+				break;
+			case 'h':
+			default:
+				send_usage(argv[0]);
+		}
+	}
+
+	memset(&log, 0, sizeof(log));
+	log.log_level = DNET_LOG_ERROR;
+	log.log = send_bench_log;
+
+	memset(&cfg, 0, sizeof(cfg));
+	cfg.log = &log;
+	cfg.wait_timeout = 60;
+	cfg.flags = DNET_CFG_NO_ROUTE_LIST;
+
+	n = dnet_node_create(&cfg);
+	if (!n)
+		goto err_out_exit;
+
+	sizes[0] = 0;
+	sizes[1] = 100;
+	sizes[2] = large;
+
+	for (i = 0; i < 3; ++i) {
+		uint64_t num = (sizes[i] == large) ? ops / 100 : ops;
+
+		err = send_bench(n, sizes[i], DNET_SEND_BATCH, num);
+		if (err)
+			break;
+
+		err = send_bench(n, sizes[i], 1, num);
+		if (err)
+			break;
+	}
+
+	dnet_node_destroy(n);
+err_out_exit:
+	if (err)
+		fprintf(stderr, "send benchmark failed: %s [%d]\n", strerror(-err), err);
+	return err;
+}
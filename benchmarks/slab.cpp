@@ -0,0 +1,286 @@
+/*
+ * 2013+ Copyright (c) Evgeniy Polyakov <zbr@ioremap.net>
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <errno.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include <deque>
+#include <memory>
+#include <vector>
+
+#include "slab.hpp"
+
+#include "bench.h"
+
+using ioremap::cache::slab_allocator_t;
+
+/*
+ * Storage of cached objects under the cache's eviction: objects are inserted until
+ * accounted bytes reach cache size, then the oldest (or random) ones are evicted.
+ * Like in the cache, metadata and payload of every object are charged, and slab layout
+ * is also charged with memory wasted in its partially used pages. Object sizes drift
+ * from phase to phase, so memory freed by one size class has to be reused by another.
+ *
+ * Old layout keeps every object as a heap metadata structure plus shared pointer
+ * to std::vector, the new one keeps metadata and payload in slab allocator.
+ * Every layout runs in its own process, so that its RSS is not affected by the other one.
+ */
+
+struct slab_bench_config {
+	size_t		cache_size;
+	uint64_t	ops;
+	int		phases;
+	size_t		min_size;
+	size_t		max_size;
+	int		random;
+};
+
+/* the same as metadata of cached object: id, timestamps, flags and tree hooks */
+struct slab_bench_meta {
+	unsigned char	id[64];
+	uint64_t	timestamp[4];
+	void		*hooks[6];
+};
+
+struct slab_bench_vector_obj {
+	slab_bench_meta				meta;
+	std::shared_ptr<std::vector<char>>	data;
+};
+
+struct slab_bench_slab_obj {
+	slab_bench_meta				meta;
+	char					*data;
+	size_t					size;
+};
+
+template <typename T>
+static T *slab_bench_evict(const slab_bench_config &cfg, std::deque<T *> &objs, unsigned int *seed)
+{
+	if (cfg.random)
+		std::swap(objs.front(), objs[rand_r(seed) % objs.size()]);
+
+	T *obj = objs.front();
+	objs.pop_front();
+	return obj;
+}
+
+/* object size of @phase, grows geometrically from @min_size to @max_size and back */
+static size_t slab_bench_size(const slab_bench_config &cfg, int phase, unsigned int *seed)
+{
+	int steps = cfg.phases > 1 ? cfg.phases - 1 : 1;
+	int step = phase % (2 * steps);
+	double base;
+
+	if (step > steps)
+		step = 2 * steps - step;
+
+	base = cfg.min_size * pow((double)cfg.max_size / cfg.min_size, (double)step / steps);
+	return base / 2 + rand_r(seed) % (size_t)base;
+}
+
+static void slab_bench_rss(const char *name, size_t accounted, size_t reserved)
+{
+	struct rusage ru;
+	long pages = 0;
+	FILE *f;
+
+	f = fopen("/proc/self/statm", "r");
+	if (f) {
+		if (fscanf(f, "%*d %ld", &pages) != 1)
+			pages = 0;
+		fclose(f);
+	}
+
+	getrusage(RUSAGE_SELF, &ru);
+
+	printf("%-40s %9.1f MB cached %9.1f MB reserved %9.1f MB rss %9.1f MB max rss\n", name,
+			accounted / 1048576.0, reserved / 1048576.0,
+			pages * sysconf(_SC_PAGESIZE) / 1048576.0, ru.ru_maxrss / 1024.0);
+}
+
+static void slab_bench_vector(const slab_bench_config &cfg)
+{
+	std::deque<slab_bench_vector_obj *> objs;
+	unsigned int seed = 0;
+	size_t accounted = 0;
+	std::vector<char> src(cfg.max_size * 3 / 2, 0xa5);
+	uint64_t start, ns, i;
+
+	start = dnet_bench_now_ns();
+	for (i = 0; i < cfg.ops; ++i) {
+		size_t size = slab_bench_size(cfg, i * cfg.phases / cfg.ops, &seed);
+		slab_bench_vector_obj *obj = new slab_bench_vector_obj;
+
+		obj->data = std::make_shared<std::vector<char>>(src.begin(), src.begin() + size);
+		objs.push_back(obj);
+		accounted += sizeof(slab_bench_vector_obj) + size;
+
+		while (accounted > cfg.cache_size) {
+			obj = slab_bench_evict(cfg, objs, &seed);
+
+			accounted -= sizeof(slab_bench_vector_obj) + obj->data->size();
+			delete obj;
+		}
+	}
+	ns = dnet_bench_now_ns() - start;
+
+	dnet_bench_report("vector insert+evict", cfg.ops, ns);
+	slab_bench_rss("vector memory", accounted, 0);
+
+	for (auto it = objs.begin(); it != objs.end(); ++it)
+		delete *it;
+}
+
+static void slab_bench_slab(const slab_bench_config &cfg)
+{
+	std::deque<slab_bench_slab_obj *> objs;
+	slab_allocator_t allocator;
+	unsigned int seed = 0;
+	size_t accounted = 0;
+	std::vector<char> src(cfg.max_size * 3 / 2, 0xa5);
+	uint64_t start, ns, i;
+
+	start = dnet_bench_now_ns();
+	for (i = 0; i < cfg.ops; ++i) {
+		size_t size = slab_bench_size(cfg, i * cfg.phases / cfg.ops, &seed);
+		slab_bench_slab_obj *obj;
+
+		obj = new (allocator.allocate(sizeof(slab_bench_slab_obj))) slab_bench_slab_obj;
+		obj->size = allocator.chunk_size(size);
+		obj->data = (char *)allocator.allocate(obj->size);
+		memcpy(obj->data, src.data(), size);
+
+		objs.push_back(obj);
+		accounted += sizeof(slab_bench_slab_obj) + obj->size;
+
+		while (accounted + allocator.wasted() > cfg.cache_size && !objs.empty()) {
+			obj = slab_bench_evict(cfg, objs, &seed);
+
+			accounted -= sizeof(slab_bench_slab_obj) + obj->size;
+			allocator.deallocate(obj->data, obj->size);
+			allocator.deallocate(obj, sizeof(slab_bench_slab_obj));
+		}
+	}
+	ns = dnet_bench_now_ns() - start;
+
+	dnet_bench_report("slab insert+evict", cfg.ops, ns);
+	slab_bench_rss("slab memory", accounted, allocator.reserved());
+
+	for (auto it = objs.begin(); it != objs.end(); ++it) {
+		allocator.deallocate((*it)->data, (*it)->size);
+		allocator.deallocate(*it, sizeof(slab_bench_slab_obj));
+	}
+}
+
+static int slab_bench_run(void (*bench)(const slab_bench_config &), const slab_bench_config &cfg)
+{
+	int status;
+	pid_t pid;
+
+	fflush(stdout);
+
+	pid = fork();
+	if (pid < 0)
+		return -errno;
+
+	if (pid == 0) {
+		bench(cfg);
+		fflush(stdout);
+		_exit(0);
+	}
+
+	if (waitpid(pid, &status, 0) < 0)
+		return -errno;
+
+	if (!WIFEXITED(status) || WEXITSTATUS(status))
+		return -EINVAL;
+
+	return 0;
+}
+
+static void slab_usage(char *p)
+{
+	fprintf(stderr, "Usage: %s <options>\n"
+			"  -c size                   - accounted size of the cache (default: 268435456)\n"
+			"  -n ops                    - number of inserted objects (default: 10000000)\n"
+			"  -p phases                 - number of object size changes (default: 8)\n"
+			"  -s size                   - average object size of the first phase (default: 64)\n"
+			"  -S size                   - average object size of the middle phase (default: 16384)\n"
+			"  -r                        - evict random objects instead of the oldest ones\n"
+			"  -h                        - this help\n"
+			, p);
+	exit(-1);
+}
+
+int main(int argc, char *argv[])
+{
+	slab_bench_config cfg;
+	int ch, err;
+
+	cfg.cache_size = 256 * 1024 * 1024;
+	cfg.ops = 10000000;
+	cfg.phases = 8;
+	cfg.min_size = 64;
+	cfg.max_size = 16384;
+	cfg.random = 0;
+
+	while ((ch = getopt(argc, argv, "c:n:p:s:S:rh")) != -1) {
+		switch (ch) {
+			case 'c':
+				cfg.cache_size = strtoull(optarg, NULL, 0);
+				break;
+			case 'n':
+				cfg.ops = strtoull(optarg, NULL, 0);
+				break;
+			case 'p':
+				cfg.phases = atoi(optarg);
+				break;
+			case 's':
+				cfg.min_size = strtoul(optarg, NULL, 0);
+				break;
+			case 'S':
+				cfg.max_size = strtoul(optarg, NULL, 0);
+				break;
+			case 'r':
+				cfg.random = 1;
+				break;
+			case 'h':
+			default:
+				slab_usage(argv[0]);
+		}
+	}
+
+	if (!cfg.ops || cfg.phases <= 0 || cfg.min_size < 2 || cfg.max_size < cfg.min_size)
+		slab_usage(argv[0]);
+
+	err = slab_bench_run(slab_bench_vector, cfg);
+	if (err)
+		goto err_out_exit;
+
+	err = slab_bench_run(slab_bench_slab, cfg);
+	if (err)
+		goto err_out_exit;
+
+err_out_exit:
+	if (err)
+		fprintf(stderr, "slab benchmark failed: %s [%d]\n", strerror(-err), err);
+	return err;
+}
@@ -0,0 +1,150 @@
+/*
+ * 2013+ Copyright (c) Evgeniy Polyakov <zbr@ioremap.net>
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "elliptics.h"
+
+#include "bench.h"
+
+/*
+ * Reply dispatch cost of per-state transaction table: every reply looks up
+ * its transaction and removes it under the state lock, then a new request
+ * with the next id (strided like ids of a fan-out) takes its place.
+ */
+static int trans_bench(unsigned int inflight, uint64_t stride, uint64_t ops)
+{
+	struct dnet_trans_table table;
+	struct dnet_trans **trans, *t;
+	pthread_mutex_t lock;
+	uint64_t i, next, start;
+	char name[64];
+	int err = 0;
+
+	memset(&table, 0, sizeof(table));
+	pthread_mutex_init(&lock, NULL);
+
+	trans = calloc(inflight, sizeof(struct dnet_trans *));
+	if (!trans) {
+		err = -ENOMEM;
+		goto err_out_exit;
+	}
+
+	for (i = 0; i < inflight; ++i) {
+		trans[i] = dnet_trans_alloc(NULL, 0);
+		if (!trans[i]) {
+			err = -ENOMEM;
+			goto err_out_free;
+		}
+
+		trans[i]->trans = i * stride;
+		err = dnet_trans_insert_nolock(&table, trans[i]);
+		if (err)
+			goto err_out_free;
+	}
+
+	next = inflight;
+	start = dnet_bench_now_ns();
+	for (i = 0; i < ops; ++i) {
+		struct dnet_trans *a = trans[i % inflight];
+
+		pthread_mutex_lock(&lock);
+		t = dnet_trans_search(&table, a->trans);
+		if (t)
+			dnet_trans_remove_nolock(&table, t);
+		pthread_mutex_unlock(&lock);
+
+		if (t != a) {
+			err = -ENOENT;
+			goto err_out_free;
+		}
+		dnet_trans_put(t);
+
+		a->trans = next++ * stride;
+
+		pthread_mutex_lock(&lock);
+		err = dnet_trans_insert_nolock(&table, a);
+		pthread_mutex_unlock(&lock);
+		if (err)
+			goto err_out_free;
+	}
+
+	snprintf(name, sizeof(name), "trans inflight: %u, stride: %llu", inflight, (unsigned long long)stride);
+	dnet_bench_report(name, ops, dnet_bench_now_ns() - start);
+
+err_out_free:
+	for (i = 0; i < inflight && trans[i]; ++i) {
+		pthread_mutex_lock(&lock);
+		dnet_trans_remove_nolock(&table, trans[i]);
+		pthread_mutex_unlock(&lock);
+		dnet_trans_put(trans[i]);
+	}
+	free(trans);
+	dnet_trans_table_destroy(&table);
+err_out_exit:
+	pthread_mutex_destroy(&lock);
+	return err;
+}
+
+static void trans_usage(char *p)
+{
+	fprintf(stderr, "Usage: %s <options>\n"
+			"  -n ops                    - number of replies to dispatch per case (default: 1000000)\n"
+			"  -s stride                 - only run cases with this id stride (default: 1, 16 and 1024)\n"
+			"  -h                        - this help\n"
+			, p);
+	exit(-1);
+}
+
+int main(int argc, char *argv[])
+{
+	static const unsigned int inflight[] = { 1000, 10000, 100000 };
+	uint64_t strides[] = { 1, 16, 1024 };
+	int num_strides = sizeof(strides) / sizeof(strides[0]);
+	uint64_t ops = 1000000;
+	unsigned int i;
+	int ch, j, err;
+
+	while ((ch = getopt(argc, argv, "n:s:h")) != -1) {
+		switch (ch) {
+			case 'n':
+				ops = strtoull(optarg, NULL, 0);
+				break;
+			case 's':
+				strides[0] = strtoull(optarg, NULL, 0);
+				num_strides = 1;
+				break;
+			case 'h':
+			default:
+				trans_usage(argv[0]);
+		}
+	}
+
+	for (j = 0; j < num_strides; ++j) {
+		for (i = 0; i < sizeof(inflight) / sizeof(inflight[0]); ++i) {
+			err = trans_bench(inflight[i], strides[j], ops);
+			if (err) {
+				fprintf(stderr, "trans benchmark failed: %s [%d]\n", strerror(-err), err);
+				return err;
+			}
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,347 @@
+/*
+ * 2013+ Copyright (c) Evgeniy Polyakov <zbr@ioremap.net>
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "file_uring.h"
+
+#include "bench.h"
+
+/*
+ * Random reads and writes of file backend's io engines in the way fio does them:
+ * blocking pread()/pwrite() made by every thread one after another, and io_uring
+ * engine where every thread keeps several requests in flight, like io threads do
+ * when replies are completed from the ring. Writes are optionally followed by fsync.
+ */
+
+struct uring_bench_req {
+	struct file_uring_req	req;
+	struct uring_bench_thread	*t;
+	struct uring_bench_req	*next;
+	char			*buf;
+};
+
+struct uring_bench_thread {
+	struct file_uring	*u;
+	int			fd, slot;
+	int			write, sync;
+	unsigned int		bsize;
+	uint64_t		blocks;
+	uint64_t		ops;
+	unsigned int		seed;
+
+	/* free requests of io_uring engine */
+	pthread_mutex_t		lock;
+	pthread_cond_t		wait;
+	struct uring_bench_req	*free;
+	struct uring_bench_req	*reqs;
+	int			req_num;
+	int			err;
+
+	pthread_t		tid;
+};
+
+static void uring_bench_complete(struct file_uring_req *req, int res)
+{
+	struct uring_bench_req *r = (struct uring_bench_req *)req;
+	struct uring_bench_thread *t = r->t;
+
+	pthread_mutex_lock(&t->lock);
+	if (res != (int)t->bsize && !t->err)
+		t->err = (res < 0) ? res : -EIO;
+	r->next = t->free;
+	t->free = r;
+	pthread_cond_signal(&t->wait);
+	pthread_mutex_unlock(&t->lock);
+}
+
+static uint64_t uring_bench_offset(struct uring_bench_thread *t)
+{
+	return (uint64_t)(rand_r(&t->seed) % t->blocks) * t->bsize;
+}
+
+static void *uring_bench_blocking(void *data)
+{
+	struct uring_bench_thread *t = data;
+	char *buf = t->reqs[0].buf;
+	ssize_t err;
+	uint64_t i;
+
+	for (i = 0; i < t->ops; ++i) {
+		if (t->write)
+			err = pwrite(t->fd, buf, t->bsize, uring_bench_offset(t));
+		else
+			err = pread(t->fd, buf, t->bsize, uring_bench_offset(t));
+
+		if (err != (ssize_t)t->bsize) {
+			t->err = (err < 0) ? -errno : -EIO;
+			break;
+		}
+
+		if (t->write && t->sync)
+			fsync(t->fd);
+	}
+
+	return NULL;
+}
+
+static int uring_bench_free_num(struct uring_bench_thread *t)
+{
+	struct uring_bench_req *r;
+	int num = 0;
+
+	for (r = t->free; r; r = r->next)
+		++num;
+
+	return num;
+}
+
+static void *uring_bench_uring(void *data)
+{
+	struct uring_bench_thread *t = data;
+	struct uring_bench_req *r;
+	uint64_t i;
+	int err = 0;
+
+	for (i = 0; i < t->ops && !err; ++i) {
+		pthread_mutex_lock(&t->lock);
+		while (!t->free)
+			pthread_cond_wait(&t->wait, &t->lock);
+		r = t->free;
+		t->free = r->next;
+		pthread_mutex_unlock(&t->lock);
+
+		if (t->write)
+			err = file_uring_write(t->u, &r->req, t->fd, t->slot, r->buf, t->bsize, uring_bench_offset(t), t->sync);
+		else
+			err = file_uring_read(t->u, &r->req, t->fd, t->slot, r->buf, t->bsize, uring_bench_offset(t));
+
+		pthread_mutex_lock(&t->lock);
+		if (err) {
+			t->err = err;
+			r->next = t->free;
+			t->free = r;
+		}
+		err = t->err;
+		pthread_mutex_unlock(&t->lock);
+	}
+
+	/* wait for requests in flight */
+	pthread_mutex_lock(&t->lock);
+	while (uring_bench_free_num(t) != t->req_num)
+		pthread_cond_wait(&t->wait, &t->lock);
+	pthread_mutex_unlock(&t->lock);
+
+	return NULL;
+}
+
+static int uring_bench(struct file_uring *u, int fd, int slot, int write, int sync, unsigned int bsize,
+		uint64_t file_size, int thread_num, int req_num, uint64_t ops)
+{
+	struct uring_bench_thread *threads;
+	uint64_t start, ns;
+	char name[64];
+	int i, j, err = 0;
+
+	threads = calloc(thread_num, sizeof(struct uring_bench_thread));
+	if (!threads)
+		return -ENOMEM;
+
+	for (i = 0; i < thread_num; ++i) {
+		struct uring_bench_thread *t = &threads[i];
+
+		t->u = u;
+		t->fd = fd;
+		t->slot = slot;
+		t->write = write;
+		t->sync = sync;
+		t->bsize = bsize;
+		t->blocks = file_size / bsize;
+		t->ops = ops;
+		t->seed = i;
+		t->req_num = u ? req_num : 1;
+
+		pthread_mutex_init(&t->lock, NULL);
+		pthread_cond_init(&t->wait, NULL);
+
+		t->reqs = calloc(t->req_num, sizeof(struct uring_bench_req));
+		if (!t->reqs) {
+			err = -ENOMEM;
+			goto err_out_free;
+		}
+
+		for (j = 0; j < t->req_num; ++j) {
+			struct uring_bench_req *r = &t->reqs[j];
+
+			r->req.complete = uring_bench_complete;
+			r->t = t;
+			r->buf = malloc(bsize);
+			if (!r->buf) {
+				err = -ENOMEM;
+				goto err_out_free;
+			}
+			memset(r->buf, j, bsize);
+
+			r->next = t->free;
+			t->free = r;
+		}
+	}
+
+	start = dnet_bench_now_ns();
+	for (i = 0; i < thread_num; ++i) {
+		err = -pthread_create(&threads[i].tid, NULL, u ? uring_bench_uring : uring_bench_blocking, &threads[i]);
+		if (err)
+			break;
+	}
+
+	thread_num = i;
+	for (i = 0; i < thread_num; ++i) {
+		pthread_join(threads[i].tid, NULL);
+		if (threads[i].err && !err)
+			err = threads[i].err;
+	}
+	ns = dnet_bench_now_ns() - start;
+
+	if (!err) {
+		snprintf(name, sizeof(name), "%s %s%s %u bytes, threads: %d",
+				u ? "io_uring" : "blocking", write ? "write" : "read", (write && sync) ? "+fsync" : "",
+				bsize, thread_num);
+		dnet_bench_report(name, ops * thread_num, ns);
+		printf("%-40s %12d in flight %10.1f MB/sec\n", "", thread_num * threads[0].req_num,
+				ops * thread_num * bsize * 1000.0 / ns);
+	}
+
+err_out_free:
+	for (i = 0; i < thread_num; ++i) {
+		if (threads[i].reqs) {
+			for (j = 0; j < threads[i].req_num; ++j)
+				free(threads[i].reqs[j].buf);
+			free(threads[i].reqs);
+		}
+
+		pthread_cond_destroy(&threads[i].wait);
+		pthread_mutex_destroy(&threads[i].lock);
+	}
+	free(threads);
+	return err;
+}
+
+static void uring_usage(char *p)
+{
+	fprintf(stderr, "Usage: %s <options>\n"
+			"  -f file                   - file to read and write (default: dnet_bench_uring.data)\n"
+			"  -s size                   - size of the file (default: 67108864)\n"
+			"  -b block                  - size of every read and write (default: 4096)\n"
+			"  -d depth                  - number of io_uring entries (default: 256)\n"
+			"  -q requests               - number of requests in flight per thread (default: 16)\n"
+			"  -n ops                    - number of reads or writes per thread (default: 100000)\n"
+			"  -t threads                - number of io threads (default: 4)\n"
+			"  -S                        - sync every write\n"
+			"  -h                        - this help\n"
+			, p);
+	exit(-1);
+}
+
+int main(int argc, char *argv[])
+{
+	char *file = "dnet_bench_uring.data";
+	uint64_t file_size = 64 * 1024 * 1024, ops = 100000;
+	unsigned int bsize = 4096, depth = 256;
+	int req_num = 16, thread_num = 4, sync = 0;
+	struct file_uring *u;
+	int ch, fd, slot, write, err;
+
+	while ((ch = getopt(argc, argv, "f:s:b:d:q:n:t:Sh")) != -1) {
+		switch (ch) {
+			case 'f':
+				file = optarg;
+				break;
+			case 's':
+				file_size = strtoull(optarg, NULL, 0);
+				break;
+			case 'b':
+				bsize = strtoul(optarg, NULL, 0);
+				break;
+			case 'd':
+				depth = strtoul(optarg, NULL, 0);
+				break;
+			case 'q':
+				req_num = atoi(optarg);
+				break;
+			case 'n':
+				ops = strtoull(optarg, NULL, 0);
+				break;
+			case 't':
+				thread_num = atoi(optarg);
+				break;
+			case 'S':
+				sync = 1;
+				break;
+			case 'h':
+			default:
+				uring_usage(argv[0]);
+		}
+	}
+
+	if (!bsize || file_size < bsize || req_num <= 0 || thread_num <= 0)
+		uring_usage(argv[0]);
+
+	fd = open(file, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+	if (fd < 0) {
+		err = -errno;
+		goto err_out_exit;
+	}
+
+	err = ftruncate(fd, file_size);
+	if (err) {
+		err = -errno;
+		goto err_out_close;
+	}
+
+	err = file_uring_init(&u, depth, 1);
+	if (err)
+		goto err_out_close;
+
+	/* file is registered in the ring like cached object files are */
+	slot = file_uring_slot_get(u, fd);
+
+	/* writes go first, so that reads do not hit holes */
+	for (write = 1; write >= 0; --write) {
+		err = uring_bench(NULL, fd, -1, write, sync, bsize, file_size, thread_num, req_num, ops);
+		if (err)
+			goto err_out_cleanup;
+
+		err = uring_bench(u, fd, slot, write, sync, bsize, file_size, thread_num, req_num, ops);
+		if (err)
+			goto err_out_cleanup;
+	}
+
+err_out_cleanup:
+	if (slot >= 0)
+		file_uring_slot_put(u, slot);
+	file_uring_cleanup(u);
+err_out_close:
+	close(fd);
+	unlink(file);
+err_out_exit:
+	if (err)
+		fprintf(stderr, "io_uring benchmark failed: %s [%d]\n", strerror(-err), err);
+	return err;
+}
@@ -219,6 +219,24 @@ struct dnet_addr_stat *stat_count_result_entry::statistics() const
 		.data<struct dnet_addr_stat>();
 }
 
+struct dnet_addr_latency_stat *stat_count_result_entry::latency() const
+{
+	struct dnet_cmd *cmd = command();
+
+	if (!(cmd->flags & DNET_ATTR_CNTR_LATENCY))
+		return NULL;
+
+	struct dnet_addr_latency_stat *ls = m_data->data
+		.skip<struct dnet_addr>()
+		.skip<struct dnet_cmd>()
+		.data<struct dnet_addr_latency_stat>();
+
+	if (!dnet_addr_latency_stat_check(ls, cmd->size))
+		return NULL;
+
+	return ls;
+}
+
 exec_result_entry::exec_result_entry()
 {
 }
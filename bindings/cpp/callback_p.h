@@ -127,7 +127,14 @@ struct entry_converter
 
 	static void convert(stat_count_result_entry &entry, callback_result_data *)
 	{
-		dnet_convert_addr_stat(entry.statistics(), 0);
+		if (struct dnet_addr_latency_stat *ls = entry.latency()) {
+			const int num = dnet_addr_latency_stat_num(entry.command()->size);
+
+			// Number of histograms is taken from reply size, so that bogus @num is never followed
+			dnet_convert_addr_latency_stat(ls, num);
+			ls->num = num;
+		} else
+			dnet_convert_addr_stat(entry.statistics(), 0);
 	}
 
 	static void convert(callback_result_entry &, callback_result_data *)
@@ -319,7 +326,11 @@ class base_stat_callback
 			cb.set_count(unlimited);
 
 			uint64_t cflags_pop = sess.get_cflags();
-			sess.set_cflags(cflags_pop | DNET_ATTR_CNTR_GLOBAL);
+			uint64_t cflags = cflags_pop | DNET_ATTR_CNTR_GLOBAL;
+			if (Command == DNET_CMD_STAT_COUNT)
+				cflags |= DNET_ATTR_CNTR_LATENCY;
+
+			sess.set_cflags(cflags);
 			int err = dnet_request_stat(sess.get_native(),
 				has_id ? &id : NULL, Command, func, priv);
 			sess.set_cflags(cflags_pop);
@@ -20,6 +20,7 @@
 #include <cerrno>
 #include <sstream>
 #include <functional>
+#include <map>
 
 extern __thread uint32_t trace_id;
 
@@ -369,6 +370,7 @@ class session_data
 			error_handler = error_handlers::none;
 			policy = session::default_exceptions;
 			trace_id = 0;
+			hedge_timeout_ms = 0;
 			::trace_id = 0;
 		}
 
@@ -378,7 +380,8 @@ class session_data
 			checker(other.checker),
 			error_handler(other.error_handler),
 			policy(other.policy),
-			trace_id(other.trace_id)
+			trace_id(other.trace_id),
+			hedge_timeout_ms(other.hedge_timeout_ms)
 		{
 			session_ptr = dnet_session_copy(other.session_ptr);
 			if (!session_ptr)
@@ -400,6 +403,7 @@ class session_data
 		result_error_handler	error_handler;
 		uint32_t		policy;
 		uint32_t		trace_id;
+		long			hedge_timeout_ms;
 };
 
 session::session(const node &n) : m_data(std::make_shared<session_data>(n))
@@ -586,6 +590,27 @@ long session::get_timeout(void) const
 	return tm->tv_sec;
 }
 
+void session::set_timeout_ms(unsigned long timeout_ms)
+{
+	dnet_session_set_timeout_ms(m_data->session_ptr, timeout_ms);
+}
+
+unsigned long session::get_timeout_ms(void) const
+{
+	struct timespec *tm = dnet_session_get_timeout(m_data->session_ptr);
+	return tm->tv_sec * 1000 + tm->tv_nsec / 1000000;
+}
+
+void session::set_hedge_timeout_ms(long timeout_ms)
+{
+	m_data->hedge_timeout_ms = timeout_ms;
+}
+
+long session::get_hedge_timeout_ms(void) const
+{
+	return m_data->hedge_timeout_ms;
+}
+
 void session::set_trace_id(uint32_t trace_id)
 {
 	m_data->trace_id = trace_id;
@@ -643,11 +668,191 @@ async_read_result session::read_data(const key &id, const std::vector<int> &grou
 	return read_data(id, groups, io, DNET_CMD_READ);
 }
 
+/*
+ * Hedged read: every group gets single-group read, the next group is tried either when
+ * the current read fails or when it has not replied within hedge delay.
+ * Both kinds of reads sent to the next group are counted as hedged ones.
+ * The first successful reply completes the result, late replies are dropped.
+ */
+class hedged_read : public std::enable_shared_from_this<hedged_read>
+{
+	public:
+		hedged_read(const session &sess, const async_read_result &result)
+			: sess(sess.clone()), handler(result), delay_ms(0),
+			m_next(0), m_pending(0), m_done(false), m_timer(NULL)
+		{
+			this->sess.set_filter(filters::all_with_ack);
+			this->sess.set_checker(checkers::no_check);
+			this->sess.set_exceptions_policy(session::no_exceptions);
+		}
+
+		void start()
+		{
+			send(false);
+		}
+
+		session sess;
+		async_result_handler<read_result_entry> handler;
+		key id;
+		dnet_io_attr io;
+		unsigned int cmd;
+		std::vector<int> groups;
+		unsigned long delay_ms;
+
+	private:
+		static int timer_complete(struct dnet_net_state *, struct dnet_cmd *cmd, void *priv)
+		{
+			std::shared_ptr<hedged_read> *self = reinterpret_cast<std::shared_ptr<hedged_read> *>(priv);
+
+			if (cmd->flags & DNET_FLAGS_DESTROY) {
+				delete self;
+				return 0;
+			}
+
+			(*self)->send(true);
+			return 0;
+		}
+
+		void *take_timer()
+		{
+			void *timer = m_timer;
+			m_timer = NULL;
+			return timer;
+		}
+
+		void send(bool hedge)
+		{
+			dnet_node *node = sess.get_node().get_native();
+			void *timer = NULL;
+			size_t index;
+			int group;
+
+			{
+				std::lock_guard<std::mutex> guard(m_mutex);
+
+				// fired timer is released here too, it has done its work
+				timer = take_timer();
+				if (m_done || m_next >= groups.size()) {
+					dnet_timer_cancel(node, timer);
+					return;
+				}
+
+				index = m_next++;
+				group = groups[index];
+				++m_pending;
+				m_hedged.push_back(hedge);
+
+				if (m_next < groups.size()) {
+					auto priv = new std::shared_ptr<hedged_read>(shared_from_this());
+					m_timer = dnet_timer_start(node, delay_ms, timer_complete, priv);
+					if (!m_timer)
+						delete priv;
+				}
+			}
+
+			dnet_timer_cancel(node, timer);
+
+			if (hedge)
+				dnet_node_counter_inc(node, DNET_CNTR_HEDGE_READ, 0);
+
+			auto self = shared_from_this();
+			auto entries = std::make_shared<std::vector<read_result_entry>>();
+
+			sess.read_data(id, std::vector<int>(1, group), io, cmd).connect(
+				[entries] (const read_result_entry &entry) {
+					entries->push_back(entry);
+				},
+				[self, entries, index] (const error_info &error) {
+					self->complete(index, *entries, error);
+				});
+		}
+
+		void complete(size_t index, const std::vector<read_result_entry> &entries, const error_info &error)
+		{
+			dnet_node *node = sess.get_node().get_native();
+			bool success = false;
+
+			for (auto it = entries.begin(); it != entries.end(); ++it)
+				success |= (it->status() == 0 && !it->data().empty());
+
+			std::unique_lock<std::mutex> guard(m_mutex);
+
+			--m_pending;
+			if (m_done)
+				return;
+
+			if (!success) {
+				m_failed.insert(m_failed.end(), entries.begin(), entries.end());
+				m_error = error ? error : create_error(-ENXIO, id, "Failed to read data");
+
+				if (m_next < groups.size()) {
+					// do not wait for hedge delay, try the next group right now
+					guard.unlock();
+					send(true);
+					return;
+				}
+
+				if (m_pending)
+					return;
+			}
+
+			m_done = true;
+			void *timer = take_timer();
+			bool hedged = m_hedged[index];
+			guard.unlock();
+
+			dnet_timer_cancel(node, timer);
+
+			if (success && hedged)
+				dnet_node_counter_inc(node, DNET_CNTR_HEDGE_READ, 1);
+
+			const std::vector<read_result_entry> &results = success ? entries : m_failed;
+			for (auto it = results.begin(); it != results.end(); ++it)
+				handler.process(*it);
+
+			handler.complete(success ? error_info() : m_error);
+		}
+
+		std::mutex m_mutex;
+		size_t m_next;
+		size_t m_pending;
+		bool m_done;
+		void *m_timer;
+		std::vector<bool> m_hedged;
+		std::vector<read_result_entry> m_failed;
+		error_info m_error;
+};
+
 async_read_result session::read_data(const key &id, const std::vector<int> &groups, const dnet_io_attr &io, unsigned int cmd)
 {
 	transform(id);
 
 	async_read_result result(*this);
+
+	if (m_data->hedge_timeout_ms && groups.size() > 1 && cmd == DNET_CMD_READ) {
+		auto hr = std::make_shared<hedged_read>(*this, result);
+
+		hr->id = id;
+		hr->io = io;
+		hr->cmd = cmd;
+		hr->groups = groups;
+		hr->delay_ms = m_data->hedge_timeout_ms;
+
+		if (m_data->hedge_timeout_ms < 0) {
+			dnet_latency_stat stat;
+			dnet_id raw = id.id();
+
+			raw.group_id = groups[0];
+			if (!dnet_state_latency_stat(m_data->session_ptr, &raw, DNET_LATENCY_READ, &stat) && stat.count)
+				hr->delay_ms = std::max<unsigned long>(stat.p95 / 1000, 1);
+			else
+				hr->delay_ms = get_timeout_ms() / 2;
+		}
+
+		hr->start();
+		return result;
+	}
+
 	struct dnet_io_control control;
 	memset(&control, 0, sizeof(control));
 
@@ -1308,6 +1513,23 @@ std::string session::lookup_address(const key &id, int group_id)
 	return std::string(buf, strlen(buf));
 }
 
+dnet_latency_stat session::state_latency(const key &id, int group_id, int latency_class)
+{
+	transform(id);
+
+	dnet_id raw = id.id();
+	raw.group_id = group_id;
+
+	dnet_latency_stat stat;
+	memset(&stat, 0, sizeof(stat));
+
+	int err = dnet_state_latency_stat(m_data->session_ptr, &raw, latency_class, &stat);
+	if (err < 0)
+		throw_error(err, raw, "Failed to get latency statistics");
+
+	return stat;
+}
+
 void session::transform(const std::string &data, struct dnet_id &id)
 {
 	dnet_transform(m_data->session_ptr, (void *)data.data(), data.size(), &id);
@@ -2034,6 +2256,110 @@ async_write_result session::bulk_write(const std::vector<dnet_io_attr> &ios, con
 	return bulk_write(ios, pointer_data);
 }
 
+async_generic_result session::bulk_write_batch(const std::vector<dnet_io_attr> &ios, const std::vector<data_pointer> &data)
+{
+	if (ios.size() != data.size() || ios.empty()) {
+		error_info error = create_error(-EINVAL, "BULK_WRITE: ios doesn't meet data: io.size: %zd, data.size: %zd",
+			ios.size(), data.size());
+		if (get_exceptions_policy() & throw_at_start) {
+			error.throw_error();
+		} else {
+			async_generic_result result(*this);
+			async_result_handler<callback_result_entry> handler(result);
+			handler.complete(error);
+			return result;
+		}
+	}
+
+	const std::vector<int> groups = get_groups();
+	std::list<async_generic_result> results;
+
+	{
+		session_scope scope(*this);
+
+		// Ensure checkers and filters will work only for aggregated request
+		set_filter(filters::all_with_ack);
+		set_checker(checkers::no_check);
+		set_exceptions_policy(no_exceptions);
+
+		dnet_node *node = get_node().get_native();
+
+		for (size_t i = 0; i < groups.size(); ++i) {
+			// every state is referenced once while its batch is being built
+			std::map<dnet_net_state *, std::vector<size_t>> batches;
+			dnet_id id;
+
+			memset(&id, 0, sizeof(id));
+			id.group_id = groups[i];
+
+			for (size_t j = 0; j < ios.size(); ++j) {
+				memcpy(id.id, ios[j].id, DNET_ID_SIZE);
+
+				dnet_net_state *st = dnet_state_get_first(node, &id);
+				std::vector<size_t> &batch = batches[st];
+
+				if (st && !batch.empty())
+					dnet_state_put(st);
+
+				batch.push_back(j);
+			}
+
+			for (auto it = batches.begin(); it != batches.end(); ++it) {
+				const std::vector<size_t> &batch = it->second;
+
+				uint64_t size = 0;
+				for (size_t j = 0; j < batch.size(); ++j)
+					size += sizeof(dnet_io_attr) + data[batch[j]].size();
+
+				data_buffer buffer(sizeof(dnet_io_attr) + size);
+
+				dnet_io_attr io;
+				memset(&io, 0, sizeof(io));
+				io.num = batch.size();
+				io.size = size;
+				io.flags = get_ioflags();
+				dnet_convert_io_attr(&io);
+				buffer.write(io);
+
+				for (size_t j = 0; j < batch.size(); ++j) {
+					const data_pointer &file = data[batch[j]];
+
+					io = ios[batch[j]];
+					io.size = file.size();
+					io.flags |= get_ioflags();
+					dnet_convert_io_attr(&io);
+
+					buffer.write(io);
+					buffer.write(file.data<char>(), file.size());
+				}
+
+				data_pointer request = std::move(buffer);
+
+				memcpy(id.id, ios[batch.front()].id, DNET_ID_SIZE);
+				id.trace_id = get_trace_id();
+
+				transport_control control;
+				control.set_key(id);
+				control.set_command(DNET_CMD_BULK_WRITE);
+				control.set_cflags(DNET_FLAGS_NEED_ACK | get_cflags());
+				control.set_data(request.data(), request.size());
+
+				async_generic_result result(*this);
+				auto cb = createCallback<single_cmd_callback>(*this, result, control);
+
+				startCallback(cb);
+
+				results.emplace_back(std::move(result));
+
+				if (it->first)
+					dnet_state_put(it->first);
+			}
+		}
+	}
+
+	return aggregated(*this, results.begin(), results.end());
+}
+
 node &session::get_node()
 {
 	return m_data->node_guard;
@@ -33,14 +33,20 @@
 
 #include "../../include/elliptics/cppdef.h"
 #include "../../example/common.h"
+#include "../../library/elliptics.h"
+#include "../../cache/slab.hpp"
 
 #include <algorithm>
+#include <future>
 
 using namespace ioremap::elliptics;
 using namespace boost::unit_test;
 
 namespace tests {
 
+/* Dirty cached objects are written to disk this many seconds after modification */
+static const int cache_sync_timeout = 1;
+
 #define ELLIPTICS_CHECK_IMPL(R, C, CMD) auto R = (C); \
 	R.wait(); \
 	{ \
@@ -160,6 +166,14 @@ public:
 		return (*this)(name, "dummy-value");
 	}
 
+	config_data &operator() (const config_data &other)
+	{
+		for (auto it = other.m_data.begin(); it != other.m_data.end(); ++it)
+			(*this)(it->first, it->second);
+
+		return *this;
+	}
+
 protected:
 	std::vector<std::pair<std::string, std::string> >  m_data;
 };
@@ -282,6 +296,11 @@ public:
 		m_node = NULL;
 	}
 
+	dnet_node *get_native()
+	{
+		return m_node;
+	}
+
 private:
 	dnet_node *m_node;
 	std::string m_path;
@@ -296,6 +315,8 @@ struct tests_data
 
 	std::vector<server_node> nodes;
 	directory_handler directory;
+	std::string base_path;
+	config_data ioserv_config;
 };
 
 static std::shared_ptr<tests_data> global_data;
@@ -305,6 +326,27 @@ static config_data_writer create_config(config_data base_config, const std::stri
 	return config_data_writer(base_config, path);
 }
 
+static server_node start_server(const config_data &ioserv_config, const std::string &path, int group, int port, int remote_port)
+{
+	create_directory(path);
+	create_directory(path + "/blob");
+	create_directory(path + "/history");
+
+	create_config(ioserv_config, path + "/ioserv.conf")
+			("log", path + "/log.log")
+			("group", group)
+			("addr", "localhost:" + boost::lexical_cast<std::string>(port) + ":2")
+			("remote", "localhost:" + boost::lexical_cast<std::string>(remote_port) + ":2")
+			("history", path + "/history")
+			("data", path + "/blob/data")
+			;
+
+	server_node server(path + "/ioserv.conf");
+	server.start();
+
+	return server;
+}
+
 static void configure_server_nodes()
 {
 	std::string base_path;
@@ -329,16 +371,6 @@ static void configure_server_nodes()
 	results_reporter::get_stream() << "Set base directory: \"" << base_path << "\"" << std::endl;
 	results_reporter::get_stream() << "Starting up servers" << std::endl;
 
-	const std::string first_server_path = base_path + "/server-1";
-	const std::string second_server_path = base_path + "/server-2";
-
-	create_directory(first_server_path);
-	create_directory(first_server_path + "/blob");
-	create_directory(first_server_path + "/history");
-	create_directory(second_server_path);
-	create_directory(second_server_path + "/blob");
-	create_directory(second_server_path + "/history");
-
 	config_data ioserv_config;
 
 	ioserv_config("log", "/dev/stderr")
@@ -373,32 +405,10 @@ static void configure_server_nodes()
 			("defrag_percentage", 25)
 			;
 
-	create_config(ioserv_config, first_server_path + "/ioserv.conf")
-			("log", first_server_path + "/log.log")
-			("group", 1)
-			("addr", "localhost:1025:2")
-			("remote", "localhost:1026:2")
-			("history", first_server_path + "/history")
-			("data", first_server_path + "/blob/data")
-			;
-
-	server_node first_server(first_server_path + "/ioserv.conf");
-
-	first_server.start();
+	server_node first_server = start_server(ioserv_config, base_path + "/server-1", 1, 1025, 1026);
 	results_reporter::get_stream() << "First server started" << std::endl;
 
-	create_config(ioserv_config, second_server_path + "/ioserv.conf")
-			("log", second_server_path + "/log.log")
-			("group", 2)
-			("addr", "localhost:1026:2")
-			("remote", "localhost:1025:2")
-			("history", second_server_path + "/history")
-			("data", second_server_path + "/blob/data")
-			;
-
-	server_node second_server(second_server_path + "/ioserv.conf");
-
-	second_server.start();
+	server_node second_server = start_server(ioserv_config, base_path + "/server-2", 2, 1026, 1025);
 	results_reporter::get_stream() << "Second server started" << std::endl;
 
 	global_data = std::make_shared<tests_data>();
@@ -406,8 +416,47 @@ static void configure_server_nodes()
 	global_data->directory = std::move(guard);
 	global_data->nodes.emplace_back(std::move(first_server));
 	global_data->nodes.emplace_back(std::move(second_server));
+	global_data->base_path = base_path;
+	global_data->ioserv_config = ioserv_config;
 }
 
+/*
+ * Separate servers of groups 1 and 2 listening on @port and @port + 1 for tests which need
+ * their own server options or restart servers, they are removed when test is finished
+ */
+struct test_servers
+{
+	test_servers(const std::string &name, const config_data &options, int port)
+		: directory(global_data->base_path + name), path(global_data->base_path + name), port(port)
+	{
+		config_data ioserv_config = global_data->ioserv_config;
+		ioserv_config(options);
+
+		create_directory(path);
+
+		nodes.emplace_back(start_server(ioserv_config, path + "/server-1", 1, port, port + 1));
+		nodes.emplace_back(start_server(ioserv_config, path + "/server-2", 2, port + 1, port));
+	}
+
+	~test_servers()
+	{
+		nodes.clear();
+	}
+
+	void restart()
+	{
+		for (auto it = nodes.begin(); it != nodes.end(); ++it) {
+			it->stop();
+			it->start();
+		}
+	}
+
+	directory_handler directory;
+	std::vector<server_node> nodes;
+	std::string path;
+	int port;
+};
+
 static void test_write(session &sess, const std::string &id, const std::string &data)
 {
 	ELLIPTICS_REQUIRE(write_result, sess.write_data(id, data, 0));
@@ -784,6 +833,64 @@ static void test_bulk_write(session &sess, size_t test_count)
 	}
 }
 
+static void test_bulk_write_batch(session &sess, size_t test_count)
+{
+	std::vector<struct dnet_io_attr> ios;
+	std::vector<data_pointer> data;
+
+	for (size_t i = 0; i < test_count; ++i) {
+		struct dnet_io_attr io;
+		struct dnet_id id;
+
+		std::ostringstream os;
+		os << "bulk_write_batch" << i;
+
+		memset(&io, 0, sizeof(io));
+		memset(&id, 0, sizeof(id));
+
+		sess.transform(os.str(), id);
+		memcpy(io.id, id.id, DNET_ID_SIZE);
+		dnet_current_time(&io.timestamp);
+
+		ios.push_back(io);
+		data.push_back(data_pointer::copy(os.str()));
+	}
+
+	ELLIPTICS_REQUIRE(write_result, sess.bulk_write_batch(ios, data));
+
+	sync_generic_result result = write_result.get();
+
+	size_t count = 0;
+
+	for (auto it = result.begin(); it != result.end(); ++it) {
+		if (it->is_ack())
+			continue;
+
+		BOOST_REQUIRE_EQUAL(it->status(), 0);
+		BOOST_REQUIRE_GE(it->data().size(), sizeof(dnet_bulk_write_reply));
+
+		dnet_bulk_write_reply *reply = it->data().data<dnet_bulk_write_reply>();
+		dnet_convert_bulk_write_reply(reply, 0);
+
+		BOOST_REQUIRE_EQUAL(it->data().size(),
+			sizeof(dnet_bulk_write_reply) + reply->num * sizeof(dnet_bulk_write_status));
+
+		for (uint64_t i = 0; i < reply->num; ++i)
+			count += (reply->status[i].status == 0);
+	}
+
+	BOOST_REQUIRE_EQUAL(count, test_count * 2);
+
+	for (size_t i = 0; i < test_count; ++i) {
+		std::ostringstream os;
+		os << "bulk_write_batch" << i;
+
+		ELLIPTICS_REQUIRE(read_result, sess.read_data(os.str(), 0, 0));
+		read_result_entry read_entry = read_result.get_one();
+		BOOST_REQUIRE_EQUAL(read_entry.file().to_string(), os.str());
+	}
+}
+
 static void test_bulk_read(session &sess, size_t test_count)
 {
 	std::vector<std::string> keys;
@@ -1112,6 +1219,618 @@ static void test_prepare_latest(session &sess, const std::string &id)
 	BOOST_REQUIRE_EQUAL(lookup_result.size(), 2);
 }
 
+static dnet_stat_count hedge_read_counter(session &sess)
+{
+	dnet_stat_count counter;
+
+	dnet_node_get_counter(sess.get_node().get_native(), DNET_CNTR_HEDGE_READ, &counter);
+	return counter;
+}
+
+/*
+ * Hedged read returns the same data as plain one whatever group replies first.
+ * DNET_CNTR_HEDGE_READ counts hedged reads sent (count) and won (err), the latter never exceeds the former.
+ * With @hedge_timeout_ms longer than any read no hedged read is sent at all.
+ */
+static void test_hedged_read(session &sess, const std::string &id, long hedge_timeout_ms, int num)
+{
+	std::string data;
+	for (int i = 0; i < 1024 * 1024; ++i)
+		data.push_back('a' + i % 26);
+
+	ELLIPTICS_REQUIRE(write_result, sess.write_data(id, data, 0));
+
+	const dnet_stat_count before = hedge_read_counter(sess);
+
+	sess.set_hedge_timeout_ms(hedge_timeout_ms);
+	BOOST_REQUIRE_EQUAL(sess.get_hedge_timeout_ms(), hedge_timeout_ms);
+
+	for (int i = 0; i < num; ++i) {
+		ELLIPTICS_REQUIRE(read_result, sess.read_data(id, 0, 0));
+		BOOST_REQUIRE_EQUAL(read_result.get_one().file().to_string(), data);
+	}
+
+	const dnet_stat_count after = hedge_read_counter(sess);
+	const uint64_t sent = after.count - before.count;
+	const uint64_t won = after.err - before.err;
+
+	BOOST_REQUIRE_LE(won, sent);
+	BOOST_REQUIRE_LE(sent, (uint64_t)num);
+
+	if (hedge_timeout_ms >= 10000)
+		BOOST_REQUIRE_EQUAL(sent, 0);
+	else if (hedge_timeout_ms > 0)
+		BOOST_WARN_MESSAGE(sent > 0, "no hedged read was sent within " << hedge_timeout_ms << " ms");
+}
+
+/*
+ * Object exists only in the last group, so every read fails in the first group and is
+ * hedged to the next one at once without waiting for the delay, and the hedged read wins.
+ */
+static void test_hedged_read_missing(session &sess, const std::string &id, const std::string &data, int num)
+{
+	session write_sess = sess.clone();
+	write_sess.set_groups(std::vector<int>(1, sess.get_groups().back()));
+
+	ELLIPTICS_REQUIRE(write_result, write_sess.write_data(id, data, 0));
+
+	const dnet_stat_count before = hedge_read_counter(sess);
+
+	sess.set_hedge_timeout_ms(10000);
+
+	for (int i = 0; i < num; ++i) {
+		ELLIPTICS_REQUIRE(read_result, sess.read_data(id, 0, 0));
+		BOOST_REQUIRE_EQUAL(read_result.get_one().file().to_string(), data);
+	}
+
+	const dnet_stat_count after = hedge_read_counter(sess);
+
+	BOOST_REQUIRE_EQUAL(after.count - before.count, (uint64_t)num);
+	BOOST_REQUIRE_EQUAL(after.err - before.err, (uint64_t)num);
+}
+
+static void test_timeout_ms(session &sess)
+{
+	sess.set_timeout_ms(300);
+	BOOST_REQUIRE_EQUAL(sess.get_timeout_ms(), 300);
+	BOOST_REQUIRE_EQUAL(sess.get_timeout(), 0);
+
+	sess.set_timeout_ms(2500);
+	BOOST_REQUIRE_EQUAL(sess.get_timeout_ms(), 2500);
+	BOOST_REQUIRE_EQUAL(sess.get_timeout(), 2);
+}
+
+/*
+ * Server replies to notification request only when the key is modified,
+ * so the request is completed by the timer wheel after sub-second timeout
+ */
+static void test_timeout_ms_expire(session &sess, const std::string &id, unsigned long timeout_ms)
+{
+	struct dnet_id raw;
+	struct timeval start, end;
+
+	sess.transform(id, raw);
+	sess.set_timeout_ms(timeout_ms);
+
+	transport_control ctl(raw, DNET_CMD_NOTIFY, DNET_FLAGS_NEED_ACK);
+
+	gettimeofday(&start, NULL);
+	ELLIPTICS_REQUIRE_ERROR(notify_result, sess.request_cmd(ctl), -ETIMEDOUT);
+	gettimeofday(&end, NULL);
+
+	const long elapsed_ms = (end.tv_sec - start.tv_sec) * 1000 + (end.tv_usec - start.tv_usec) / 1000;
+
+	BOOST_REQUIRE_GE(elapsed_ms, (long)timeout_ms - 10);
+	BOOST_REQUIRE_LT(elapsed_ms, 1000);
+}
+
+static float state_weight(session &sess, struct dnet_id &raw)
+{
+	dnet_net_state *st = dnet_state_get_first(sess.get_node().get_native(), &raw);
+	BOOST_REQUIRE(st != NULL);
+
+	const float weight = st->weight;
+	dnet_state_put(st);
+
+	return weight;
+}
+
+/*
+ * Timed out transaction halves weight of the state, state which only serves
+ * writes afterwards wins its weight back
+ */
+static void test_state_weight_recovery(session &sess, const std::string &id, int group_id)
+{
+	struct dnet_id raw;
+
+	sess.transform(id, raw);
+	raw.group_id = group_id;
+
+	const float before = state_weight(sess, raw);
+
+	session notify_sess = sess.clone();
+	notify_sess.set_timeout_ms(100);
+
+	transport_control ctl(raw, DNET_CMD_NOTIFY, DNET_FLAGS_NEED_ACK);
+	ELLIPTICS_REQUIRE_ERROR(notify_result, notify_sess.request_cmd(ctl), -ETIMEDOUT);
+
+	const float timed_out = state_weight(sess, raw);
+	if (before >= 2)
+		BOOST_REQUIRE_LT(timed_out, before);
+
+	// Weight is increased at most once a second, read replies change it on their own
+	struct timeval start, now;
+	gettimeofday(&start, NULL);
+	do {
+		ELLIPTICS_REQUIRE(write_result, sess.write_data(id + "-data", std::string("weight recovery data"), 0));
+		usleep(100 * 1000);
+		gettimeofday(&now, NULL);
+	} while (now.tv_sec - start.tv_sec < 3);
+
+	BOOST_REQUIRE_GT(state_weight(sess, raw), timed_out);
+}
+
+/*
+ * Dirty objects removed while their write-back is queued or running must not reappear on disk
+ */
+static void test_cache_remove_before_sync(uint32_t ioflags, int num)
+{
+	test_servers servers("cache-remove-before-sync", config_data()("cache_sync_timeout", cache_sync_timeout), 1029);
+
+	logger log(NULL);
+	node n(log);
+	n.add_remote("localhost", servers.port);
+
+	session sess = create_session(n, {1, 2}, 0, ioflags);
+
+	// Read without cache flags is served by backend when object is not cached
+	session disk_sess = create_session(n, {1, 2}, 0, 0);
+
+	std::vector<std::string> ids;
+	for (int i = 0; i < num; ++i) {
+		std::ostringstream os;
+		os << "cache-remove-before-sync-" << i;
+		ids.push_back(os.str());
+	}
+
+	for (auto it = ids.begin(); it != ids.end(); ++it) {
+		ELLIPTICS_REQUIRE(write_result, sess.write_data(*it, std::string(64 * 1024, 'r'), 0));
+	}
+
+	// Objects become due for write-back while they are being removed
+	sleep(cache_sync_timeout);
+
+	for (auto it = ids.begin(); it != ids.end(); ++it) {
+		ELLIPTICS_REQUIRE(remove_result, sess.remove(*it));
+	}
+
+	// Life check thread runs every second, queued write-backs are surely processed by now
+	sleep(cache_sync_timeout + 2);
+
+	for (auto it = ids.begin(); it != ids.end(); ++it) {
+		ELLIPTICS_REQUIRE_ERROR(read_result, disk_sess.read_data(*it, 0, 0), -ENOENT);
+	}
+}
+
+/*
+ * Cache is saved into snapshot when server stops and is loaded back on start,
+ * objects keep their absolute expiration time.
+ */
+static void test_cache_snapshot(uint32_t ioflags, const std::string &id, const std::string &expiring_id, const std::string &data)
+{
+	const long lifetime = 15;
+
+	test_servers servers("cache-snapshot", config_data()("cache_snapshot", 1), 1027);
+
+	logger log(NULL);
+	node n(log);
+	n.add_remote("localhost", servers.port);
+
+	session sess = create_session(n, {1, 2}, 0, ioflags);
+
+	ELLIPTICS_REQUIRE(write_result, sess.write_cache(id, data, 0));
+	ELLIPTICS_REQUIRE(expiring_write_result, sess.write_cache(expiring_id, data, lifetime));
+	const time_t expires = time(NULL) + lifetime;
+
+	servers.restart();
+
+	node restored_node(log);
+	restored_node.add_remote("localhost", servers.port);
+
+	session restored_sess = create_session(restored_node, {1, 2}, 0, ioflags);
+
+	ELLIPTICS_COMPARE_REQUIRE(read_result, restored_sess.read_data(id, 0, 0), data);
+	ELLIPTICS_COMPARE_REQUIRE(expiring_read_result, restored_sess.read_data(expiring_id, 0, 0), data);
+
+	// Life check thread runs every second
+	const time_t now = time(NULL);
+	if (now < expires + 2)
+		sleep(expires + 2 - now);
+
+	ELLIPTICS_COMPARE_REQUIRE(persistent_read_result, restored_sess.read_data(id, 0, 0), data);
+	ELLIPTICS_REQUIRE_ERROR(expired_read_result, restored_sess.read_data(expiring_id, 0, 0), -ENOENT);
+}
+
+static dnet_net_state *route_snapshot_search(dnet_node *n, dnet_id &id, bool &published)
+{
+	int idx = dnet_route_read_lock(n);
+	dnet_route_table *route = dnet_route_get(n);
+	dnet_net_state *st = route ? dnet_route_search(route, &id) : NULL;
+	dnet_route_read_unlock(n, idx);
+
+	published = (route != NULL);
+	return st;
+}
+
+/*
+ * Lock-free search in routing table snapshot finds the same state as locked search in groups
+ * for random ids and for ids of the routing table itself
+ */
+static void test_route_snapshot(session &sess, int num)
+{
+	dnet_node *n = sess.get_node().get_native();
+	std::vector<dnet_id> ids;
+
+	dnet_route_update(n);
+
+	int idx = dnet_route_read_lock(n);
+	dnet_route_table *route = dnet_route_get(n);
+	for (int i = 0; route && i < route->group_num; ++i) {
+		for (int j = 0; j < route->groups[i].id_num; ++j) {
+			dnet_id id;
+
+			memset(&id, 0, sizeof(id));
+			memcpy(id.id, route->groups[i].entries[j].id.id, DNET_ID_SIZE);
+			id.group_id = route->groups[i].group_id;
+			ids.push_back(id);
+
+			// the same first 8 bytes, which are compared as a number
+			id.id[DNET_ID_SIZE - 1] ^= 1;
+			ids.push_back(id);
+		}
+	}
+	dnet_route_read_unlock(n, idx);
+
+	BOOST_REQUIRE(!ids.empty());
+
+	for (int i = 0; i < num; ++i) {
+		dnet_id id;
+
+		memset(&id, 0, sizeof(id));
+		for (int j = 0; j < DNET_ID_SIZE; ++j)
+			id.id[j] = rand();
+		id.group_id = 1 + i % 2;
+		ids.push_back(id);
+	}
+
+	for (auto it = ids.begin(); it != ids.end(); ++it) {
+		bool published;
+		dnet_net_state *snapshot = route_snapshot_search(n, *it, published);
+
+		pthread_mutex_lock(&n->state_lock);
+		dnet_net_state *locked = dnet_state_search_nolock(n, &*it);
+		pthread_mutex_unlock(&n->state_lock);
+		dnet_state_put(locked);
+
+		BOOST_REQUIRE(published);
+		BOOST_REQUIRE_EQUAL(snapshot, locked);
+	}
+}
+
+/*
+ * Transaction ids of one state are strided by the fan-out of concurrent requests,
+ * they must still spread over all buckets while the table grows and shrinks
+ */
+static void test_trans_table_strided(uint64_t stride, unsigned int num)
+{
+	struct dnet_trans_table table;
+	std::vector<dnet_trans *> trans;
+
+	memset(&table, 0, sizeof(table));
+
+	for (unsigned int i = 0; i < num; ++i) {
+		dnet_trans *t = dnet_trans_alloc(NULL, 0);
+		BOOST_REQUIRE(t != NULL);
+
+		t->trans = i * stride;
+		BOOST_REQUIRE_EQUAL(dnet_trans_insert_nolock(&table, t), 0);
+		trans.push_back(t);
+	}
+
+	BOOST_REQUIRE_EQUAL(table.num, num);
+	BOOST_REQUIRE_GE(table.size, num);
+
+	unsigned int max_chain = 0;
+	for (unsigned int i = 0; i < table.size; ++i) {
+		unsigned int chain = 0;
+		for (struct list_head *pos = table.buckets[i].next; pos != &table.buckets[i]; pos = pos->next)
+			++chain;
+		max_chain = std::max(max_chain, chain);
+	}
+	BOOST_REQUIRE_LE(max_chain, 16);
+
+	for (unsigned int i = 0; i < num; ++i) {
+		dnet_trans *t = dnet_trans_search(&table, i * stride);
+		BOOST_REQUIRE_EQUAL(t, trans[i]);
+		dnet_trans_put(t);
+	}
+
+	// Shrink the table back and make sure the rest of transactions are still found
+	for (unsigned int i = 0; i < num; ++i) {
+		if (i % 16)
+			dnet_trans_remove_nolock(&table, trans[i]);
+	}
+
+	BOOST_REQUIRE_LT(table.size, num);
+
+	for (unsigned int i = 0; i < num; ++i) {
+		dnet_trans *t = dnet_trans_search(&table, i * stride);
+		BOOST_REQUIRE_EQUAL(t, (i % 16) ? NULL : trans[i]);
+		dnet_trans_put(t);
+	}
+
+	for (unsigned int i = 0; i < num; i += 16)
+		dnet_trans_remove_nolock(&table, trans[i]);
+
+	BOOST_REQUIRE_EQUAL(table.num, 0);
+	BOOST_REQUIRE_EQUAL(table.size, DNET_TRANS_TABLE_MIN_SIZE);
+
+	for (auto it = trans.begin(); it != trans.end(); ++it)
+		dnet_trans_put(*it);
+
+	dnet_trans_table_destroy(&table);
+}
+
+/*
+ * Chunk sizes are 16-byte aligned, grow monotonically and never by more than 1/4 plus alignment,
+ * requests bigger than the biggest class are rounded up to page size
+ */
+static void test_slab_size_classes()
+{
+	using ioremap::cache::slab_allocator_t;
+	slab_allocator_t allocator;
+	size_t prev = 0;
+
+	BOOST_REQUIRE_EQUAL(allocator.chunk_size(1), slab_allocator_t::min_chunk_size);
+	BOOST_REQUIRE_EQUAL(allocator.chunk_size(slab_allocator_t::min_chunk_size), slab_allocator_t::min_chunk_size);
+	BOOST_REQUIRE_EQUAL(allocator.chunk_size(slab_allocator_t::min_chunk_size + 1), 80);
+
+	for (size_t size = 1; size <= slab_allocator_t::max_chunk_size; ++size) {
+		size_t chunk = allocator.chunk_size(size);
+
+		BOOST_REQUIRE_GE(chunk, size);
+		BOOST_REQUIRE_EQUAL(chunk % 16, 0);
+		BOOST_REQUIRE_GE(chunk, prev);
+		BOOST_REQUIRE_LE(chunk, std::max<size_t>(slab_allocator_t::min_chunk_size, size + size / 4 + 16));
+
+		prev = chunk;
+	}
+
+	BOOST_REQUIRE_EQUAL(prev, slab_allocator_t::max_chunk_size);
+	BOOST_REQUIRE_EQUAL(allocator.chunk_size(slab_allocator_t::max_chunk_size + 1), slab_allocator_t::page_size);
+	BOOST_REQUIRE_EQUAL(allocator.chunk_size(slab_allocator_t::page_size + 1), 2 * slab_allocator_t::page_size);
+}
+
+/*
+ * Freed chunk is handed out again to the next allocation of its class,
+ * and all chunks of one page are carved before the next page is taken
+ */
+static void test_slab_reuse()
+{
+	using ioremap::cache::slab_allocator_t;
+	slab_allocator_t allocator;
+	const size_t size = 100;
+	const size_t chunk = allocator.chunk_size(size);
+	const size_t num = slab_allocator_t::max_chunk_size / chunk;
+	std::vector<void *> ptrs;
+
+	for (size_t i = 0; i < num; ++i) {
+		ptrs.push_back(allocator.allocate(size));
+		memset(ptrs.back(), i, size);
+	}
+
+	BOOST_REQUIRE_EQUAL(allocator.used(), num * chunk);
+	BOOST_REQUIRE_EQUAL(allocator.reserved(), slab_allocator_t::page_size);
+
+	BOOST_REQUIRE_EQUAL(std::set<void *>(ptrs.begin(), ptrs.end()).size(), num);
+	for (size_t i = 0; i < num; ++i)
+		BOOST_REQUIRE_EQUAL(((unsigned char *)ptrs[i])[size - 1], (unsigned char)i);
+
+	void *ptr = ptrs[num / 2];
+	allocator.deallocate(ptr, size);
+	BOOST_REQUIRE_EQUAL(allocator.allocate(size), ptr);
+	BOOST_REQUIRE_EQUAL(allocator.reserved(), slab_allocator_t::page_size);
+
+	// page is full now, the next chunk comes from a new one
+	ptrs.push_back(allocator.allocate(size));
+	BOOST_REQUIRE_EQUAL(allocator.reserved(), 2 * slab_allocator_t::page_size);
+
+	for (auto it = ptrs.begin(); it != ptrs.end(); ++it)
+		allocator.deallocate(*it, size);
+
+	BOOST_REQUIRE_EQUAL(allocator.used(), 0);
+}
+
+/*
+ * Page whose chunks are all freed is released, the last one is kept as a spare
+ * and is reused by another size class
+ */
+static void test_slab_page_release(int pages)
+{
+	using ioremap::cache::slab_allocator_t;
+	slab_allocator_t allocator;
+	const size_t small = 200, big = 3000;
+	const size_t num = pages * (slab_allocator_t::max_chunk_size / allocator.chunk_size(small));
+	std::vector<void *> ptrs;
+
+	for (size_t i = 0; i < num; ++i)
+		ptrs.push_back(allocator.allocate(small));
+
+	BOOST_REQUIRE_EQUAL(allocator.reserved(), pages * slab_allocator_t::page_size);
+
+	// freeing every other chunk releases nothing
+	for (size_t i = 0; i < num; i += 2)
+		allocator.deallocate(ptrs[i], small);
+	BOOST_REQUIRE_EQUAL(allocator.reserved(), pages * slab_allocator_t::page_size);
+
+	for (size_t i = 1; i < num; i += 2)
+		allocator.deallocate(ptrs[i], small);
+	BOOST_REQUIRE_EQUAL(allocator.used(), 0);
+	BOOST_REQUIRE_EQUAL(allocator.reserved(), slab_allocator_t::page_size);
+
+	// objects change their size, spare page is taken by another class
+	ptrs.clear();
+	for (size_t i = 0; i < slab_allocator_t::max_chunk_size / allocator.chunk_size(big); ++i)
+		ptrs.push_back(allocator.allocate(big));
+	BOOST_REQUIRE_EQUAL(allocator.reserved(), slab_allocator_t::page_size);
+
+	for (auto it = ptrs.begin(); it != ptrs.end(); ++it)
+		allocator.deallocate(*it, big);
+	BOOST_REQUIRE_EQUAL(allocator.reserved(), slab_allocator_t::page_size);
+
+	// big allocations are not kept
+	void *ptr = allocator.allocate(3 * slab_allocator_t::page_size);
+	BOOST_REQUIRE_EQUAL(allocator.reserved(), 4 * slab_allocator_t::page_size);
+	allocator.deallocate(ptr, 3 * slab_allocator_t::page_size);
+	BOOST_REQUIRE_EQUAL(allocator.reserved(), slab_allocator_t::page_size);
+}
+
+/*
+ * Messages logged by server with DNET_CFG_ASYNC_LOG are written to its log file by the time
+ * server is stopped, except those dropped on full ring which are counted in DNET_CNTR_LOG_DROPPED.
+ * Up to a few hundred short messages fit into the ring and are never dropped.
+ */
+static void test_async_log(int num)
+{
+	test_servers servers("async-log", config_data()("flags", 4 | DNET_CFG_ASYNC_LOG), 1031);
+	dnet_node *n = servers.nodes[0].get_native();
+	dnet_stat_count before, after;
+
+	BOOST_REQUIRE(n->flags & DNET_CFG_ASYNC_LOG);
+
+	dnet_node_get_counter(n, DNET_CNTR_LOG_DROPPED, &before);
+
+	for (int i = 0; i < num; ++i)
+		dnet_log(n, DNET_LOG_ERROR, "async-log-test-message: %d\n", i);
+
+	dnet_node_get_counter(n, DNET_CNTR_LOG_DROPPED, &after);
+	const uint64_t dropped = after.count - before.count;
+
+	// queued messages are flushed when node is destroyed
+	servers.nodes[0].stop();
+
+	std::ifstream log_file((servers.path + "/server-1/log.log").c_str());
+	BOOST_REQUIRE(log_file);
+
+	uint64_t delivered = 0;
+	for (std::string line; std::getline(log_file, line); ) {
+		if (line.find("async-log-test-message: ") != std::string::npos)
+			++delivered;
+	}
+
+	BOOST_REQUIRE_EQUAL(delivered + dropped, (uint64_t)num);
+	BOOST_REQUIRE_GT(delivered, 0);
+
+	if (num <= 500)
+		BOOST_REQUIRE_EQUAL(dropped, 0);
+}
+
+static dnet_stat_count oplock_counter(dnet_node *n, int counter)
+{
+	dnet_stat_count count[__DNET_CNTR_MAX];
+
+	memset(count, 0, sizeof(count));
+	dnet_locks_stat(n, count);
+
+	return count[counter];
+}
+
+/*
+ * Readers of the same key hold operation lock at the same time,
+ * second reader takes it while the first one still holds it
+ */
+static void test_oplock_shared_readers()
+{
+	logger log(NULL);
+	node client(log);
+	dnet_node *n = client.get_native();
+
+	BOOST_REQUIRE_EQUAL(dnet_locks_init(n, 16), 0);
+
+	dnet_id key;
+	memset(&key, 0, sizeof(key));
+	key.id[0] = 0x11;
+
+	const dnet_stat_count before = oplock_counter(n, DNET_CNTR_OPLOCK_SHARED);
+
+	dnet_oplock_mode(n, &key, DNET_OPLOCK_READ);
+
+	auto reader = std::async(std::launch::async, [n, &key] () {
+		dnet_oplock_mode(n, &key, DNET_OPLOCK_READ);
+		dnet_opunlock(n, &key);
+	});
+
+	BOOST_REQUIRE(reader.wait_for(std::chrono::seconds(10)) == std::future_status::ready);
+
+	BOOST_REQUIRE_EQUAL(dnet_optrylock(n, &key), -EBUSY);
+	dnet_opunlock(n, &key);
+
+	const dnet_stat_count after = oplock_counter(n, DNET_CNTR_OPLOCK_SHARED);
+
+	BOOST_REQUIRE_EQUAL(after.count - before.count, 2);
+	BOOST_REQUIRE_EQUAL(after.err - before.err, 1);
+
+	dnet_locks_destroy(n);
+}
+
+/*
+ * Writer waits until all readers of the key release operation lock and takes it after the last one
+ */
+static void test_oplock_writer_waits(int readers)
+{
+	logger log(NULL);
+	node client(log);
+	dnet_node *n = client.get_native();
+
+	BOOST_REQUIRE_EQUAL(dnet_locks_init(n, 16), 0);
+
+	dnet_id key;
+	memset(&key, 0, sizeof(key));
+	key.id[0] = 0x22;
+
+	for (int i = 0; i < readers; ++i)
+		dnet_oplock_mode(n, &key, DNET_OPLOCK_READ);
+
+	const dnet_stat_count before = oplock_counter(n, DNET_CNTR_OPLOCK);
+	const dnet_stat_count stripe_before = oplock_counter(n, DNET_CNTR_OPLOCK_STRIPE);
+
+	auto writer = std::async(std::launch::async, [n, &key] () {
+		dnet_oplock(n, &key);
+		dnet_opunlock(n, &key);
+	});
+
+	// writer has taken the stripe lock, it is released only when writer starts waiting for readers
+	for (int i = 0; i < 1000 && oplock_counter(n, DNET_CNTR_OPLOCK_STRIPE).count == stripe_before.count; ++i)
+		usleep(10 * 1000);
+
+	for (int i = 0; i < readers; ++i) {
+		BOOST_REQUIRE(writer.wait_for(std::chrono::milliseconds(100)) == std::future_status::timeout);
+		dnet_opunlock(n, &key);
+	}
+
+	BOOST_REQUIRE(writer.wait_for(std::chrono::seconds(10)) == std::future_status::ready);
+
+	const dnet_stat_count after = oplock_counter(n, DNET_CNTR_OPLOCK);
+
+	BOOST_REQUIRE_EQUAL(after.count - before.count, 1);
+	BOOST_REQUIRE_EQUAL(after.err - before.err, 1);
+
+	BOOST_REQUIRE_EQUAL(dnet_optrylock(n, &key), 0);
+	dnet_opunlock(n, &key);
+
+	dnet_locks_destroy(n);
+}
+
 bool register_tests()
 {
 	srand(time(0));
@@ -1149,6 +1868,7 @@ bool register_tests()
 	ELLIPTICS_TEST_CASE(test_prepare_commit, create_session(n, {1, 2}, 0, 0), "prepare-commit-test-3", 1, 0);
 	ELLIPTICS_TEST_CASE(test_prepare_commit, create_session(n, {1, 2}, 0, 0), "prepare-commit-test-4", 1, 1);
 	ELLIPTICS_TEST_CASE(test_bulk_write, create_session(n, {1, 2}, 0, 0), 1000);
+	ELLIPTICS_TEST_CASE(test_bulk_write_batch, create_session(n, {1, 2}, 0, 0), 1000);
 	ELLIPTICS_TEST_CASE(test_bulk_read, create_session(n, {1, 2}, 0, 0), 1000);
 	ELLIPTICS_TEST_CASE(test_range_request, create_session(n, {2}, 0, 0), 0, 255, 2);
 	ELLIPTICS_TEST_CASE(test_range_request, create_session(n, {2}, 0, 0), 3, 14, 2);
@@ -1159,6 +1879,30 @@ bool register_tests()
 	ELLIPTICS_TEST_CASE(test_partial_bulk_read, create_session(n, {1, 2, 3}, 0, 0));
 	ELLIPTICS_TEST_CASE(test_indexes_update, create_session(n, {2}, 0, 0));
 	ELLIPTICS_TEST_CASE(test_prepare_latest, create_session(n, {1, 2}, 0, 0), "prepare-latest-key");
+	ELLIPTICS_TEST_CASE(test_hedged_read, create_session(n, {1, 2}, 0, 0), "hedged-read-key", 1, 100);
+	ELLIPTICS_TEST_CASE(test_hedged_read, create_session(n, {1, 2}, 0, 0), "hedged-read-key", -1, 100);
+	ELLIPTICS_TEST_CASE(test_hedged_read, create_session(n, {1, 2}, 0, 0), "hedged-read-key", 10000, 10);
+	ELLIPTICS_TEST_CASE(test_hedged_read_missing, create_session(n, {1, 2}, 0, 0), "hedged-read-missing-key", "hedged-data", 10);
+	ELLIPTICS_TEST_CASE(test_timeout_ms, create_session(n, {1, 2}, 0, 0));
+	ELLIPTICS_TEST_CASE(test_timeout_ms_expire, create_session(n, {1, 2}, 0, 0), "timeout-ms-key", 300);
+	ELLIPTICS_TEST_CASE(test_state_weight_recovery, create_session(n, {1}, 0, 0), "weight-recovery-key", 1);
+	ELLIPTICS_TEST_CASE(test_route_snapshot, create_session(n, {1, 2}, 0, 0), 10000);
+	ELLIPTICS_TEST_CASE(test_trans_table_strided, 1, 10000);
+	ELLIPTICS_TEST_CASE(test_trans_table_strided, 2, 10000);
+	ELLIPTICS_TEST_CASE(test_trans_table_strided, 64, 10000);
+	ELLIPTICS_TEST_CASE(test_trans_table_strided, 1024, 10000);
+	ELLIPTICS_TEST_CASE(test_slab_size_classes);
+	ELLIPTICS_TEST_CASE(test_slab_reuse);
+	ELLIPTICS_TEST_CASE(test_slab_page_release, 1);
+	ELLIPTICS_TEST_CASE(test_slab_page_release, 16);
+	ELLIPTICS_TEST_CASE(test_async_log, 500);
+	ELLIPTICS_TEST_CASE(test_async_log, 100000);
+	ELLIPTICS_TEST_CASE(test_oplock_shared_readers);
+	ELLIPTICS_TEST_CASE(test_oplock_writer_waits, 1);
+	ELLIPTICS_TEST_CASE(test_oplock_writer_waits, 3);
+	ELLIPTICS_TEST_CASE(test_cache_remove_before_sync, DNET_IO_FLAGS_CACHE, 200);
+	ELLIPTICS_TEST_CASE(test_cache_snapshot, DNET_IO_FLAGS_CACHE | DNET_IO_FLAGS_CACHE_ONLY,
+			"cache-snapshot-key", "cache-snapshot-expiring-key", "cache-snapshot-data");
 
 	return true;
 }
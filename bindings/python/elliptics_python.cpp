@@ -55,6 +55,8 @@ enum elliptics_cflags {
 	cflags_default = 0,
 	cflags_direct = DNET_FLAGS_DIRECT,
 	cflags_nolock = DNET_FLAGS_NOLOCK,
+	cflags_prio_high = DNET_FLAGS_PRIO_HIGH,
+	cflags_prio_background = DNET_FLAGS_PRIO_BACKGROUND,
 };
 
 enum elliptics_ioflags {
@@ -919,8 +921,41 @@ class elliptics_session: public session, public bp::wrapper<session> {
 			return create_result(std::move(session::list_indexes(id)));
 		}
 
+		bp::dict latency_stat(const struct dnet_addr_latency_stat *ls) {
+			bp::dict latency, commands, backend;
+
+			if (ls->hist_size != DNET_LATENCY_HIST_SIZE)
+				return latency;
+
+			for (int j = 0; j < ls->num; ++j) {
+				const struct dnet_latency_hist *h = &ls->hist[j];
+				if (!h->count)
+					continue;
+
+				bp::dict hist;
+				hist[std::string("count")] = (unsigned long long)h->count;
+				hist[std::string("avg")] = (unsigned long long)(h->sum / h->count);
+				hist[std::string("p50")] = (unsigned long long)dnet_latency_hist_percentile(h, 50);
+				hist[std::string("p90")] = (unsigned long long)dnet_latency_hist_percentile(h, 90);
+				hist[std::string("p99")] = (unsigned long long)dnet_latency_hist_percentile(h, 99);
+				hist[std::string("p999")] = (unsigned long long)dnet_latency_hist_percentile(h, 99.9);
+				hist[std::string("max")] = (unsigned long long)h->max;
+
+				if (j < ls->cmd_num)
+					commands[std::string(dnet_cmd_string(j))] = hist;
+				else
+					backend[std::string(dnet_cmd_string(j % ls->cmd_num))] = hist;
+			}
+
+			latency["commands"] = commands;
+			latency["backend"] = backend;
+
+			return latency;
+		}
+
 		bp::list stat_log_count() {
 			bp::list statistics;
+			std::map<std::string, bp::dict> nodes;
 
 			const sync_stat_count_result result = session::stat_log_count();
 
@@ -930,15 +965,30 @@ class elliptics_session: public session, public bp::wrapper<session> {
 				if (data.size() <= sizeof(struct dnet_addr_stat))
 					continue;
 
-				bp::dict node_stat, storage_commands, proxy_commands, counters;
 				struct dnet_addr *addr = data.address();
 				struct dnet_cmd *cmd = data.command();
+				std::string address(dnet_server_convert_dnet_addr(addr));
 
-				struct dnet_addr_stat *as = data.statistics();
+				/* counters and latency histograms of the same node come in separate entries */
+				auto it = nodes.find(address);
+				if (it == nodes.end()) {
+					bp::dict node_stat;
+					node_stat[std::string("addr")] = address;
+					node_stat[std::string("group_id")] = cmd->id.group_id;
 
-				std::string address(dnet_server_convert_dnet_addr(addr));
-				node_stat[std::string("addr")] = address;
-				node_stat[std::string("group_id")] = cmd->id.group_id;
+					it = nodes.insert(std::make_pair(address, node_stat)).first;
+					statistics.append(node_stat);
+				}
+
+				bp::dict &node_stat = it->second;
+
+				if (struct dnet_addr_latency_stat *ls = data.latency()) {
+					node_stat["latency"] = latency_stat(ls);
+					continue;
+				}
+
+				bp::dict storage_commands, proxy_commands, counters;
+				struct dnet_addr_stat *as = data.statistics();
 
 				for (int j = 0; j < as->num; ++j) {
 					if (j < as->cmd_num) {
@@ -959,8 +1009,6 @@ class elliptics_session: public session, public bp::wrapper<session> {
 				node_stat["storage_commands"] = storage_commands;
 				node_stat["proxy_commands"] = proxy_commands;
 				node_stat["counters"] = counters;
-
-				statistics.append(node_stat);
 			}
 
 			return statistics;
@@ -1414,6 +1462,7 @@ BOOST_PYTHON_MODULE(elliptics)
 		.def_readwrite("io_thread_num", &dnet_config::io_thread_num)
 		.def_readwrite("nonblocking_io_thread_num", &dnet_config::nonblocking_io_thread_num)
 		.def_readwrite("net_thread_num", &dnet_config::net_thread_num)
+		.def_readwrite("net_max_events", &dnet_config::net_max_events)
 		.def_readwrite("client_prio", &dnet_config::client_prio)
 	;
 
@@ -1597,6 +1646,8 @@ BOOST_PYTHON_MODULE(elliptics)
 		.value("default", cflags_default)
 		.value("direct", cflags_direct)
 		.value("nolock", cflags_nolock)
+		.value("prio_high", cflags_prio_high)
+		.value("prio_background", cflags_prio_background)
 	;
 
 	bp::enum_<elliptics_ioflags>("io_flags")
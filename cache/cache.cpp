@@ -14,12 +14,21 @@
  */
 
 #include <iostream>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
 #include <deque>
+#include <map>
 #include <vector>
 #include <deque>
 #include <mutex>
 #include <thread>
 
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <fcntl.h>
+#include <stdio.h>
+
 #include <boost/unordered_map.hpp>
 #include <boost/intrusive/list.hpp>
 #include <boost/intrusive/set.hpp>
@@ -27,28 +36,207 @@
 #include "../library/elliptics.h"
 #include "../indexes/local_session.h"
 
+#include "slab.hpp"
+
 #include "elliptics/packet.h"
 #include "elliptics/interface.h"
 
 namespace ioremap { namespace cache {
 
+/*
+ * Object payload allocated from slab.
+ *
+ * Data is stored in a single contiguous chunk. Chunked objects (created by append-only writes)
+ * get a new chunk when the last one is full instead of reallocating and copying the whole object,
+ * chunks are merged by linearize() when contiguous data is needed.
+ */
 class raw_data_t {
 	public:
-		raw_data_t(const char *data, size_t size) {
-			m_data.reserve(size);
-			m_data.insert(m_data.begin(), data, data + size);
+		raw_data_t(slab_allocator_t &allocator, const char *data, size_t size) :
+		m_allocator(allocator), m_size(0), m_chunked(false) {
+			m_head.data = NULL;
+			m_head.size = m_head.capacity = 0;
+
+			if (size) {
+				m_head.capacity = m_allocator.chunk_size(size);
+				m_head.data = (char *)m_allocator.allocate(m_head.capacity);
+
+				memcpy(m_head.data, data, size);
+				m_head.size = m_size = size;
+			}
 		}
 
-		std::vector<char> &data(void) {
-			return m_data;
+		// Contiguous copy of @other
+		raw_data_t(const raw_data_t &other) :
+		m_allocator(other.m_allocator), m_size(0), m_chunked(other.m_chunked) {
+			m_head.data = NULL;
+			m_head.size = m_head.capacity = 0;
+
+			if (other.m_size) {
+				m_head.capacity = m_allocator.chunk_size(other.m_size);
+				m_head.data = (char *)m_allocator.allocate(m_head.capacity);
+
+				other.copy_to(m_head.data);
+				m_head.size = m_size = other.m_size;
+			}
+		}
+
+		~raw_data_t() {
+			m_allocator.deallocate(m_head.data, m_head.capacity);
+
+			for (auto it = m_tail.begin(); it != m_tail.end(); ++it)
+				m_allocator.deallocate(it->data, it->capacity);
+		}
+
+		raw_data_t &operator =(const raw_data_t &other) = delete;
+
+		slab_allocator_t &allocator(void) const {
+			return m_allocator;
+		}
+
+		// Only valid for contiguous data, see linearize()
+		char *data(void) const {
+			return m_head.data;
+		}
+
+		size_t size(void) const {
+			return m_size;
 		}
 
-		size_t size(void) {
-			return m_data.size();
+		size_t capacity(void) const {
+			size_t capacity = m_head.capacity;
+
+			for (auto it = m_tail.begin(); it != m_tail.end(); ++it)
+				capacity += it->capacity;
+
+			return capacity;
+		}
+
+		bool chunked(void) const {
+			return m_chunked;
+		}
+
+		void set_chunked(bool chunked) {
+			m_chunked = chunked;
+		}
+
+		void append(const char *data, size_t size) {
+			if (!size)
+				return;
+
+			if (!m_chunked) {
+				reserve(m_size + size, m_size);
+
+				memcpy(m_head.data + m_size, data, size);
+				m_head.size += size;
+				m_size += size;
+				return;
+			}
+
+			chunk_t *last = m_tail.empty() ? &m_head : &m_tail.back();
+			size_t copy = std::min(size, last->capacity - last->size);
+
+			memcpy(last->data + last->size, data, copy);
+			last->size += copy;
+			m_size += copy;
+
+			data += copy;
+			size -= copy;
+
+			if (size) {
+				chunk_t c;
+
+				c.capacity = m_allocator.chunk_size(std::max(size, std::min(m_size, (size_t)slab_allocator_t::max_chunk_size)));
+				c.data = (char *)m_allocator.allocate(c.capacity);
+				c.size = size;
+				memcpy(c.data, data, size);
+
+				if (!m_head.capacity)
+					m_head = c;
+				else
+					m_tail.push_back(c);
+
+				m_size += size;
+			}
+		}
+
+		// Puts @data at @offset and truncates object to the end of written data
+		void write(size_t offset, const char *data, size_t size) {
+			const size_t new_size = offset + size;
+
+			linearize();
+			reserve(new_size, std::min(m_size, offset));
+
+			if (offset > m_size)
+				memset(m_head.data + m_size, 0, offset - m_size);
+
+			memcpy(m_head.data + offset, data, size);
+			m_head.size = m_size = new_size;
+		}
+
+		void linearize(void) {
+			if (m_tail.empty())
+				return;
+
+			chunk_t c;
+
+			c.capacity = m_allocator.chunk_size(m_size);
+			c.data = (char *)m_allocator.allocate(c.capacity);
+			c.size = m_size;
+			copy_to(c.data);
+
+			m_allocator.deallocate(m_head.data, m_head.capacity);
+			for (auto it = m_tail.begin(); it != m_tail.end(); ++it)
+				m_allocator.deallocate(it->data, it->capacity);
+
+			m_tail.clear();
+			m_head = c;
 		}
 
 	private:
-		std::vector<char> m_data;
+		struct chunk_t {
+			char	*data;
+			size_t	size;
+			size_t	capacity;
+		};
+
+		slab_allocator_t &m_allocator;
+		size_t m_size;
+		bool m_chunked;
+		chunk_t m_head;
+		std::vector<chunk_t> m_tail;
+
+		void copy_to(char *dst) const {
+			memcpy(dst, m_head.data, m_head.size);
+			dst += m_head.size;
+
+			for (auto it = m_tail.begin(); it != m_tail.end(); ++it) {
+				memcpy(dst, it->data, it->size);
+				dst += it->size;
+			}
+		}
+
+		/*
+		 * Makes contiguous chunk suitable for @size bytes, first @copy bytes are preserved.
+		 * Growing chunk is reserved with 1/4 headroom, so that appends are amortized,
+		 * chunk is shrunk when data becomes less than half of its capacity.
+		 */
+		void reserve(size_t size, size_t copy) {
+			size_t capacity;
+
+			if (size > m_head.capacity)
+				capacity = m_allocator.chunk_size(std::max(size, m_head.capacity + m_head.capacity / 4));
+			else if (size < m_head.capacity / 2)
+				capacity = m_allocator.chunk_size(size);
+			else
+				return;
+
+			if (capacity == m_head.capacity)
+				return;
+
+			m_head.data = (char *)m_allocator.reallocate(m_head.data, m_head.capacity, capacity, copy);
+			m_head.capacity = capacity;
+		}
 };
 
 struct data_lru_tag_t;
@@ -76,16 +264,17 @@ class data_t : public lru_list_base_hook_t, public set_base_hook_t, public time_
 			memcpy(m_id.id, id, DNET_ID_SIZE);
 		}
 
-		data_t(const unsigned char *id, size_t lifetime, const char *data, size_t size, bool remove_from_disk) :
+		data_t(slab_allocator_t &allocator, const unsigned char *id, size_t lifetime, const char *data, size_t size, bool remove_from_disk) :
 			m_lifetime(0), m_synctime(0), m_user_flags(0),
-			m_remove_from_disk(remove_from_disk), m_remove_from_cache(false), m_only_append(false) {
+			m_remove_from_disk(remove_from_disk), m_remove_from_cache(false), m_only_append(false),
+			m_protected(false), m_accounted(0) {
 			memcpy(m_id.id, id, DNET_ID_SIZE);
 			dnet_empty_time(&m_timestamp);
 
 			if (lifetime)
 				m_lifetime = lifetime + time(NULL);
 
-			m_data.reset(new raw_data_t(data, size));
+			m_data = std::allocate_shared<raw_data_t>(slab_stl_allocator_t<raw_data_t>(allocator), allocator, data, size);
 		}
 
 		data_t(const data_t &other) = delete;
@@ -102,6 +291,19 @@ class data_t : public lru_list_base_hook_t, public set_base_hook_t, public time_
 			return m_data;
 		}
 
+		/*
+		 * Data which is going to be modified.
+		 * Readers may still send previous data without the lock, so it is copied if shared.
+		 */
+		raw_data_t &writable_data(void) {
+			if (m_data.use_count() > 1) {
+				slab_allocator_t &allocator = m_data->allocator();
+				m_data = std::allocate_shared<raw_data_t>(slab_stl_allocator_t<raw_data_t>(allocator), *m_data);
+			}
+
+			return *m_data;
+		}
+
 		size_t lifetime(void) const {
 			return m_lifetime;
 		}
@@ -158,10 +360,32 @@ class data_t : public lru_list_base_hook_t, public set_base_hook_t, public time_
 			m_only_append = only_append;
 		}
 
+		bool is_protected() const {
+			return m_protected;
+		}
+
+		void set_protected(bool is_protected) {
+			m_protected = is_protected;
+		}
+
 		size_t size(void) const {
 			return m_data->size();
 		}
 
+		// Memory occupied by the object
+		size_t footprint(void) const {
+			return sizeof(data_t) + sizeof(raw_data_t) + m_data->capacity();
+		}
+
+		// Footprint charged to the cache when object was linked into LRU
+		size_t accounted(void) const {
+			return m_accounted;
+		}
+
+		void set_accounted(size_t accounted) {
+			m_accounted = accounted;
+		}
+
 		friend bool operator< (const data_t &a, const data_t &b) {
 			return dnet_id_cmp_str(a.id().id, b.id().id) < 0;
 		}
@@ -182,6 +406,8 @@ class data_t : public lru_list_base_hook_t, public set_base_hook_t, public time_
 		bool m_remove_from_disk;
 		bool m_remove_from_cache;
 		bool m_only_append;
+		bool m_protected;
+		size_t m_accounted;
 		struct dnet_raw_id m_id;
 		std::shared_ptr<raw_data_t> m_data;
 };
@@ -213,19 +439,119 @@ typedef boost::intrusive::set<data_t, boost::intrusive::base_hook<sync_set_base_
 					  boost::intrusive::compare<synctime_less>
 			     > sync_set_t;
 
+struct cache_stats_t {
+	uint64_t lock_acquired;
+	uint64_t lock_contended;
+	uint64_t hit;
+	uint64_t miss;
+	uint64_t admitted;
+	uint64_t rejected;
+	uint64_t evicted;
+};
+
+/*
+ * Dirty object taken out of shard's sync set for write-back
+ */
+struct sync_item_t {
+	size_t shard;
+	uint64_t gen;
+	dnet_id id;
+	std::shared_ptr<raw_data_t> data;
+	uint64_t user_flags;
+	dnet_time timestamp;
+};
+
+/*
+ * Write-back of the key which was handed to sync threads and is not acknowledged yet.
+ * Queued item whose generation does not match is stale and is not written.
+ */
+struct writeback_t {
+	uint64_t gen;
+	bool running;
+};
+
+struct raw_id_less {
+	bool operator() (const dnet_raw_id &a, const dnet_raw_id &b) const {
+		return dnet_id_cmp_str(a.id, b.id) < 0;
+	}
+};
+
+typedef std::map<dnet_raw_id, writeback_t, raw_id_less> writeback_map_t;
+
+/*
+ * Cache snapshot file layout: header followed by @num records,
+ * every record is followed by object data padded to 8 bytes.
+ * Lifetime is stored as absolute expiration time, so that downtime is accounted.
+ *
+ * Snapshot is written only at shutdown after all dirty objects have been synced,
+ * and is marked clean when it is complete. Objects may be changed on disk bypassing
+ * the cache while server runs, so any other snapshot could serve stale data and is never loaded.
+ */
+#define DNET_CACHE_SNAPSHOT_MAGIC	"dnetcsnp"
+#define DNET_CACHE_SNAPSHOT_VERSION	2
+#define DNET_CACHE_SNAPSHOT_ALIGN(x)	(((x) + 7) & ~7ULL)
+
+#define DNET_CACHE_SNAPSHOT_CLEAN	(1ULL << 0)
+
+struct snapshot_header_t {
+	char magic[8];
+	uint64_t version;
+	uint64_t flags;
+	uint64_t num;
+	uint64_t time;
+};
+
+struct snapshot_record_t {
+	struct dnet_raw_id id;
+	uint64_t lifetime;
+	uint64_t user_flags;
+	struct dnet_time timestamp;
+	uint64_t size;
+	uint64_t remove_from_disk;
+};
+
+/*
+ * Clean object pinned for snapshot
+ */
+struct snapshot_item_t {
+	struct dnet_raw_id id;
+	std::shared_ptr<raw_data_t> data;
+	size_t lifetime;
+	uint64_t user_flags;
+	dnet_time timestamp;
+	bool remove_from_disk;
+};
+
+/*
+ * Share of the shard occupied by protected segment in segmented LRU mode.
+ * Objects are promoted there on the second access, new objects
+ * (including everything populated from disk) live in probationary segment
+ * and are evicted first, so a single scan can not flush the working set.
+ */
+#define DNET_CACHE_SLRU_PROTECTED_PERCENT	80
+
 class cache_t {
 	public:
-		cache_t(struct dnet_node *n, size_t max_size) :
+		cache_t(struct dnet_node *n, slab_allocator_t &allocator, size_t max_size) :
 		m_need_exit(false),
 		m_node(n),
+		m_allocator(allocator),
 		m_cache_size(0),
-		m_max_cache_size(max_size) {
-			m_lifecheck = std::thread(std::bind(&cache_t::life_check, this));
+		m_max_cache_size(max_size),
+		m_protected_size(0),
+		m_max_protected_size(max_size / 100 * DNET_CACHE_SLRU_PROTECTED_PERCENT),
+		m_lock_acquired(0),
+		m_lock_contended(0),
+		m_hit(0),
+		m_miss(0),
+		m_admitted(0),
+		m_rejected(0),
+		m_evicted(0),
+		m_writeback_gen(0) {
 		}
 
 		~cache_t() {
 			stop();
-			m_lifecheck.join();
 
 			m_max_cache_size = 0; //sets max_size to 0 for erasing lru set
 			resize(0);
@@ -245,6 +571,19 @@ class cache_t {
 			m_need_exit = true;
 		}
 
+		cache_stats_t stats() const {
+			cache_stats_t stats;
+
+			stats.lock_acquired = m_lock_acquired;
+			stats.lock_contended = m_lock_contended;
+			stats.hit = m_hit;
+			stats.miss = m_miss;
+			stats.admitted = m_admitted;
+			stats.rejected = m_rejected;
+			stats.evicted = m_evicted;
+			return stats;
+		}
+
 		int write(const unsigned char *id, dnet_net_state *st, dnet_cmd *cmd, dnet_io_attr *io, const char *data) {
 			const size_t lifetime = io->start;
 			const size_t size = io->size;
@@ -254,10 +593,12 @@ class cache_t {
 			const bool append = (io->flags & DNET_IO_FLAGS_APPEND);
 
 			dnet_log(m_node, DNET_LOG_DEBUG, "%s: CACHE: before guard\n", dnet_dump_id_str(id));
-			std::unique_lock<std::mutex> guard(m_lock);
+			std::unique_lock<std::mutex> guard(m_lock, std::defer_lock);
+			lock(guard);
 			dnet_log(m_node, DNET_LOG_DEBUG, "%s: CACHE: after guard\n", dnet_dump_id_str(id));
 
 			iset_t::iterator it = m_set.find(id);
+			const bool hit = (it != m_set.end());
 
 			if (it == m_set.end() && !cache) {
 				dnet_log(m_node, DNET_LOG_DEBUG, "%s: CACHE: not a cache call\n", dnet_dump_id_str(id));
@@ -270,31 +611,31 @@ class cache_t {
 					if (it == m_set.end()) {
 						it = create_data(id, 0, 0, false);
 						it->set_only_append(true);
+						it->data()->set_chunked(true);
 						it->set_synctime(time(NULL) + m_node->cache_sync_timeout);
 						m_syncset.insert(*it);
 					}
 
-					auto &raw = it->data()->data();
+					unlink(&*it);
 
-					m_cache_size -= raw.size();
-					m_lru.erase(m_lru.iterator_to(*it));
+					const size_t new_size = it->size() + io->size;
 
-					const size_t new_size = raw.size() + io->size;
+					const size_t overhead = slab_overhead();
 
-					if (m_cache_size + new_size > m_max_cache_size) {
+					if (m_cache_size + overhead + new_size > m_max_cache_size) {
 						dnet_log(m_node, DNET_LOG_DEBUG, "%s: CACHE: resize called\n", dnet_dump_id_str(id));
-						resize(new_size * 2);
+						resize(new_size * 2 + overhead);
 						dnet_log(m_node, DNET_LOG_DEBUG, "%s: CACHE: resize finished\n", dnet_dump_id_str(id));
 					}
 
-					m_lru.push_back(*it);
-					m_cache_size += new_size;
-
-					raw.insert(raw.end(), data, data + io->size);
+					it->writable_data().append(data, io->size);
+					link(&*it, hit);
 
 					it->set_timestamp(io->timestamp);
 					it->set_user_flags(io->user_flags);
 
+					guard.unlock();
+
 					cmd->flags &= ~DNET_FLAGS_NEED_ACK;
 					return dnet_send_file_info_ts_without_fd(st, cmd, data, io->size, &io->timestamp);
 				} else if (it != m_set.end() && it->only_append()) {
@@ -333,14 +674,16 @@ class cache_t {
 			}
 			dnet_log(m_node, DNET_LOG_DEBUG, "%s: CACHE: data ensured\n", dnet_dump_id_str(id));
 
-			raw_data_t &raw = *it->data();
-
 			if (io->flags & DNET_IO_FLAGS_COMPARE_AND_SWAP) {
+				raw_data_t &raw = *it->data();
+
 				// Data is already in memory, so it's free to use it
 				// raw.size() is zero only if there is no such file on the server
 				if (raw.size() != 0) {
 					struct dnet_raw_id csum;
-					dnet_transform_node(m_node, raw.data().data(), raw.size(), csum.id, sizeof(csum.id));
+
+					raw.linearize();
+					dnet_transform_node(m_node, raw.data(), raw.size(), csum.id, sizeof(csum.id));
 
 					if (memcmp(csum.id, io->parent, DNET_ID_SIZE)) {
 						dnet_log(m_node, DNET_LOG_ERROR, "%s: cas: cache checksum mismatch\n", dnet_dump_id(&cmd->id));
@@ -354,32 +697,35 @@ class cache_t {
 			size_t new_size = 0;
 
 			if (append) {
-				new_size = raw.size() + size;
+				new_size = it->size() + size;
 			} else {
 				new_size = io->offset + io->size;
 			}
 
 			// Recalc used space, free enough space for new data, move object to the end of the queue
-			m_cache_size -= raw.size();
-			m_lru.erase(m_lru.iterator_to(*it));
+			unlink(&*it);
+
+			const size_t overhead = slab_overhead();
 
-			if (m_cache_size + new_size > m_max_cache_size) {
+			if (m_cache_size + overhead + new_size > m_max_cache_size) {
 				dnet_log(m_node, DNET_LOG_DEBUG, "%s: CACHE: resize called\n", dnet_dump_id_str(id));
-				resize(new_size * 2);
+				resize(new_size * 2 + overhead);
 				dnet_log(m_node, DNET_LOG_DEBUG, "%s: CACHE: resize finished\n", dnet_dump_id_str(id));
 			}
 
-			m_lru.push_back(*it);
 			it->set_remove_from_cache(false);
-			m_cache_size += new_size;
+
+			raw_data_t &raw = it->writable_data();
 
 			if (append) {
-				raw.data().insert(raw.data().end(), data, data + size);
+				raw.append(data, size);
 			} else {
-				raw.data().resize(new_size);
-				memcpy(raw.data().data() + io->offset, data, size);
+				raw.write(io->offset, data, size);
 			}
 
+			// Object is charged to the cache only after it has been modified, since its footprint has changed
+			link(&*it, hit);
+
 			dnet_log(m_node, DNET_LOG_DEBUG, "%s: CACHE: data modified\n", dnet_dump_id_str(id));
 
 			// Mark data as dirty one, so it will be synced to the disk
@@ -401,8 +747,12 @@ class cache_t {
 
 			dnet_log(m_node, DNET_LOG_DEBUG, "%s: CACHE: finished write\n", dnet_dump_id_str(id));
 
+			// Written data is exactly what client has sent, so reply is built from the request
+			// buffer and shard is unlocked before touching the socket
+			guard.unlock();
+
 			cmd->flags &= ~DNET_FLAGS_NEED_ACK;
-			return dnet_send_file_info_ts_without_fd(st, cmd, raw.data().data() + io->offset, io->size, &io->timestamp);
+			return dnet_send_file_info_ts_without_fd(st, cmd, data, io->size, &io->timestamp);
 		}
 
 		std::shared_ptr<raw_data_t> read(const unsigned char *id, dnet_cmd *cmd, dnet_io_attr *io) {
@@ -411,7 +761,8 @@ class cache_t {
 			(void) cmd;
 
 			dnet_log(m_node, DNET_LOG_DEBUG, "%s: CACHE READ: before guard\n", dnet_dump_id_str(id));
-			std::unique_lock<std::mutex> guard(m_lock);
+			std::unique_lock<std::mutex> guard(m_lock, std::defer_lock);
+			lock(guard);
 			dnet_log(m_node, DNET_LOG_DEBUG, "%s: CACHE READ: after guard\n", dnet_dump_id_str(id));
 
 			iset_t::iterator it = m_set.find(id);
@@ -422,10 +773,23 @@ class cache_t {
 				it = m_set.end();
 			}
 
+			const bool hit = (it != m_set.end());
+			if (hit)
+				++m_hit;
+			else
+				++m_miss;
+
 			if (it == m_set.end() && cache && !cache_only) {
 				dnet_log(m_node, DNET_LOG_DEBUG, "%s: CACHE READ: not exist\n", dnet_dump_id_str(id));
 				int err = 0;
-				it = populate_from_disk(guard, id, false, &err);
+				std::shared_ptr<raw_data_t> rejected;
+
+				it = populate_from_disk(guard, id, false, &err, &rejected, io);
+				if (rejected) {
+					dnet_log(m_node, DNET_LOG_DEBUG, "%s: CACHE READ: not admitted, size: %zd\n",
+							dnet_dump_id_str(id), rejected->size());
+					return rejected;
+				}
 			} else {
 				dnet_log(m_node, DNET_LOG_DEBUG, "%s: CACHE READ: exists\n", dnet_dump_id_str(id));
 			}
@@ -433,9 +797,9 @@ class cache_t {
 			dnet_log(m_node, DNET_LOG_DEBUG, "%s: CACHE READ: data ensured\n", dnet_dump_id_str(id));
 
 			if (it != m_set.end()) {
-				m_lru.erase(m_lru.iterator_to(*it));
+				unlink(&*it);
 				it->set_remove_from_cache(false);
-				m_lru.push_back(*it);
+				link(&*it, hit);
 
 				io->timestamp = it->timestamp();
 				io->user_flags = it->user_flags();
@@ -451,7 +815,17 @@ class cache_t {
 			bool remove_from_disk = !cache_only;
 			int err = -ENOENT;
 
-			std::unique_lock<std::mutex> guard(m_lock);
+			dnet_raw_id key;
+			memcpy(key.id, id, DNET_ID_SIZE);
+
+			std::unique_lock<std::mutex> guard(m_lock, std::defer_lock);
+			lock(guard);
+
+			// Queued write-back would resurrect the key after it is removed from disk
+			writeback_wait(guard, key);
+			if (!cache_only)
+				writeback_cancel(key);
+
 			iset_t::iterator it = m_set.find(id);
 			if (it != m_set.end()) {
 				// If cache_only is not set the data also should be remove from the disk
@@ -484,7 +858,8 @@ class cache_t {
 		int lookup(const unsigned char *id, dnet_net_state *st, dnet_cmd *cmd) {
 			int err = 0;
 
-			std::unique_lock<std::mutex> guard(m_lock);
+			std::unique_lock<std::mutex> guard(m_lock, std::defer_lock);
+			lock(guard);
 			iset_t::iterator it = m_set.find(id);
 			if (it == m_set.end()) {
 				return -ENOTSUP;
@@ -514,35 +889,382 @@ class cache_t {
 			return dnet_send_reply(st, cmd, data.data(), data.size(), 0);
 		}
 
+		/*
+		 * Single pass over expired and dirty elements.
+		 * It is called from the thread shared by all shards in cache_manager.
+		 */
+		void life_check(std::vector<sync_item_t> &batch) {
+			std::deque<struct dnet_id> remove;
+
+			while (!m_need_exit && !m_lifeset.empty()) {
+				size_t time = ::time(NULL);
+
+				std::unique_lock<std::mutex> guard(m_lock, std::defer_lock);
+				lock(guard);
+
+				if (m_lifeset.empty())
+					break;
+
+				life_set_t::iterator it = m_lifeset.begin();
+				if (it->lifetime() > time)
+					break;
+
+				// Dirty object is synced inline on erase, it must not overtake its previous version being written
+				if (it->synctime() && writeback_running(it->id()))
+					break;
+
+				if (it->remove_from_disk()) {
+					struct dnet_id id;
+					memset(&id, 0, sizeof(struct dnet_id));
+
+					dnet_setup_id(&id, 0, (unsigned char *)it->id().id);
+
+					remove.push_back(id);
+				}
+
+				erase_element(&(*it));
+			}
+
+			/*
+			 * Dirty objects are moved into @batch under single lock acquisition,
+			 * they are written back by cache_manager sync threads.
+			 * Key has at most one write-back in flight, object modified meanwhile
+			 * stays dirty until the previous version is acknowledged.
+			 * Appended data is written inline, since appends must reach disk in order.
+			 */
+			size_t time = ::time(NULL);
+			std::unique_lock<std::mutex> guard(m_lock, std::defer_lock);
+			lock(guard);
+
+			for (sync_set_t::iterator it = m_syncset.begin(); !m_need_exit && it != m_syncset.end();) {
+				data_t *obj = &*it;
+				if (obj->synctime() > time)
+					break;
+
+				if (m_writeback.count(obj->id())) {
+					++it;
+					continue;
+				}
+
+				if (obj->only_append()) {
+					sync_after_append(guard, true, obj);
+					it = m_syncset.begin();
+					continue;
+				}
+
+				sync_item_t item;
+				item.gen = ++m_writeback_gen;
+				memset(&item.id, 0, sizeof(item.id));
+				memcpy(item.id.id, obj->id().id, DNET_ID_SIZE);
+				// Data is pinned instead of being copied, writers will make their own copy
+				item.data = obj->data();
+				item.data->linearize();
+				item.user_flags = obj->user_flags();
+				item.timestamp = obj->timestamp();
+				item.shard = 0;
+
+				writeback_t &wb = m_writeback[obj->id()];
+				wb.gen = item.gen;
+				wb.running = false;
+
+				it = m_syncset.erase(it);
+				obj->clear_synctime();
+
+				batch.push_back(item);
+			}
+
+			guard.unlock();
+
+			for (std::deque<struct dnet_id>::iterator it = remove.begin(); it != remove.end(); ++it) {
+				dnet_remove_local(m_node, &(*it));
+			}
+		}
+
+		/*
+		 * Writes all dirty objects to disk, used before shutdown snapshot
+		 */
+		void sync_all(void) {
+			std::unique_lock<std::mutex> guard(m_lock, std::defer_lock);
+			lock(guard);
+
+			while (!m_syncset.empty()) {
+				data_t *obj = &*m_syncset.begin();
+
+				if (obj->only_append()) {
+					sync_after_append(guard, true, obj);
+					continue;
+				}
+
+				sync_element(obj);
+
+				m_syncset.erase(m_syncset.iterator_to(*obj));
+				obj->clear_synctime();
+
+				if (obj->remove_from_cache())
+					erase_element(obj);
+			}
+		}
+
+		/*
+		 * Pins objects which are in sync with disk (or never go there), they are written
+		 * into snapshot without the lock. Object whose write-back is not acknowledged yet
+		 * is not on disk either.
+		 */
+		void snapshot(std::vector<snapshot_item_t> &items) {
+			std::unique_lock<std::mutex> guard(m_lock, std::defer_lock);
+			lock(guard);
+
+			for (auto it = m_set.begin(); it != m_set.end(); ++it) {
+				if (it->synctime() || it->remove_from_cache() || !it->size() || m_writeback.count(it->id()))
+					continue;
+
+				snapshot_item_t item;
+				item.id = it->id();
+				item.data = it->data();
+				item.data->linearize();
+				item.lifetime = it->lifetime();
+				item.user_flags = it->user_flags();
+				item.timestamp = it->timestamp();
+				item.remove_from_disk = it->remove_from_disk();
+
+				items.push_back(item);
+			}
+		}
+
+		/*
+		 * Inserts object loaded from snapshot, objects already present are not replaced
+		 * and nothing is evicted to make room for snapshot data
+		 */
+		bool restore(const snapshot_record_t &rec, const char *data) {
+			std::unique_lock<std::mutex> guard(m_lock, std::defer_lock);
+			lock(guard);
+
+			if (m_set.find(rec.id.id) != m_set.end())
+				return false;
+
+			if (m_cache_size + rec.size > m_max_cache_size)
+				return false;
+
+			iset_t::iterator it = create_data(rec.id.id, data, rec.size, rec.remove_from_disk);
+
+			it->set_user_flags(rec.user_flags);
+			it->set_timestamp(rec.timestamp);
+
+			if (rec.lifetime) {
+				it->set_lifetime(rec.lifetime);
+				m_lifeset.insert(*it);
+			}
+
+			return true;
+		}
+
+		/*
+		 * Called by sync thread before writing object from life_check() batch.
+		 * Returns false if write-back was cancelled or superseded, item must be dropped then.
+		 */
+		bool writeback_start(const sync_item_t &item) {
+			std::unique_lock<std::mutex> guard(m_lock, std::defer_lock);
+			lock(guard);
+
+			auto it = m_writeback.find(raw_id(item.id));
+			if (it == m_writeback.end() || it->second.gen != item.gen)
+				return false;
+
+			it->second.running = true;
+			return true;
+		}
+
+		/*
+		 * Called when object from life_check() batch was written to disk,
+		 * object evicted while being dirty is dropped now.
+		 */
+		void synced(const sync_item_t &item) {
+			std::unique_lock<std::mutex> guard(m_lock, std::defer_lock);
+			lock(guard);
+
+			auto it = m_writeback.find(raw_id(item.id));
+			if (it != m_writeback.end() && it->second.gen == item.gen) {
+				m_writeback.erase(it);
+				m_writeback_wait.notify_all();
+			}
+
+			auto jt = m_set.find(item.id.id);
+			if (jt != m_set.end() && jt->remove_from_cache())
+				erase_element(&*jt);
+		}
+
 	private:
 		bool m_need_exit;
 		struct dnet_node *m_node;
+		slab_allocator_t &m_allocator;
 		size_t m_cache_size, m_max_cache_size;
 		std::mutex m_lock;
+		size_t m_protected_size, m_max_protected_size;
+		std::atomic<uint64_t> m_lock_acquired;
+		std::atomic<uint64_t> m_lock_contended;
+		std::atomic<uint64_t> m_hit;
+		std::atomic<uint64_t> m_miss;
+		std::atomic<uint64_t> m_admitted;
+		std::atomic<uint64_t> m_rejected;
+		std::atomic<uint64_t> m_evicted;
 		iset_t m_set;
 		lru_list_t m_lru;
+		lru_list_t m_protected;
 		life_set_t m_lifeset;
 		sync_set_t m_syncset;
-		std::thread m_lifecheck;
+		writeback_map_t m_writeback;
+		std::condition_variable m_writeback_wait;
+		uint64_t m_writeback_gen;
 
 		cache_t(const cache_t &) = delete;
 
+		// Takes shard lock and accounts whether somebody else was holding it
+		void lock(std::unique_lock<std::mutex> &guard) {
+			if (!guard.try_lock()) {
+				guard.lock();
+				++m_lock_contended;
+			}
+			++m_lock_acquired;
+		}
+
+		static dnet_raw_id raw_id(const dnet_id &id) {
+			dnet_raw_id raw;
+			memcpy(raw.id, id.id, DNET_ID_SIZE);
+			return raw;
+		}
+
+		bool writeback_running(const dnet_raw_id &id) const {
+			auto it = m_writeback.find(id);
+			return it != m_writeback.end() && it->second.running;
+		}
+
+		// Waits until sync thread finishes writing the key, shard is unlocked meanwhile
+		void writeback_wait(std::unique_lock<std::mutex> &guard, const dnet_raw_id &id) {
+			while (writeback_running(id))
+				m_writeback_wait.wait(guard);
+		}
+
+		// Queued write-back of the key is skipped by sync thread, it must not be running
+		void writeback_cancel(const dnet_raw_id &id) {
+			m_writeback.erase(id);
+		}
+
+		bool segmented(void) const {
+			return m_node->cache_policy == DNET_CACHE_POLICY_SLRU;
+		}
+
+		void lru_erase(data_t *obj) {
+			if (obj->is_protected()) {
+				m_protected.erase(m_protected.iterator_to(*obj));
+				m_protected_size -= obj->accounted();
+				obj->set_protected(false);
+			} else {
+				m_lru.erase(m_lru.iterator_to(*obj));
+			}
+		}
+
+		/*
+		 * Puts object to the tail of its segment.
+		 * In segmented mode object which was accessed again is promoted to protected segment,
+		 * protected segment overflow is demoted back to the tail of probationary one.
+		 */
+		void lru_insert(data_t *obj, bool hit) {
+			if (!hit || !segmented()) {
+				m_lru.push_back(*obj);
+				return;
+			}
+
+			obj->set_protected(true);
+			m_protected.push_back(*obj);
+			m_protected_size += obj->accounted();
+
+			while (m_protected_size > m_max_protected_size && !m_protected.empty()) {
+				data_t *victim = &m_protected.front();
+
+				m_protected.pop_front();
+				m_protected_size -= victim->accounted();
+				victim->set_protected(false);
+				m_lru.push_back(*victim);
+			}
+		}
+
+		/*
+		 * Objects are charged to the cache with their real memory footprint.
+		 * Object is unlinked from LRU before modification and linked back after it,
+		 * so that its footprint is recalculated.
+		 */
+		void link(data_t *obj, bool hit) {
+			obj->set_accounted(obj->footprint());
+			m_cache_size += obj->accounted();
+			lru_insert(obj, hit);
+		}
+
+		void unlink(data_t *obj) {
+			lru_erase(obj);
+			m_cache_size -= obj->accounted();
+		}
+
+		/*
+		 * Slab memory which is reserved but not used by any object is shared by all shards,
+		 * every shard is charged with its part, so that fragmentation left by objects
+		 * of changing sizes is bounded by eviction. Partially used page of every size class
+		 * is not charged.
+		 */
+		size_t slab_overhead(void) const {
+			size_t shards;
+
+			if (!m_max_cache_size)
+				return 0;
+
+			shards = std::max<size_t>(m_node->cache_size / m_max_cache_size, 1);
+			return m_allocator.wasted() / shards;
+		}
+
+		/*
+		 * Object read from disk is admitted only if it can be placed without evicting protected entries
+		 */
+		bool admit(size_t size) const {
+			if (!segmented())
+				return true;
+
+			return m_protected_size + slab_overhead() + size <= m_max_cache_size;
+		}
+
 		iset_t::iterator create_data(const unsigned char *id, const char *data, size_t size, bool remove_from_disk) {
-			if (m_cache_size + size > m_max_cache_size) {
+			const size_t overhead = slab_overhead();
+
+			if (m_cache_size + overhead + size > m_max_cache_size) {
 				dnet_log(m_node, DNET_LOG_DEBUG, "%s: CACHE: resize called from create_data\n", dnet_dump_id_str(id));
-				resize(size);
+				resize(size + overhead);
 				dnet_log(m_node, DNET_LOG_DEBUG, "%s: CACHE: resize finished from create_data\n", dnet_dump_id_str(id));
 			}
 
-			data_t *raw = new data_t(id, 0, data, size, remove_from_disk);
+			void *mem = m_allocator.allocate(sizeof(data_t));
+			data_t *raw;
 
-			m_cache_size += size;
+			try {
+				raw = new (mem) data_t(m_allocator, id, 0, data, size, remove_from_disk);
+			} catch (...) {
+				m_allocator.deallocate(mem, sizeof(data_t));
+				throw;
+			}
 
-			m_lru.push_back(*raw);
+			link(raw, false);
 			return m_set.insert(*raw).first;
 		}
 
-		iset_t::iterator populate_from_disk(std::unique_lock<std::mutex> &guard, const unsigned char *id, bool remove_from_disk, int *err) {
+		void destroy_data(data_t *obj) {
+			obj->~data_t();
+			m_allocator.deallocate(obj, sizeof(data_t));
+		}
+
+		/*
+		 * When @rejected is not NULL, read data goes through admission policy.
+		 * Data which was not admitted is returned in @rejected without being cached,
+		 * its timestamp and user flags are stored in @io.
+		 */
+		iset_t::iterator populate_from_disk(std::unique_lock<std::mutex> &guard, const unsigned char *id, bool remove_from_disk, int *err,
+				std::shared_ptr<raw_data_t> *rejected = NULL, dnet_io_attr *io = NULL) {
 			if (guard.owns_lock()) {
 				guard.unlock();
 			}
@@ -564,10 +1286,27 @@ class cache_t {
 
 			dnet_log(m_node, DNET_LOG_DEBUG, "%s: CACHE: populating from disk finished: %d\n", dnet_dump_id_str(id), *err);
 
-			guard.lock();
+			lock(guard);
 
 			if (*err == 0) {
-				auto it = create_data(id, reinterpret_cast<char *>(data.data()), data.size(), remove_from_disk);
+				// Somebody could populate or write this object while shard was unlocked
+				auto it = m_set.find(id);
+				if (it != m_set.end())
+					return it;
+
+				if (rejected && !admit(data.size())) {
+					++m_rejected;
+					*rejected = std::allocate_shared<raw_data_t>(slab_stl_allocator_t<raw_data_t>(m_allocator),
+							m_allocator, reinterpret_cast<char *>(data.data()), data.size());
+					io->timestamp = timestamp;
+					io->user_flags = user_flags;
+					return m_set.end();
+				}
+
+				if (rejected)
+					++m_admitted;
+
+				it = create_data(id, reinterpret_cast<char *>(data.data()), data.size(), remove_from_disk);
 				it->set_user_flags(user_flags);
 				it->set_timestamp(timestamp);
 				return it;
@@ -576,10 +1315,16 @@ class cache_t {
 			return m_set.end();
 		}
 
+		// Probationary segment is evicted first, protected one is touched only when it is not enough
 		void resize(size_t reserve) {
 			size_t removed_size = 0;
 
-			for (auto it = m_lru.begin(); it != m_lru.end();) {
+			resize(m_lru, reserve, removed_size);
+			resize(m_protected, reserve, removed_size);
+		}
+
+		void resize(lru_list_t &lru, size_t reserve, size_t &removed_size) {
+			for (auto it = lru.begin(); it != lru.end();) {
 				if (m_max_cache_size > m_cache_size + reserve + removed_size)
 					break;
 
@@ -593,37 +1338,39 @@ class cache_t {
 						m_syncset.erase(m_syncset.iterator_to(*raw));
 						raw->set_synctime(1);
 						m_syncset.insert(*raw);
+						++m_evicted;
 					}
-					removed_size += raw->size();
+					removed_size += raw->accounted();
 				} else {
 					erase_element(raw);
+					++m_evicted;
 				}
 			}
 		}
 
 		void erase_element(data_t *obj) {
-			m_lru.erase(m_lru.iterator_to(*obj));
+			unlink(obj);
 			m_set.erase(m_set.iterator_to(*obj));
 			if (obj->lifetime())
 				m_lifeset.erase(m_lifeset.iterator_to(*obj));
 
 			if (obj->synctime()) {
+				// Newer version is written inline, queued one is obsolete
+				writeback_cancel(obj->id());
 				sync_element(obj);
 
 				m_syncset.erase(m_syncset.iterator_to(*obj));
 				obj->clear_synctime();
 			}
 
-			m_cache_size -= obj->size();
-
-			delete obj;
+			destroy_data(obj);
 		}
 
-		void sync_element(const dnet_id &raw, bool after_append, const std::vector<char> &data, uint64_t user_flags, const dnet_time &timestamp) {
+		void sync_element(const dnet_id &raw, bool after_append, const char *data, size_t size, uint64_t user_flags, const dnet_time &timestamp) {
 			local_session sess(m_node);
 			sess.set_ioflags(DNET_IO_FLAGS_NOCACHE | (after_append ? DNET_IO_FLAGS_APPEND : 0));
 
-			int err = sess.write(raw, data.data(), data.size(), user_flags, timestamp);
+			int err = sess.write(raw, data, size, user_flags, timestamp);
 			if (err) {
 				dnet_log(m_node, DNET_LOG_ERROR, "%s: CACHE: forced to sync to disk, err: %d\n", dnet_dump_id_str(raw.id), err);
 			} else {
@@ -636,9 +1383,10 @@ class cache_t {
 			memset(&raw, 0, sizeof(struct dnet_id));
 			memcpy(raw.id, obj->id().id, DNET_ID_SIZE);
 
-			auto &data = obj->data()->data();
+			std::shared_ptr<raw_data_t> data = obj->data();
+			data->linearize();
 
-			sync_element(raw, obj->only_append(), data, obj->user_flags(), obj->timestamp());
+			sync_element(raw, obj->only_append(), data->data(), data->size(), obj->user_flags(), obj->timestamp());
 		}
 
 		void sync_after_append(std::unique_lock<std::mutex> &guard, bool lock_guard, data_t *obj) {
@@ -660,112 +1408,78 @@ class cache_t {
 			local_session sess(m_node);
 			sess.set_ioflags(DNET_IO_FLAGS_NOCACHE | DNET_IO_FLAGS_APPEND);
 
-			auto &raw = raw_data->data();
+			raw_data->linearize();
 
-			int err = sess.write(id, raw.data(), raw.size(), user_flags, timestamp);
+			int err = sess.write(id, raw_data->data(), raw_data->size(), user_flags, timestamp);
 			dnet_log(m_node, DNET_LOG_DEBUG, "%s: CACHE: sync after append, err: %d", dnet_dump_id_str(id.id), err);
 
 			if (lock_guard)
-				guard.lock();
+				lock(guard);
 		}
+};
 
-		void life_check(void) {
-			while (!m_need_exit) {
-				std::deque<struct dnet_id> remove;
-
-				while (!m_need_exit && !m_lifeset.empty()) {
-					size_t time = ::time(NULL);
-
-					std::lock_guard<std::mutex> guard(m_lock);
-
-					if (m_lifeset.empty())
-						break;
-
-					life_set_t::iterator it = m_lifeset.begin();
-					if (it->lifetime() > time)
-						break;
-
-					if (it->remove_from_disk()) {
-						struct dnet_id id;
-						memset(&id, 0, sizeof(struct dnet_id));
-
-						dnet_setup_id(&id, 0, (unsigned char *)it->id().id);
-
-						remove.push_back(id);
-					}
-
-					erase_element(&(*it));
-				}
-
-				dnet_id id;
-				std::vector<char> data;
-				uint64_t user_flags;
-				dnet_time timestamp;
-
-				memset(&id, 0, sizeof(id));
-
-				while (!m_need_exit && !m_syncset.empty()) {
-					size_t time = ::time(NULL);
-
-					std::unique_lock<std::mutex> guard(m_lock);
-
-					if (m_syncset.empty())
-						break;
-
-					sync_set_t::iterator it = m_syncset.begin();
-
-					data_t *obj = &*it;
-					if (obj->synctime() > time)
-						break;
-
-					if (obj->only_append()) {
-						sync_after_append(guard, false, obj);
-						continue;
-					}
+class cache_manager {
+	public:
+		cache_manager(struct dnet_node *n, int num, const std::string &snapshot) :
+		m_need_exit(false),
+		m_sync_exit(false),
+		m_node(n),
+		m_allocator(std::make_shared<slab_allocator_t>()),
+		m_sync_queue_items(0),
+		m_sync_queue_bytes(0),
+		m_synced(0),
+		m_sync_time(0),
+		m_prev_synced(0),
+		m_prev_sync_time(0),
+		m_rate_tokens(0),
+		m_snapshot(snapshot) {
+			for (int i  = 0; i < num; ++i) {
+				m_caches.emplace_back(std::make_shared<cache_t>(n, *m_allocator, n->cache_size / num));
+			}
 
-					memcpy(id.id, obj->id().id, DNET_ID_SIZE);
-					data = it->data()->data();
-					user_flags = obj->user_flags();
-					timestamp = obj->timestamp();
+			if (!m_snapshot.empty())
+				load_snapshot();
 
-					m_syncset.erase(it);
-					obj->clear_synctime();
+			gettimeofday(&m_rate_time, NULL);
 
-					guard.unlock();
+			for (int i = 0; i < n->cache_sync_threads; ++i) {
+				m_sync_threads.emplace_back(std::bind(&cache_manager::sync_thread, this));
+			}
 
-					sync_element(id, false, data, user_flags, timestamp);
+			m_lifecheck = std::thread(std::bind(&cache_manager::life_check, this));
+		}
 
-					guard.lock();
+		~cache_manager() {
+			m_need_exit = true;
 
-					auto jt = m_set.find(id.id);
-					if (jt != m_set.end()) {
-						if (jt->remove_from_cache()) {
-							erase_element(&*jt);
-						}
-					}
-				}
+			//Stops all caches in parallel. Avoids sleeping in all cache distructors
+			for (auto it(m_caches.begin()), end(m_caches.end()); it != end; ++it) {
+				(*it)->stop(); //Sets cache as stopped
+			}
 
-				for (std::deque<struct dnet_id>::iterator it = remove.begin(); it != remove.end(); ++it) {
-					dnet_remove_local(m_node, &(*it));
-				}
+			m_lifecheck.join();
 
-				sleep(1);
+			// Objects already taken for write-back are not in sync sets anymore, queue is drained without rate limit
+			{
+				std::lock_guard<std::mutex> guard(m_sync_lock);
+				m_sync_exit = true;
+				m_sync_wait.notify_all();
+			}
+			{
+				std::lock_guard<std::mutex> guard(m_rate_lock);
+				m_rate_wait.notify_all();
 			}
-		}
-};
 
-class cache_manager {
-	public:
-		cache_manager(struct dnet_node *n, int num = 16) {
-			for (int i  = 0; i < num; ++i) {
-				m_caches.emplace_back(std::make_shared<cache_t>(n, n->cache_size / num));
+			for (auto it = m_sync_threads.begin(); it != m_sync_threads.end(); ++it) {
+				it->join();
 			}
-		}
 
-		~cache_manager() {
-			//Stops all caches in parallel. Avoids sleeping in all cache distructors
-			for (auto it(m_caches.begin()), end(m_caches.end()); it != end; ++it) {
-				(*it)->stop(); //Sets cache as stopped
+			if (!m_snapshot.empty()) {
+				for (auto it = m_caches.begin(); it != m_caches.end(); ++it) {
+					(*it)->sync_all();
+				}
+
+				save_snapshot();
 			}
 		}
 
@@ -785,6 +1499,10 @@ class cache_manager {
 			return m_caches[idx(id)]->lookup(id, st, cmd);
 		}
 
+		std::shared_ptr<slab_allocator_t> allocator(void) const {
+			return m_allocator;
+		}
+
 		int indexes_find(dnet_cmd *cmd, dnet_indexes_request *request) {
 			(void) cmd;
 			(void) request;
@@ -804,11 +1522,410 @@ class cache_manager {
 		}
 
 	private:
+		bool m_need_exit;
+		bool m_sync_exit;
+		struct dnet_node *m_node;
+		/*
+		 * Must outlive shards, since their objects are allocated from it.
+		 * Data being sent by network threads holds its own reference.
+		 */
+		std::shared_ptr<slab_allocator_t> m_allocator;
 		std::vector<std::shared_ptr<cache_t>> m_caches;
+		std::thread m_lifecheck;
 
+		std::vector<std::thread> m_sync_threads;
+		std::mutex m_sync_lock;
+		std::condition_variable m_sync_wait;
+		std::deque<sync_item_t> m_sync_queue;
+		std::atomic<uint64_t> m_sync_queue_items;
+		std::atomic<uint64_t> m_sync_queue_bytes;
+		std::atomic<uint64_t> m_synced;
+		std::atomic<uint64_t> m_sync_time;
+		uint64_t m_prev_synced, m_prev_sync_time;
+
+		std::mutex m_rate_lock;
+		std::condition_variable m_rate_wait;
+		double m_rate_tokens;
+		struct timeval m_rate_time;
+
+		std::string m_snapshot;
+
+		/*
+		 * Node owns a contiguous ID range, so the first bytes of the IDs
+		 * it stores are nearly the same - hash the whole ID to spread keys over shards.
+		 */
 		size_t idx(const unsigned char *id) {
-			unsigned i = *(unsigned *)id;
-			return i % m_caches.size();
+			return dnet_id_hash(id) % m_caches.size();
+		}
+
+		static bool sync_item_less(const sync_item_t &a, const sync_item_t &b) {
+			return dnet_id_cmp_str(a.id.id, b.id.id) < 0;
+		}
+
+		/*
+		 * Dirty objects from all shards are gathered into single batch and sorted by ID,
+		 * so that backend receives writes in key order.
+		 */
+		void life_check(void) {
+			while (!m_need_exit) {
+				std::vector<sync_item_t> batch;
+
+				for (size_t i = 0; i < m_caches.size() && !m_need_exit; ++i) {
+					size_t start = batch.size();
+
+					m_caches[i]->life_check(batch);
+
+					for (size_t j = start; j < batch.size(); ++j)
+						batch[j].shard = i;
+				}
+
+				if (!batch.empty()) {
+					std::sort(batch.begin(), batch.end(), sync_item_less);
+
+					std::lock_guard<std::mutex> guard(m_sync_lock);
+					for (auto it = batch.begin(); it != batch.end(); ++it) {
+						m_sync_queue_items++;
+						m_sync_queue_bytes += it->data->size();
+						m_sync_queue.push_back(*it);
+					}
+					m_sync_wait.notify_all();
+				}
+
+				update_stats();
+
+				sleep(1);
+			}
+		}
+
+		/*
+		 * Snapshot is written at shutdown into temporary file, header is marked clean
+		 * and the file is renamed only when it is complete and synced
+		 */
+		int save_snapshot(void) {
+			std::string tmp = m_snapshot + ".tmp";
+			std::vector<snapshot_item_t> items;
+			snapshot_header_t header;
+			static const char pad[8] = {0, };
+			struct timeval start, end;
+			int err = 0;
+
+			gettimeofday(&start, NULL);
+
+			FILE *f = fopen(tmp.c_str(), "w");
+			if (!f) {
+				err = -errno;
+				dnet_log_err(m_node, "CACHE: could not create snapshot '%s'", tmp.c_str());
+				goto err_out_exit;
+			}
+
+			memset(&header, 0, sizeof(header));
+			memcpy(header.magic, DNET_CACHE_SNAPSHOT_MAGIC, sizeof(header.magic));
+			header.version = DNET_CACHE_SNAPSHOT_VERSION;
+			header.time = time(NULL);
+
+			fwrite(&header, sizeof(header), 1, f);
+
+			for (size_t i = 0; i < m_caches.size(); ++i) {
+				items.clear();
+				m_caches[i]->snapshot(items);
+
+				for (auto it = items.begin(); it != items.end(); ++it) {
+					snapshot_record_t rec;
+
+					memset(&rec, 0, sizeof(rec));
+					rec.id = it->id;
+					rec.lifetime = it->lifetime;
+					rec.user_flags = it->user_flags;
+					rec.timestamp = it->timestamp;
+					rec.size = it->data->size();
+					rec.remove_from_disk = it->remove_from_disk;
+
+					fwrite(&rec, sizeof(rec), 1, f);
+					fwrite(it->data->data(), 1, rec.size, f);
+					fwrite(pad, 1, DNET_CACHE_SNAPSHOT_ALIGN(rec.size) - rec.size, f);
+
+					header.num++;
+				}
+			}
+			items.clear();
+
+			header.flags |= DNET_CACHE_SNAPSHOT_CLEAN;
+
+			fseek(f, 0, SEEK_SET);
+			fwrite(&header, sizeof(header), 1, f);
+			fflush(f);
+
+			if (ferror(f) || fsync(fileno(f))) {
+				err = -EIO;
+				dnet_log(m_node, DNET_LOG_ERROR, "CACHE: failed to write snapshot '%s'\n", tmp.c_str());
+				goto err_out_close;
+			}
+
+			fclose(f);
+			f = NULL;
+
+			if (rename(tmp.c_str(), m_snapshot.c_str())) {
+				err = -errno;
+				dnet_log_err(m_node, "CACHE: could not rename snapshot '%s' -> '%s'", tmp.c_str(), m_snapshot.c_str());
+				goto err_out_unlink;
+			}
+
+			gettimeofday(&end, NULL);
+
+			dnet_log(m_node, DNET_LOG_INFO, "CACHE: saved snapshot '%s': objects: %llu, time: %ld usecs\n",
+					m_snapshot.c_str(), (unsigned long long)header.num,
+					(end.tv_sec - start.tv_sec) * 1000000 + end.tv_usec - start.tv_usec);
+			return 0;
+
+err_out_close:
+			fclose(f);
+err_out_unlink:
+			unlink(tmp.c_str());
+err_out_exit:
+			return err;
+		}
+
+		int load_snapshot(void) {
+			struct dnet_map_fd m;
+			struct stat st;
+			snapshot_header_t *header;
+			uint64_t restored = 0, skipped = 0, offset;
+			time_t now = time(NULL);
+			int err;
+
+			memset(&m, 0, sizeof(m));
+
+			m.fd = open(m_snapshot.c_str(), O_RDONLY | O_CLOEXEC);
+			if (m.fd < 0) {
+				err = -errno;
+				if (err != -ENOENT)
+					dnet_log_err(m_node, "CACHE: could not open snapshot '%s'", m_snapshot.c_str());
+				goto err_out_exit;
+			}
+
+			err = fstat(m.fd, &st);
+			if (err) {
+				err = -errno;
+				dnet_log_err(m_node, "CACHE: could not stat snapshot '%s'", m_snapshot.c_str());
+				goto err_out_close;
+			}
+
+			if ((uint64_t)st.st_size < sizeof(snapshot_header_t)) {
+				err = -EINVAL;
+				dnet_log(m_node, DNET_LOG_ERROR, "CACHE: snapshot '%s' is too small: %llu\n",
+						m_snapshot.c_str(), (unsigned long long)st.st_size);
+				goto err_out_remove;
+			}
+
+			m.size = st.st_size;
+
+			err = dnet_data_map(&m);
+			if (err) {
+				dnet_log(m_node, DNET_LOG_ERROR, "CACHE: could not map snapshot '%s': %d\n", m_snapshot.c_str(), err);
+				goto err_out_close;
+			}
+
+			header = (snapshot_header_t *)m.data;
+			if (memcmp(header->magic, DNET_CACHE_SNAPSHOT_MAGIC, sizeof(header->magic)) ||
+					header->version != DNET_CACHE_SNAPSHOT_VERSION) {
+				err = -EINVAL;
+				dnet_log(m_node, DNET_LOG_ERROR, "CACHE: snapshot '%s' has invalid magic or version\n", m_snapshot.c_str());
+				goto err_out_unmap;
+			}
+
+			if (!(header->flags & DNET_CACHE_SNAPSHOT_CLEAN)) {
+				err = -EINVAL;
+				dnet_log(m_node, DNET_LOG_ERROR, "CACHE: snapshot '%s' was not written at clean shutdown, ignoring\n",
+						m_snapshot.c_str());
+				goto err_out_unmap;
+			}
+
+			offset = sizeof(snapshot_header_t);
+			for (uint64_t i = 0; i < header->num && !m_need_exit; ++i) {
+				if (offset + sizeof(snapshot_record_t) > m.size) {
+					err = -EINVAL;
+					break;
+				}
+
+				snapshot_record_t *rec = (snapshot_record_t *)((char *)m.data + offset);
+				offset += sizeof(snapshot_record_t);
+
+				if (rec->size > m.size - offset) {
+					err = -EINVAL;
+					break;
+				}
+
+				if ((rec->lifetime && (time_t)rec->lifetime <= now) ||
+						!m_caches[idx(rec->id.id)]->restore(*rec, (char *)m.data + offset))
+					skipped++;
+				else
+					restored++;
+
+				offset += DNET_CACHE_SNAPSHOT_ALIGN(rec->size);
+			}
+
+			if (err)
+				dnet_log(m_node, DNET_LOG_ERROR, "CACHE: snapshot '%s' is truncated at offset %llu\n",
+						m_snapshot.c_str(), (unsigned long long)offset);
+
+			dnet_log(m_node, DNET_LOG_INFO, "CACHE: loaded snapshot '%s': restored: %llu, skipped: %llu\n",
+					m_snapshot.c_str(), (unsigned long long)restored, (unsigned long long)skipped);
+
+			err = 0;
+
+err_out_unmap:
+			dnet_data_unmap(&m);
+err_out_remove:
+			// Snapshot is used once, so that it is not loaded again after crash of the server which has loaded it
+			unlink(m_snapshot.c_str());
+err_out_close:
+			close(m.fd);
+err_out_exit:
+			return err;
+		}
+
+		// Maximum number of objects sync thread takes from the queue at once
+		enum { sync_batch_size = 128 };
+
+		void sync_thread(void) {
+			local_session sess(m_node);
+			sess.set_ioflags(DNET_IO_FLAGS_NOCACHE);
+
+			while (true) {
+				std::vector<sync_item_t> batch;
+
+				{
+					std::unique_lock<std::mutex> guard(m_sync_lock);
+
+					while (m_sync_queue.empty() && !m_sync_exit)
+						m_sync_wait.wait(guard);
+
+					if (m_sync_queue.empty())
+						break;
+
+					while (!m_sync_queue.empty() && batch.size() < sync_batch_size) {
+						batch.push_back(m_sync_queue.front());
+						m_sync_queue.pop_front();
+					}
+				}
+
+				sync(sess, batch);
+			}
+		}
+
+		void sync(local_session &sess, std::vector<sync_item_t> &batch) {
+			struct timeval start, end;
+
+			for (auto it = batch.begin(); it != batch.end(); ++it) {
+				cache_t &cache = *m_caches[it->shard];
+				const size_t size = it->data->size();
+
+				m_sync_queue_items--;
+				m_sync_queue_bytes -= size;
+
+				// Key was removed or rewritten inline after it had been queued
+				if (!cache.writeback_start(*it)) {
+					dnet_log(m_node, DNET_LOG_DEBUG, "%s: CACHE: stale write-back skipped\n", dnet_dump_id_str(it->id.id));
+					it->data.reset();
+					continue;
+				}
+
+				throttle(size);
+
+				gettimeofday(&start, NULL);
+				int err = sess.write(it->id, it->data->data(), size, it->user_flags, it->timestamp);
+				gettimeofday(&end, NULL);
+
+				if (err) {
+					dnet_log(m_node, DNET_LOG_ERROR, "%s: CACHE: failed to sync to disk, err: %d\n", dnet_dump_id_str(it->id.id), err);
+				} else {
+					dnet_log(m_node, DNET_LOG_DEBUG, "%s: CACHE: synced to disk, size: %zu\n", dnet_dump_id_str(it->id.id), size);
+				}
+
+				m_sync_time += (end.tv_sec - start.tv_sec) * 1000000 + end.tv_usec - start.tv_usec;
+				m_synced++;
+
+				it->data.reset();
+				cache.synced(*it);
+			}
+		}
+
+		/*
+		 * Token bucket limiting write-back to n->cache_sync_rate bytes per second.
+		 * Bucket holds at most one second worth of tokens, object bigger than that
+		 * is written as soon as bucket is not empty, leaving it in debt.
+		 */
+		void throttle(size_t size) {
+			const double rate = m_node->cache_sync_rate;
+
+			if (rate <= 0)
+				return;
+
+			std::unique_lock<std::mutex> guard(m_rate_lock);
+
+			while (!m_sync_exit) {
+				struct timeval now;
+
+				gettimeofday(&now, NULL);
+				m_rate_tokens += rate * ((now.tv_sec - m_rate_time.tv_sec) + (now.tv_usec - m_rate_time.tv_usec) / 1000000.0);
+				m_rate_tokens = std::min(m_rate_tokens, rate);
+				m_rate_time = now;
+
+				if (m_rate_tokens > 0) {
+					m_rate_tokens -= size;
+					break;
+				}
+
+				m_rate_wait.wait_for(guard, std::chrono::microseconds((long)(-m_rate_tokens / rate * 1000000) + 1));
+			}
+		}
+
+		void update_stats(void) {
+			cache_stats_t total;
+			uint64_t max_contended = 0;
+			size_t max_shard = 0;
+
+			memset(&total, 0, sizeof(total));
+
+			for (size_t i = 0; i < m_caches.size(); ++i) {
+				cache_stats_t stats = m_caches[i]->stats();
+
+				total.lock_acquired += stats.lock_acquired;
+				total.lock_contended += stats.lock_contended;
+				total.hit += stats.hit;
+				total.miss += stats.miss;
+				total.admitted += stats.admitted;
+				total.rejected += stats.rejected;
+				total.evicted += stats.evicted;
+
+				if (stats.lock_contended > max_contended) {
+					max_contended = stats.lock_contended;
+					max_shard = i;
+				}
+			}
+
+			dnet_counter_set(m_node, DNET_CNTR_CACHE_LOCK, 0, total.lock_acquired);
+			dnet_counter_set(m_node, DNET_CNTR_CACHE_LOCK, 1, total.lock_contended);
+			dnet_counter_set(m_node, DNET_CNTR_CACHE_LOCK_MAX_SHARD, 0, max_shard);
+			dnet_counter_set(m_node, DNET_CNTR_CACHE_LOCK_MAX_SHARD, 1, max_contended);
+			dnet_counter_set(m_node, DNET_CNTR_CACHE_HIT, 0, total.hit);
+			dnet_counter_set(m_node, DNET_CNTR_CACHE_HIT, 1, total.miss);
+			dnet_counter_set(m_node, DNET_CNTR_CACHE_ADMIT, 0, total.admitted);
+			dnet_counter_set(m_node, DNET_CNTR_CACHE_ADMIT, 1, total.rejected);
+			dnet_counter_set(m_node, DNET_CNTR_CACHE_EVICT, 0, total.evicted);
+			dnet_counter_set(m_node, DNET_CNTR_CACHE_MEMORY, 0, m_allocator->used());
+			dnet_counter_set(m_node, DNET_CNTR_CACHE_MEMORY, 1, m_allocator->reserved());
+
+			uint64_t synced = m_synced, sync_time = m_sync_time;
+
+			dnet_counter_set(m_node, DNET_CNTR_CACHE_SYNC_QUEUE, 0, m_sync_queue_items);
+			dnet_counter_set(m_node, DNET_CNTR_CACHE_SYNC_QUEUE, 1, m_sync_queue_bytes);
+			dnet_counter_set(m_node, DNET_CNTR_CACHE_SYNC_TIME, 0, synced);
+			dnet_counter_set(m_node, DNET_CNTR_CACHE_SYNC_TIME, 1, (synced > m_prev_synced) ?
+					(sync_time - m_prev_sync_time) / (synced - m_prev_synced) : 0);
+
+			m_prev_synced = synced;
+			m_prev_sync_time = sync_time;
 		}
 };
 
@@ -816,6 +1933,20 @@ class cache_manager {
 
 using namespace ioremap::cache;
 
+/*
+ * Reference to cached data queued for sending,
+ * allocator is destroyed last, since data is returned into it
+ */
+struct cache_read_ref_t {
+	std::shared_ptr<slab_allocator_t> allocator;
+	std::shared_ptr<raw_data_t> data;
+};
+
+static void cache_read_ref_put(void *priv)
+{
+	delete static_cast<cache_read_ref_t *>(priv);
+}
+
 int dnet_cmd_cache_io(struct dnet_net_state *st, struct dnet_cmd *cmd, struct dnet_io_attr *io, char *data)
 {
 	struct dnet_node *n = st->n;
@@ -828,6 +1959,7 @@ int dnet_cmd_cache_io(struct dnet_net_state *st, struct dnet_cmd *cmd, struct dn
 
 	cache_manager *cache = (cache_manager *)n->cache;
 	std::shared_ptr<raw_data_t> d;
+	cache_read_ref_t *ref;
 
 	try {
 		switch (cmd->cmd) {
@@ -859,7 +1991,13 @@ int dnet_cmd_cache_io(struct dnet_net_state *st, struct dnet_cmd *cmd, struct dn
 					io->size = d->size() - io->offset;
 
 				cmd->flags &= ~DNET_FLAGS_NEED_ACK;
-				err = dnet_send_read_data(st, cmd, io, (char *)d->data().data() + io->offset, -1, io->offset, 0);
+
+				/* object is pinned until it is sent, so it is not copied into send queue */
+				ref = new cache_read_ref_t;
+				ref->allocator = cache->allocator();
+				ref->data = d;
+
+				err = dnet_send_read_data_ref(st, cmd, io, d->data() + io->offset, cache_read_ref_put, ref);
 				break;
 			case DNET_CMD_DEL:
 				err = cache->remove(cmd->id.id, io);
@@ -930,13 +2068,22 @@ int dnet_cmd_cache_lookup(struct dnet_net_state *st, struct dnet_cmd *cmd)
 	return err;
 }
 
-int dnet_cache_init(struct dnet_node *n)
+int dnet_cache_init(struct dnet_node *n, struct dnet_config *cfg)
 {
+	std::string snapshot;
+
 	if (!n->cache_size)
 		return 0;
 
+	if (cfg->cache_snapshot) {
+		if (cfg->history_env[0])
+			snapshot = std::string(cfg->history_env) + "/cache.snapshot";
+		else
+			dnet_log(n, DNET_LOG_ERROR, "Cache snapshot requires history directory, snapshot is disabled\n");
+	}
+
 	try {
-		n->cache = (void *)(new cache_manager(n, 16));
+		n->cache = (void *)(new cache_manager(n, n->cache_shards, snapshot));
 	} catch (const std::exception &e) {
 		dnet_log_raw(n, DNET_LOG_ERROR, "Could not create cache: %s\n", e.what());
 		return -ENOMEM;
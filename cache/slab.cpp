@@ -0,0 +1,308 @@
+/*
+ * 2013+ Copyright (c) Evgeniy Polyakov <zbr@ioremap.net>
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <algorithm>
+#include <new>
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "slab.hpp"
+
+namespace ioremap { namespace cache {
+
+#define SLAB_ALIGN(x)	(((x) + 15) & ~((size_t)15))
+#define PAGE_ALIGN(x)	(((x) + slab_allocator_t::page_size - 1) & ~((size_t)slab_allocator_t::page_size - 1))
+
+slab_allocator_t::slab_allocator_t() : m_class_num(0), m_used(0), m_reserved(0), m_spare(NULL),
+	m_free_pages(NULL), m_extent_pos(NULL), m_extent_end(NULL)
+{
+	size_t size = min_chunk_size;
+
+	while (m_class_num < max_classes) {
+		size_class_t &c = m_classes[m_class_num++];
+
+		c.size = size;
+		c.chunks = max_chunk_size / size;
+		c.head = c.tail = NULL;
+
+		if (size == max_chunk_size)
+			break;
+
+		size = std::min<size_t>(SLAB_ALIGN(size + size / 4), max_chunk_size);
+	}
+}
+
+slab_allocator_t::~slab_allocator_t()
+{
+	for (auto it = m_extents.begin(); it != m_extents.end(); ++it)
+		munmap(*it, extent_size);
+}
+
+int slab_allocator_t::class_index(size_t size) const
+{
+	int low = 0, high = m_class_num - 1;
+
+	if (size > m_classes[high].size)
+		return -1;
+
+	while (low < high) {
+		int mid = (low + high) / 2;
+
+		if (m_classes[mid].size < size)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+
+	return low;
+}
+
+size_t slab_allocator_t::chunk_size(size_t size) const
+{
+	int idx = class_index(size);
+
+	if (idx < 0)
+		return PAGE_ALIGN(size);
+
+	return m_classes[idx].size;
+}
+
+slab_allocator_t::page_t *slab_allocator_t::page_alloc(void)
+{
+	page_t *page = m_spare.exchange(NULL);
+
+	if (!page) {
+		std::lock_guard<std::mutex> guard(m_pages_lock);
+
+		if (m_free_pages) {
+			page = m_free_pages;
+			m_free_pages = page->next;
+		} else {
+			if (m_extent_pos == m_extent_end) {
+				size_t size = extent_size + page_size;
+				char *mem, *start;
+
+				mem = (char *)mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+				if (mem == MAP_FAILED)
+					throw std::bad_alloc();
+
+				/* trim mapping to page aligned extent */
+				start = (char *)PAGE_ALIGN((uintptr_t)mem);
+				if (start != mem)
+					munmap(mem, start - mem);
+				munmap(start + extent_size, mem + size - start - extent_size);
+
+				try {
+					m_extents.push_back(start);
+				} catch (...) {
+					munmap(start, extent_size);
+					throw;
+				}
+
+				m_extent_pos = start;
+				m_extent_end = start + extent_size;
+			}
+
+			page = (page_t *)m_extent_pos;
+			m_extent_pos += page_size;
+		}
+
+		m_reserved += page_size;
+	}
+
+	page->prev = page->next = NULL;
+	page->free_list = NULL;
+	page->pos = (char *)page + page_header_size;
+	page->inuse = 0;
+	return page;
+}
+
+/*
+ * Empty page becomes a spare, previous spare is returned to the system and put into the pool
+ */
+void slab_allocator_t::page_free(page_t *page)
+{
+	page = m_spare.exchange(page);
+	if (!page)
+		return;
+
+	madvise(page, page_size, MADV_DONTNEED);
+
+	std::lock_guard<std::mutex> guard(m_pages_lock);
+	page->next = m_free_pages;
+	m_free_pages = page;
+	m_reserved -= page_size;
+}
+
+void slab_allocator_t::page_unlink(size_class_t &c, page_t *page)
+{
+	if (page->prev)
+		page->prev->next = page->next;
+	else
+		c.head = page->next;
+
+	if (page->next)
+		page->next->prev = page->prev;
+	else
+		c.tail = page->prev;
+
+	page->prev = page->next = NULL;
+}
+
+void slab_allocator_t::page_link_head(size_class_t &c, page_t *page)
+{
+	page->prev = NULL;
+	page->next = c.head;
+
+	if (c.head)
+		c.head->prev = page;
+	else
+		c.tail = page;
+
+	c.head = page;
+}
+
+void slab_allocator_t::page_link_tail(size_class_t &c, page_t *page)
+{
+	page->next = NULL;
+	page->prev = c.tail;
+
+	if (c.tail)
+		c.tail->next = page;
+	else
+		c.head = page;
+
+	c.tail = page;
+}
+
+void *slab_allocator_t::allocate(size_t size)
+{
+	int idx = class_index(size);
+	void *ptr;
+
+	if (idx < 0) {
+		size = PAGE_ALIGN(size);
+
+		ptr = malloc(size);
+		if (!ptr)
+			throw std::bad_alloc();
+
+		m_used += size;
+		m_reserved += size;
+		return ptr;
+	}
+
+	size_class_t &c = m_classes[idx];
+	std::lock_guard<std::mutex> guard(c.lock);
+
+	page_t *page = c.head;
+	if (!page || page->inuse == c.chunks) {
+		page = page_alloc();
+		page_link_head(c, page);
+	}
+
+	if (page->free_list) {
+		ptr = page->free_list;
+		page->free_list = *(void **)ptr;
+	} else {
+		ptr = page->pos;
+		page->pos += c.size;
+	}
+
+	if (++page->inuse == c.chunks) {
+		page_unlink(c, page);
+		page_link_tail(c, page);
+	}
+
+	m_used += c.size;
+	return ptr;
+}
+
+void slab_allocator_t::deallocate(void *ptr, size_t size)
+{
+	int idx;
+
+	if (!ptr)
+		return;
+
+	idx = class_index(size);
+	if (idx < 0) {
+		size = PAGE_ALIGN(size);
+
+		free(ptr);
+		m_used -= size;
+		m_reserved -= size;
+		return;
+	}
+
+	size_class_t &c = m_classes[idx];
+	page_t *page = (page_t *)((uintptr_t)ptr & ~((uintptr_t)page_size - 1));
+	std::unique_lock<std::mutex> guard(c.lock);
+
+	*(void **)ptr = page->free_list;
+	page->free_list = ptr;
+	m_used -= c.size;
+
+	if (--page->inuse == 0) {
+		page_unlink(c, page);
+		guard.unlock();
+
+		page_free(page);
+	} else if (page->inuse == c.chunks - 1) {
+		page_unlink(c, page);
+		page_link_head(c, page);
+	}
+}
+
+size_t slab_allocator_t::wasted(void) const
+{
+	size_t reserved = m_reserved, used = m_used;
+	size_t slack = (m_class_num + 1) * page_size;
+
+	if (reserved <= used + slack)
+		return 0;
+
+	return reserved - used - slack;
+}
+
+void *slab_allocator_t::reallocate(void *ptr, size_t old_size, size_t new_size, size_t copy)
+{
+	if (ptr && class_index(old_size) < 0 && class_index(new_size) < 0) {
+		old_size = PAGE_ALIGN(old_size);
+		new_size = PAGE_ALIGN(new_size);
+
+		void *tmp = realloc(ptr, new_size);
+		if (!tmp)
+			throw std::bad_alloc();
+
+		m_used += new_size - old_size;
+		m_reserved += new_size - old_size;
+		return tmp;
+	}
+
+	void *tmp = allocate(new_size);
+
+	if (ptr) {
+		memcpy(tmp, ptr, std::min(copy, new_size));
+		deallocate(ptr, old_size);
+	}
+
+	return tmp;
+}
+
+}}
@@ -0,0 +1,204 @@
+/*
+ * 2013+ Copyright (c) Evgeniy Polyakov <zbr@ioremap.net>
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef ELLIPTICS_CACHE_SLAB_HPP
+#define ELLIPTICS_CACHE_SLAB_HPP
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <cstddef>
+
+namespace ioremap { namespace cache {
+
+/*
+ * Size-class allocator for cached objects and their metadata.
+ *
+ * Chunk sizes grow by 1/4 starting from the smallest class, every class
+ * carves its chunks from its own slab pages. Pages are cut from mmap()ed extents
+ * and are aligned to their size, so freed chunk finds its page by address and is put
+ * into page's free list. Page whose chunks are all free is returned to the system
+ * by madvise() and is put into the pool shared by all classes, so that memory freed
+ * in one class is reused by another one when object sizes change. The last freed page
+ * is kept as a spare, so that class on the edge of a page does not thrash.
+ * Requests bigger than the biggest class are served by malloc() rounded up to page size.
+ */
+class slab_allocator_t {
+	public:
+		enum {
+			min_chunk_size = 64,
+			page_size = 64 * 1024,
+			page_header_size = 64,
+			extent_size = 32 * page_size,
+			max_chunk_size = page_size - page_header_size,
+			max_classes = 64,
+		};
+
+		slab_allocator_t();
+		~slab_allocator_t();
+
+		void *allocate(size_t size);
+		void deallocate(void *ptr, size_t size);
+
+		/*
+		 * Grows or shrinks allocation, first @copy bytes are preserved.
+		 * Big allocations are resized in place by realloc() when possible.
+		 */
+		void *reallocate(void *ptr, size_t old_size, size_t new_size, size_t copy);
+
+		// Number of bytes really consumed by allocation of @size bytes
+		size_t chunk_size(size_t size) const;
+
+		// Bytes handed out to users, rounded to chunk sizes
+		size_t used(void) const {
+			return m_used;
+		}
+
+		// Bytes taken from the system, released pages are not counted
+		size_t reserved(void) const {
+			return m_reserved;
+		}
+
+		// Reserved bytes lost to fragmentation, beyond one partially used page per class and the spare
+		size_t wasted(void) const;
+
+	private:
+		/*
+		 * Header at the start of every slab page.
+		 * Pages with free chunks are kept at the head of class' list, full ones at the tail.
+		 */
+		struct page_t {
+			page_t			*prev;
+			page_t			*next;
+			void			*free_list;
+			char			*pos;
+			unsigned int		inuse;
+		};
+
+		static_assert(sizeof(page_t) <= page_header_size, "slab page header does not fit into reserved space");
+
+		struct size_class_t {
+			size_t			size;
+			unsigned int		chunks;
+			std::mutex		lock;
+			page_t			*head;
+			page_t			*tail;
+		};
+
+		size_class_t m_classes[max_classes];
+		int m_class_num;
+		std::atomic<size_t> m_used;
+		std::atomic<size_t> m_reserved;
+		std::atomic<page_t *> m_spare;
+
+		// Released pages and the rest of the last extent
+		std::mutex m_pages_lock;
+		page_t *m_free_pages;
+		char *m_extent_pos;
+		char *m_extent_end;
+		std::vector<void *> m_extents;
+
+		slab_allocator_t(const slab_allocator_t &) = delete;
+		slab_allocator_t &operator =(const slab_allocator_t &) = delete;
+
+		int class_index(size_t size) const;
+
+		page_t *page_alloc(void);
+		void page_free(page_t *page);
+
+		void page_unlink(size_class_t &c, page_t *page);
+		void page_link_head(size_class_t &c, page_t *page);
+		void page_link_tail(size_class_t &c, page_t *page);
+};
+
+/*
+ * STL adapter, used to put shared pointer control blocks into slab
+ */
+template <typename T>
+class slab_stl_allocator_t {
+	public:
+		typedef T value_type;
+		typedef T *pointer;
+		typedef const T *const_pointer;
+		typedef T &reference;
+		typedef const T &const_reference;
+		typedef size_t size_type;
+		typedef ptrdiff_t difference_type;
+
+		template <typename U>
+		struct rebind {
+			typedef slab_stl_allocator_t<U> other;
+		};
+
+		slab_stl_allocator_t(slab_allocator_t &allocator) : m_allocator(&allocator) {
+		}
+
+		template <typename U>
+		slab_stl_allocator_t(const slab_stl_allocator_t<U> &other) : m_allocator(other.allocator()) {
+		}
+
+		pointer address(reference x) const {
+			return &x;
+		}
+
+		const_pointer address(const_reference x) const {
+			return &x;
+		}
+
+		pointer allocate(size_type n, const void * = 0) {
+			return static_cast<pointer>(m_allocator->allocate(n * sizeof(T)));
+		}
+
+		void deallocate(pointer p, size_type n) {
+			m_allocator->deallocate(p, n * sizeof(T));
+		}
+
+		size_type max_size() const {
+			return size_t(-1) / sizeof(T);
+		}
+
+		template <typename U, typename... Args>
+		void construct(U *p, Args&&... args) {
+			::new((void *)p) U(std::forward<Args>(args)...);
+		}
+
+		template <typename U>
+		void destroy(U *p) {
+			p->~U();
+		}
+
+		slab_allocator_t *allocator() const {
+			return m_allocator;
+		}
+
+	private:
+		slab_allocator_t *m_allocator;
+};
+
+template <typename T, typename U>
+bool operator ==(const slab_stl_allocator_t<T> &a, const slab_stl_allocator_t<U> &b)
+{
+	return a.allocator() == b.allocator();
+}
+
+template <typename T, typename U>
+bool operator !=(const slab_stl_allocator_t<T> &a, const slab_stl_allocator_t<U> &b)
+{
+	return a.allocator() != b.allocator();
+}
+
+}}
+
+#endif /* ELLIPTICS_CACHE_SLAB_HPP */
@@ -0,0 +1,28 @@
+# Check whether io_uring with read/write opcodes and sparse registered files is supported.
+# There is no dependency on liburing, rings are set up with raw syscalls.
+
+include(CheckCSourceCompiles)
+
+if (UNIX OR MINGW)
+    SET(CMAKE_REQUIRED_DEFINITIONS -Werror-implicit-function-declaration)
+endif()
+
+check_c_source_compiles("#include <sys/syscall.h>
+#include <unistd.h>
+#include <linux/io_uring.h>
+int main()
+{
+    struct io_uring_params p;
+    struct io_uring_files_update up;
+    int ops[] = { IORING_OP_READ, IORING_OP_WRITE, IORING_OP_FSYNC, IORING_REGISTER_FILES_UPDATE };
+    syscall(__NR_io_uring_setup, 1, &p);
+    syscall(__NR_io_uring_enter, 0, 0, 0, IORING_ENTER_GETEVENTS, NULL, 0);
+    syscall(__NR_io_uring_register, 0, IORING_REGISTER_FILES, &up, 0);
+    return ops[0] + IOSQE_IO_LINK + IOSQE_FIXED_FILE;
+}" HAVE_IO_URING)
+unset(CMAKE_REQUIRED_DEFINITIONS)
+
+if(HAVE_IO_URING)
+    add_definitions(-DHAVE_IO_URING=1)
+endif()
+message(STATUS "io_uring support: ${HAVE_IO_URING}")
@@ -84,6 +84,14 @@ static int dnet_simple_set(struct dnet_config_backend *b __unused, char *key, ch
 		dnet_cur_cfg_data->cfg_state.check_timeout = value;
 	else if (!strcmp(key, "cache_sync_timeout"))
 		dnet_cur_cfg_data->cfg_state.cache_sync_timeout = value;
+	else if (!strcmp(key, "cache_shards"))
+		dnet_cur_cfg_data->cfg_state.cache_shards = value;
+	else if (!strcmp(key, "cache_sync_threads"))
+		dnet_cur_cfg_data->cfg_state.cache_sync_threads = value;
+	else if (!strcmp(key, "cache_sync_rate"))
+		dnet_cur_cfg_data->cfg_state.cache_sync_rate = value;
+	else if (!strcmp(key, "cache_snapshot"))
+		dnet_cur_cfg_data->cfg_state.cache_snapshot = value;
 	else if (!strcmp(key, "stall_count"))
 		dnet_cur_cfg_data->cfg_state.stall_count = value;
 	else if (!strcmp(key, "join"))
@@ -98,6 +106,14 @@ static int dnet_simple_set(struct dnet_config_backend *b __unused, char *key, ch
 		dnet_cur_cfg_data->cfg_state.nonblocking_io_thread_num = value;
 	else if (!strcmp(key, "net_thread_num"))
 		dnet_cur_cfg_data->cfg_state.net_thread_num = value;
+	else if (!strcmp(key, "net_max_events"))
+		dnet_cur_cfg_data->cfg_state.net_max_events = value;
+	else if (!strcmp(key, "net_cpu_affinity"))
+		dnet_cur_cfg_data->cfg_state.net_cpu_affinity = value;
+	else if (!strcmp(key, "io_cpu_affinity"))
+		dnet_cur_cfg_data->cfg_state.io_cpu_affinity = value;
+	else if (!strcmp(key, "io_key_affinity"))
+		dnet_cur_cfg_data->cfg_state.io_key_affinity = value;
 	else if (!strcmp(key, "bg_ionice_class"))
 		dnet_cur_cfg_data->cfg_state.bg_ionice_class = value;
 	else if (!strcmp(key, "bg_ionice_prio"))
@@ -336,6 +352,18 @@ static int dnet_set_cache_size(struct dnet_config_backend *b __unused, char *key
 	return 0;
 }
 
+static int dnet_set_cache_policy(struct dnet_config_backend *b __unused, char *key __unused, char *value)
+{
+	if (!strcmp(value, "lru"))
+		dnet_cur_cfg_data->cfg_state.cache_policy = DNET_CACHE_POLICY_LRU;
+	else if (!strcmp(value, "slru"))
+		dnet_cur_cfg_data->cfg_state.cache_policy = DNET_CACHE_POLICY_SLRU;
+	else
+		return -EINVAL;
+
+	return 0;
+}
+
 static struct dnet_config_entry dnet_cfg_entries[] = {
 	{"mallopt_mmap_threshold", dnet_set_malloc_options},
 	{"log_level", dnet_simple_set},
@@ -355,6 +383,10 @@ static struct dnet_config_entry dnet_cfg_entries[] = {
 	{"io_thread_num", dnet_simple_set},
 	{"nonblocking_io_thread_num", dnet_simple_set},
 	{"net_thread_num", dnet_simple_set},
+	{"net_max_events", dnet_simple_set},
+	{"net_cpu_affinity", dnet_simple_set},
+	{"io_cpu_affinity", dnet_simple_set},
+	{"io_key_affinity", dnet_simple_set},
 	{"bg_ionice_class", dnet_simple_set},
 	{"bg_ionice_prio", dnet_simple_set},
 	{"removal_delay", dnet_simple_set},
@@ -363,6 +395,11 @@ static struct dnet_config_entry dnet_cfg_entries[] = {
 	{"client_net_prio", dnet_simple_set},
 	{"srw_config", dnet_set_srw},
 	{"cache_size", dnet_set_cache_size},
+	{"cache_shards", dnet_simple_set},
+	{"cache_policy", dnet_set_cache_policy},
+	{"cache_sync_threads", dnet_simple_set},
+	{"cache_sync_rate", dnet_simple_set},
+	{"cache_snapshot", dnet_simple_set},
 	{"indexes_shard_count", dnet_simple_set},
 };
 
@@ -53,40 +53,108 @@
 #endif
 
 
-struct eblob_read_params {
+/*
+ * Access pattern of every blob is tracked in the slot selected by its fd.
+ * Reads which jump further than random_distance from the end of the previous
+ * read of the same blob decrease its score, near ones increase it.
+ * Blob is considered randomly accessed while its score is negative.
+ *
+ * Slots are updated without locks, racing reads only lose a step of the score.
+ */
+#define EBLOB_READ_PATTERN_SIZE		1024
+#define EBLOB_READ_PATTERN_MAX		8
+
+struct eblob_read_pattern {
 	int			fd;
-	int			pad;
-	uint64_t		offset;
+	int			score;
+	uint64_t		next_offset;
+};
+
+/*
+ * Per-object read counters, indexed by the id, halved every EBLOB_HOTNESS_DECAY reads.
+ * Decay period is tied to the table size: uniformly spread reads add 1/2 to every counter
+ * between decays, so they settle around 1 and object is hot only if it is read several times
+ * more often than the average one.
+ * Pages of hot objects are never dropped from the page cache.
+ */
+#define EBLOB_HOTNESS_SIZE		(64 * 1024)
+#define EBLOB_HOTNESS_DECAY		(EBLOB_HOTNESS_SIZE / 2)
+#define EBLOB_HOTNESS_HOT		4
+
+struct eblob_backend_config {
+	struct eblob_config		data;
+	struct eblob_backend		*eblob;
+
+	uint64_t			random_distance;	/* quarter of RAM in bytes */
+	struct eblob_read_pattern	read_patterns[EBLOB_READ_PATTERN_SIZE];
+
+	uint64_t			reads;
+	uint64_t			read_random, read_random_hot;
+	uint8_t				hotness[EBLOB_HOTNESS_SIZE];
 };
 
-static int eblob_read_params_compare(const void *p1, const void *p2)
+/*
+ * Returns 1 if blob @fd is read randomly
+ */
+static int eblob_read_pattern_update(struct eblob_backend_config *c, int fd, uint64_t offset, uint64_t size)
 {
-	const struct eblob_read_params *r1 = p1;
-	const struct eblob_read_params *r2 = p2;
-	int ret;
+	struct eblob_read_pattern *p = &c->read_patterns[fd & (EBLOB_READ_PATTERN_SIZE - 1)];
+	uint64_t next = p->next_offset;
+	uint64_t distance;
+	int score = p->score;
 
-	ret = r1->fd - r2->fd;
-	if (ret != 0)
-		return ret;
+	if (p->fd != fd) {
+		/* slot is taken over by another blob, which starts as sequentially read one */
+		p->fd = fd;
+		score = 0;
+	} else {
+		distance = (offset > next) ? offset - next : next - offset;
+
+		if (distance > c->random_distance) {
+			if (score > -EBLOB_READ_PATTERN_MAX)
+				score--;
+		} else {
+			if (score < EBLOB_READ_PATTERN_MAX)
+				score++;
+		}
 
-	if (r1->offset > r2->offset)
-		return 1;
-	if (r1->offset < r2->offset)
-		return -1;
+		if ((p->score < 0) != (score < 0)) {
+			dnet_backend_log(DNET_LOG_INFO, "EBLOB: fd: %d: switch RA %d -> %d, distance: %llu, random distance: %llu\n",
+					fd, p->score < 0, score < 0,
+					(unsigned long long)distance, (unsigned long long)c->random_distance);
+		}
+	}
 
-	return 0;
+	p->score = score;
+	p->next_offset = offset + size;
+
+	return score < 0;
 }
 
-struct eblob_backend_config {
-	struct eblob_config		data;
-	struct eblob_backend		*eblob;
+/*
+ * Accounts read of object @id, returns 1 if object is hot
+ */
+static int eblob_hotness_update(struct eblob_backend_config *c, const unsigned char *id)
+{
+	uint64_t reads, h;
+	uint8_t *cnt, v;
+	int i;
 
-	pthread_mutex_t			last_read_lock;
-	int64_t				vm_total;		/* squared in bytes */
-	int				random_access;
-	int				last_read_index;
-	struct eblob_read_params	last_reads[100];
-};
+	memcpy(&h, id, sizeof(h));
+	cnt = &c->hotness[h % EBLOB_HOTNESS_SIZE];
+
+	v = *cnt;
+	if (v < 0xff)
+		*cnt = ++v;
+
+	reads = __sync_add_and_fetch(&c->reads, 1);
+	if (reads % EBLOB_HOTNESS_DECAY == 0) {
+		for (i = 0; i < EBLOB_HOTNESS_SIZE; ++i)
+			c->hotness[i] >>= 1;
+	}
+
+	return v >= EBLOB_HOTNESS_HOT;
+}
 
 /* Pre-callback that formats arguments and calls ictl->callback */
 static int blob_iterate_callback(struct eblob_disk_control *dc,
@@ -333,71 +401,19 @@ static int blob_read(struct eblob_backend_config *c, void *state, struct dnet_cm
 		cmd->flags &= ~DNET_FLAGS_NEED_ACK;
 
 	if (fd >= 0) {
-		struct eblob_read_params *p, *prev;
-		int i;
-
-		pthread_mutex_lock(&c->last_read_lock);
-		p = &c->last_reads[c->last_read_index];
-
-		if (++c->last_read_index >= (int)ARRAY_SIZE(c->last_reads)) {
-			int64_t tmp;
-			int64_t mult = 1;
-			int64_t mean = 0;
-			int old_ra;
+		int random = eblob_read_pattern_update(c, fd, offset, size);
+		int hot = eblob_hotness_update(c, io->id);
 
-			qsort(c->last_reads, ARRAY_SIZE(c->last_reads), sizeof(struct eblob_read_params), eblob_read_params_compare);
+		if (random) {
+			__sync_add_and_fetch(&c->read_random, 1);
 
-			prev = &c->last_reads[0];
-			tmp = prev->offset;
-
-			for (i = 1; i < (int)ARRAY_SIZE(c->last_reads); ++i) {
-				p = &c->last_reads[i];
-
-				if (p->fd != prev->fd)
-					mult++;
-
-				tmp += p->offset * mult;
-				prev = p;
-			}
-
-			/* found mean offset */
-			mean = tmp / ARRAY_SIZE(c->last_reads);
-
-			/* calculating mean squared error */
-			tmp = 0;
-			for (i = 0; i < (int)ARRAY_SIZE(c->last_reads); ++i) {
-				p = &c->last_reads[i];
-
-				tmp += ((int64_t)p->offset - mean) * ((int64_t)p->offset - mean);
-			}
-			tmp /= ARRAY_SIZE(c->last_reads);
-
-			/*
-			 * tmp and vm_total are squared, so if this check is true,
-			 * mean offset difference (error) is more than 25% of RAM
-			 */
-			old_ra = c->random_access;
-			if (tmp > c->vm_total / 16)
-				c->random_access = 1;
+			if (hot)
+				__sync_add_and_fetch(&c->read_random_hot, 1);
 			else
-				c->random_access = 0;
-
-			if (old_ra != c->random_access) {
-				dnet_backend_log(DNET_LOG_ERROR, "EBLOB: switch RA %d -> %d, offset MSE: %llu, squared VM total: %llu\n",
-						old_ra, c->random_access, (unsigned long long)tmp, (unsigned long long)c->vm_total);
-			}
-
-			c->last_read_index = 0;
+				on_close = DNET_IO_REQ_FLAGS_CACHE_FORGET;
 		}
-
-		p->fd = fd;
-		p->offset = offset;
-		pthread_mutex_unlock(&c->last_read_lock);
 	}
 
-	if (c->random_access)
-		on_close = DNET_IO_REQ_FLAGS_CACHE_FORGET;
-
 	err = dnet_send_read_data(state, cmd, io, NULL, fd, offset, on_close);
 
 err_out_exit:
@@ -419,6 +435,48 @@ static int blob_cmp_range_request(const void *req1, const void *req2)
 	return memcmp(((struct eblob_range_request *)(req1))->record_key, ((struct eblob_range_request *)(req2))->record_key, EBLOB_ID_SIZE);
 }
 
+/*
+ * Range reads hint kernel about next EBLOB_READ_RANGE_READAHEAD records,
+ * at most EBLOB_READ_RANGE_READAHEAD_SIZE bytes of every record are hinted.
+ * Records closer than EBLOB_READ_RANGE_GAP bytes are merged into single region.
+ */
+#define EBLOB_READ_RANGE_READAHEAD		32
+#define EBLOB_READ_RANGE_READAHEAD_SIZE		(1024 * 1024)
+#define EBLOB_READ_RANGE_GAP			4096
+
+/*
+ * Disk control is immediately followed by record data, which starts with
+ * extension header for BLOB_DISK_CTL_EXTHDR records, so both are read at once.
+ * Record removed after range iterator has collected it is reported as -ENOENT.
+ */
+struct blob_range_record_hdr {
+	struct eblob_disk_control	dc;
+	struct dnet_ext_list_hdr	ehdr;
+} __attribute__ ((packed));
+
+static int blob_range_record_hdr_read(struct eblob_range_request *req, struct blob_range_record_hdr *hdr)
+{
+	ssize_t err;
+
+	if (req->record_offset < sizeof(struct eblob_disk_control))
+		return -EINVAL;
+
+	err = pread(req->record_fd, hdr, sizeof(struct blob_range_record_hdr),
+			req->record_offset - sizeof(struct eblob_disk_control));
+	if (err < (ssize_t)sizeof(struct eblob_disk_control))
+		return (err == -1) ? -errno : -EINTR;
+
+	eblob_convert_disk_control(&hdr->dc);
+
+	if (hdr->dc.flags & BLOB_DISK_CTL_REMOVE)
+		return -ENOENT;
+
+	if ((hdr->dc.flags & BLOB_DISK_CTL_EXTHDR) && (err != sizeof(struct blob_range_record_hdr)))
+		return -EINTR;
+
+	return 0;
+}
+
 static int blob_read_range_callback(struct eblob_range_request *req)
 {
 	struct eblob_read_range_priv *p = req->priv;
@@ -431,27 +489,26 @@ static int blob_read_range_callback(struct eblob_range_request *req)
 	}
 
 	if (!(p->flags & DNET_IO_FLAGS_NODATA)) {
-		struct eblob_write_control wc;
+		struct blob_range_record_hdr hdr;
 
-		io.flags = 0;
+		memset(&io, 0, sizeof(io));
 		io.size = req->record_size - req->requested_offset;
 		io.offset = req->requested_offset;
 
-		/* FIXME: This is slow! */
-		err = eblob_read_return(req->back, (struct eblob_key *)req->record_key,
-				EBLOB_READ_NOCSUM, &wc);
+		err = blob_range_record_hdr_read(req, &hdr);
+		if (err == -ENOENT) {
+			dnet_backend_log(DNET_LOG_DEBUG, "%s: EBLOB: blob-read-range: record was removed, skipping\n",
+					dnet_dump_id_str(req->record_key));
+			err = 0;
+			goto err_out_exit;
+		}
 		if (err)
 			goto err_out_exit;
 
-		if (wc.flags & BLOB_DISK_CTL_EXTHDR) {
-			struct dnet_ext_list_hdr ehdr;
+		if (hdr.dc.flags & BLOB_DISK_CTL_EXTHDR) {
 			struct dnet_ext_list elist;
 
-			err = dnet_ext_hdr_read(&ehdr, req->record_fd, req->record_offset);
-			if (err != 0)
-				goto err_out_exit;
-
-			dnet_ext_hdr_to_list(&ehdr, &elist);
+			dnet_ext_hdr_to_list(&hdr.ehdr, &elist);
 			dnet_ext_list_to_io(&elist, &io);
 
 			io.offset += sizeof(struct dnet_ext_list_hdr);
@@ -474,6 +531,44 @@ err_out_exit:
 	return err;
 }
 
+/*
+ * Asks kernel to read records [pos, end) in background, adjacent records
+ * of the same blob are hinted as single region
+ */
+static void blob_read_range_readahead(struct eblob_range_request *keys, uint64_t pos, uint64_t end)
+{
+	uint64_t start = 0, stop = 0;
+	int fd = -1;
+
+	for (; pos < end; ++pos) {
+		struct eblob_range_request *r = &keys[pos];
+		uint64_t rstart, rstop;
+
+		if (r->record_offset < sizeof(struct eblob_disk_control))
+			continue;
+
+		rstart = r->record_offset - sizeof(struct eblob_disk_control);
+		rstop = r->record_offset + (r->record_size < EBLOB_READ_RANGE_READAHEAD_SIZE ?
+				r->record_size : EBLOB_READ_RANGE_READAHEAD_SIZE);
+
+		if (fd == r->record_fd && rstart >= start && rstart <= stop + EBLOB_READ_RANGE_GAP) {
+			if (rstop > stop)
+				stop = rstop;
+			continue;
+		}
+
+		if (fd >= 0)
+			posix_fadvise(fd, start, stop - start, POSIX_FADV_WILLNEED);
+
+		fd = r->record_fd;
+		start = rstart;
+		stop = rstop;
+	}
+
+	if (fd >= 0)
+		posix_fadvise(fd, start, stop - start, POSIX_FADV_WILLNEED);
+}
+
 static int blob_del_range_callback(struct eblob_range_request *req)
 {
 	struct eblob_key key;
@@ -546,7 +641,7 @@ static int blob_read_range(struct eblob_backend_config *c, void *state, struct d
 	struct dnet_io_attr *io = data;
 	struct eblob_backend *b = c->eblob;
 	struct eblob_range_request req;
-	uint64_t i, start_from = 0;
+	uint64_t i, start_from = 0, end = 0, ra_pos;
 	int err;
 
 	memset(&p, 0, sizeof(p));
@@ -587,13 +682,32 @@ static int blob_read_range(struct eblob_backend_config *c, void *state, struct d
 
 	if (cmd->cmd == DNET_CMD_READ_RANGE) {
 		start_from = io->start;
+
+		end = p.keys_cnt;
+		if ((io->num > 0) && (io->num + start_from < end))
+			end = io->num + start_from;
 	}
 
+	ra_pos = start_from;
+
 	for (i = start_from; i < p.keys_cnt; ++i) {
 		switch(cmd->cmd) {
 			case DNET_CMD_READ_RANGE:
 				if ((io->num > 0) && (i >= (io->num + start_from)))
 					break;
+
+				/* hint the next window when half of the previous one is sent */
+				if (!(p.flags & DNET_IO_FLAGS_NODATA) && ra_pos < end &&
+						ra_pos <= i + EBLOB_READ_RANGE_READAHEAD / 2) {
+					uint64_t ra_end = i + EBLOB_READ_RANGE_READAHEAD;
+
+					if (ra_end > end)
+						ra_end = end;
+
+					blob_read_range_readahead(p.keys, ra_pos, ra_end);
+					ra_pos = ra_end;
+				}
+
 				dnet_backend_log(DNET_LOG_DEBUG, "%s: EBLOB: blob-read-range: READ\n",
 						dnet_dump_id_str(p.keys[i].record_key));
 				err = blob_read_range_callback(&p.keys[i]);
@@ -761,6 +875,25 @@ err_out_exit:
 	return err;
 }
 
+static int eblob_backend_location(void *priv, const unsigned char *id, int *fd, uint64_t *offset, uint64_t *size)
+{
+	struct eblob_backend_config *c = priv;
+	struct eblob_write_control wc;
+	struct eblob_key key;
+	int err;
+
+	memcpy(key.id, id, EBLOB_ID_SIZE);
+	err = eblob_read_return(c->eblob, &key, EBLOB_READ_NOCSUM, &wc);
+	if (err < 0)
+		return err;
+
+	*fd = wc.data_fd;
+	*offset = wc.data_offset;
+	*size = wc.total_data_size;
+
+	return 0;
+}
+
 static int blob_start_defrag(struct eblob_backend_config *c, struct dnet_cmd *cmd, void *data)
 {
 	struct dnet_defrag_ctl *ctl = data;
@@ -976,6 +1109,25 @@ static int dnet_blob_set_blob_flags(struct dnet_config_backend *b, char *key __u
 	return 0;
 }
 
+static void eblob_read_pattern_stat(struct eblob_backend_config *c, struct dnet_stat *st)
+{
+	int i;
+
+	st->read_random = c->read_random;
+	st->read_random_hot = c->read_random_hot;
+
+	for (i = 0; i < EBLOB_READ_PATTERN_SIZE; ++i) {
+		struct eblob_read_pattern *p = &c->read_patterns[i];
+
+		if (p->fd <= 0)
+			continue;
+
+		st->blob_tracked++;
+		if (p->score < 0)
+			st->blob_random++;
+	}
+}
+
 int eblob_backend_storage_stat(void *priv, struct dnet_stat *st)
 {
 	int err;
@@ -998,6 +1150,8 @@ int eblob_backend_storage_stat(void *priv, struct dnet_stat *st)
 			return err;
 	}
 
+	eblob_read_pattern_stat(r, st);
+
 	return 0;
 }
 
@@ -1007,7 +1161,6 @@ static void eblob_backend_cleanup(void *priv)
 
 	eblob_cleanup(c->eblob);
 
-	pthread_mutex_destroy(&c->last_read_lock);
 	free(c->data.file);
 }
 
@@ -1031,24 +1184,17 @@ static int dnet_blob_config_init(struct dnet_config_backend *b, struct dnet_conf
 
 	c->data.log = (struct eblob_log *)b->log;
 
-	err = pthread_mutex_init(&c->last_read_lock, NULL);
-	if (err) {
-		err = -err;
-		dnet_backend_log(DNET_LOG_ERROR, "blob: could not create last-read lock: %d.\n", err);
-		goto err_out_exit;
-	}
-
 	memset(&st, 0, sizeof(struct dnet_stat));
 	err = eblob_backend_storage_stat(c, &st);
 	if (err)
-		goto err_out_last_read_lock_destroy;
+		goto err_out_exit;
 
-	c->vm_total = st.vm_total * st.vm_total * 1024 * 1024;
+	c->random_distance = st.vm_total * 1024 / 4;
 
 	c->eblob = eblob_init(&c->data);
 	if (!c->eblob) {
 		err = -EINVAL;
-		goto err_out_last_read_lock_destroy;
+		goto err_out_exit;
 	}
 
 	cfg->cb = &b->cb;
@@ -1060,13 +1206,12 @@ static int dnet_blob_config_init(struct dnet_config_backend *b, struct dnet_conf
 	b->cb.command_handler = eblob_backend_command_handler;
 	b->cb.backend_cleanup = eblob_backend_cleanup;
 	b->cb.checksum = eblob_backend_checksum;
+	b->cb.location = eblob_backend_location;
 
 	b->cb.iterator = dnet_eblob_iterator;
 
 	return 0;
 
-err_out_last_read_lock_destroy:
-	pthread_mutex_destroy(&c->last_read_lock);
 err_out_exit:
 	return err;
 }
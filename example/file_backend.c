@@ -25,6 +25,7 @@
 #include <dirent.h>
 #include <fcntl.h>
 #include <limits.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -36,6 +37,8 @@
 #include "elliptics/backends.h"
 
 #include "common.h"
+#include "file_uring.h"
+#include "../library/list.h"
 
 #ifndef __unused
 #define __unused	__attribute__ ((unused))
@@ -56,6 +59,53 @@ struct file_backend_root
 
 	struct eblob_log	log;
 	struct eblob_backend	*meta;
+
+	/* cache of open object files, disabled when fd_cache_size is zero */
+	pthread_mutex_t		fd_lock;
+	int			fd_cache_size;
+	int			fd_num;
+	unsigned int		fd_hash_size;
+	struct hlist_head	*fd_hash;
+	struct list_head	fd_lru;
+
+	/* io_uring engine, blocking io is used when it is not initialized */
+	int			io_uring_depth;
+	struct file_uring	*uring;
+};
+
+/*
+ * Requests larger than this are processed by blocking io: reads are sent with
+ * sendfile() without copying, and large write payload is not duplicated
+ */
+#define FILE_BACKEND_URING_MAX_SIZE	(1024 * 1024)
+
+/*
+ * Open object file. Cached entries hold one reference in the cache,
+ * descriptor is closed when the last reference is dropped.
+ */
+struct file_backend_fd
+{
+	struct file_backend_root	*root;
+	struct hlist_node	hash_entry;
+	struct list_head	lru_entry;
+	unsigned char		id[DNET_ID_SIZE];
+	int			fd;
+	int			slot;
+	int			refcnt;
+};
+
+/*
+ * Request submitted to io_uring engine, @data is read into or written from
+ */
+struct file_backend_aio
+{
+	struct file_uring_req	req;
+	struct file_backend_root	*root;
+	struct file_backend_fd	*f;
+	struct dnet_async_reply	*reply;
+	struct dnet_io_attr	io;
+	struct dnet_ext_list_hdr	ehdr;
+	char			data[0];
 };
 
 static inline void file_backend_setup_file(struct file_backend_root *r, char *file,
@@ -115,60 +165,449 @@ static void dnet_remove_file_local(struct file_backend_root *r, struct dnet_io_a
 	remove(file);
 }
 
-static int file_write_raw(struct file_backend_root *r, struct dnet_io_attr *io)
+static struct hlist_head *file_backend_fd_bucket(struct file_backend_root *r, const unsigned char *id)
+{
+	uint64_t h;
+
+	memcpy(&h, id, sizeof(h));
+	return &r->fd_hash[h & (r->fd_hash_size - 1)];
+}
+
+static struct file_backend_fd *file_backend_fd_search_nolock(struct file_backend_root *r, const unsigned char *id)
+{
+	struct file_backend_fd *f;
+	struct hlist_node *pos;
+
+	hlist_for_each_entry(f, pos, file_backend_fd_bucket(r, id), hash_entry) {
+		if (!memcmp(f->id, id, DNET_ID_SIZE))
+			return f;
+	}
+
+	return NULL;
+}
+
+/*
+ * Unregistering descriptor from io_uring may wait for requests in flight,
+ * whose completions take fd_lock, so entries are freed without it
+ */
+static void file_backend_fd_free(struct file_backend_root *r, struct file_backend_fd *f)
+{
+	if (f->slot >= 0 && r->uring)
+		file_uring_slot_put(r->uring, f->slot);
+
+	close(f->fd);
+	free(f);
+}
+
+static void file_backend_fd_free_list(struct file_backend_root *r, struct list_head *head)
+{
+	struct file_backend_fd *f, *tmp;
+
+	list_for_each_entry_safe(f, tmp, head, lru_entry)
+		file_backend_fd_free(r, f);
+}
+
+/* entry is moved to @dead list when the last reference is dropped */
+static void file_backend_fd_put_nolock(struct file_backend_fd *f, struct list_head *dead)
+{
+	if (--f->refcnt == 0)
+		list_add_tail(&f->lru_entry, dead);
+}
+
+static void file_backend_fd_put(struct file_backend_root *r, struct file_backend_fd *f)
+{
+	LIST_HEAD(dead);
+
+	pthread_mutex_lock(&r->fd_lock);
+	file_backend_fd_put_nolock(f, &dead);
+	pthread_mutex_unlock(&r->fd_lock);
+
+	file_backend_fd_free_list(r, &dead);
+}
+
+static void file_backend_fd_unlink_nolock(struct file_backend_root *r, struct file_backend_fd *f,
+		struct list_head *dead)
+{
+	hlist_del(&f->hash_entry);
+	list_del_init(&f->lru_entry);
+	r->fd_num--;
+
+	file_backend_fd_put_nolock(f, dead);
+}
+
+/*
+ * Drops cached descriptor of the object, must be called before its file is removed
+ */
+static void file_backend_fd_forget(struct file_backend_root *r, const unsigned char *id)
+{
+	struct file_backend_fd *f;
+	LIST_HEAD(dead);
+
+	if (!r->fd_cache_size)
+		return;
+
+	pthread_mutex_lock(&r->fd_lock);
+	f = file_backend_fd_search_nolock(r, id);
+	if (f)
+		file_backend_fd_unlink_nolock(r, f, &dead);
+	pthread_mutex_unlock(&r->fd_lock);
+
+	file_backend_fd_free_list(r, &dead);
+}
+
+static int file_backend_fd_open(struct file_backend_root *r, const unsigned char *id, int oflags)
 {
 	/* null byte + maximum directory length (32 bits in hex) + '/' directory prefix */
 	char file[DNET_ID_SIZE * 2 + 8 + 8 + 2];
-	int oflags = O_RDWR | O_CREAT | O_LARGEFILE | O_CLOEXEC;
-	void *data = io + 1;
-	int fd;
-	ssize_t err;
+	char dir[2*DNET_ID_SIZE+1];
+	int create = oflags & O_CREAT;
+	int fd, err;
 
-	file_backend_setup_file(r, file, sizeof(file), io->id);
+	file_backend_setup_file(r, file, sizeof(file), id);
+
+	oflags |= O_RDWR | O_LARGEFILE | O_CLOEXEC;
 
-	if (io->flags & DNET_IO_FLAGS_APPEND)
-		oflags |= O_APPEND;
-	else if (!io->offset)
-		oflags |= O_TRUNC;
-	
 	fd = open(file, oflags, 0644);
+
+	/* directory is only created when the first object in it is written */
+	if (fd < 0 && errno == ENOENT && create) {
+		file_backend_get_dir(id, r->bit_num, dir);
+
+		err = mkdir(dir, 0755);
+		if (err < 0 && errno != EEXIST) {
+			err = -errno;
+			dnet_backend_log(DNET_LOG_ERROR, "%s: FILE: %s: dir-create: %d: %s.\n",
+					dnet_dump_id_str(id), dir, err, strerror(-err));
+			return err;
+		}
+
+		fd = open(file, oflags, 0644);
+	}
+
+	if (fd < 0 && (errno == EROFS || errno == EACCES) && !create)
+		fd = open(file, O_RDONLY | O_LARGEFILE | O_CLOEXEC);
+
 	if (fd < 0) {
 		err = -errno;
-		dnet_backend_log(DNET_LOG_ERROR, "%s: FILE: %s: OPEN: %zd: %s.\n",
-				dnet_dump_id_str(io->id), file, err, strerror(-err));
-		goto err_out_exit;
+		dnet_backend_log(DNET_LOG_ERROR, "%s: FILE: %s: OPEN: %d: %s.\n",
+				dnet_dump_id_str(id), file, err, strerror(-err));
+		return err;
 	}
 
+	return fd;
+}
+
+/*
+ * Returns referenced descriptor of the object file opened with additional @oflags.
+ * Only O_CREAT is allowed for cached descriptors, others bypass the cache.
+ */
+static struct file_backend_fd *file_backend_fd_get(struct file_backend_root *r, const unsigned char *id,
+		int oflags, int *errp)
+{
+	struct file_backend_fd *f, *tmp;
+	int cache = r->fd_cache_size && !(oflags & ~O_CREAT);
+	LIST_HEAD(dead);
+	int fd, slot;
+
+	if (cache) {
+		pthread_mutex_lock(&r->fd_lock);
+		f = file_backend_fd_search_nolock(r, id);
+		if (f) {
+			f->refcnt++;
+			list_move_tail(&f->lru_entry, &r->fd_lru);
+			pthread_mutex_unlock(&r->fd_lock);
+			return f;
+		}
+		pthread_mutex_unlock(&r->fd_lock);
+	}
+
+	fd = file_backend_fd_open(r, id, oflags);
+	if (fd < 0) {
+		*errp = fd;
+		return NULL;
+	}
+
+	f = malloc(sizeof(struct file_backend_fd));
+	if (!f) {
+		close(fd);
+		*errp = -ENOMEM;
+		return NULL;
+	}
+
+	f->root = r;
+	INIT_HLIST_NODE(&f->hash_entry);
+	INIT_LIST_HEAD(&f->lru_entry);
+	memcpy(f->id, id, DNET_ID_SIZE);
+	f->fd = fd;
+	f->slot = -1;
+	f->refcnt = 1;
+
+	if (!cache)
+		return f;
+
+	pthread_mutex_lock(&r->fd_lock);
+	tmp = file_backend_fd_search_nolock(r, id);
+	if (tmp) {
+		/* another thread has opened this file in parallel */
+		tmp->refcnt++;
+		list_move_tail(&tmp->lru_entry, &r->fd_lru);
+		pthread_mutex_unlock(&r->fd_lock);
+
+		close(f->fd);
+		free(f);
+		return tmp;
+	}
+
+	while (r->fd_num >= r->fd_cache_size) {
+		tmp = list_first_entry(&r->fd_lru, struct file_backend_fd, lru_entry);
+		file_backend_fd_unlink_nolock(r, tmp, &dead);
+	}
+
+	f->refcnt++;
+	hlist_add_head(&f->hash_entry, file_backend_fd_bucket(r, id));
+	list_add_tail(&f->lru_entry, &r->fd_lru);
+	r->fd_num++;
+	pthread_mutex_unlock(&r->fd_lock);
+
+	file_backend_fd_free_list(r, &dead);
+
+	/* cached descriptor is registered in io_uring, until then requests use it directly */
+	if (r->uring) {
+		slot = file_uring_slot_get(r->uring, fd);
+		if (slot >= 0) {
+			pthread_mutex_lock(&r->fd_lock);
+			f->slot = slot;
+			pthread_mutex_unlock(&r->fd_lock);
+		}
+	}
+
+	return f;
+}
+
+/* callback of the send queue, it drops reference held by read reply */
+static void file_backend_fd_release(void *priv)
+{
+	struct file_backend_fd *f = priv;
+
+	file_backend_fd_put(f->root, f);
+}
+
+static int file_backend_fd_init(struct file_backend_root *r)
+{
+	unsigned int i;
+	int err;
+
+	INIT_LIST_HEAD(&r->fd_lru);
+
+	err = pthread_mutex_init(&r->fd_lock, NULL);
+	if (err)
+		return -err;
+
+	if (r->fd_cache_size < 0)
+		r->fd_cache_size = 0;
+	if (!r->fd_cache_size)
+		return 0;
+
+	for (r->fd_hash_size = 1; r->fd_hash_size < (unsigned int)r->fd_cache_size; r->fd_hash_size <<= 1)
+		;
+
+	r->fd_hash = malloc(r->fd_hash_size * sizeof(struct hlist_head));
+	if (!r->fd_hash) {
+		pthread_mutex_destroy(&r->fd_lock);
+		return -ENOMEM;
+	}
+
+	for (i = 0; i < r->fd_hash_size; ++i)
+		INIT_HLIST_HEAD(&r->fd_hash[i]);
+
+	return 0;
+}
+
+static void file_backend_fd_cleanup(struct file_backend_root *r)
+{
+	struct file_backend_fd *f, *tmp;
+	LIST_HEAD(dead);
+
+	pthread_mutex_lock(&r->fd_lock);
+	list_for_each_entry_safe(f, tmp, &r->fd_lru, lru_entry)
+		file_backend_fd_unlink_nolock(r, f, &dead);
+	pthread_mutex_unlock(&r->fd_lock);
+
+	file_backend_fd_free_list(r, &dead);
+
+	pthread_mutex_destroy(&r->fd_lock);
+	free(r->fd_hash);
+	r->fd_hash = NULL;
+}
+
+/*
+ * Append descriptor is opened with O_APPEND, so the kernel atomically places data
+ * at the end of file and offset is ignored. Cached descriptor has no O_TRUNC.
+ */
+static int file_write_truncate(struct dnet_io_attr *io, int fd)
+{
+	int err;
+
+	if (!(io->flags & DNET_IO_FLAGS_APPEND) && !io->offset) {
+		err = ftruncate(fd, 0);
+		if (err) {
+			err = -errno;
+			dnet_backend_log(DNET_LOG_ERROR, "%s: FILE: TRUNCATE: %d: %s.\n",
+					dnet_dump_id_str(io->id), err, strerror(-err));
+			return err;
+		}
+	}
+
+	return 0;
+}
+
+static int file_write_raw(struct file_backend_root *r, struct dnet_io_attr *io, int fd)
+{
+	void *data = io + 1;
+	ssize_t err;
+
+	err = file_write_truncate(io, fd);
+	if (err)
+		goto err_out_exit;
+
 	err = pwrite(fd, data, io->size, io->offset);
 	if (err != (ssize_t)io->size) {
 		err = -errno;
-		dnet_backend_log(DNET_LOG_ERROR, "%s: FILE: %s: WRITE: %zd: offset: %llu, size: %llu: %s.\n",
-			dnet_dump_id_str(io->id), file, err,
+		dnet_backend_log(DNET_LOG_ERROR, "%s: FILE: WRITE: %zd: offset: %llu, size: %llu: %s.\n",
+			dnet_dump_id_str(io->id), err,
 			(unsigned long long)io->offset, (unsigned long long)io->size,
 			strerror(-err));
-		goto err_out_close;
+		goto err_out_exit;
 	}
 
 	if (!r->sync)
 		fsync(fd);
 
-	return fd;
+	return 0;
 
-err_out_close:
-	dnet_remove_file_if_empty_raw(file);
-	close(fd);
 err_out_exit:
 	return err;
 }
 
+/*
+ * Updates metadata and sends reply once data is written, @err is the result of data write.
+ * Drops reference to @f.
+ */
+static int file_write_finish(struct file_backend_root *r, void *state, struct dnet_cmd *cmd,
+		struct dnet_io_attr *io, struct file_backend_fd *f, struct dnet_ext_list_hdr *ehdr, int err)
+{
+	struct eblob_key key;
+	static const size_t ehdr_size = sizeof(struct dnet_ext_list_hdr);
+
+	if (err < 0)
+		goto err_out_check_remove;
+
+	memcpy(key.id, io->id, EBLOB_ID_SIZE);
+
+	err = eblob_write(r->meta, &key, ehdr, 0, ehdr_size, 0);
+
+	if (err) {
+		dnet_backend_log(DNET_LOG_ERROR, "%s: FILE: META WRITE: %d: %s.\n",
+				dnet_dump_id(&cmd->id), err, strerror(-err));
+		goto err_out_remove;
+	}
+
+	dnet_backend_log(DNET_LOG_INFO, "%s: FILE: WRITE: Ok: offset: %llu, size: %llu.\n",
+			dnet_dump_id(&cmd->id), (unsigned long long)io->offset, (unsigned long long)io->size);
+
+	if (io->flags & DNET_IO_FLAGS_WRITE_NO_FILE_INFO) {
+		cmd->flags |= DNET_FLAGS_NEED_ACK;
+		err = 0;
+		goto err_out_put;
+	}
+
+	err = dnet_send_file_info(state, cmd, f->fd, 0, -1);
+	goto err_out_put;
+
+err_out_check_remove:
+	file_backend_fd_forget(r, io->id);
+	dnet_remove_file_if_empty(r, io);
+	goto err_out_put;
+err_out_remove:
+	file_backend_fd_forget(r, io->id);
+	dnet_remove_file_local(r, io);
+err_out_put:
+	file_backend_fd_put(r, f);
+	return err;
+}
+
+static void file_write_complete(struct file_uring_req *req, int res)
+{
+	struct file_backend_aio *aio = container_of(req, struct file_backend_aio, req);
+	struct dnet_io_attr *io = &aio->io;
+	int err = 0;
+
+	if (res != (int)io->size) {
+		err = (res < 0) ? res : -EIO;
+		dnet_backend_log(DNET_LOG_ERROR, "%s: FILE: WRITE: %d: offset: %llu, size: %llu: %s.\n",
+			dnet_dump_id_str(io->id), res,
+			(unsigned long long)io->offset, (unsigned long long)io->size,
+			strerror(-err));
+	}
+
+	err = file_write_finish(aio->root, dnet_async_reply_state(aio->reply), dnet_async_reply_cmd(aio->reply),
+			io, aio->f, &aio->ehdr, err);
+
+	dnet_async_reply_complete(aio->reply, err);
+	free(aio);
+}
+
+/*
+ * Payload is copied, since request buffer is freed when command handler returns.
+ * Reply is always completed, even if write could not be submitted.
+ */
+static void file_write_async(struct file_backend_root *r, struct dnet_async_reply *reply,
+		struct dnet_io_attr *io, struct file_backend_fd *f, struct dnet_ext_list_hdr *ehdr)
+{
+	struct file_backend_aio *aio;
+	int err;
+
+	aio = malloc(sizeof(struct file_backend_aio) + io->size);
+	if (!aio) {
+		err = -ENOMEM;
+		goto err_out_finish;
+	}
+
+	aio->req.complete = file_write_complete;
+	aio->root = r;
+	aio->f = f;
+	aio->reply = reply;
+	memcpy(&aio->io, io, sizeof(struct dnet_io_attr));
+	memcpy(&aio->ehdr, ehdr, sizeof(struct dnet_ext_list_hdr));
+	memcpy(aio->data, io + 1, io->size);
+
+	err = file_write_truncate(io, f->fd);
+	if (err)
+		goto err_out_free;
+
+	err = file_uring_write(r->uring, &aio->req, f->fd, f->slot, aio->data, io->size, io->offset, !r->sync);
+	if (err) {
+		dnet_backend_log(DNET_LOG_ERROR, "%s: FILE: WRITE-SUBMIT: %d: %s.\n",
+				dnet_dump_id_str(io->id), err, strerror(-err));
+		goto err_out_free;
+	}
+
+	return;
+
+err_out_free:
+	free(aio);
+err_out_finish:
+	err = file_write_finish(r, dnet_async_reply_state(reply), dnet_async_reply_cmd(reply), io, f, ehdr, err);
+	dnet_async_reply_complete(reply, err);
+}
+
 static int file_write(struct file_backend_root *r, void *state __unused, struct dnet_cmd *cmd, void *data)
 {
-	int err, fd;
-	char dir[2*DNET_ID_SIZE+1];
+	int err;
 	struct dnet_io_attr *io = data;
-	struct eblob_key key;
+	struct file_backend_fd *f;
+	struct dnet_async_reply *reply;
 	struct dnet_ext_list elist;
-	static const size_t ehdr_size = sizeof(struct dnet_ext_list_hdr);
 	struct dnet_ext_list_hdr ehdr;
 
 	dnet_convert_io_attr(io);
@@ -176,113 +615,148 @@ static int file_write(struct file_backend_root *r, void *state __unused, struct
 	dnet_ext_list_init(&elist);
 	dnet_ext_io_to_list(io, &elist);
 
-	memcpy(key.id, io->id, EBLOB_ID_SIZE);
-	
-	data += sizeof(struct dnet_io_attr);
+	/* Copy data from elist to ehdr */
+	dnet_ext_list_to_hdr(&elist, &ehdr);
 
-	file_backend_get_dir(io->id, r->bit_num, dir);
+	f = file_backend_fd_get(r, io->id, O_CREAT | ((io->flags & DNET_IO_FLAGS_APPEND) ? O_APPEND : 0), &err);
+	if (!f)
+		goto err_out_exit;
 
-	err = mkdir(dir, 0755);
-	if (err < 0) {
-		if (errno != EEXIST) {
-			err = -errno;
-			dnet_backend_log(DNET_LOG_ERROR, "%s: FILE: %s: dir-create: %d: %s.\n",
-					dnet_dump_id(&cmd->id), dir, err, strerror(-err));
+	if (r->uring && io->size <= FILE_BACKEND_URING_MAX_SIZE) {
+		reply = dnet_async_reply_start(state, cmd);
+		if (reply) {
+			file_write_async(r, reply, io, f, &ehdr);
+			err = 0;
 			goto err_out_exit;
 		}
 	}
 
-	err = file_write_raw(r, io);
-	if (err < 0)
-		goto err_out_check_remove;
+	err = file_write_raw(r, io, f->fd);
+	err = file_write_finish(r, state, cmd, io, f, &ehdr, err);
 
-	fd = err;
+err_out_exit:
+	dnet_ext_list_destroy(&elist);
+	return err;
+}
 
-	/* Copy data from elist to ehdr */
-	dnet_ext_list_to_hdr(&elist, &ehdr);
+static void file_read_release(void *priv)
+{
+	free(priv);
+}
 
-	err = eblob_write(r->meta, &key, &ehdr, 0, ehdr_size, 0);
+static void file_read_complete(struct file_uring_req *req, int res)
+{
+	struct file_backend_aio *aio = container_of(req, struct file_backend_aio, req);
+	struct dnet_async_reply *reply = aio->reply;
+	struct dnet_io_attr *io = &aio->io;
+	int err;
 
-	if (err) {
-		dnet_backend_log(DNET_LOG_ERROR, "%s: FILE: %s: META WRITE: %d: %s.\n",
-				dnet_dump_id(&cmd->id), dir, err, strerror(-err));
-		goto err_out_remove;
+	file_backend_fd_put(aio->root, aio->f);
+
+	if (res != (int)io->size) {
+		err = (res < 0) ? res : -EIO;
+		dnet_backend_log(DNET_LOG_ERROR, "%s: FILE: READ: %d: offset: %llu, size: %llu: %s.\n",
+			dnet_dump_id_str(io->id), res,
+			(unsigned long long)io->offset, (unsigned long long)io->size,
+			strerror(-err));
+		free(aio);
+		goto err_out_complete;
 	}
 
-	dnet_backend_log(DNET_LOG_INFO, "%s: FILE: %s: WRITE: Ok: offset: %llu, size: %llu.\n",
-			dnet_dump_id(&cmd->id), dir, (unsigned long long)io->offset, (unsigned long long)io->size);
+	/* buffer is freed when data is sent */
+	err = dnet_send_read_data_ref(dnet_async_reply_state(reply), dnet_async_reply_cmd(reply), io,
+			aio->data, file_read_release, aio);
 
-	if (io->flags & DNET_IO_FLAGS_WRITE_NO_FILE_INFO) {
-		cmd->flags |= DNET_FLAGS_NEED_ACK;
-		err = 0;
-		goto err_out_close;
+err_out_complete:
+	dnet_async_reply_complete(reply, err);
+}
+
+static void file_read_async(struct file_backend_root *r, struct dnet_async_reply *reply,
+		struct dnet_io_attr *io, struct file_backend_fd *f)
+{
+	struct file_backend_aio *aio;
+	int err;
+
+	aio = malloc(sizeof(struct file_backend_aio) + io->size);
+	if (!aio) {
+		err = -ENOMEM;
+		goto err_out_put;
 	}
 
-	err = dnet_send_file_info(state, cmd, fd, 0, -1);
-	if (err)
-		goto err_out_close;
+	aio->req.complete = file_read_complete;
+	aio->root = r;
+	aio->f = f;
+	aio->reply = reply;
+	memcpy(&aio->io, io, sizeof(struct dnet_io_attr));
 
-	close(fd);
+	err = file_uring_read(r->uring, &aio->req, f->fd, f->slot, aio->data, io->size, io->offset);
+	if (err) {
+		dnet_backend_log(DNET_LOG_ERROR, "%s: FILE: READ-SUBMIT: %d: %s.\n",
+				dnet_dump_id_str(io->id), err, strerror(-err));
+		goto err_out_free;
+	}
 
-	return 0;
+	return;
 
-err_out_remove:
-	dnet_remove_file_local(r, io);
-err_out_close:
-	close(fd);
-err_out_check_remove:
-	dnet_remove_file_if_empty(r, io);
-err_out_exit:
-	dnet_ext_list_destroy(&elist);
-	return err;
+err_out_free:
+	free(aio);
+err_out_put:
+	file_backend_fd_put(r, f);
+	dnet_async_reply_complete(reply, err);
 }
 
-static int file_read(struct file_backend_root *r, void *state, struct dnet_cmd *cmd, void *data)
+/*
+ * Reads of a single key may complete asynchronously,
+ * replies of bulk reads are sent before handler returns
+ */
+static int file_read(struct file_backend_root *r, void *state, struct dnet_cmd *cmd, void *data, int async)
 {
 	struct dnet_io_attr *io = data;
-	int fd, err;
+	struct dnet_async_reply *reply;
+	struct file_backend_fd *f;
+	int err;
 	ssize_t size;
-	char file[DNET_ID_SIZE * 2 + 8 + 8 + 2];
 	struct stat st;
 
 	data += sizeof(struct dnet_io_attr);
 
 	dnet_convert_io_attr(io);
 
-	file_backend_setup_file(r, file, sizeof(file), io->id);
-
-	fd = open(file, O_RDONLY | O_CLOEXEC, 0644);
-	if (fd < 0) {
-		err = -errno;
-		dnet_backend_log(DNET_LOG_ERROR, "%s: FILE: %s: READ: %d: %s.\n",
-				dnet_dump_id(&cmd->id), file, err, strerror(-err));
+	f = file_backend_fd_get(r, io->id, 0, &err);
+	if (!f)
 		goto err_out_exit;
-	}
 
 	size = io->size;
 
-	err = fstat(fd, &st);
+	err = fstat(f->fd, &st);
 	if (err) {
 		err = -errno;
-		dnet_backend_log(DNET_LOG_ERROR, "%s: FILE: %s: read-stat: %d: %s.\n",
-				dnet_dump_id(&cmd->id), file, err, strerror(-err));
-		goto err_out_close_fd;
+		dnet_backend_log(DNET_LOG_ERROR, "%s: FILE: read-stat: %d: %s.\n",
+				dnet_dump_id(&cmd->id), err, strerror(-err));
+		goto err_out_put;
 	}
 
 	size = dnet_backend_check_get_size(io, st.st_size);
 	if (size <= 0) {
 		err = size;
-		goto err_out_close_fd;
+		goto err_out_put;
 	}
 
 	io->size = size;
-	err = dnet_send_read_data(state, cmd, io, NULL, fd, io->offset, 1);
-	if (err)
-		goto err_out_close_fd;
-	return 0;
 
-err_out_close_fd:
-	close(fd);
+	if (async && r->uring && io->size <= FILE_BACKEND_URING_MAX_SIZE) {
+		reply = dnet_async_reply_start(state, cmd);
+		if (reply) {
+			file_read_async(r, reply, io, f);
+			return 0;
+		}
+	}
+
+	/* reference is dropped when data is sent or sending fails */
+	return dnet_send_read_fd_ref(state, cmd, io, f->fd, io->offset, file_backend_fd_release, f);
+
+err_out_put:
+	file_backend_fd_put(r, f);
 err_out_exit:
 	return err;
 }
@@ -299,6 +773,8 @@ static int file_del(struct file_backend_root *r, void *state __unused, struct dn
 
 	snprintf(file, sizeof(file), "%s/%s",
 		dir, dnet_dump_id_len_raw(cmd->id.id, DNET_ID_SIZE, id));
+
+	file_backend_fd_forget(r, cmd->id.id);
 	remove(file);
 
 	eblob_remove(r->meta, &key);
@@ -382,7 +858,7 @@ static int file_bulk_read(struct file_backend_root *r, void *state, struct dnet_
 	count = io->size / sizeof(struct dnet_io_attr);
 
 	for (i = 0; i < count; i++) {
-		ret = file_read(r, state, cmd, &ios[i]);
+		ret = file_read(r, state, cmd, &ios[i], 0);
 		if (!ret)
 			err = 0;
 		else if (err == -1)
@@ -404,7 +880,7 @@ static int file_backend_command_handler(void *state, void *priv, struct dnet_cmd
 			err = file_write(r, state, cmd, data);
 			break;
 		case DNET_CMD_READ:
-			err = file_read(r, state, cmd, data);
+			err = file_read(r, state, cmd, data, 1);
 			break;
 		case DNET_CMD_STAT:
 			err = backend_stat(state, r->root, cmd);
@@ -484,6 +960,22 @@ static int dnet_file_set_sync(struct dnet_config_backend *b, char *key __unused,
 	return 0;
 }
 
+static int dnet_file_set_fd_cache_size(struct dnet_config_backend *b, char *key __unused, char *value)
+{
+	struct file_backend_root *r = b->data;
+
+	r->fd_cache_size = atoi(value);
+	return 0;
+}
+
+static int dnet_file_set_io_uring_depth(struct dnet_config_backend *b, char *key __unused, char *value)
+{
+	struct file_backend_root *r = b->data;
+
+	r->io_uring_depth = atoi(value);
+	return 0;
+}
+
 static int dnet_file_set_root(struct dnet_config_backend *b, char *key __unused, char *root)
 {
 	struct file_backend_root *r = b->data;
@@ -577,7 +1069,14 @@ static void file_backend_cleanup(void *priv)
 {
 	struct file_backend_root *r = priv;
 
+	/* completions of queued requests use metadata and descriptor cache */
+	if (r->uring) {
+		file_uring_cleanup(r->uring);
+		r->uring = NULL;
+	}
+
 	dnet_file_db_cleanup(r);
+	file_backend_fd_cleanup(r);
 	close(r->rootfd);
 	free(r->root);
 }
@@ -610,12 +1109,32 @@ static int dnet_file_config_init(struct dnet_config_backend *b, struct dnet_conf
 	b->cb.storage_stat = file_backend_storage_stat;
 	b->cb.backend_cleanup = file_backend_cleanup;
 
+	err = file_backend_fd_init(r);
+	if (err) {
+		dnet_backend_log(DNET_LOG_ERROR, "Failed to initialize fd cache: %s\n", strerror(-err));
+		return err;
+	}
+
 	mkdir("history", 0755);
 	err = dnet_file_db_init(r, c, "history");
 	if (err)
-		return err;
+		goto err_out_fd_cleanup;
+
+	if (r->io_uring_depth > 0) {
+		/* only cached descriptors are registered */
+		err = file_uring_init(&r->uring, r->io_uring_depth, r->fd_cache_size);
+		if (err) {
+			dnet_backend_log(DNET_LOG_ERROR, "Failed to initialize io_uring engine, using blocking io: %s\n",
+					strerror(-err));
+			r->uring = NULL;
+		}
+	}
 
 	return 0;
+
+err_out_fd_cleanup:
+	file_backend_fd_cleanup(r);
+	return err;
 }
 
 static void dnet_file_config_cleanup(struct dnet_config_backend *b)
@@ -633,6 +1152,8 @@ static struct dnet_config_entry dnet_cfg_entries_filesystem[] = {
 	{"blob_size", dnet_file_set_blob_size},
 	{"defrag_timeout", dnet_file_set_defrag_timeout},
 	{"defrag_percentage", dnet_file_set_defrag_percentage},
+	{"fd_cache_size", dnet_file_set_fd_cache_size},
+	{"io_uring_depth", dnet_file_set_io_uring_depth},
 };
 
 static struct dnet_config_backend dnet_file_backend = {
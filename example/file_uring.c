@@ -0,0 +1,539 @@
+/*
+ * 2013+ Copyright (c) Evgeniy Polyakov <zbr@ioremap.net>
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <errno.h>
+
+#include "file_uring.h"
+
+#ifndef __unused
+#define __unused	__attribute__ ((unused))
+#endif
+
+#ifdef HAVE_IO_URING
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include <linux/io_uring.h>
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* low bit of user data marks fsync linked to the write, requests are aligned */
+#define FILE_URING_LINKED	1ULL
+
+struct file_uring {
+	int			fd;
+	unsigned int		depth;
+
+	void			*sq_ptr, *cq_ptr;
+	size_t			sq_size, cq_size;
+
+	unsigned int		*sq_tail, *sq_mask, *sq_array;
+	struct io_uring_sqe	*sqes;
+	size_t			sqes_size;
+
+	unsigned int		*cq_head, *cq_tail, *cq_mask;
+	struct io_uring_cqe	*cqes;
+
+	/*
+	 * Protects submission queue. Requests are counted in @inflight until completed,
+	 * which is never more than @depth, so queue can not overflow.
+	 * @pending ones are queued, but not yet passed to the kernel.
+	 */
+	pthread_mutex_t		lock;
+	pthread_cond_t		wait;
+	unsigned int		tail;
+	unsigned int		inflight;
+	unsigned int		pending;
+	int			submitting;
+	int			need_exit;
+
+	pthread_t		tid;
+
+	/* stack of free registered slots */
+	pthread_mutex_t		slot_lock;
+	int			*slots;
+	int			slot_num;
+	int			slot_free;
+};
+
+static int file_uring_setup(unsigned int entries, struct io_uring_params *p)
+{
+	return syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int file_uring_enter(struct file_uring *u, unsigned int to_submit, unsigned int min_complete, unsigned int flags)
+{
+	return syscall(__NR_io_uring_enter, u->fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static int file_uring_register(struct file_uring *u, unsigned int opcode, void *arg, unsigned int num)
+{
+	return syscall(__NR_io_uring_register, u->fd, opcode, arg, num);
+}
+
+static void file_uring_complete(struct io_uring_cqe *cqe)
+{
+	struct file_uring_req *req = (struct file_uring_req *)(uintptr_t)(cqe->user_data & ~FILE_URING_LINKED);
+
+	/* wake up request queued on exit */
+	if (!req)
+		return;
+
+	if (cqe->user_data & FILE_URING_LINKED) {
+		/* fsync is cancelled when the write has failed, its error is already there */
+		if (cqe->res < 0 && cqe->res != -ECANCELED)
+			req->res = cqe->res;
+	} else if (req->res >= 0) {
+		req->res = cqe->res;
+	}
+
+	if (--req->pending == 0)
+		req->complete(req, req->res);
+}
+
+static void *file_uring_process(void *data)
+{
+	struct file_uring *u = data;
+	unsigned int head, tail, num;
+
+	while (1) {
+		pthread_mutex_lock(&u->lock);
+		if (u->need_exit && !u->inflight) {
+			pthread_mutex_unlock(&u->lock);
+			break;
+		}
+		pthread_mutex_unlock(&u->lock);
+
+		if (file_uring_enter(u, 0, 1, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR) {
+			sched_yield();
+			continue;
+		}
+
+		head = *u->cq_head;
+		tail = __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE);
+
+		for (num = 0; head != tail; ++head, ++num)
+			file_uring_complete(&u->cqes[head & *u->cq_mask]);
+
+		__atomic_store_n(u->cq_head, head, __ATOMIC_RELEASE);
+
+		if (num) {
+			pthread_mutex_lock(&u->lock);
+			u->inflight -= num;
+			pthread_cond_broadcast(&u->wait);
+			pthread_mutex_unlock(&u->lock);
+		}
+	}
+
+	return NULL;
+}
+
+/*
+ * Queues @num entries, they are linked in the order given if needed.
+ * The first thread which finds nobody in the kernel submits everything queued in the meantime.
+ */
+static int file_uring_submit(struct file_uring *u, struct io_uring_sqe *sqes, unsigned int num, int on_exit)
+{
+	unsigned int i, idx;
+	int ret;
+
+	pthread_mutex_lock(&u->lock);
+	while (u->inflight + num > u->depth && !(u->need_exit && !on_exit))
+		pthread_cond_wait(&u->wait, &u->lock);
+
+	if (u->need_exit && !on_exit) {
+		pthread_mutex_unlock(&u->lock);
+		return -ESHUTDOWN;
+	}
+
+	for (i = 0; i < num; ++i) {
+		idx = u->tail++ & *u->sq_mask;
+
+		memcpy(&u->sqes[idx], &sqes[i], sizeof(struct io_uring_sqe));
+		u->sq_array[idx] = idx;
+	}
+	__atomic_store_n(u->sq_tail, u->tail, __ATOMIC_RELEASE);
+
+	u->inflight += num;
+	u->pending += num;
+
+	if (u->submitting) {
+		pthread_mutex_unlock(&u->lock);
+		return 0;
+	}
+
+	u->submitting = 1;
+	while (u->pending) {
+		num = u->pending;
+		pthread_mutex_unlock(&u->lock);
+
+		ret = file_uring_enter(u, num, 0, 0);
+		if (ret < 0)
+			ret = -errno;
+
+		pthread_mutex_lock(&u->lock);
+		if (ret > 0) {
+			u->pending -= ret;
+			continue;
+		}
+
+		/* out of kernel resources, completions will free them */
+		if (ret == -EAGAIN || ret == -EBUSY || ret == -ENOMEM) {
+			pthread_mutex_unlock(&u->lock);
+			sched_yield();
+			pthread_mutex_lock(&u->lock);
+			continue;
+		}
+
+		/* queued entries are not lost, they will be submitted together with the next ones */
+		if (ret != -EINTR)
+			break;
+	}
+	u->submitting = 0;
+	pthread_mutex_unlock(&u->lock);
+
+	return 0;
+}
+
+static void file_uring_prep_rw(struct io_uring_sqe *sqe, int opcode, int fd, int slot,
+		const void *buf, unsigned int size, uint64_t offset)
+{
+	memset(sqe, 0, sizeof(struct io_uring_sqe));
+
+	sqe->opcode = opcode;
+	if (slot >= 0) {
+		sqe->fd = slot;
+		sqe->flags = IOSQE_FIXED_FILE;
+	} else {
+		sqe->fd = fd;
+	}
+	sqe->addr = (uintptr_t)buf;
+	sqe->len = size;
+	sqe->off = offset;
+}
+
+int file_uring_read(struct file_uring *u, struct file_uring_req *req, int fd, int slot,
+		void *buf, unsigned int size, uint64_t offset)
+{
+	struct io_uring_sqe sqe;
+
+	file_uring_prep_rw(&sqe, IORING_OP_READ, fd, slot, buf, size, offset);
+	sqe.user_data = (uintptr_t)req;
+
+	req->res = 0;
+	req->pending = 1;
+
+	return file_uring_submit(u, &sqe, 1, 0);
+}
+
+int file_uring_write(struct file_uring *u, struct file_uring_req *req, int fd, int slot,
+		const void *buf, unsigned int size, uint64_t offset, int sync)
+{
+	struct io_uring_sqe sqes[2];
+
+	file_uring_prep_rw(&sqes[0], IORING_OP_WRITE, fd, slot, buf, size, offset);
+	sqes[0].user_data = (uintptr_t)req;
+
+	req->res = 0;
+	req->pending = 1;
+
+	if (sync) {
+		/* fsync is started only after the write has completed successfully */
+		sqes[0].flags |= IOSQE_IO_LINK;
+
+		file_uring_prep_rw(&sqes[1], IORING_OP_FSYNC, fd, slot, NULL, 0, 0);
+		sqes[1].user_data = (uintptr_t)req | FILE_URING_LINKED;
+
+		req->pending = 2;
+	}
+
+	return file_uring_submit(u, sqes, req->pending, 0);
+}
+
+int file_uring_slot_get(struct file_uring *u, int fd)
+{
+	struct io_uring_files_update up;
+	int slot, err;
+
+	pthread_mutex_lock(&u->slot_lock);
+	slot = u->slot_free ? u->slots[--u->slot_free] : -ENOSPC;
+	pthread_mutex_unlock(&u->slot_lock);
+
+	if (slot < 0)
+		return slot;
+
+	memset(&up, 0, sizeof(up));
+	up.offset = slot;
+	up.fds = (uintptr_t)&fd;
+
+	err = file_uring_register(u, IORING_REGISTER_FILES_UPDATE, &up, 1);
+	if (err < 0) {
+		err = -errno;
+		file_uring_slot_put(u, slot);
+		return err;
+	}
+
+	return slot;
+}
+
+void file_uring_slot_put(struct file_uring *u, int slot)
+{
+	struct io_uring_files_update up;
+	int fd = -1;
+
+	/* registered file holds a reference to the file which has to be dropped */
+	memset(&up, 0, sizeof(up));
+	up.offset = slot;
+	up.fds = (uintptr_t)&fd;
+	file_uring_register(u, IORING_REGISTER_FILES_UPDATE, &up, 1);
+
+	pthread_mutex_lock(&u->slot_lock);
+	u->slots[u->slot_free++] = slot;
+	pthread_mutex_unlock(&u->slot_lock);
+}
+
+/* sparse table of registered files, every slot is empty */
+static int file_uring_slots_init(struct file_uring *u, int slot_num)
+{
+	int i, err;
+
+	if (slot_num <= 0)
+		return 0;
+
+	u->slots = malloc(slot_num * sizeof(int));
+	if (!u->slots)
+		return -ENOMEM;
+
+	for (i = 0; i < slot_num; ++i)
+		u->slots[i] = -1;
+
+	err = file_uring_register(u, IORING_REGISTER_FILES, u->slots, slot_num);
+	if (err < 0) {
+		/* kernels without sparse tables work with plain descriptors */
+		free(u->slots);
+		u->slots = NULL;
+		return 0;
+	}
+
+	for (i = 0; i < slot_num; ++i)
+		u->slots[i] = slot_num - i - 1;
+
+	u->slot_num = u->slot_free = slot_num;
+	return 0;
+}
+
+static int file_uring_map(struct file_uring *u, struct io_uring_params *p)
+{
+	int err;
+
+	u->sq_size = p->sq_off.array + p->sq_entries * sizeof(unsigned int);
+	u->cq_size = p->cq_off.cqes + p->cq_entries * sizeof(struct io_uring_cqe);
+
+	if (p->features & IORING_FEAT_SINGLE_MMAP) {
+		if (u->cq_size > u->sq_size)
+			u->sq_size = u->cq_size;
+		u->cq_size = u->sq_size;
+	}
+
+	u->sq_ptr = mmap(NULL, u->sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQ_RING);
+	if (u->sq_ptr == MAP_FAILED) {
+		err = -errno;
+		goto err_out_exit;
+	}
+
+	if (p->features & IORING_FEAT_SINGLE_MMAP) {
+		u->cq_ptr = u->sq_ptr;
+	} else {
+		u->cq_ptr = mmap(NULL, u->cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_CQ_RING);
+		if (u->cq_ptr == MAP_FAILED) {
+			err = -errno;
+			goto err_out_unmap_sq;
+		}
+	}
+
+	u->sqes_size = p->sq_entries * sizeof(struct io_uring_sqe);
+	u->sqes = mmap(NULL, u->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQES);
+	if (u->sqes == MAP_FAILED) {
+		err = -errno;
+		goto err_out_unmap_cq;
+	}
+
+	u->sq_tail = u->sq_ptr + p->sq_off.tail;
+	u->sq_mask = u->sq_ptr + p->sq_off.ring_mask;
+	u->sq_array = u->sq_ptr + p->sq_off.array;
+
+	u->cq_head = u->cq_ptr + p->cq_off.head;
+	u->cq_tail = u->cq_ptr + p->cq_off.tail;
+	u->cq_mask = u->cq_ptr + p->cq_off.ring_mask;
+	u->cqes = u->cq_ptr + p->cq_off.cqes;
+
+	u->tail = *u->sq_tail;
+	u->depth = p->sq_entries;
+	return 0;
+
+err_out_unmap_cq:
+	if (u->cq_ptr != u->sq_ptr)
+		munmap(u->cq_ptr, u->cq_size);
+err_out_unmap_sq:
+	munmap(u->sq_ptr, u->sq_size);
+err_out_exit:
+	return err;
+}
+
+static void file_uring_unmap(struct file_uring *u)
+{
+	munmap(u->sqes, u->sqes_size);
+	if (u->cq_ptr != u->sq_ptr)
+		munmap(u->cq_ptr, u->cq_size);
+	munmap(u->sq_ptr, u->sq_size);
+}
+
+int file_uring_init(struct file_uring **up, unsigned int depth, int slot_num)
+{
+	struct io_uring_params p;
+	struct file_uring *u;
+	int err;
+
+	u = malloc(sizeof(struct file_uring));
+	if (!u) {
+		err = -ENOMEM;
+		goto err_out_exit;
+	}
+	memset(u, 0, sizeof(struct file_uring));
+
+	/* write linked with fsync takes two entries */
+	if (depth < 2)
+		depth = 2;
+
+	memset(&p, 0, sizeof(p));
+	u->fd = file_uring_setup(depth, &p);
+	if (u->fd < 0) {
+		err = -errno;
+		goto err_out_free;
+	}
+
+	err = file_uring_map(u, &p);
+	if (err)
+		goto err_out_close;
+
+	err = file_uring_slots_init(u, slot_num);
+	if (err)
+		goto err_out_unmap;
+
+	err = -pthread_mutex_init(&u->lock, NULL);
+	if (err)
+		goto err_out_free_slots;
+
+	err = -pthread_cond_init(&u->wait, NULL);
+	if (err)
+		goto err_out_destroy_lock;
+
+	err = -pthread_mutex_init(&u->slot_lock, NULL);
+	if (err)
+		goto err_out_destroy_wait;
+
+	err = -pthread_create(&u->tid, NULL, file_uring_process, u);
+	if (err)
+		goto err_out_destroy_slot_lock;
+
+	*up = u;
+	return 0;
+
+err_out_destroy_slot_lock:
+	pthread_mutex_destroy(&u->slot_lock);
+err_out_destroy_wait:
+	pthread_cond_destroy(&u->wait);
+err_out_destroy_lock:
+	pthread_mutex_destroy(&u->lock);
+err_out_free_slots:
+	free(u->slots);
+err_out_unmap:
+	file_uring_unmap(u);
+err_out_close:
+	close(u->fd);
+err_out_free:
+	free(u);
+err_out_exit:
+	return err;
+}
+
+void file_uring_cleanup(struct file_uring *u)
+{
+	struct io_uring_sqe sqe;
+
+	pthread_mutex_lock(&u->lock);
+	u->need_exit = 1;
+	pthread_cond_broadcast(&u->wait);
+	pthread_mutex_unlock(&u->lock);
+
+	/* completion thread exits once this and every previously queued request are completed */
+	memset(&sqe, 0, sizeof(sqe));
+	sqe.opcode = IORING_OP_NOP;
+	file_uring_submit(u, &sqe, 1, 1);
+
+	pthread_join(u->tid, NULL);
+
+	pthread_mutex_destroy(&u->slot_lock);
+	pthread_cond_destroy(&u->wait);
+	pthread_mutex_destroy(&u->lock);
+
+	free(u->slots);
+	file_uring_unmap(u);
+	close(u->fd);
+	free(u);
+}
+
+#else
+
+int file_uring_init(struct file_uring **up __unused, unsigned int depth __unused,
+		int slot_num __unused)
+{
+	return -ENOTSUP;
+}
+
+void file_uring_cleanup(struct file_uring *u __unused)
+{
+}
+
+int file_uring_slot_get(struct file_uring *u __unused, int fd __unused)
+{
+	return -ENOTSUP;
+}
+
+void file_uring_slot_put(struct file_uring *u __unused, int slot __unused)
+{
+}
+
+int file_uring_read(struct file_uring *u __unused, struct file_uring_req *req __unused,
+		int fd __unused, int slot __unused, void *buf __unused,
+		unsigned int size __unused, uint64_t offset __unused)
+{
+	return -ENOTSUP;
+}
+
+int file_uring_write(struct file_uring *u __unused, struct file_uring_req *req __unused,
+		int fd __unused, int slot __unused, const void *buf __unused,
+		unsigned int size __unused, uint64_t offset __unused,
+		int sync __unused)
+{
+	return -ENOTSUP;
+}
+
+#endif /* HAVE_IO_URING */
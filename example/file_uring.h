@@ -0,0 +1,68 @@
+/*
+ * 2013+ Copyright (c) Evgeniy Polyakov <zbr@ioremap.net>
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef __DNET_FILE_URING_H
+#define __DNET_FILE_URING_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * io_uring engine of the file backend.
+ *
+ * Requests queued by several threads are submitted by a single syscall made by
+ * whichever of them comes first, completions are reaped by engine's own thread
+ * which calls @complete of every request. Descriptors which are used often can be
+ * registered in the ring, registered slot is then passed instead of -1.
+ *
+ * Without HAVE_IO_URING every function returns -ENOTSUP.
+ */
+
+struct file_uring;
+
+struct file_uring_req {
+	/* @res is the number of bytes read or written, or negative error of the request or linked fsync */
+	void			(*complete)(struct file_uring_req *req, int res);
+
+	/* private to the engine */
+	int			res;
+	int			pending;
+};
+
+int file_uring_init(struct file_uring **up, unsigned int depth, int slot_num);
+
+/* waits until all queued requests are completed */
+void file_uring_cleanup(struct file_uring *u);
+
+/* returns registered slot of @fd or negative error if it can not be registered */
+int file_uring_slot_get(struct file_uring *u, int fd);
+void file_uring_slot_put(struct file_uring *u, int slot);
+
+int file_uring_read(struct file_uring *u, struct file_uring_req *req, int fd, int slot,
+		void *buf, unsigned int size, uint64_t offset);
+
+/* if @sync is set, data is synced by fsync linked to the write */
+int file_uring_write(struct file_uring *u, struct file_uring_req *req, int fd, int slot,
+		const void *buf, unsigned int size, uint64_t offset, int sync);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __DNET_FILE_URING_H */
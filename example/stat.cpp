@@ -44,7 +44,7 @@ using namespace ioremap::elliptics;
 #endif
 
 static struct dnet_log stat_logger;
-static int stat_mem, stat_la, stat_fs;
+static int stat_mem, stat_la, stat_fs, stat_latency;
 static FILE *stream = NULL;
 
 static void print_stat(const stat_result_entry &result)
@@ -97,6 +97,43 @@ static void print_stat(const stat_result_entry &result)
 	fflush(stream);
 }
 
+static void print_latency(const stat_count_result_entry &result)
+{
+	dnet_addr_latency_stat *ls = result.latency();
+	dnet_latency_hist *h;
+
+	char str[64];
+	struct tm tm;
+	struct timeval tv;
+
+	if (!ls || ls->hist_size != DNET_LATENCY_HIST_SIZE)
+		return;
+
+	gettimeofday(&tv, NULL);
+	localtime_r((time_t *)&tv.tv_sec, &tm);
+	strftime(str, sizeof(str), "%F %R:%S", &tm);
+
+	for (int i = 0; i < ls->num; ++i) {
+		h = &ls->hist[i];
+		if (!h->count)
+			continue;
+
+		fprintf(stream, "%s.%06lu : %s: %-7s %-16s count: %8llu, avg: %8llu, p50: %8llu, p90: %8llu, "
+				"p99: %8llu, p999: %8llu, max: %8llu usecs\n",
+			str, (unsigned long)tv.tv_usec,
+			dnet_server_convert_dnet_addr(result.address()),
+			(i < ls->cmd_num) ? "cmd" : "backend", dnet_cmd_string(i % ls->cmd_num),
+			(unsigned long long)h->count, (unsigned long long)(h->sum / h->count),
+			(unsigned long long)dnet_latency_hist_percentile(h, 50),
+			(unsigned long long)dnet_latency_hist_percentile(h, 90),
+			(unsigned long long)dnet_latency_hist_percentile(h, 99),
+			(unsigned long long)dnet_latency_hist_percentile(h, 99.9),
+			(unsigned long long)h->max);
+	}
+
+	fflush(stream);
+}
+
 static void stat_usage(char *p)
 {
 	fprintf(stderr, "Usage: %s\n"
@@ -110,6 +147,7 @@ static void stat_usage(char *p)
 			" -M                   - show memory usage statistics\n"
 			" -F                   - show filesystem usage statistics\n"
 			" -A                   - show load average statistics\n"
+			" -C                   - show per-command latency percentiles\n"
 	       , p);
 }
 
@@ -132,7 +170,7 @@ int main(int argc, char *argv[])
 
 	timeout = 1;
 
-	while ((ch = getopt(argc, argv, "g:MFAt:m:w:l:I:r:h")) != -1) {
+	while ((ch = getopt(argc, argv, "g:MFACt:m:w:l:I:r:h")) != -1) {
 		switch (ch) {
 			case 'g':
 				group = atoi(optarg);
@@ -146,6 +184,9 @@ int main(int argc, char *argv[])
 			case 'A':
 				stat_la = 1;
 				break;
+			case 'C':
+				stat_latency = 1;
+				break;
 			case 't':
 				timeout = atoi(optarg);
 				break;
@@ -220,6 +261,11 @@ int main(int argc, char *argv[])
 				}
 			}
 
+			if (stat_latency) {
+				auto result = sess.stat_log_count();
+				std::for_each(result.begin(), result.end(), print_latency);
+			}
+
 			sleep(timeout);
 		}
 	} catch (const std::exception &e) {
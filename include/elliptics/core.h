@@ -68,8 +68,14 @@
 
 #define DNET_DEFAULT_CACHE_SYNC_TIMEOUT_SEC 30
 
+#define DNET_DEFAULT_CACHE_SHARDS 16
+
+#define DNET_DEFAULT_CACHE_SYNC_THREADS 2
+
 #define DNET_DEFAULT_STALL_TRANSACTIONS 5
 
+#define DNET_DEFAULT_NET_MAX_EVENTS 64
+
 #define DNET_DEFAULT_INDEXES_SHARD_COUNT 16
 
 #define ARRAY_SIZE(arr) (sizeof(arr) / sizeof((arr)[0]))
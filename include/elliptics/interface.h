@@ -162,6 +162,35 @@ int dnet_search_range(struct dnet_node *n, struct dnet_id *id,
 int __attribute__((weak)) dnet_send_read_data(void *state, struct dnet_cmd *cmd, struct dnet_io_attr *io,
 		void *data, int fd, uint64_t offset, int on_exit);
 
+/*
+ * Sends read reply without copying @data into send queue,
+ * @put(@priv) is called when data is no longer needed, even if sending failed
+ */
+int __attribute__((weak)) dnet_send_read_data_ref(void *state, struct dnet_cmd *cmd, struct dnet_io_attr *io, void *data,
+		void (*put)(void *priv), void *priv);
+
+/*
+ * Sends read reply from @fd which is not closed afterwards,
+ * @put(@priv) is called when descriptor is no longer needed, even if sending failed
+ */
+int __attribute__((weak)) dnet_send_read_fd_ref(void *state, struct dnet_cmd *cmd, struct dnet_io_attr *io,
+		int fd, uint64_t offset, void (*put)(void *priv), void *priv);
+
+/*
+ * Asynchronous completion of the command being processed by the backend.
+ *
+ * dnet_async_reply_start() returns NULL if command must be completed before
+ * the handler returns, for example when it is a part of bulk or local request.
+ * Otherwise returned reply owns copy of the command, its ack and operation lock,
+ * handler's return value is ignored, and dnet_async_reply_complete() must be called
+ * exactly once with the result after all replies are sent.
+ */
+struct dnet_async_reply;
+struct dnet_async_reply * __attribute__((weak)) dnet_async_reply_start(void *state, struct dnet_cmd *cmd);
+void * __attribute__((weak)) dnet_async_reply_state(struct dnet_async_reply *r);
+struct dnet_cmd * __attribute__((weak)) dnet_async_reply_cmd(struct dnet_async_reply *r);
+void __attribute__((weak)) dnet_async_reply_complete(struct dnet_async_reply *r, int err);
+
 /*
  * Reads given file from the storage. If there are multiple transformation functions,
  * they will be tried one after another.
@@ -218,6 +247,12 @@ enum dnet_log_level {
 #define DNET_CFG_MIX_STATES		(1<<2)		/* mix states according to their weights before reading data */
 #define DNET_CFG_NO_CSUM		(1<<3)		/* globally disable checksum verification and update */
 #define DNET_CFG_RANDOMIZE_STATES	(1<<5)		/* randomize states for read requests */
+#define DNET_CFG_LATENCY_STATES		(1<<6)		/* order states by read latency and in-flight requests before reading data */
+#define DNET_CFG_ASYNC_LOG		(1<<7)		/* format log messages into per-thread ring buffers, write them from background thread */
+
+/* cfg->cache_policy */
+#define DNET_CACHE_POLICY_LRU		0		/* plain LRU eviction */
+#define DNET_CACHE_POLICY_SLRU		1		/* scan-resistant segmented LRU with admission of disk reads */
 
 struct dnet_log {
 	/*
@@ -282,6 +317,12 @@ struct dnet_backend_callbacks {
 	 * Returns dir used by backend
 	 */
 	char *			(* dir)(void);
+
+	/*
+	 * Optional: fills file descriptor, offset and size of the object's data without reading it.
+	 * Used to order bulk reads by physical position and to issue readahead hints.
+	 */
+	int			(* location)(void *priv, const unsigned char *id, int *fd, uint64_t *offset, uint64_t *size);
 };
 
 /*
@@ -395,8 +436,42 @@ struct dnet_config
 
 	int			cache_sync_timeout;
 
+	/* Number of independently locked cache shards, 0 means number of online CPUs */
+	int			cache_shards;
+
+	/* Cache eviction policy, DNET_CACHE_POLICY_* */
+	int			cache_policy;
+
+	/* Number of threads writing dirty cache objects back to disk */
+	int			cache_sync_threads;
+
+	/* Cache write-back rate limit in bytes per second, 0 means unlimited */
+	int			cache_sync_rate;
+
+	/*
+	 * Save cache contents into 'cache.snapshot' file in history directory on clean shutdown,
+	 * load it on start
+	 */
+	int			cache_snapshot;
+
+	/* Maximum number of events returned by single epoll_wait() call in network thread */
+	int			net_max_events;
+
+	/*
+	 * If set, network (io) threads are bound to online CPUs one by one,
+	 * io threads take CPUs following those used by network threads
+	 */
+	int			net_cpu_affinity;
+	int			io_cpu_affinity;
+
+	/*
+	 * If set, commands for the same key are always processed by the same io thread
+	 * in the order they were received, otherwise idle io threads steal work from busy ones
+	 */
+	int			io_key_affinity;
+
 	/* so that we do not change major version frequently */
-	int			reserved_for_future_use[11];
+	int			reserved_for_future_use[1];
 };
 
 struct dnet_node *dnet_get_node_from_state(void *state);
@@ -420,6 +495,7 @@ void dnet_session_set_user_flags(struct dnet_session *s, uint64_t user_flags);
 uint64_t dnet_session_get_user_flags(struct dnet_session *s);
 
 void dnet_session_set_timeout(struct dnet_session *s, unsigned int wait_timeout);
+void dnet_session_set_timeout_ms(struct dnet_session *s, unsigned long wait_timeout_ms);
 struct timespec *dnet_session_get_timeout(struct dnet_session *s);
 
 int dnet_session_set_ns(struct dnet_session *s, const char *ns, int nsize);
@@ -710,6 +786,23 @@ static inline int dnet_id_cmp(const struct dnet_id *id1, const struct dnet_id *i
 int __attribute__((weak)) dnet_send_reply(void *state, struct dnet_cmd *cmd, void *odata, unsigned int size, int more);
 int __attribute__((weak)) dnet_send_reply_threshold(void *state, struct dnet_cmd *cmd, void *odata, unsigned int size, int more);
 
+/*
+ * Reply built in place: returns zeroed @size bytes of payload placed in the send queue request
+ * right after reply command, so it is neither copied nor allocated twice.
+ * Payload is sent by dnet_send_reply_commit() or dropped by dnet_send_reply_free().
+ * Reply command is filled from @cmd at allocation time.
+ */
+void * __attribute__((weak)) dnet_send_reply_alloc(struct dnet_cmd *cmd, uint64_t size, int more);
+int __attribute__((weak)) dnet_send_reply_commit(void *state, void *payload);
+void __attribute__((weak)) dnet_send_reply_free(void *payload);
+
+/*
+ * Sends caller-owned @data as reply payload without copying it,
+ * @put(@priv) is called when data is no longer needed, even if sending failed
+ */
+int __attribute__((weak)) dnet_send_reply_ref(void *state, struct dnet_cmd *cmd, void *data, uint64_t size, int more,
+		void (*put)(void *priv), void *priv);
+
 
 /*
  * Request statistics from the node corresponding to given ID.
@@ -910,6 +1003,42 @@ static inline int is_trans_destroyed(struct dnet_net_state *st, struct dnet_cmd
 
 int dnet_mix_states(struct dnet_session *s, struct dnet_id *id, int **groupsp);
 
+/*
+ * One-shot timer driven by node's transaction timer wheel with 10 ms resolution.
+ * @complete is called from timer thread with NULL state and -ETIMEDOUT status when timer fires,
+ * and then once more with DNET_FLAGS_DESTROY flag when the timer is released.
+ * Every started timer must be released by dnet_timer_cancel() which returns 1
+ * if timer was cancelled before it fired.
+ */
+void *dnet_timer_start(struct dnet_node *n, unsigned long timeout_ms,
+		int (* complete)(struct dnet_net_state *st, struct dnet_cmd *cmd, void *priv), void *priv);
+int dnet_timer_cancel(struct dnet_node *n, void *timer);
+void dnet_node_get_counter(struct dnet_node *n, int counter, struct dnet_stat_count *st);
+void dnet_node_counter_inc(struct dnet_node *n, int counter, int err);
+
+/*
+ * Client-side latency of replies from remote node, tracked per command class
+ */
+enum dnet_latency_class {
+	DNET_LATENCY_READ = 0,		/* READ, LOOKUP, BULK_READ, READ_RANGE */
+	DNET_LATENCY_WRITE,		/* WRITE, DEL, DEL_RANGE */
+	DNET_LATENCY_OTHER,
+	__DNET_LATENCY_MAX
+};
+
+/* all times are in usecs, percentiles are upper bounds of power-of-two histogram buckets */
+struct dnet_latency_stat {
+	uint64_t		ewma;
+	uint64_t		p50;
+	uint64_t		p95;
+	uint64_t		p99;
+	uint64_t		count;
+	int			inflight;
+};
+
+/* fills @stat for node serving @id, returns -ENXIO if there is no such node */
+int dnet_state_latency_stat(struct dnet_session *s, struct dnet_id *id, int latency_class, struct dnet_latency_stat *stat);
+
 char * __attribute__((weak)) dnet_cmd_string(int cmd);
 char *dnet_counter_string(int cntr, int cmd_num);
 
@@ -61,6 +61,7 @@ enum dnet_commands {
 	DNET_CMD_INDEXES_UPDATE,		/* Update secondary indexes for id */
 	DNET_CMD_INDEXES_INTERNAL,		/* Update identificators table for certain secondary index. Internal usage only */
 	DNET_CMD_INDEXES_FIND,		/* Find all objects by indexes */
+	DNET_CMD_BULK_WRITE,			/* Write a number of ids at one time, single reply with per-id statuses */
 	DNET_CMD_UNKNOWN,			/* This slot is allocated for statistics gathered for unknown commands */
 	__DNET_CMD_MAX,
 };
@@ -92,6 +93,27 @@ enum dnet_counters {
 	DNET_CNTR_DBR_ERROR,			/* Kyoto Cabinet DB read error */
 	DNET_CNTR_DBW_SYSTEM,			/* Kyoto Cabinet DB write error KCESYSTEM */
 	DNET_CNTR_DBW_ERROR,			/* Kyoto Cabinet DB write error */
+	DNET_CNTR_CACHE_LOCK,			/* Cache shard lock acquisitions, err - contended acquisitions */
+	DNET_CNTR_CACHE_LOCK_MAX_SHARD,		/* Most contended cache shard, err - its contended acquisitions */
+	DNET_CNTR_CACHE_HIT,			/* Cache read hits, err - misses */
+	DNET_CNTR_CACHE_ADMIT,			/* Objects read from disk and admitted into cache, err - rejected ones */
+	DNET_CNTR_CACHE_EVICT,			/* Objects evicted from cache */
+	DNET_CNTR_CACHE_MEMORY,			/* Bytes allocated for cached objects, err - bytes reserved from the system */
+	DNET_CNTR_CACHE_SYNC_QUEUE,		/* Objects waiting for cache write-back, err - their size in bytes */
+	DNET_CNTR_CACHE_SYNC_TIME,		/* Objects written back from cache, err - average write time in usecs */
+	DNET_CNTR_RECV_CALLS,			/* recv() calls made by network threads, err - commands received */
+	DNET_CNTR_RECV_POOL,			/* Received requests reused from size-class pools, err - newly allocated ones */
+	DNET_CNTR_RECV_LARGE,			/* Received requests too big for pools, err - bytes cached in pools */
+	DNET_CNTR_IO_PRIO_HIGH,			/* High priority requests waiting in io queues, err - average wait time in usecs */
+	DNET_CNTR_IO_PRIO_NORMAL,		/* Normal priority requests waiting in io queues, err - average wait time in usecs */
+	DNET_CNTR_IO_PRIO_BACKGROUND,		/* Background requests waiting in io queues, err - average wait time in usecs */
+	DNET_CNTR_HEDGE_READ,			/* Hedged reads sent to the next group after delay or failure, err - those which completed the read */
+	DNET_CNTR_LOG_DROPPED,			/* Log messages dropped because thread's log ring was full */
+	DNET_CNTR_OPLOCK,			/* Per-key operation locks taken, err - ones which waited for conflicting request */
+	DNET_CNTR_OPLOCK_SHARED,		/* Shared operation locks taken by reads, err - ones taken while key was already read */
+	DNET_CNTR_OPLOCK_STRIPE,		/* Operation lock stripe acquisitions, err - contended acquisitions */
+	DNET_CNTR_READ_RANDOM,			/* Reads from randomly accessed blobs, err - ones of hot objects, whose pages were kept cached */
+	DNET_CNTR_BLOB_RANDOM,			/* Blobs tracked by backend, err - randomly accessed ones */
 	DNET_CNTR_UNKNOWN,			/* This slot is allocated for statistics gathered for unknown counters */
 	__DNET_CNTR_MAX,
 };
@@ -131,6 +153,14 @@ enum dnet_counters {
 /* Currently only valid flag for LOOKUP command - when set, don't check fileinfo in cache */
 #define DNET_FLAGS_NOCACHE		(1<<6)
 
+/*
+ * Server-side scheduling class of the command: high priority commands are served before others,
+ * background ones (iterators, bulk and range reads, defragmentation get this class by default)
+ * get a small share of io threads when there are other commands in the queue
+ */
+#define DNET_FLAGS_PRIO_HIGH		(1<<7)
+#define DNET_FLAGS_PRIO_BACKGROUND	(1<<8)
+
 struct dnet_id {
 	uint8_t			id[DNET_ID_SIZE];
 	uint32_t		group_id;
@@ -188,6 +218,8 @@ static inline void dnet_convert_cmd(struct dnet_cmd *cmd)
 
 /* What type of counters to fetch */
 #define DNET_ATTR_CNTR_GLOBAL			(1ULL<<32)
+/* Global counters are followed by latency histograms, also marks reply which carries them */
+#define DNET_ATTR_CNTR_LATENCY			(1ULL<<33)
 
 /* Bulk request for checking files */
 #define DNET_ATTR_BULK_CHECK			(1ULL<<32)
@@ -403,6 +435,37 @@ static inline void dnet_convert_io_attr(struct dnet_io_attr *a)
 	a->size = dnet_bswap64(a->size);
 }
 
+/*
+ * BULK_WRITE request is dnet_io_attr header, whose @num is number of objects
+ * and @size is size of the rest of the request, followed by @num entries.
+ * Every entry is dnet_io_attr immediately followed by its @size bytes of data.
+ *
+ * Reply carries single dnet_bulk_write_reply with statuses in request order.
+ */
+struct dnet_bulk_write_status
+{
+	struct dnet_raw_id	id;
+	int			status;
+} __attribute__ ((packed));
+
+struct dnet_bulk_write_reply
+{
+	uint64_t			num;
+	struct dnet_bulk_write_status	status[0];
+} __attribute__ ((packed));
+
+static inline void dnet_convert_bulk_write_reply(struct dnet_bulk_write_reply *r, uint64_t num)
+{
+	uint64_t i;
+
+	r->num = dnet_bswap64(r->num);
+	if (!num)
+		num = r->num;
+
+	for (i = 0; i < num; ++i)
+		r->status[i].status = dnet_bswap32(r->status[i].status);
+}
+
 struct dnet_history_entry
 {
 	uint8_t			id[DNET_ID_SIZE];
@@ -489,10 +552,17 @@ struct dnet_stat
 	uint64_t		vm_buffers;
 
 	/*
-	 * Per node IO statistics will live here.
-	 * Reserved for future use.
+	 * Per node IO statistics.
+	 * Reads from randomly accessed blobs and ones among them which hit hot objects,
+	 * randomly accessed and all tracked blobs.
 	 */
-	uint64_t		reserved[32];
+	uint64_t		read_random;
+	uint64_t		read_random_hot;
+	uint64_t		blob_random;
+	uint64_t		blob_tracked;
+
+	/* Reserved for future use */
+	uint64_t		reserved[28];
 };
 
 static inline void dnet_convert_stat(struct dnet_stat *st)
@@ -519,6 +589,11 @@ static inline void dnet_convert_stat(struct dnet_stat *st)
 	st->vm_free = dnet_bswap64(st->vm_free);
 	st->vm_buffers = dnet_bswap64(st->vm_buffers);
 	st->vm_cached = dnet_bswap64(st->vm_cached);
+
+	st->read_random = dnet_bswap64(st->read_random);
+	st->read_random_hot = dnet_bswap64(st->read_random_hot);
+	st->blob_random = dnet_bswap64(st->blob_random);
+	st->blob_tracked = dnet_bswap64(st->blob_tracked);
 }
 
 struct dnet_io_notification
@@ -579,6 +654,159 @@ static inline void dnet_stat_inc(struct dnet_stat_count *st, int cmd, int err)
 		st[cmd].err++;
 }
 
+/*
+ * Log-linear (HDR-like) latency histogram in microseconds.
+ * Values below 2^DNET_LATENCY_HIST_SUB_BITS have their own buckets, every next power of two
+ * is split into 2^DNET_LATENCY_HIST_SUB_BITS equal buckets, so bucket width never exceeds 1/8 of its value.
+ * Values of 2^DNET_LATENCY_HIST_MAX_BITS usecs and above land into the last bucket.
+ */
+#define DNET_LATENCY_HIST_SUB_BITS	3
+#define DNET_LATENCY_HIST_MAX_BITS	26
+#define DNET_LATENCY_HIST_SIZE		((DNET_LATENCY_HIST_MAX_BITS - DNET_LATENCY_HIST_SUB_BITS + 1) << DNET_LATENCY_HIST_SUB_BITS)
+
+enum dnet_latency_hist_type {
+	DNET_LATENCY_HIST_CMD = 0,		/* Whole command processing time, including cache and reply */
+	DNET_LATENCY_HIST_BACKEND,		/* Time spent in backend's command handler */
+	__DNET_LATENCY_HIST_MAX,
+};
+
+struct dnet_latency_hist
+{
+	uint64_t			count;
+	uint64_t			sum;
+	uint64_t			max;
+	uint64_t			buckets[DNET_LATENCY_HIST_SIZE];
+};
+
+static inline void dnet_convert_latency_hist(struct dnet_latency_hist *h, int num)
+{
+	int i, j;
+
+	for (i=0; i<num; ++i) {
+		h[i].count = dnet_bswap64(h[i].count);
+		h[i].sum = dnet_bswap64(h[i].sum);
+		h[i].max = dnet_bswap64(h[i].max);
+
+		for (j=0; j<DNET_LATENCY_HIST_SIZE; ++j)
+			h[i].buckets[j] = dnet_bswap64(h[i].buckets[j]);
+	}
+}
+
+/*
+ * Histograms of command @cmd live at hist[type * cmd_num + cmd]
+ * Header is 48 bytes, so histograms are naturally aligned and structure is not packed.
+ */
+#define DNET_LATENCY_STAT_MAGIC		"dnlt"
+
+struct dnet_addr_latency_stat
+{
+	struct dnet_addr		addr;
+	int				num;
+	int				cmd_num;
+	int				hist_size;
+	char				magic[4];
+	struct dnet_latency_hist	hist[0];
+};
+
+/*
+ * Servers which do not know about histograms echo request flags into counters reply,
+ * so latency reply of @size bytes is recognized by its size and magic instead of DNET_ATTR_CNTR_LATENCY.
+ * Check does not depend on byte order of @st.
+ */
+static inline int dnet_addr_latency_stat_check(const struct dnet_addr_latency_stat *st, uint64_t size)
+{
+	return size > sizeof(struct dnet_addr_latency_stat) &&
+		(size - sizeof(struct dnet_addr_latency_stat)) % sizeof(struct dnet_latency_hist) == 0 &&
+		!memcmp(st->magic, DNET_LATENCY_STAT_MAGIC, sizeof(st->magic));
+}
+
+static inline int dnet_addr_latency_stat_num(uint64_t size)
+{
+	return (size - sizeof(struct dnet_addr_latency_stat)) / sizeof(struct dnet_latency_hist);
+}
+
+static inline void dnet_convert_addr_latency_stat(struct dnet_addr_latency_stat *st, int num)
+{
+	st->addr.addr_len = dnet_bswap32(st->addr.addr_len);
+	st->num = dnet_bswap32(st->num);
+	if (!num)
+		num = st->num;
+	st->cmd_num = dnet_bswap32(st->cmd_num);
+	st->hist_size = dnet_bswap32(st->hist_size);
+
+	dnet_convert_latency_hist(st->hist, num);
+}
+
+static inline int dnet_latency_hist_index(uint64_t usecs)
+{
+	int e;
+
+	if (usecs < (1ULL << DNET_LATENCY_HIST_SUB_BITS))
+		return usecs;
+	if (usecs >= (1ULL << DNET_LATENCY_HIST_MAX_BITS))
+		return DNET_LATENCY_HIST_SIZE - 1;
+
+	e = 63 - __builtin_clzll(usecs);
+
+	return ((e - DNET_LATENCY_HIST_SUB_BITS + 1) << DNET_LATENCY_HIST_SUB_BITS) |
+		((usecs >> (e - DNET_LATENCY_HIST_SUB_BITS)) & ((1 << DNET_LATENCY_HIST_SUB_BITS) - 1));
+}
+
+/*
+ * Returns the biggest value which falls into bucket @idx
+ */
+static inline uint64_t dnet_latency_hist_value(int idx)
+{
+	int e, shift;
+
+	if (idx < (1 << DNET_LATENCY_HIST_SUB_BITS))
+		return idx;
+
+	e = (idx >> DNET_LATENCY_HIST_SUB_BITS) + DNET_LATENCY_HIST_SUB_BITS - 1;
+	shift = e - DNET_LATENCY_HIST_SUB_BITS;
+
+	return (((uint64_t)(idx & ((1 << DNET_LATENCY_HIST_SUB_BITS) - 1)) | (1ULL << DNET_LATENCY_HIST_SUB_BITS)) << shift) +
+		(1ULL << shift) - 1;
+}
+
+static inline void dnet_latency_hist_merge(struct dnet_latency_hist *dst, const struct dnet_latency_hist *src)
+{
+	int i;
+
+	dst->count += src->count;
+	dst->sum += src->sum;
+	if (src->max > dst->max)
+		dst->max = src->max;
+
+	for (i=0; i<DNET_LATENCY_HIST_SIZE; ++i)
+		dst->buckets[i] += src->buckets[i];
+}
+
+/*
+ * Returns upper bound of the bucket which contains @percentile (0-100) of samples, capped by the maximum seen value
+ */
+static inline uint64_t dnet_latency_hist_percentile(const struct dnet_latency_hist *h, double percentile)
+{
+	uint64_t rank, sum = 0, value;
+	int i;
+
+	if (!h->count)
+		return 0;
+
+	rank = h->count * percentile / 100.0;
+	if (rank < 1)
+		rank = 1;
+
+	for (i=0; i<DNET_LATENCY_HIST_SIZE; ++i) {
+		sum += h->buckets[i];
+		if (sum >= rank)
+			break;
+	}
+
+	value = dnet_latency_hist_value(i < DNET_LATENCY_HIST_SIZE ? i : DNET_LATENCY_HIST_SIZE - 1);
+	return value < h->max ? value : h->max;
+}
+
 static inline void dnet_convert_time(struct dnet_time *tm)
 {
 	tm->tsec = dnet_bswap64(tm->tsec);
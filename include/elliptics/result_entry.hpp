@@ -160,6 +160,12 @@ class stat_count_result_entry : public callback_result_entry
 		stat_count_result_entry &operator =(const stat_count_result_entry &other);
 
 		struct dnet_addr_stat *statistics() const;
+
+		/*
+		 * Returns per-command latency histograms if this entry carries them, NULL otherwise.
+		 * Every node replies with counters entry followed by latency entry.
+		 */
+		struct dnet_addr_latency_stat *latency() const;
 };
 
 class exec_context;
@@ -351,6 +351,23 @@ class session
 		void			set_timeout(unsigned int timeout);
 		long			get_timeout() const;
 
+		/*!
+		 * Set/get transaction timeout in milliseconds
+		 */
+		void			set_timeout_ms(unsigned long timeout_ms);
+		unsigned long		get_timeout_ms() const;
+
+		/*!
+		 * Set/get hedged reads delay in milliseconds.
+		 * When read is sent to several groups and the current one has not replied
+		 * within this delay, the same read is sent to the next group and the first
+		 * successful reply wins, a failed read is followed by the next group at once.
+		 * 0 (default) disables hedging, negative value means that delay is taken
+		 * from p95 read latency of the node serving the first group.
+		 */
+		void			set_hedge_timeout_ms(long timeout_ms);
+		long			get_hedge_timeout_ms() const;
+
 		/*!
 		 * Sets/gets trace_id for all elliptics commands
 		 */
@@ -517,6 +534,13 @@ class session
 		 */
 		std::string		lookup_address(const key &id, int group_id = 0);
 
+		/*!
+		 * Returns client-side reply latency statistics of remote node
+		 * responsible for key \a id in group \a group_id.
+		 * \a latency_class is one of DNET_LATENCY_* command classes.
+		 */
+		dnet_latency_stat	state_latency(const key &id, int group_id, int latency_class = DNET_LATENCY_READ);
+
 		/*!
 		 * Lookups information for key \a id.
 		 *
@@ -700,6 +724,17 @@ class session
 		 * Allows to pass list of std::string as \a data.
 		 */
 		async_write_result bulk_write(const std::vector<struct dnet_io_attr> &ios, const std::vector<std::string> &data);
+		/*!
+		 * Writes all data \a data to server nodes by the list \a ios with DNET_CMD_BULK_WRITE.
+		 * Objects are split by nodes responsible for them in every group,
+		 * and every node gets single request and sends single reply.
+		 *
+		 * Every non-ack entry carries dnet_bulk_write_reply with statuses
+		 * of objects written by that node.
+		 *
+		 * Returns async_generic_result.
+		 */
+		async_generic_result bulk_write_batch(const std::vector<struct dnet_io_attr> &ios, const std::vector<data_pointer> &data);
 
 		async_set_indexes_result set_indexes(const key &id, const std::vector<index_entry> &indexes);
 		async_set_indexes_result set_indexes(const key &id, const std::vector<std::string> &indexes,
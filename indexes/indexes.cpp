@@ -406,36 +406,32 @@ err_out_complete:
 
 	int complete(int err, bool *finished)
 	{
-		data_buffer buffer(sizeof(dnet_indexes_reply) + result.size() * sizeof(dnet_indexes_reply_entry));
+		std::lock_guard<std::mutex> lock(requests_order_guard);
 
-		dnet_indexes_reply reply;
-		memset(&reply, 0, sizeof(reply));
+		*finished = (0 == --requests_in_progress);
+		cmd.status = 0;
 
-		reply.entries_count = result.size();
+		bool more = *finished && !err;
 
-		buffer.write(reply);
-
-		for (size_t i = 0; i < result.size(); ++i) {
-			buffer.write(result[i]);
+		if (!more) {
+			cmd.flags &= (DNET_FLAGS_NEED_ACK | DNET_FLAGS_MORE);
 		}
 
-		data_pointer data = std::move(buffer);
-
-		{
-			std::lock_guard<std::mutex> lock(requests_order_guard);
-
-			*finished = (0 == --requests_in_progress);
-			cmd.status = 0;
+		// Reply is built right in the send queue
+		void *data = dnet_send_reply_alloc(&cmd, sizeof(dnet_indexes_reply) + result.size() * sizeof(dnet_indexes_reply_entry), more);
+		if (!data)
+			return err;
 
-			bool more = *finished && !err;
+		dnet_indexes_reply *reply = reinterpret_cast<dnet_indexes_reply *>(data);
+		reply->entries_count = result.size();
 
-			if (!more) {
-				cmd.flags &= (DNET_FLAGS_NEED_ACK | DNET_FLAGS_MORE);
-			}
-
-			dnet_send_reply(state, &cmd, data.data(), data.size(), more);
+		dnet_indexes_reply_entry *entries = reinterpret_cast<dnet_indexes_reply_entry *>(reply + 1);
+		for (size_t i = 0; i < result.size(); ++i) {
+			entries[i] = result[i];
 		}
 
+		dnet_send_reply_commit(state, data);
+
 		return err;
 	}
 };
@@ -541,28 +537,23 @@ int process_internal_indexes(dnet_net_state *state, dnet_cmd *cmd, dnet_indexes_
 		err = sess.write(cmd->id, new_data);
 	}
 
-	data_buffer buffer(sizeof(dnet_indexes_reply) + sizeof(dnet_indexes_reply_entry));
-
-	dnet_indexes_reply reply;
-	dnet_indexes_reply_entry reply_entry;
-	memset(&reply, 0, sizeof(reply));
-	memset(&reply_entry, 0, sizeof(reply_entry));
+	if (!err) {
+		cmd->flags &= (DNET_FLAGS_NEED_ACK | DNET_FLAGS_MORE);
+	}
 
-	reply.entries_count = 1;
+	void *reply_data = dnet_send_reply_alloc(cmd, sizeof(dnet_indexes_reply) + sizeof(dnet_indexes_reply_entry), err ? 1 : 0);
+	if (!reply_data)
+		return err;
 
-	reply_entry.id = entry.id;
-	reply_entry.status = err;
+	dnet_indexes_reply *reply = reinterpret_cast<dnet_indexes_reply *>(reply_data);
+	dnet_indexes_reply_entry *reply_entry = reinterpret_cast<dnet_indexes_reply_entry *>(reply + 1);
 
-	buffer.write(reply);
-	buffer.write(reply_entry);
+	reply->entries_count = 1;
 
-	data_pointer reply_data = std::move(buffer);
+	reply_entry->id = entry.id;
+	reply_entry->status = err;
 
-	if (!err) {
-		cmd->flags &= (DNET_FLAGS_NEED_ACK | DNET_FLAGS_MORE);
-	}
-
-	dnet_send_reply(state, cmd, reply_data.data(), reply_data.size(), err ? 1 : 0);
+	dnet_send_reply_commit(state, reply_data);
 
 	return err;
 }
@@ -671,8 +662,12 @@ int process_find_indexes(dnet_net_state *state, dnet_cmd *cmd, dnet_indexes_requ
 	msgpack::sbuffer buffer;
 	msgpack::pack(&buffer, result);
 
+	// Packed buffer is handed over to the send queue, it is freed when reply has been sent
+	size_t size = buffer.size();
+	char *data = buffer.release();
+
 	cmd->flags &= ~DNET_FLAGS_NEED_ACK;
-	dnet_send_reply(state, cmd, buffer.data(), buffer.size(), 0);
+	dnet_send_reply_ref(state, cmd, data, size, 0, free, data);
 
 	return err;
 }
@@ -13,6 +13,10 @@
  * GNU General Public License for more details.
  */
 
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/socket.h>
@@ -52,6 +56,21 @@ long dnet_get_id(void)
 {
 	return syscall(SYS_gettid);
 }
+
+#include <sched.h>
+int dnet_thread_set_affinity(pthread_t tid, int cpu)
+{
+	cpu_set_t set;
+	long num = sysconf(_SC_NPROCESSORS_ONLN);
+
+	if (num <= 0)
+		return -EINVAL;
+
+	CPU_ZERO(&set);
+	CPU_SET(cpu % num, &set);
+
+	return -pthread_setaffinity_np(tid, sizeof(set), &set);
+}
 #else
 int dnet_set_name(char *name __attribute__ ((unused))) { return 0; }
 
@@ -59,6 +78,11 @@ long dnet_get_id(void)
 {
 	return pthread_self();
 }
+
+int dnet_thread_set_affinity(pthread_t tid __attribute__ ((unused)), int cpu __attribute__ ((unused)))
+{
+	return -ENOTSUP;
+}
 #endif
 
 #ifdef HAVE_SENDFILE4_SUPPORT
@@ -164,7 +164,7 @@ static int dnet_send_idc(struct dnet_net_state *lstate, struct dnet_net_state *s
 
 	gettimeofday(&start, NULL);
 
-	buf = malloc(size);
+	buf = dnet_send_alloc(size);
 	if (!buf) {
 		err = -ENOMEM;
 		goto err_out_exit;
@@ -182,9 +182,7 @@ static int dnet_send_idc(struct dnet_net_state *lstate, struct dnet_net_state *s
 			dnet_server_convert_dnet_addr_raw(dnet_state_addr(send), client_addr, sizeof(client_addr)),
 			n->addr_num, diff);
 
-	err = dnet_send(send, buf, size);
-
-	free(buf);
+	err = dnet_send_commit(send, buf);
 
 err_out_exit:
 	return err;
@@ -329,8 +327,8 @@ static int dnet_cmd_route_list(struct dnet_net_state *orig, struct dnet_cmd *cmd
 	struct dnet_node *n = orig->n;
 	struct dnet_net_state *st;
 	struct dnet_group *g;
-	void *buf = NULL;
-	size_t size, orig_size = 0;
+	void *buf;
+	size_t size;
 	int err;
 
 	pthread_mutex_lock(&n->state_lock);
@@ -342,14 +340,10 @@ static int dnet_cmd_route_list(struct dnet_net_state *orig, struct dnet_cmd *cmd
 			size = st->idc->id_num * sizeof(struct dnet_raw_id) +
 				sizeof(struct dnet_addr_cmd) + n->addr_num * sizeof(struct dnet_addr);
 
-			if (size > orig_size) {
-				buf = realloc(buf, size);
-				if (!buf) {
-					err = -ENOMEM;
-					goto err_out_unlock;
-				}
-
-				orig_size = size;
+			buf = dnet_send_alloc(size);
+			if (!buf) {
+				err = -ENOMEM;
+				goto err_out_unlock;
 			}
 
 			dnet_log(n, DNET_LOG_NOTICE, "%s: %d %s, id_num: %d, addr_num: %d\n",
@@ -361,7 +355,7 @@ static int dnet_cmd_route_list(struct dnet_net_state *orig, struct dnet_cmd *cmd
 			cmd->id.group_id = g->group_id;
 			dnet_send_idc_fill(st, buf, size, &cmd->id, cmd->trans, DNET_CMD_ROUTE_LIST, 1, 0, 1);
 
-			err = dnet_send(orig, buf, size);
+			err = dnet_send_commit(orig, buf);
 			if (err)
 				goto err_out_unlock;
 		}
@@ -371,7 +365,6 @@ static int dnet_cmd_route_list(struct dnet_net_state *orig, struct dnet_cmd *cmd
 
 err_out_unlock:
 	pthread_mutex_unlock(&n->state_lock);
-	free(buf);
 	return err;
 }
 
@@ -401,12 +394,17 @@ err_out_exit:
 	return err;
 }
 
-static int dnet_cmd_stat_count_single(struct dnet_net_state *orig, struct dnet_cmd *cmd, struct dnet_net_state *st, struct dnet_addr_stat *as)
+static int dnet_cmd_stat_count_single(struct dnet_net_state *orig, struct dnet_cmd *cmd, struct dnet_net_state *st)
 {
+	struct dnet_addr_stat *as;
 	int i;
 
 	cmd->cmd = DNET_CMD_STAT_COUNT;
 
+	as = dnet_send_reply_alloc(cmd, sizeof(struct dnet_addr_stat) + __DNET_CMD_MAX * sizeof(struct dnet_stat_count), 1);
+	if (!as)
+		return -ENOMEM;
+
 	memcpy(&as->addr, &st->addr, sizeof(struct dnet_addr));
 	as->num = __DNET_CMD_MAX;
 	as->cmd_num = __DNET_CMD_MAX;
@@ -417,27 +415,67 @@ static int dnet_cmd_stat_count_single(struct dnet_net_state *orig, struct dnet_c
 
 	dnet_convert_addr_stat(as, as->num);
 
-	return dnet_send_reply(orig, cmd, as, sizeof(struct dnet_addr_stat) + __DNET_CMD_MAX * sizeof(struct dnet_stat_count), 1);
+	return dnet_send_reply_commit(orig, as);
 }
 
-static int dnet_cmd_stat_count_global(struct dnet_net_state *orig, struct dnet_cmd *cmd,
-		struct dnet_node *n, struct dnet_addr_stat *as)
+static int dnet_cmd_stat_count_latency(struct dnet_net_state *orig, struct dnet_cmd *cmd, struct dnet_node *n)
 {
+	struct dnet_addr_latency_stat *ls;
+	int num = __DNET_LATENCY_HIST_MAX * __DNET_CMD_MAX;
+
+	cmd->cmd = DNET_CMD_STAT_COUNT;
+	cmd->flags |= DNET_ATTR_CNTR_LATENCY;
+
+	ls = dnet_send_reply_alloc(cmd, sizeof(struct dnet_addr_latency_stat) + num * sizeof(struct dnet_latency_hist), 1);
+	if (!ls)
+		return -ENOMEM;
+
+	memcpy(&ls->addr, &orig->addr, sizeof(struct dnet_addr));
+	ls->num = num;
+	ls->cmd_num = __DNET_CMD_MAX;
+	ls->hist_size = DNET_LATENCY_HIST_SIZE;
+	memcpy(ls->magic, DNET_LATENCY_STAT_MAGIC, sizeof(ls->magic));
+
+	dnet_io_latency_stat(n, ls->hist);
+
+	dnet_convert_addr_latency_stat(ls, ls->num);
+
+	return dnet_send_reply_commit(orig, ls);
+}
+
+static int dnet_cmd_stat_count_global(struct dnet_net_state *orig, struct dnet_cmd *cmd, struct dnet_node *n)
+{
+	struct dnet_addr_stat *as;
+	struct dnet_stat_count count[__DNET_CNTR_MAX];
 	struct dnet_stat st;
+	uint64_t flags = cmd->flags;
 	int err = 0;
 
 	cmd->cmd = DNET_CMD_STAT_COUNT;
 
+	/* counters reply never carries latency flag, so that client can tell replies apart */
+	cmd->flags &= ~DNET_ATTR_CNTR_LATENCY;
+	as = dnet_send_reply_alloc(cmd, sizeof(struct dnet_addr_stat) + __DNET_CNTR_MAX * sizeof(struct dnet_stat_count), 1);
+	cmd->flags = flags;
+	if (!as)
+		return -ENOMEM;
+
 	memcpy(&as->addr, &orig->addr, sizeof(struct dnet_addr));
 	as->num = __DNET_CNTR_MAX;
 	as->cmd_num = __DNET_CMD_MAX;
 
-	memcpy(as->count, n->counters, sizeof(struct dnet_stat_count) * __DNET_CNTR_MAX);
+	/* counters are filled in aligned buffer, reply structure is packed */
+	memcpy(count, n->counters, sizeof(count));
+	dnet_io_stat(n, count);
+	dnet_locks_stat(n, count);
+	memcpy(as->count, count, sizeof(count));
 
 	if (n->cb->storage_stat) {
 		err = n->cb->storage_stat(n->cb->command_private, &st);
-		if (err)
+		if (err) {
+			dnet_send_reply_free(as);
 			return err;
+		}
 
 		as->count[DNET_CNTR_LA1].count = st.la[0];
 		as->count[DNET_CNTR_LA5].count = st.la[1];
@@ -457,39 +495,38 @@ static int dnet_cmd_stat_count_global(struct dnet_net_state *orig, struct dnet_c
 		as->count[DNET_CNTR_VM_FREE].count = st.vm_free;
 		as->count[DNET_CNTR_VM_CACHED].count = st.vm_cached;
 		as->count[DNET_CNTR_VM_BUFFERS].count = st.vm_buffers;
+		as->count[DNET_CNTR_READ_RANDOM].count = st.read_random;
+		as->count[DNET_CNTR_READ_RANDOM].err = st.read_random_hot;
+		as->count[DNET_CNTR_BLOB_RANDOM].count = st.blob_tracked;
+		as->count[DNET_CNTR_BLOB_RANDOM].err = st.blob_random;
 	}
 
 	dnet_convert_addr_stat(as, as->num);
 
-	return dnet_send_reply(orig, cmd, as, sizeof(struct dnet_addr_stat) + __DNET_CNTR_MAX * sizeof(struct dnet_stat_count), 1);
+	return dnet_send_reply_commit(orig, as);
 }
 
 static int dnet_cmd_stat_count(struct dnet_net_state *orig, struct dnet_cmd *cmd, void *data __unused)
 {
 	struct dnet_node *n = orig->n;
 	struct dnet_net_state *st;
-	struct dnet_addr_stat *as;
 	int err = 0;
 
-	as = alloca(sizeof(struct dnet_addr_stat) + __DNET_CNTR_MAX * sizeof(struct dnet_stat_count));
-	if (!as) {
-		err = -ENOMEM;
-		goto err_out_exit;
-	}
-
 	if (cmd->flags & DNET_ATTR_CNTR_GLOBAL) {
-		err = dnet_cmd_stat_count_global(orig, cmd, orig->n, as);
+		err = dnet_cmd_stat_count_global(orig, cmd, orig->n);
+		if (!err && (cmd->flags & DNET_ATTR_CNTR_LATENCY))
+			err = dnet_cmd_stat_count_latency(orig, cmd, orig->n);
 	} else {
 		pthread_mutex_lock(&n->state_lock);
 #if 0
 	list_for_each_entry(st, &n->state_list, state_entry) {
-		err = dnet_cmd_stat_count_single(orig, cmd, st, as);
+		err = dnet_cmd_stat_count_single(orig, cmd, st);
 		if (err)
 			goto err_out_unlock;
 	}
 #endif
 		list_for_each_entry(st, &n->empty_state_list, state_entry) {
-			err = dnet_cmd_stat_count_single(orig, cmd, st, as);
+			err = dnet_cmd_stat_count_single(orig, cmd, st);
 			if (err)
 				goto err_out_unlock;
 		}
@@ -497,7 +534,6 @@ err_out_unlock:
 		pthread_mutex_unlock(&n->state_lock);
 	}
 
-err_out_exit:
 	return err;
 }
 
@@ -571,28 +607,36 @@ err_out_exit:
 
 int dnet_send_ack(struct dnet_net_state *st, struct dnet_cmd *cmd, int err, int recursive)
 {
+	/* commands processed on behalf of the node itself are not acked, like replies are not sent */
+	if (st && st == st->n->st)
+		return err;
+
 	if (st && cmd && (cmd->flags & DNET_FLAGS_NEED_ACK)) {
 		struct dnet_node *n = st->n;
 		unsigned long long tid = cmd->trans & ~DNET_TRANS_REPLY;
-		struct dnet_cmd ack;
+		struct dnet_cmd *ack;
+
+		ack = dnet_send_alloc(sizeof(struct dnet_cmd));
+		if (!ack)
+			return -ENOMEM;
 
-		memcpy(&ack.id, &cmd->id, sizeof(struct dnet_id));
-		ack.cmd = cmd->cmd;
-		ack.trans = cmd->trans | DNET_TRANS_REPLY;
-		ack.size = 0;
+		memcpy(&ack->id, &cmd->id, sizeof(struct dnet_id));
+		ack->cmd = cmd->cmd;
+		ack->trans = cmd->trans | DNET_TRANS_REPLY;
+		ack->size = 0;
 		// In recursive mode keep DNET_FLAGS_MORE flag
 		if (recursive)
-			ack.flags = cmd->flags & ~(DNET_FLAGS_NEED_ACK);
+			ack->flags = cmd->flags & ~(DNET_FLAGS_NEED_ACK);
 		else
-			ack.flags = cmd->flags & ~(DNET_FLAGS_NEED_ACK | DNET_FLAGS_MORE);
-		ack.status = err;
+			ack->flags = cmd->flags & ~(DNET_FLAGS_NEED_ACK | DNET_FLAGS_MORE);
+		ack->status = err;
 
 		dnet_log(n, DNET_LOG_NOTICE, "%s: %s: ack -> %s: trans: %llu, flags: 0x%llx, status: %d.\n",
 				dnet_dump_id(&cmd->id), dnet_cmd_string(cmd->cmd), dnet_server_convert_dnet_addr(&st->addr),
-				tid, (unsigned long long)ack.flags, err);
+				tid, (unsigned long long)ack->flags, err);
 
-		dnet_convert_cmd(&ack);
-		err = dnet_send(st, &ack, sizeof(struct dnet_cmd));
+		dnet_convert_cmd(ack);
+		err = dnet_send_commit(st, ack);
 	}
 
 	return err;
@@ -934,11 +978,92 @@ err_out_exit:
 	return err;
 }
 
+/*
+ * Commands which do not modify the key share its operation lock
+ */
+static int dnet_cmd_oplock_mode(struct dnet_cmd *cmd)
+{
+	switch (cmd->cmd) {
+		case DNET_CMD_READ:
+		case DNET_CMD_LOOKUP:
+		case DNET_CMD_BULK_READ:
+			return DNET_OPLOCK_READ;
+		default:
+			return DNET_OPLOCK_WRITE;
+	}
+}
+
+/* number of sorted bulk read objects kernel is asked to read ahead */
+#define DNET_BULK_READ_READAHEAD	16
+
+struct dnet_bulk_read_entry {
+	struct dnet_io_attr	*io;
+	int			fd;
+	uint64_t		offset;
+	uint64_t		size;
+};
+
+/*
+ * Orders by file and offset, keys which backend could not locate go last
+ */
+static int dnet_bulk_read_entry_cmp(const void *p1, const void *p2)
+{
+	const struct dnet_bulk_read_entry *e1 = p1, *e2 = p2;
+
+	if (e1->fd != e2->fd)
+		return ((unsigned int)e1->fd < (unsigned int)e2->fd) ? -1 : 1;
+	if (e1->offset != e2->offset)
+		return (e1->offset < e2->offset) ? -1 : 1;
+
+	return 0;
+}
+
+static void dnet_bulk_read_readahead(struct dnet_bulk_read_entry *e)
+{
+	if (e->fd >= 0 && e->size)
+		posix_fadvise(e->fd, e->offset, e->size, POSIX_FADV_WILLNEED);
+}
+
+/*
+ * Resolves data location of every key and sorts keys by it, so that disk is read in one pass.
+ * Returns NULL if backend can not locate objects, keys are read in request order then.
+ */
+static struct dnet_bulk_read_entry *dnet_bulk_read_sort(struct dnet_node *n, struct dnet_io_attr *ios, uint64_t count)
+{
+	struct dnet_bulk_read_entry *entries;
+	uint64_t i;
+	int err;
+
+	if (!n->cb->location || count < 2)
+		return NULL;
+
+	entries = malloc(count * sizeof(struct dnet_bulk_read_entry));
+	if (!entries)
+		return NULL;
+
+	for (i = 0; i < count; ++i) {
+		struct dnet_bulk_read_entry *e = &entries[i];
+
+		e->io = &ios[i];
+
+		err = n->cb->location(n->cb->command_private, ios[i].id, &e->fd, &e->offset, &e->size);
+		if (err) {
+			e->fd = -1;
+			e->offset = e->size = 0;
+		}
+	}
+
+	qsort(entries, count, sizeof(struct dnet_bulk_read_entry), dnet_bulk_read_entry_cmp);
+
+	return entries;
+}
+
 static int dnet_cmd_bulk_read(struct dnet_net_state *st, struct dnet_cmd *cmd, void *data)
 {
 	int err = -1, ret;
 	struct dnet_io_attr *io = data;
 	struct dnet_io_attr *ios = io + 1;
+	struct dnet_bulk_read_entry *entries;
 	uint64_t count = 0;
 	uint64_t i;
 
@@ -962,11 +1087,30 @@ static int dnet_cmd_bulk_read(struct dnet_net_state *st, struct dnet_cmd *cmd, v
 		dnet_opunlock(st->n, &cmd->id);
 	}
 
-	dnet_log(st->n, DNET_LOG_NOTICE, "%s: starting BULK_READ for %d commands\n",
-		dnet_dump_id(&cmd->id), (int) count);
+	entries = dnet_bulk_read_sort(st->n, ios, count);
+
+	dnet_log(st->n, DNET_LOG_NOTICE, "%s: starting BULK_READ for %d commands, sorted: %d\n",
+		dnet_dump_id(&cmd->id), (int) count, !!entries);
+
+	/*
+	 * Kernel reads the next DNET_BULK_READ_READAHEAD objects in background while current one is sent,
+	 * so that disk has a bounded number of requests in flight
+	 */
+	if (entries) {
+		for (i = 0; i < count && i < DNET_BULK_READ_READAHEAD; ++i)
+			dnet_bulk_read_readahead(&entries[i]);
+	}
 
 	for (i = 0; i < count; i++) {
-		ret = dnet_process_cmd_raw(st, &read_cmd, &ios[i], 1);
+		if (entries) {
+			if (i + DNET_BULK_READ_READAHEAD < count)
+				dnet_bulk_read_readahead(&entries[i + DNET_BULK_READ_READAHEAD]);
+
+			ret = dnet_process_cmd_raw(st, &read_cmd, entries[i].io, 1);
+		} else {
+			ret = dnet_process_cmd_raw(st, &read_cmd, &ios[i], 1);
+		}
+
 		dnet_log(st->n, DNET_LOG_NOTICE, "%s: processing BULK_READ.READ for %d/%d command, err: %d\n",
 			dnet_dump_id(&cmd->id), (int) i, (int) count, ret);
 
@@ -979,13 +1123,134 @@ static int dnet_cmd_bulk_read(struct dnet_net_state *st, struct dnet_cmd *cmd, v
 			err = ret;
 	}
 
+	free(entries);
+
 	if (!(cmd->flags & DNET_FLAGS_NOLOCK)) {
-		dnet_oplock(st->n, &cmd->id);
+		dnet_oplock_mode(st->n, &cmd->id, dnet_cmd_oplock_mode(cmd));
 	}
 
 	return err;
 }
 
+/*
+ * Every object is written by recursive WRITE command processed against node's own state,
+ * so that per-object file info replies and acks are dropped, and client gets
+ * single reply with all statuses followed by transaction ack.
+ */
+static int dnet_cmd_bulk_write(struct dnet_net_state *st, struct dnet_cmd *cmd, void *data)
+{
+	struct dnet_node *n = st->n;
+	struct dnet_io_attr *io = data, *eio, tmp;
+	struct dnet_bulk_write_reply *reply;
+	struct dnet_cmd write_cmd;
+	uint64_t size, num, i;
+	void *ptr;
+	int err = -1, ret;
+
+	if (!n->st)
+		return -ENOTSUP;
+
+	if (cmd->size < sizeof(struct dnet_io_attr)) {
+		dnet_log(n, DNET_LOG_ERROR, "%s: BULK_WRITE: invalid size: %llu\n",
+			dnet_dump_id(&cmd->id), (unsigned long long)cmd->size);
+		return -EINVAL;
+	}
+
+	dnet_convert_io_attr(io);
+	num = io->num;
+	size = cmd->size - sizeof(struct dnet_io_attr);
+
+	if (io->size != size || num > size / sizeof(struct dnet_io_attr)) {
+		dnet_log(n, DNET_LOG_ERROR, "%s: BULK_WRITE: invalid header: num: %llu, size: %llu, rest: %llu\n",
+			dnet_dump_id(&cmd->id), (unsigned long long)num,
+			(unsigned long long)io->size, (unsigned long long)size);
+		return -EINVAL;
+	}
+
+	/* check the whole batch before anything is written */
+	ptr = io + 1;
+	for (i = 0; i < num; ++i) {
+		if (size < sizeof(struct dnet_io_attr))
+			break;
+
+		tmp = *(struct dnet_io_attr *)ptr;
+		dnet_convert_io_attr(&tmp);
+
+		if (tmp.size > size - sizeof(struct dnet_io_attr))
+			break;
+
+		size -= sizeof(struct dnet_io_attr) + tmp.size;
+		ptr += sizeof(struct dnet_io_attr) + tmp.size;
+	}
+
+	if (i != num || size) {
+		dnet_log(n, DNET_LOG_ERROR, "%s: BULK_WRITE: broken entry: %llu/%llu, rest: %llu\n",
+			dnet_dump_id(&cmd->id), (unsigned long long)i,
+			(unsigned long long)num, (unsigned long long)size);
+		return -EINVAL;
+	}
+
+	reply = dnet_send_reply_alloc(cmd, sizeof(struct dnet_bulk_write_reply) +
+			num * sizeof(struct dnet_bulk_write_status), 0);
+	if (!reply)
+		return -ENOMEM;
+
+	reply->num = num;
+
+	write_cmd = *cmd;
+	write_cmd.cmd = DNET_CMD_WRITE;
+	write_cmd.flags &= ~(DNET_FLAGS_NEED_ACK | DNET_FLAGS_MORE);
+
+	/* see dnet_cmd_bulk_read() */
+	if (!(cmd->flags & DNET_FLAGS_NOLOCK)) {
+		dnet_opunlock(n, &cmd->id);
+	}
+
+	dnet_log(n, DNET_LOG_NOTICE, "%s: starting BULK_WRITE for %llu commands\n",
+		dnet_dump_id(&cmd->id), (unsigned long long)num);
+
+	ptr = io + 1;
+	for (i = 0; i < num; ++i) {
+		eio = ptr;
+
+		tmp = *eio;
+		dnet_convert_io_attr(&tmp);
+		ptr += sizeof(struct dnet_io_attr) + tmp.size;
+
+		tmp.flags |= DNET_IO_FLAGS_WRITE_NO_FILE_INFO;
+		*eio = tmp;
+		dnet_convert_io_attr(eio);
+
+		memcpy(write_cmd.id.id, tmp.id, DNET_ID_SIZE);
+		write_cmd.size = sizeof(struct dnet_io_attr) + tmp.size;
+
+		ret = dnet_process_cmd_raw(n->st, &write_cmd, eio, 1);
+
+		dnet_log(n, DNET_LOG_NOTICE, "%s: processing BULK_WRITE.WRITE for %d/%d command, err: %d\n",
+			dnet_dump_id(&write_cmd.id), (int) i, (int) num, ret);
+
+		memcpy(reply->status[i].id.id, tmp.id, DNET_ID_SIZE);
+		reply->status[i].status = ret;
+
+		if (!ret)
+			err = 0;
+		else if (err == -1)
+			err = ret;
+	}
+
+	if (!(cmd->flags & DNET_FLAGS_NOLOCK)) {
+		dnet_oplock_mode(n, &cmd->id, dnet_cmd_oplock_mode(cmd));
+	}
+
+	dnet_convert_bulk_write_reply(reply, num);
+
+	ret = dnet_send_reply_commit(st, reply);
+	if (ret)
+		return ret;
+
+	return num ? err : 0;
+}
+
 int dnet_cas_local(struct dnet_node *n, struct dnet_id *id, void *remote_csum, int csize)
 {
 	char csum[DNET_ID_SIZE];
@@ -1032,6 +1297,122 @@ int dnet_cas_local(struct dnet_node *n, struct dnet_id *id, void *remote_csum, i
 	return err;
 }
 
+/*
+ * Command processed by the backend in this thread, only it may be completed asynchronously
+ */
+struct dnet_async_ctx {
+	struct dnet_net_state	*st;
+	struct dnet_cmd		*cmd;
+	void			*data;
+	struct timeval		start, backend_start;
+	struct dnet_async_reply	*reply;
+};
+
+static __thread struct dnet_async_ctx *dnet_thread_async;
+
+struct dnet_async_reply {
+	struct dnet_net_state	*st;
+	struct dnet_cmd		cmd;
+	struct dnet_io_attr	io;
+	struct timeval		start, backend_start;
+};
+
+static void dnet_backend_complete(struct dnet_net_state *st, struct dnet_cmd *cmd, void *data, int err,
+		struct timeval *backend_start)
+{
+	struct timeval end;
+
+	gettimeofday(&end, NULL);
+	dnet_io_latency_record(st->n, DNET_LATENCY_HIST_BACKEND, cmd->cmd,
+			(end.tv_sec - backend_start->tv_sec) * 1000000 + (end.tv_usec - backend_start->tv_usec));
+
+	/* If there was error in WRITE command - send empty reply
+	   to notify client with error code and destroy transaction */
+	if (err && ((cmd->cmd == DNET_CMD_WRITE) || (cmd->cmd == DNET_CMD_READ))) {
+		cmd->flags |= DNET_FLAGS_NEED_ACK;
+	}
+
+	if (!err && (cmd->cmd == DNET_CMD_WRITE)) {
+		dnet_update_notify(st, cmd, data);
+	}
+}
+
+static int dnet_cmd_complete(struct dnet_net_state *st, struct dnet_cmd *cmd, int err, int recursive,
+		struct timeval *start)
+{
+	struct dnet_node *n = st->n;
+	unsigned long long tid = cmd->trans & ~DNET_TRANS_REPLY;
+	struct timeval end;
+	long diff;
+
+	dnet_stat_inc(st->stat, cmd->cmd, err);
+	if (st->__join_state == DNET_JOIN)
+		dnet_counter_inc(n, cmd->cmd, err);
+	else
+		dnet_counter_inc(n, cmd->cmd + __DNET_CMD_MAX, err);
+
+	gettimeofday(&end, NULL);
+
+	diff = (end.tv_sec - start->tv_sec) * 1000000 + (end.tv_usec - start->tv_usec);
+	dnet_io_latency_record(n, DNET_LATENCY_HIST_CMD, cmd->cmd, diff);
+
+	dnet_log(n, DNET_LOG_INFO, "%s: %s: trans: %llu, cflags: 0x%llx, time: %ld usecs, err: %d.\n",
+			dnet_dump_id(&cmd->id), dnet_cmd_string(cmd->cmd), tid,
+			(unsigned long long)cmd->flags, diff, err);
+
+	err = dnet_send_ack(st, cmd, err, recursive);
+
+	if (!(cmd->flags & DNET_FLAGS_NOLOCK))
+		dnet_opunlock(n, &cmd->id);
+
+	return err;
+}
+
+struct dnet_async_reply *dnet_async_reply_start(void *state, struct dnet_cmd *cmd)
+{
+	struct dnet_async_ctx *ctx = dnet_thread_async;
+	struct dnet_async_reply *r;
+
+	if (!ctx || ctx->st != state || ctx->cmd != cmd || ctx->reply)
+		return NULL;
+
+	r = malloc(sizeof(struct dnet_async_reply));
+	if (!r)
+		return NULL;
+
+	r->st = dnet_state_get(ctx->st);
+	memcpy(&r->cmd, cmd, sizeof(struct dnet_cmd));
+	/* io attribute is needed for write notifications */
+	if (cmd->cmd == DNET_CMD_WRITE)
+		memcpy(&r->io, ctx->data, sizeof(struct dnet_io_attr));
+	else
+		memset(&r->io, 0, sizeof(struct dnet_io_attr));
+	r->start = ctx->start;
+	r->backend_start = ctx->backend_start;
+
+	ctx->reply = r;
+	return r;
+}
+
+void *dnet_async_reply_state(struct dnet_async_reply *r)
+{
+	return r->st;
+}
+
+struct dnet_cmd *dnet_async_reply_cmd(struct dnet_async_reply *r)
+{
+	return &r->cmd;
+}
+
+void dnet_async_reply_complete(struct dnet_async_reply *r, int err)
+{
+	dnet_backend_complete(r->st, &r->cmd, &r->io, err, &r->backend_start);
+	dnet_cmd_complete(r->st, &r->cmd, err, 0, &r->start);
+
+	dnet_state_put(r->st);
+	free(r);
+}
+
 int dnet_process_cmd_raw(struct dnet_net_state *st, struct dnet_cmd *cmd, void *data, int recursive)
 {
 	int err = 0;
@@ -1042,14 +1423,14 @@ int dnet_process_cmd_raw(struct dnet_net_state *st, struct dnet_cmd *cmd, void *
 #if 0
 	struct dnet_indexes_request *indexes_request;
 #endif
-	struct timeval start, end;
+	struct dnet_async_ctx async, *prev_async;
+	struct timeval start, backend_start;
 	char time_str[64];
 	struct tm io_tm;
 	struct timeval io_tv;
-	long diff;
 
 	if (!(cmd->flags & DNET_FLAGS_NOLOCK)) {
-		dnet_oplock(n, &cmd->id);
+		dnet_oplock_mode(n, &cmd->id, dnet_cmd_oplock_mode(cmd));
 	}
 
 	gettimeofday(&start, NULL);
@@ -1114,6 +1495,14 @@ int dnet_process_cmd_raw(struct dnet_net_state *st, struct dnet_cmd *cmd, void *
 		case DNET_CMD_BULK_READ:
 			err = dnet_cmd_bulk_read(st, cmd, data);
 			break;
+		case DNET_CMD_BULK_WRITE:
+			if (n->ro) {
+				err = -EROFS;
+				break;
+			}
+
+			err = dnet_cmd_bulk_write(st, cmd, data);
+			break;
 		case DNET_CMD_READ:
 		case DNET_CMD_WRITE:
 		case DNET_CMD_DEL:
@@ -1132,18 +1521,20 @@ int dnet_process_cmd_raw(struct dnet_net_state *st, struct dnet_cmd *cmd, void *
 			io = data;
 			dnet_convert_io_attr(io);
 
-			io_tv.tv_sec = io->timestamp.tsec;
-			io_tv.tv_usec = io->timestamp.tnsec / 1000;
+			if (dnet_log_enabled(n, DNET_LOG_INFO)) {
+				io_tv.tv_sec = io->timestamp.tsec;
+				io_tv.tv_usec = io->timestamp.tnsec / 1000;
 
-			localtime_r((time_t *)&io_tv.tv_sec, &io_tm);
-			strftime(time_str, sizeof(time_str), "%F %R:%S", &io_tm);
+				localtime_r((time_t *)&io_tv.tv_sec, &io_tm);
+				strftime(time_str, sizeof(time_str), "%F %R:%S", &io_tm);
 
-			dnet_log(n, DNET_LOG_INFO, "%s: %s io command, offset: %llu, size: %llu, ioflags: 0x%x, cflags: 0x%llx, "
-					"node-flags: 0x%x, ts: %ld.%06ld '%s'\n",
-					dnet_dump_id_str(io->id), dnet_cmd_string(cmd->cmd),
-					(unsigned long long)io->offset, (unsigned long long)io->size,
-					io->flags, (unsigned long long)cmd->flags,
-					n->flags, io_tv.tv_sec, io_tv.tv_usec, time_str);
+				dnet_log(n, DNET_LOG_INFO, "%s: %s io command, offset: %llu, size: %llu, ioflags: 0x%x, cflags: 0x%llx, "
+						"node-flags: 0x%x, ts: %ld.%06ld '%s'\n",
+						dnet_dump_id_str(io->id), dnet_cmd_string(cmd->cmd),
+						(unsigned long long)io->offset, (unsigned long long)io->size,
+						io->flags, (unsigned long long)cmd->flags,
+						n->flags, io_tv.tv_sec, io_tv.tv_usec, time_str);
+			}
 
 			if (n->flags & DNET_CFG_NO_CSUM)
 				io->flags |= DNET_IO_FLAGS_NOCSUM;
@@ -1178,39 +1569,36 @@ int dnet_process_cmd_raw(struct dnet_net_state *st, struct dnet_cmd *cmd, void *
 			if ((cmd->cmd == DNET_CMD_WRITE) || (cmd->cmd == DNET_CMD_READ)) {
 				cmd->flags &= ~DNET_FLAGS_NEED_ACK;
 			}
+			gettimeofday(&backend_start, NULL);
+
+			/*
+			 * Only commands received from the network may be completed asynchronously,
+			 * recursive ones and those of local sessions are waited for by the caller
+			 */
+			memset(&async, 0, sizeof(async));
+			async.st = st;
+			async.cmd = cmd;
+			async.data = data;
+			async.start = start;
+			async.backend_start = backend_start;
+
+			prev_async = dnet_thread_async;
+			dnet_thread_async = (!recursive && st != n->st && st->write_s >= 0) ? &async : NULL;
 			err = n->cb->command_handler(st, n->cb->command_private, cmd, data);
+			dnet_thread_async = prev_async;
 
-			/* If there was error in WRITE command - send empty reply
-			   to notify client with error code and destroy transaction */
-			if (err && ((cmd->cmd == DNET_CMD_WRITE) || (cmd->cmd == DNET_CMD_READ))) {
-				cmd->flags |= DNET_FLAGS_NEED_ACK;
+			/* ack, statistics and operation lock are handled by dnet_async_reply_complete() */
+			if (async.reply) {
+				dnet_log(n, DNET_LOG_NOTICE, "%s: %s: trans: %llu, completes asynchronously.\n",
+						dnet_dump_id(&cmd->id), dnet_cmd_string(cmd->cmd), tid);
+				return 0;
 			}
 
-			if (!err && (cmd->cmd == DNET_CMD_WRITE)) {
-				dnet_update_notify(st, cmd, data);
-			}
+			dnet_backend_complete(st, cmd, data, err, &backend_start);
 			break;
 	}
 
-	dnet_stat_inc(st->stat, cmd->cmd, err);
-	if (st->__join_state == DNET_JOIN)
-		dnet_counter_inc(n, cmd->cmd, err);
-	else
-		dnet_counter_inc(n, cmd->cmd + __DNET_CMD_MAX, err);
-
-	gettimeofday(&end, NULL);
-
-	diff = (end.tv_sec - start.tv_sec) * 1000000 + (end.tv_usec - start.tv_usec);
-	dnet_log(n, DNET_LOG_INFO, "%s: %s: trans: %llu, cflags: 0x%llx, time: %ld usecs, err: %d.\n",
-			dnet_dump_id(&cmd->id), dnet_cmd_string(cmd->cmd), tid,
-			(unsigned long long)cmd->flags, diff, err);
-
-	err = dnet_send_ack(st, cmd, err, recursive);
-
-	if (!(cmd->flags & DNET_FLAGS_NOLOCK))
-		dnet_opunlock(n, &cmd->id);
-
-	return err;
+	return dnet_cmd_complete(st, cmd, err, recursive, &start);
 }
 
 int dnet_state_join_nolock(struct dnet_net_state *st)
@@ -1354,8 +1742,8 @@ err_out_exit:
 }
 */
 
-int dnet_send_read_data(void *state, struct dnet_cmd *cmd, struct dnet_io_attr *io, void *data,
-		int fd, uint64_t offset, int on_exit)
+static int dnet_send_read_data_raw(void *state, struct dnet_cmd *cmd, struct dnet_io_attr *io, void *data,
+		int fd, uint64_t offset, int on_exit, void (*put)(void *priv), void *priv)
 {
 	struct dnet_net_state *st = state;
 	struct dnet_node *n = st->n;
@@ -1370,13 +1758,15 @@ int dnet_send_read_data(void *state, struct dnet_cmd *cmd, struct dnet_io_attr *
 	 * back to parental client, instead server will wrap data into
 	 * proper transaction reply next to this obscure packet.
 	 */
-	if (io->flags & DNET_IO_FLAGS_SKIP_SENDING)
-		return 0;
+	if (io->flags & DNET_IO_FLAGS_SKIP_SENDING) {
+		err = 0;
+		goto err_out_put;
+	}
 
 	c = malloc(hsize);
 	if (!c) {
 		err = -ENOMEM;
-		goto err_out_exit;
+		goto err_out_put;
 	}
 
 	memset(c, 0, hsize);
@@ -1413,17 +1803,45 @@ int dnet_send_read_data(void *state, struct dnet_cmd *cmd, struct dnet_io_attr *
 			goto err_out_free;
 	}
 
-	if (data)
+	/* reference to @data or @fd is consumed by send queue */
+	if (put && data)
+		err = dnet_send_data_ref(st, c, hsize, data, rio->size, put, priv);
+	else if (put)
+		err = dnet_send_fd_ref(st, c, hsize, fd, offset, rio->size, put, priv);
+	else if (data)
 		err = dnet_send_data(st, c, hsize, data, rio->size);
 	else
 		err = dnet_send_fd(st, c, hsize, fd, offset, rio->size, on_exit);
 
+	free(c);
+	return err;
+
 err_out_free:
 	free(c);
-err_out_exit:
+err_out_put:
+	if (put)
+		put(priv);
 	return err;
 }
 
+int dnet_send_read_data(void *state, struct dnet_cmd *cmd, struct dnet_io_attr *io, void *data,
+		int fd, uint64_t offset, int on_exit)
+{
+	return dnet_send_read_data_raw(state, cmd, io, data, fd, offset, on_exit, NULL, NULL);
+}
+
+int dnet_send_read_data_ref(void *state, struct dnet_cmd *cmd, struct dnet_io_attr *io, void *data,
+		void (*put)(void *priv), void *priv)
+{
+	return dnet_send_read_data_raw(state, cmd, io, data, -1, 0, 0, put, priv);
+}
+
+int dnet_send_read_fd_ref(void *state, struct dnet_cmd *cmd, struct dnet_io_attr *io,
+		int fd, uint64_t offset, void (*put)(void *priv), void *priv)
+{
+	return dnet_send_read_data_raw(state, cmd, io, NULL, fd, offset, 0, put, priv);
+}
+
 static void dnet_fill_state_addr(void *state, struct dnet_addr *addr)
 {
 	struct dnet_net_state *st = state;
@@ -1476,7 +1894,7 @@ int dnet_send_file_info(void *state, struct dnet_cmd *cmd, int fd, uint64_t offs
 
 	flen = err;
 
-	addr = malloc(sizeof(struct dnet_addr) + sizeof(struct dnet_file_info) + flen);
+	addr = dnet_send_reply_alloc(cmd, sizeof(struct dnet_addr) + sizeof(struct dnet_file_info) + flen, 0);
 	if (!addr) {
 		err = -ENOMEM;
 		goto err_out_free_file;
@@ -1524,10 +1942,11 @@ int dnet_send_file_info(void *state, struct dnet_cmd *cmd, int fd, uint64_t offs
 
 	dnet_convert_file_info(info);
 
-	err = dnet_send_reply(state, cmd, addr, sizeof(struct dnet_addr) + sizeof(struct dnet_file_info) + flen, 0);
+	free(file);
+	return dnet_send_reply_commit(state, addr);
 
 err_out_free:
-	free(addr);
+	dnet_send_reply_free(addr);
 err_out_free_file:
 	free(file);
 err_out_exit:
@@ -1561,7 +1980,7 @@ int dnet_send_file_info_ts(void *state, struct dnet_cmd *cmd, int fd,
 	}
 
 	a_size = sizeof(struct dnet_addr) + sizeof(struct dnet_file_info) + flen;
-	a = calloc(1, a_size);
+	a = dnet_send_reply_alloc(cmd, a_size, 0);
 	if (a == NULL) {
 		err = -ENOMEM;
 		goto err_out_free_file;
@@ -1583,8 +2002,7 @@ int dnet_send_file_info_ts(void *state, struct dnet_cmd *cmd, int fd,
 				info->size, info->checksum, sizeof(info->checksum));
 
 	dnet_convert_file_info(info);
-	err = dnet_send_reply(state, cmd, a, a_size, 0);
-	free(a);
+	err = dnet_send_reply_commit(state, a);
 
 err_out_free_file:
 	free(file);
@@ -1604,8 +2022,9 @@ int dnet_send_file_info_ts_without_fd(void *state, struct dnet_cmd *cmd, const v
 	struct dnet_addr *a;
 	const size_t a_size = sizeof(struct dnet_addr) + sizeof(struct dnet_file_info) + 1;
 
-	a = alloca(a_size);
-	memset(a, 0, a_size);
+	a = dnet_send_reply_alloc(cmd, a_size, 0);
+	if (!a)
+		return -ENOMEM;
 
 	info = (struct dnet_file_info *)(a + 1);
 
@@ -1622,7 +2041,7 @@ int dnet_send_file_info_ts_without_fd(void *state, struct dnet_cmd *cmd, const v
 		info->mtime = *timestamp;
 
 	dnet_convert_file_info(info);
-	return dnet_send_reply(state, cmd, a, a_size, 0);
+	return dnet_send_reply_commit(state, a);
 }
 
 int dnet_checksum_data(struct dnet_node *n, const void *data, uint64_t size, unsigned char *csum, int csize)
@@ -140,6 +140,7 @@ static char *dnet_cmd_strings[] = {
 	[DNET_CMD_INDEXES_UPDATE] = "INDEXES_UPDATE",
 	[DNET_CMD_INDEXES_INTERNAL] = "INDEXES_INTERNAL",
 	[DNET_CMD_INDEXES_FIND] = "INDEXES_FIND",
+	[DNET_CMD_BULK_WRITE] = "BULK_WRITE",
 	[DNET_CMD_UNKNOWN] = "UNKNOWN",
 };
 
@@ -170,6 +171,27 @@ static char *dnet_counter_strings[] = {
 	[DNET_CNTR_DBR_ERROR] = "DNET_CNTR_DBR_ERROR",
 	[DNET_CNTR_DBW_SYSTEM] = "DNET_CNTR_DBW_SYSTEM",
 	[DNET_CNTR_DBW_ERROR] = "DNET_CNTR_DBW_ERROR",
+	[DNET_CNTR_CACHE_LOCK] = "DNET_CNTR_CACHE_LOCK",
+	[DNET_CNTR_CACHE_LOCK_MAX_SHARD] = "DNET_CNTR_CACHE_LOCK_MAX_SHARD",
+	[DNET_CNTR_CACHE_HIT] = "DNET_CNTR_CACHE_HIT",
+	[DNET_CNTR_CACHE_ADMIT] = "DNET_CNTR_CACHE_ADMIT",
+	[DNET_CNTR_CACHE_EVICT] = "DNET_CNTR_CACHE_EVICT",
+	[DNET_CNTR_CACHE_MEMORY] = "DNET_CNTR_CACHE_MEMORY",
+	[DNET_CNTR_CACHE_SYNC_QUEUE] = "DNET_CNTR_CACHE_SYNC_QUEUE",
+	[DNET_CNTR_CACHE_SYNC_TIME] = "DNET_CNTR_CACHE_SYNC_TIME",
+	[DNET_CNTR_RECV_CALLS] = "DNET_CNTR_RECV_CALLS",
+	[DNET_CNTR_RECV_POOL] = "DNET_CNTR_RECV_POOL",
+	[DNET_CNTR_RECV_LARGE] = "DNET_CNTR_RECV_LARGE",
+	[DNET_CNTR_IO_PRIO_HIGH] = "DNET_CNTR_IO_PRIO_HIGH",
+	[DNET_CNTR_IO_PRIO_NORMAL] = "DNET_CNTR_IO_PRIO_NORMAL",
+	[DNET_CNTR_IO_PRIO_BACKGROUND] = "DNET_CNTR_IO_PRIO_BACKGROUND",
+	[DNET_CNTR_HEDGE_READ] = "DNET_CNTR_HEDGE_READ",
+	[DNET_CNTR_LOG_DROPPED] = "DNET_CNTR_LOG_DROPPED",
+	[DNET_CNTR_OPLOCK] = "DNET_CNTR_OPLOCK",
+	[DNET_CNTR_OPLOCK_SHARED] = "DNET_CNTR_OPLOCK_SHARED",
+	[DNET_CNTR_OPLOCK_STRIPE] = "DNET_CNTR_OPLOCK_STRIPE",
+	[DNET_CNTR_READ_RANDOM] = "DNET_CNTR_READ_RANDOM",
+	[DNET_CNTR_BLOB_RANDOM] = "DNET_CNTR_BLOB_RANDOM",
 	[DNET_CNTR_UNKNOWN] = "UNKNOWN",
 };
 
@@ -1486,6 +1508,36 @@ static int dnet_stat_complete(struct dnet_net_state *state, struct dnet_cmd *cmd
 				(unsigned long long)(st->bavail * st->bsize / 1024 / 1024),
 				(unsigned long long)st->files, (unsigned long long)st->fsid);
 		err = 0;
+	} else if (cmd->cmd == DNET_CMD_STAT_COUNT && (cmd->flags & DNET_ATTR_CNTR_LATENCY) &&
+			dnet_addr_latency_stat_check((struct dnet_addr_latency_stat *)(cmd + 1), cmd->size)) {
+		struct dnet_addr_latency_stat *ls = (struct dnet_addr_latency_stat *)(cmd + 1);
+		struct dnet_latency_hist *h;
+		int i;
+
+		dnet_convert_addr_latency_stat(ls, dnet_addr_latency_stat_num(cmd->size));
+
+		if (ls->hist_size != DNET_LATENCY_HIST_SIZE || ls->num != dnet_addr_latency_stat_num(cmd->size))
+			return -EINVAL;
+
+		for (i=0; i<ls->num; ++i) {
+			h = &ls->hist[i];
+			if (!h->count)
+				continue;
+
+			dnet_log(state->n, DNET_LOG_DATA, "%s: %s:    %s %s latency: count: %llu, avg: %llu, "
+					"p50: %llu, p90: %llu, p99: %llu, p999: %llu, max: %llu usecs\n",
+					dnet_dump_id(&cmd->id), dnet_state_dump_addr(state),
+					(i < ls->cmd_num) ? "cmd" : "backend",
+					dnet_cmd_string(i % ls->cmd_num),
+					(unsigned long long)h->count,
+					(unsigned long long)(h->sum / h->count),
+					(unsigned long long)dnet_latency_hist_percentile(h, 50),
+					(unsigned long long)dnet_latency_hist_percentile(h, 90),
+					(unsigned long long)dnet_latency_hist_percentile(h, 99),
+					(unsigned long long)dnet_latency_hist_percentile(h, 99.9),
+					(unsigned long long)h->max);
+		}
+		err = 0;
 	} else if (cmd->size >= sizeof(struct dnet_addr_stat) && cmd->cmd == DNET_CMD_STAT_COUNT) {
 		struct dnet_addr_stat *as = (struct dnet_addr_stat *)(cmd + 1);
 		int i;
@@ -2025,13 +2077,101 @@ static int dnet_weight_get_winner(struct dnet_weight *w, int num)
 	return num - 1;
 }
 
+struct dnet_latency_weight {
+	uint64_t		score;
+	int			group_id;
+};
+
+/*
+ * Expected reply time of the state: read latency EWMA multiplied by the number
+ * of requests already in flight to it
+ */
+static uint64_t dnet_state_latency_score(struct dnet_net_state *st)
+{
+	uint64_t ewma;
+	unsigned int inflight;
+
+	pthread_mutex_lock(&st->trans_lock);
+	ewma = st->latency[DNET_LATENCY_READ].ewma;
+	inflight = st->trans_table.num;
+	pthread_mutex_unlock(&st->trans_lock);
+
+	if (!ewma)
+		ewma = DNET_LATENCY_DEFAULT;
+
+	return ewma * (inflight + 1);
+}
+
+/*
+ * Orders groups by expected reply time. Every position is filled by the
+ * better of two randomly chosen remaining groups, so that all clients do not rush
+ * to the single fastest replica at once.
+ */
+static int dnet_mix_states_latency(struct dnet_node *n, struct dnet_id *id, int *groups, int group_num)
+{
+	struct dnet_latency_weight *w = alloca(group_num * sizeof(*w));
+	struct dnet_latency_weight tmp;
+	struct dnet_route_table *route;
+	struct dnet_net_state *st;
+	int i, a, b, num = 0, idx;
+
+	idx = dnet_route_read_lock(n);
+	route = dnet_route_get(n);
+	for (i = 0; route && i < group_num; ++i) {
+		id->group_id = groups[i];
+
+		st = dnet_route_search(route, id);
+		if (!st || st == n->st)
+			continue;
+
+		w[num].score = dnet_state_latency_score(st);
+		w[num].group_id = groups[i];
+		num++;
+	}
+	dnet_route_read_unlock(n, idx);
+
+	for (i = 0; !route && i < group_num; ++i) {
+		id->group_id = groups[i];
+
+		st = dnet_state_get_first(n, id);
+		if (!st)
+			continue;
+
+		w[num].score = dnet_state_latency_score(st);
+		w[num].group_id = groups[i];
+		num++;
+
+		dnet_state_put(st);
+	}
+
+	for (i = 0; i < num - 1; ++i) {
+		a = i + rand() % (num - i);
+		b = i + rand() % (num - i - 1);
+		if (b >= a)
+			b++;
+
+		if (w[b].score < w[a].score)
+			a = b;
+
+		tmp = w[i];
+		w[i] = w[a];
+		w[a] = tmp;
+	}
+
+	for (i = 0; i < num; ++i)
+		groups[i] = w[i].group_id;
+
+	return num;
+}
+
 int dnet_mix_states(struct dnet_session *s, struct dnet_id *id, int **groupsp)
 {
 	struct dnet_node *n = s->node;
 	struct dnet_weight *weights;
 	int *groups;
-	int group_num, i, num;
+	int group_num, i, num, idx;
 	struct dnet_net_state *st;
+	struct dnet_route_table *route;
 
 	if (!s->group_num)
 		return -ENXIO;
@@ -2054,6 +2194,15 @@ int dnet_mix_states(struct dnet_session *s, struct dnet_id *id, int **groupsp)
 			weights[i].group_id = groups[i];
 		}
 		num = group_num;
+	} else if ((n->flags & DNET_CFG_LATENCY_STATES) && id) {
+		num = dnet_mix_states_latency(n, id, groups, group_num);
+		if (num == 0) {
+			free(groups);
+			return -ENXIO;
+		}
+
+		*groupsp = groups;
+		return num;
 	} else {
 		if (!(n->flags & DNET_CFG_MIX_STATES) || !id) {
 			*groupsp = groups;
@@ -2062,7 +2211,23 @@ int dnet_mix_states(struct dnet_session *s, struct dnet_id *id, int **groupsp)
 
 		memset(weights, 0, group_num * sizeof(*weights));
 
-		for (i = 0, num = 0; i < group_num; ++i) {
+		/* all groups are looked up in the same routing table snapshot without taking any locks */
+		idx = dnet_route_read_lock(n);
+		route = dnet_route_get(n);
+		for (i = 0, num = 0; route && i < group_num; ++i) {
+			id->group_id = groups[i];
+
+			st = dnet_route_search(route, id);
+			if (st && st != n->st) {
+				weights[num].weight = (int)st->weight;
+				weights[num].group_id = id->group_id;
+
+				num++;
+			}
+		}
+		dnet_route_read_unlock(n, idx);
+
+		for (i = 0, num = 0; !route && i < group_num; ++i) {
 			id->group_id = groups[i];
 
 			st = dnet_state_get_first(n, id);
@@ -62,9 +62,13 @@ struct dnet_net_state;
 
 extern __thread uint32_t trace_id;
 
+/* must be checked before any work done only to prepare log arguments */
+#define dnet_log_enabled(n, level)								\
+	((n)->log && (((n)->log->log_level >= (level)) || (trace_id & DNET_TRACE_BIT)))
+
 #define dnet_log(n, level, format, a...)							\
 	do {											\
-		if (n->log && ((n->log->log_level >= level) || (trace_id & DNET_TRACE_BIT)))	\
+		if (dnet_log_enabled(n, level))							\
 			dnet_log_raw(n, level, format, ##a);					\
 		} while (0)
 #define dnet_log_err(n, f, a...) dnet_log(n, DNET_LOG_ERROR, f ": %s [%d].\n", ##a, strerror(errno), errno)
@@ -84,6 +88,23 @@ struct dnet_io_req {
 	int			fd;
 	off_t			local_offset;
 	size_t			fsize;
+
+	/*
+	 * If set, @data is not copied into request, but referenced,
+	 * @data_put(@data_priv) is called when request is destroyed
+	 */
+	void			(*data_put)(void *priv);
+	void			*data_priv;
+
+	/*
+	 * Size-class pool received request was taken from,
+	 * NULL if request was allocated by malloc()
+	 */
+	struct dnet_io_req_pool	*pool;
+
+	/* scheduling class of received request and time it was queued in usecs */
+	int			prio;
+	uint64_t		queue_time;
 };
 
 /*
@@ -97,6 +118,14 @@ struct dnet_io_req {
 /* Attached data should be discarded */
 #define DNET_IO_DROP		(1<<1)
 
+/*
+ * Every connection receives into its own buffer of this size,
+ * so many small commands are read by single recv() call.
+ * Bodies bigger than @DNET_RECV_DIRECT_SIZE are received directly into request.
+ */
+#define DNET_RECV_BUFFER_SIZE		(16 * 1024)
+#define DNET_RECV_DIRECT_SIZE		(4 * 1024)
+
 #define DNET_STATE_MAX_WEIGHT		(1024 * 10)
 
 /* Iterator watermarks for sending data and sleeping */
@@ -106,6 +135,37 @@ struct dnet_io_req {
 /* Internal flag to ignore cache */
 #define DNET_IO_FLAGS_NOCACHE		(1<<28)
 
+/*
+ * Reply latency estimator: EWMA with 1/8 weight of the new sample and
+ * histogram of power-of-two usecs buckets, which is halved every
+ * @DNET_LATENCY_DECAY_COUNT samples, so that percentiles follow recent replies.
+ * States without samples are assumed to reply in @DNET_LATENCY_DEFAULT usecs.
+ */
+#define DNET_LATENCY_BUCKETS		24
+#define DNET_LATENCY_DECAY_COUNT	1024
+#define DNET_LATENCY_DEFAULT		1000
+
+struct dnet_latency {
+	uint64_t		ewma;
+	uint64_t		count;
+	uint32_t		hist[DNET_LATENCY_BUCKETS];
+};
+
+uint64_t dnet_latency_percentile(struct dnet_latency *l, int percent);
+
+/*
+ * In-flight transactions of the state hashed by transaction id.
+ * Table doubles when it holds more transactions than buckets and
+ * halves when it is less than 1/8 full, buckets are allocated on first insert.
+ */
+#define DNET_TRANS_TABLE_MIN_SIZE	64
+
+struct dnet_trans_table {
+	struct list_head	*buckets;
+	unsigned int		size;
+	unsigned int		num;
+};
+
 struct dnet_net_state
 {
 	struct list_head	state_entry;
@@ -134,12 +194,19 @@ struct dnet_net_state
 
 	int			(* process)(struct dnet_net_state *st, struct epoll_event *ev);
 
+	/* network thread this state is attached to */
+	struct dnet_net_io	*net_io;
+
 	struct dnet_cmd		rcv_cmd;
 	uint64_t		rcv_offset;
 	uint64_t		rcv_end;
 	unsigned int		rcv_flags;
 	void			*rcv_data;
 
+	/* receive buffer, data in [@rcv_buf_head, @rcv_buf_tail) is not parsed yet */
+	char			*rcv_buf;
+	size_t			rcv_buf_head, rcv_buf_tail;
+
 	int			epoll_fd;
 	size_t			send_offset;
 	pthread_mutex_t		send_lock;
@@ -153,8 +220,12 @@ struct dnet_net_state
 	atomic_t		send_queue_size;
 
 	pthread_mutex_t		trans_lock;
-	struct rb_root		trans_root;
-	struct list_head	trans_list;
+	struct dnet_trans_table	trans_table;
+
+	/* time in msecs when stall counter was increased last time */
+	uint64_t		stall_time;
+	/* time in msecs when weight was increased after successful reply last time */
+	uint64_t		weight_time;
 
 
 	int			la;
@@ -162,6 +233,9 @@ struct dnet_net_state
 	float			weight;
 	long			median_read_time;
 
+	/* protected by @trans_lock */
+	struct dnet_latency	latency[__DNET_LATENCY_MAX];
+
 	struct dnet_idc		*idc;
 
 	struct dnet_stat_count	stat[__DNET_CMD_MAX];
@@ -188,6 +262,36 @@ struct dnet_idc {
 int dnet_idc_create(struct dnet_net_state *st, int group_id, struct dnet_raw_id *ids, int id_num);
 void dnet_idc_destroy_nolock(struct dnet_net_state *st);
 
+/*
+ * Immutable snapshot of the routing table.
+ * It is dropped when ids are added or removed and rebuilt from groups by the checking
+ * thread at most once per timer tick, snapshot is swapped under node's @route_lock.
+ * Readers do not take locks but only mark themselves in @route_readers of the current
+ * epoch, old snapshot is freed when readers of both epochs have left.
+ */
+struct dnet_route_entry {
+	struct dnet_raw_id	id;
+	struct dnet_net_state	*st;
+};
+
+struct dnet_route_group {
+	unsigned int		group_id;
+	int			id_num;
+	/* first 8 bytes of every id as big-endian number, full ids are compared only when they match */
+	uint64_t		*keys;
+	struct dnet_route_entry	*entries;
+};
+
+struct dnet_route_table {
+	uint64_t		version;
+	int			group_num;
+	/* sorted by group id */
+	struct dnet_route_group	groups[];
+};
+
+struct dnet_net_state *dnet_route_search(struct dnet_route_table *route, struct dnet_id *id);
+void dnet_route_update(struct dnet_node *n);
+
 int dnet_state_micro_init(struct dnet_net_state *st, struct dnet_node *n, struct dnet_addr *addr, int join,
 		int (* process)(struct dnet_net_state *st, struct epoll_event *ev));
 
@@ -253,6 +357,10 @@ struct dnet_wait
 	gettimeofday(&__tv, NULL);							\
 	__ts.tv_nsec = __tv.tv_usec * 1000 + (wts)->tv_nsec;				\
 	__ts.tv_sec = __tv.tv_sec + (wts)->tv_sec;						\
+	if (__ts.tv_nsec >= 1000000000) {						\
+		__ts.tv_sec++;								\
+		__ts.tv_nsec -= 1000000000;						\
+	}										\
 	pthread_mutex_lock(&(w)->wait_lock);						\
 	while (!(condition) && !__err)							\
 		__err = pthread_cond_timedwait(&(w)->wait, &(w)->wait_lock, &__ts);		\
@@ -339,8 +447,21 @@ struct dnet_net_io {
 	int			epoll_fd;
 	pthread_t		tid;
 	struct dnet_node	*n;
+
+	/* events returned by single epoll_wait() call */
+	int			max_events;
+	struct epoll_event	*events;
+
+	/* number of connections handled by this thread */
+	atomic_t		state_num;
 };
 
+/*
+ * Number of times state is processed in a row before network thread
+ * switches to the next ready state returned by the same epoll_wait() call
+ */
+#define DNET_NET_PROCESS_BUDGET		16
+
 enum dnet_work_io_mode {
 	DNET_WORK_IO_MODE_BLOCKING = 0,
 	DNET_WORK_IO_MODE_NONBLOCKING,
@@ -348,11 +469,23 @@ enum dnet_work_io_mode {
 };
 
 struct dnet_work_pool;
-struct dnet_work_io {
-	struct list_head	wio_entry;
-	int			thread_index;
-	pthread_t		tid;
-	struct dnet_work_pool	*pool;
+
+/*
+ * Scheduling classes of received requests, class is selected by DNET_FLAGS_PRIO_* command flags
+ * or derived from command type
+ */
+enum dnet_io_prio {
+	DNET_IO_PRIO_HIGH = 0,
+	DNET_IO_PRIO_NORMAL,
+	DNET_IO_PRIO_BACKGROUND,
+	__DNET_IO_PRIO_MAX,
+};
+
+struct dnet_io_prio_stat {
+	/* requests waiting in queues */
+	int64_t			queued;
+	/* moving average of time spent in queue in usecs */
+	uint64_t		wait_time;
 };
 
 struct list_stat {
@@ -394,56 +527,155 @@ static inline void list_stat_reset(struct list_stat *st, struct timeval *time) {
 	st->time_base.tv_usec = time->tv_usec;
 }
 
+struct dnet_work_io {
+	struct list_head	wio_entry;
+	int			thread_index;
+	pthread_t		tid;
+	struct dnet_work_pool	*pool;
+
+	pthread_mutex_t		lock;
+	pthread_cond_t		wait;
+
+	/*
+	 * Every scheduling class has two queues: requests which must be processed by this thread
+	 * (replies of claimed transactions and key-sticky commands) and requests which idle threads
+	 * are allowed to steal
+	 */
+	struct list_head	pinned_list[__DNET_IO_PRIO_MAX];
+	struct list_head	list[__DNET_IO_PRIO_MAX];
+	struct list_stat	list_stats;
+
+	/* weighted fair queueing between classes: virtual time of the next request of every class */
+	uint64_t		vtime[__DNET_IO_PRIO_MAX];
+	uint64_t		vclock;
+
+	int			idle;
+	int			wakeup;
+
+	/* updated only by this thread without locks, readers merge them in dnet_io_latency_stat() */
+	struct dnet_latency_hist	latency[__DNET_LATENCY_HIST_MAX * __DNET_CMD_MAX];
+};
+
+/*
+ * Multi-reply transaction claimed by worker thread,
+ * all its replies are queued to that thread to preserve their order
+ */
+struct dnet_work_trans {
+	struct list_head	trans_entry;
+	uint64_t		tid;
+	int			thread_index;
+	time_t			time;
+};
+
+#define DNET_WORK_TRANS_HASH_BITS	10
+#define DNET_WORK_TRANS_HASH_SIZE	(1 << DNET_WORK_TRANS_HASH_BITS)
+
+/* every bucket of claimed transactions map has its own lock, replies of different transactions do not contend */
+struct dnet_work_trans_bucket {
+	pthread_mutex_t		lock;
+	struct list_head	list;
+};
+
 struct dnet_work_pool {
 	struct dnet_node	*n;
 	int			mode;
 	int			num;
-	struct list_head	list;
-	struct list_stat	list_stats;
-	pthread_mutex_t		lock;
-	pthread_cond_t		wait;
+
+	/* commands are queued to the thread selected by hash of their IDs */
+	int			key_affinity;
+	unsigned int		next;
+
 	struct list_head	wio_list;
-	uint64_t		*trans;
+	struct dnet_work_io	**wio;
+
+	struct dnet_io_prio_stat	prio_stat[__DNET_IO_PRIO_MAX];
+
+	/* protects @wio_list */
+	pthread_mutex_t		lock;
+
+	struct dnet_work_trans_bucket	trans_hash[DNET_WORK_TRANS_HASH_SIZE];
+	/* updated only by checking thread, see dnet_io_trans_sweep() */
+	time_t			trans_sweep_time;
 };
 
 struct dnet_io {
 	int			need_exit;
 
-	int			net_thread_num, net_thread_pos;
+	int			net_thread_num;
 	struct dnet_net_io	*net;
 
 	struct dnet_work_pool	*recv_pool;
 	struct dnet_work_pool	*recv_pool_nb;
+
+	/* receive statistics, updated atomically by network threads */
+	uint64_t		recv_calls, recv_commands;
+	uint64_t		recv_large;
+
+	/* latency of commands processed outside of io pool threads, updated atomically */
+	struct dnet_latency_hist	latency[__DNET_LATENCY_HIST_MAX * __DNET_CMD_MAX];
 };
 
 int dnet_state_accept_process(struct dnet_net_state *st, struct epoll_event *ev);
 int dnet_state_net_process(struct dnet_net_state *st, struct epoll_event *ev);
 int dnet_io_init(struct dnet_node *n, struct dnet_config *cfg);
 void dnet_io_exit(struct dnet_node *n);
+void dnet_io_trans_sweep(struct dnet_node *n);
 
 void dnet_io_req_free(struct dnet_io_req *r);
+void dnet_io_req_pool_put(struct dnet_io_req *r);
+void dnet_io_stat(struct dnet_node *n, struct dnet_stat_count *count);
+void dnet_io_latency_record(struct dnet_node *n, int type, int cmd, uint64_t usecs);
+void dnet_io_latency_stat(struct dnet_node *n, struct dnet_latency_hist *hist);
 
+/*
+ * Lock of the single key, lives in its stripe's list only while somebody holds or waits for it.
+ * Entry is protected by stripe's lock, only requests which wait for this key sleep on @wait.
+ */
 struct dnet_locks_entry {
-	struct rb_node		lock_tree_entry;
 	struct list_head	lock_list_entry;
-	pthread_mutex_t		lock;
 	pthread_cond_t		wait;
 	struct dnet_raw_id	id;
-	int			locked;
-	atomic_t		refcnt;
+	int			readers;
+	int			writer;
+	int			waiting_writers;
+
+	/* number of holders and waiters */
+	int			refcnt;
 };
 
-struct dnet_locks {
-	struct list_head	lock_list;
-	struct rb_root		lock_tree;
+#define DNET_LOCKS_STRIPE_CACHE		16
+
+struct dnet_locks_stripe {
 	pthread_mutex_t		lock;
+	struct list_head	lock_list;
+
+	/* released entries are kept here to avoid condition variable setup on every lock */
+	struct list_head	free_list;
+	int			free_num;
+
+	/* statistics, updated under @lock */
+	uint64_t		taken, waited;
+	uint64_t		shared, shared_concurrent;
+	uint64_t		acquired, contended;
+} __attribute__ ((aligned(64)));
+
+struct dnet_locks {
+	unsigned int		num;
+	struct dnet_locks_stripe	stripes[0];
+};
+
+enum dnet_oplock_mode {
+	DNET_OPLOCK_WRITE = 0,			/* exclusive lock */
+	DNET_OPLOCK_READ,			/* shared with other readers of the same key */
 };
 
 void dnet_locks_destroy(struct dnet_node *n);
 int dnet_locks_init(struct dnet_node *n, int num);
 void dnet_oplock(struct dnet_node *n, struct dnet_id *key);
+void dnet_oplock_mode(struct dnet_node *n, struct dnet_id *key, int mode);
 void dnet_opunlock(struct dnet_node *n, struct dnet_id *key);
 int dnet_optrylock(struct dnet_node *n, struct dnet_id *key);
+void dnet_locks_stat(struct dnet_node *n, struct dnet_stat_count *count);
 
 struct dnet_config_data
 {
@@ -465,6 +697,29 @@ struct dnet_config_data
 	int cfg_backend_num;
 };
 
+/*
+ * Hierarchical timing wheel with millisecond resolution used for transaction timeouts.
+ * Root wheel has a slot per millisecond, every next level slot covers the whole previous level.
+ * Transactions are moved into lower levels when time reaches their slot,
+ * so expiration costs O(expired) plus one cascade per level step.
+ */
+#define DNET_TIMER_ROOT_BITS		8
+#define DNET_TIMER_ROOT_SIZE		(1 << DNET_TIMER_ROOT_BITS)
+#define DNET_TIMER_LEVEL_BITS		6
+#define DNET_TIMER_LEVEL_SIZE		(1 << DNET_TIMER_LEVEL_BITS)
+#define DNET_TIMER_LEVELS		3
+
+/* How frequently timer thread checks for expired transactions */
+#define DNET_TIMER_INTERVAL_MS		10
+
+struct dnet_trans_timer {
+	pthread_mutex_t		lock;
+	/* the next millisecond to be processed */
+	uint64_t		time;
+	struct list_head	root[DNET_TIMER_ROOT_SIZE];
+	struct list_head	level[DNET_TIMER_LEVELS][DNET_TIMER_LEVEL_SIZE];
+};
+
 struct dnet_node
 {
 	struct list_head	check_entry;
@@ -489,6 +744,15 @@ struct dnet_node
 	pthread_mutex_t		state_lock;
 	struct list_head	group_list;
 
+	/* routing table snapshot, see dnet_route_read_lock() */
+	struct dnet_route_table	*route;
+	pthread_mutex_t		route_lock;
+	uint64_t		route_version;
+	/* groups have changed since the last snapshot rebuild, protected by @state_lock */
+	int			route_dirty;
+	int			route_epoch;
+	atomic_t		route_readers[2];
+
 	/* hosts client states, i.e. those who didn't join network */
 	struct list_head	empty_state_list;
 
@@ -506,6 +770,8 @@ struct dnet_node
 	struct dnet_wait	*wait;
 	struct timespec		wait_ts;
 
+	struct dnet_trans_timer	trans_timer;
+
 	struct dnet_io		*io;
 
 	int			check_in_progress;
@@ -555,11 +821,37 @@ struct dnet_node
 	pthread_mutex_t		iterator_lock;
 
 	size_t			cache_size;
+	int			cache_shards;
+	int			cache_policy;
+	int			cache_sync_threads;
+	int			cache_sync_rate;
 	void			*cache;
 
 	struct dnet_config_data *config_data;
 };
 
+/*
+ * Route snapshot returned by dnet_route_get() can be used until dnet_route_read_unlock(),
+ * states found there must be referenced to be used after that.
+ */
+static inline int dnet_route_read_lock(struct dnet_node *n)
+{
+	int idx = *(volatile int *)&n->route_epoch & 1;
+
+	atomic_inc(&n->route_readers[idx]);
+	return idx;
+}
+
+static inline struct dnet_route_table *dnet_route_get(struct dnet_node *n)
+{
+	return *(struct dnet_route_table * volatile *)&n->route;
+}
+
+static inline void dnet_route_read_unlock(struct dnet_node *n, int idx)
+{
+	atomic_dec(&n->route_readers[idx]);
+}
+
 
 struct dnet_session {
 	struct dnet_node	*node;
@@ -629,6 +921,34 @@ static inline void dnet_counter_set(struct dnet_node *n, int counter, int err, i
 	dnet_lock_unlock(&n->counters_lock);
 }
 
+/*
+ * FNV-1a hash of the whole ID.
+ * Node owns a contiguous ID range, so the first bytes of the IDs it serves are nearly
+ * the same and can not be used to spread keys over threads or lock stripes.
+ */
+static inline uint64_t dnet_id_hash(const unsigned char *id)
+{
+	uint64_t hash = 14695981039346656037ULL;
+	int i;
+
+	for (i = 0; i < DNET_ID_SIZE; ++i) {
+		hash ^= id[i];
+		hash *= 1099511628211ULL;
+	}
+
+	return hash;
+}
+
+/*
+ * Multiplicative (Fibonacci) hash of transaction id into @bits bits.
+ * Ids come from the node-wide counter, so ids seen by one state or thread are strided
+ * by the fan-out of concurrent requests, upper bits of the product depend on every bit of the id.
+ */
+static inline unsigned int dnet_trans_hash(uint64_t trans, int bits)
+{
+	return (trans * 0x9E3779B97F4A7C15ULL) >> (64 - bits);
+}
+
 struct dnet_trans;
 int __attribute__((weak)) dnet_process_cmd_raw(struct dnet_net_state *st, struct dnet_cmd *cmd, void *data, int recursive);
 int dnet_process_recv(struct dnet_net_state *st, struct dnet_io_req *r);
@@ -636,7 +956,14 @@ int dnet_process_recv(struct dnet_net_state *st, struct dnet_io_req *r);
 int dnet_recv(struct dnet_net_state *st, void *data, unsigned int size);
 int dnet_sendfile(struct dnet_net_state *st, int fd, uint64_t *offset, uint64_t size);
 
-int dnet_send_request(struct dnet_net_state *st, struct dnet_io_req *r);
+/*
+ * Maximum number of requests sent at once and number of iovec entries
+ * used to send their header and data parts
+ */
+#define DNET_SEND_BATCH		32
+#define DNET_SEND_IOV_MAX	(DNET_SEND_BATCH * 2)
+
+int dnet_send_request(struct dnet_net_state *st, struct dnet_io_req **reqs, int num, int *completed);
 
 int __attribute__((weak)) dnet_send_ack(struct dnet_net_state *st, struct dnet_cmd *cmd, int err, int recursive);
 
@@ -656,12 +983,20 @@ int __attribute__((weak)) dnet_state_join_nolock(struct dnet_net_state *st);
 
 struct dnet_trans
 {
-	struct rb_node			trans_entry;
+	/* entry in state's @trans_table bucket, protected by state's @trans_lock */
+	struct list_head		trans_entry;
+
+	/* entry in timer wheel, protected by timer lock, modified under state's @trans_lock */
 	struct list_head		trans_list_entry;
+	/* entry in the list of expired transactions */
+	struct list_head		expire_entry;
 
-	struct timeval			time, start;
+	struct timeval			start;
 	struct timespec			wait_ts;
 
+	/* msecs since arbitrary point (monotonic clock) when transaction times out */
+	uint64_t			expires;
+
 	struct dnet_net_state		*orig; /* only for forward */
 
 	struct dnet_net_state		*st;
@@ -678,6 +1013,13 @@ struct dnet_trans
 						     void *priv);
 };
 
+uint64_t dnet_time_ms(void);
+
+int dnet_trans_timer_init(struct dnet_node *n);
+void dnet_trans_timer_destroy(struct dnet_node *n);
+void dnet_trans_timer_add(struct dnet_node *n, struct dnet_trans *t);
+void dnet_trans_timer_del(struct dnet_node *n, struct dnet_trans *t);
+
 void dnet_trans_destroy(struct dnet_trans *t);
 struct dnet_trans *dnet_trans_alloc(struct dnet_node *n, uint64_t size);
 int dnet_trans_alloc_send_state(struct dnet_session *s, struct dnet_net_state *st, struct dnet_trans_control *ctl);
@@ -695,10 +1037,12 @@ static inline void dnet_trans_put(struct dnet_trans *t)
 		dnet_trans_destroy(t);
 }
 
-int dnet_trans_insert_nolock(struct rb_root *root, struct dnet_trans *a);
+int dnet_trans_insert_nolock(struct dnet_trans_table *table, struct dnet_trans *a);
 void dnet_trans_remove(struct dnet_trans *t);
-void dnet_trans_remove_nolock(struct rb_root *root, struct dnet_trans *t);
-struct dnet_trans *dnet_trans_search(struct rb_root *root, uint64_t trans);
+void dnet_trans_remove_nolock(struct dnet_trans_table *table, struct dnet_trans *t);
+struct dnet_trans *dnet_trans_search(struct dnet_trans_table *table, uint64_t trans);
+struct dnet_trans *dnet_trans_next_nolock(struct dnet_trans_table *table, unsigned int *pos);
+void dnet_trans_table_destroy(struct dnet_trans_table *table);
 
 int dnet_trans_send(struct dnet_trans *t, struct dnet_io_req *req);
 
@@ -706,8 +1050,18 @@ int dnet_recv_list(struct dnet_node *n, struct dnet_net_state *st);
 
 ssize_t dnet_send_fd(struct dnet_net_state *st, void *header, uint64_t hsize,
 		int fd, uint64_t offset, uint64_t dsize, int on_exit);
+/* @fd is not closed, @put(@priv) is called instead when request is destroyed */
+ssize_t dnet_send_fd_ref(struct dnet_net_state *st, void *header, uint64_t hsize,
+		int fd, uint64_t offset, uint64_t fsize, void (*put)(void *priv), void *priv);
 ssize_t dnet_send_data(struct dnet_net_state *st, void *header, uint64_t hsize, void *data, uint64_t dsize);
+ssize_t dnet_send_data_ref(struct dnet_net_state *st, void *header, uint64_t hsize, void *data, uint64_t dsize,
+		void (*put)(void *priv), void *priv);
 ssize_t dnet_send(struct dnet_net_state *st, void *data, uint64_t size);
+
+/* Data allocated inside send queue request, it is queued by dnet_send_commit() without copying */
+void *dnet_send_alloc(uint64_t size);
+int dnet_send_commit(struct dnet_net_state *st, void *data);
+void dnet_send_free(void *data);
 ssize_t dnet_send_nolock(struct dnet_net_state *st, void *data, uint64_t size);
 
 struct dnet_io_completion
@@ -725,6 +1079,17 @@ struct dnet_addr_storage
 	unsigned int			__join_state;
 };
 
+/*
+ * Asynchronous logging: every thread formats messages into its own lock-free ring buffer,
+ * single background writer passes them to node's logger. Messages which do not fit
+ * into the ring are dropped and accounted in DNET_CNTR_LOG_DROPPED.
+ */
+#define DNET_LOG_RING_SIZE		(64 * 1024)
+#define DNET_LOG_WRITER_SLEEP_USEC	10000
+
+int dnet_log_async_start(struct dnet_node *n);
+void dnet_log_flush(struct dnet_node *n);
+
 int dnet_check_thread_start(struct dnet_node *n);
 void dnet_check_thread_stop(struct dnet_node *n);
 int dnet_try_reconnect(struct dnet_node *n);
@@ -733,6 +1098,7 @@ void dnet_monitor_exit(struct dnet_node *n);
 int dnet_monitor_init(struct dnet_node *n, struct dnet_config *cfg);
 
 int dnet_set_name(char *name);
+int dnet_thread_set_affinity(pthread_t tid, int cpu);
 int dnet_ioprio_set(long pid, int class_id, int prio);
 int dnet_ioprio_get(long pid);
 
@@ -756,7 +1122,7 @@ int dnet_srw_init(struct dnet_node *n, struct dnet_config *cfg);
 void dnet_srw_cleanup(struct dnet_node *n);
 int dnet_cmd_exec_raw(struct dnet_net_state *st, struct dnet_cmd *cmd, struct sph *header, const void *data);
 
-int dnet_cache_init(struct dnet_node *n);
+int dnet_cache_init(struct dnet_node *n, struct dnet_config *cfg);
 void dnet_cache_cleanup(struct dnet_node *n);
 int dnet_cmd_cache_io(struct dnet_net_state *st, struct dnet_cmd *cmd, struct dnet_io_attr *io, char *data);
 int dnet_cmd_cache_indexes(struct dnet_net_state *st, struct dnet_cmd *cmd, struct dnet_indexes_request *request);
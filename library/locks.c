@@ -23,74 +23,86 @@
 
 #include "elliptics.h"
 
-void dnet_locks_destroy(struct dnet_node *n)
+static void dnet_locks_stripe_destroy(struct dnet_locks_stripe *stripe)
 {
-	struct dnet_locks_entry *r, *tmp;
+	struct dnet_locks_entry *entry, *tmp;
 
-	if (n->locks) {
+	list_for_each_entry_safe(entry, tmp, &stripe->lock_list, lock_list_entry) {
+		list_del(&entry->lock_list_entry);
+		pthread_cond_destroy(&entry->wait);
+		free(entry);
+	}
+
+	list_for_each_entry_safe(entry, tmp, &stripe->free_list, lock_list_entry) {
+		list_del(&entry->lock_list_entry);
+		pthread_cond_destroy(&entry->wait);
+		free(entry);
+	}
 
-		list_for_each_entry_safe(r, tmp, &n->locks->lock_list, lock_list_entry) {
-			list_del(&r->lock_list_entry);
-			pthread_mutex_destroy(&r->lock);
-			pthread_cond_destroy(&r->wait);
+	pthread_mutex_destroy(&stripe->lock);
+}
 
-			if (r->lock_tree_entry.rb_parent_color) {
-				rb_erase(&r->lock_tree_entry, &n->locks->lock_tree);
-			}
-		}
+void dnet_locks_destroy(struct dnet_node *n)
+{
+	unsigned int i;
+
+	if (n->locks) {
+		for (i = 0; i < n->locks->num; ++i)
+			dnet_locks_stripe_destroy(&n->locks->stripes[i]);
 
 		free(n->locks);
 		n->locks = NULL;
 	}
 }
 
+/*
+ * Keys are spread over @num lock stripes, @num is rounded up to power of two.
+ * If @num is not positive, number of stripes is derived from number of CPUs.
+ */
 int dnet_locks_init(struct dnet_node *n, int num)
 {
+	struct dnet_locks_stripe *stripe;
+	unsigned int size = 1;
+	long cpus;
 	int err, i;
-	struct dnet_locks_entry *entry;
 
-	n->locks = malloc(sizeof(struct dnet_locks) + num * sizeof(struct dnet_locks_entry));
-	if (!n->locks) {
-		err = -ENOMEM;
-		goto err_out_exit;
+	if (num <= 0) {
+		cpus = sysconf(_SC_NPROCESSORS_ONLN);
+		num = (cpus > 0) ? cpus * 4 : 64;
+		if (num < 16)
+			num = 16;
 	}
 
-	INIT_LIST_HEAD(&n->locks->lock_list);
-	n->locks->lock_tree = RB_ROOT;
+	while (size < (unsigned int)num)
+		size <<= 1;
 
-	err = pthread_mutex_init(&n->locks->lock, NULL);
+	err = posix_memalign((void **)&n->locks, 64, sizeof(struct dnet_locks) + size * sizeof(struct dnet_locks_stripe));
 	if (err) {
-		err = -err;
-		dnet_log(n, DNET_LOG_ERROR, "Could not create lock: %s [%d]\n", strerror(-err), err);
-
-		goto err_out_destroy;
+		n->locks = NULL;
+		err = -ENOMEM;
+		goto err_out_exit;
 	}
 
-	entry = (struct dnet_locks_entry *) (n->locks + 1);
+	memset(n->locks, 0, sizeof(struct dnet_locks) + size * sizeof(struct dnet_locks_stripe));
 
-	for (i = 0; i < num; ++i, ++entry) {
-		entry->locked = 0;
+	for (i = 0; i < (int)size; ++i) {
+		stripe = &n->locks->stripes[i];
 
-		err = pthread_mutex_init(&entry->lock, NULL);
+		err = pthread_mutex_init(&stripe->lock, NULL);
 		if (err) {
 			err = -err;
-			dnet_log(n, DNET_LOG_ERROR, "Could not create lock %d/%d: %s [%d]\n", i, num, strerror(-err), err);
+			dnet_log(n, DNET_LOG_ERROR, "Could not create lock %d/%u: %s [%d]\n", i, size, strerror(-err), err);
 
 			goto err_out_destroy;
 		}
-		err = pthread_cond_init(&entry->wait, NULL);
-		if (err) {
-			err = -err;
-			dnet_log(n, DNET_LOG_ERROR, "Could not create cond %d/%d: %s [%d]\n", i, num, strerror(-err), err);
 
-			pthread_mutex_destroy(&entry->lock);
-			goto err_out_destroy;
-		}
+		INIT_LIST_HEAD(&stripe->lock_list);
+		INIT_LIST_HEAD(&stripe->free_list);
 
-		memset(&entry->lock_tree_entry, 0, sizeof(struct rb_node));
-		list_add_tail(&entry->lock_list_entry, &n->locks->lock_list);
+		n->locks->num++;
 	}
 
+	dnet_log(n, DNET_LOG_INFO, "Initialized %u operation lock stripes\n", size);
 	return 0;
 
 err_out_destroy:
@@ -99,180 +111,222 @@ err_out_exit:
 	return err;
 }
 
-static struct dnet_locks_entry *dnet_oplock_search_nolock(struct dnet_node *n, struct dnet_id *id)
+static struct dnet_locks_stripe *dnet_locks_stripe(struct dnet_node *n, struct dnet_id *key)
 {
-	struct rb_root *root = &n->locks->lock_tree;
-	struct rb_node *node = root->rb_node;
-	struct dnet_locks_entry *entry = NULL;
-	int cmp = 1;
-
-	while (node) {
-		entry = rb_entry(node, struct dnet_locks_entry, lock_tree_entry);
-
-		cmp = memcmp(entry->id.id, id->id, DNET_ID_SIZE);
-		if (cmp < 0)
-			node = node->rb_left;
-		else if (cmp > 0)
-			node = node->rb_right;
-		else
-			return entry;
-	}
-
-	return NULL;
+	return &n->locks->stripes[dnet_id_hash(key->id) & (n->locks->num - 1)];
 }
 
-static int dnet_oplock_insert_nolock(struct dnet_node *n, struct dnet_locks_entry *a)
+static void dnet_locks_stripe_lock(struct dnet_locks_stripe *stripe)
 {
-	struct rb_root *root = &n->locks->lock_tree;
-	struct rb_node **node = &root->rb_node, *parent = NULL;
-	struct dnet_locks_entry *t;
-	int cmp;
-
-	while (*node) {
-		parent = *node;
-
-		t = rb_entry(parent, struct dnet_locks_entry, lock_tree_entry);
-
-		cmp = memcmp(t->id.id, a->id.id, DNET_ID_SIZE);
-		if (cmp < 0)
-			node = &parent->rb_left;
-		else if (cmp > 0)
-			node = &parent->rb_right;
-		else
-			return -EEXIST;
+	if (pthread_mutex_trylock(&stripe->lock)) {
+		pthread_mutex_lock(&stripe->lock);
+		stripe->contended++;
 	}
 
-	rb_link_node(&a->lock_tree_entry, parent, node);
-	rb_insert_color(&a->lock_tree_entry, root);
-	return 0;
+	stripe->acquired++;
 }
 
-static void dnet_oplock_remove_nolock(struct dnet_node *n, struct dnet_locks_entry *entry)
+static struct dnet_locks_entry *dnet_oplock_search_nolock(struct dnet_locks_stripe *stripe, struct dnet_id *key)
 {
-	struct rb_root *root = &n->locks->lock_tree;
+	struct dnet_locks_entry *entry;
 
-	if (!entry->lock_tree_entry.rb_parent_color) {
-		dnet_log(n, DNET_LOG_ERROR, "%s: trying to remove non-existen oplock.\n",
-			dnet_dump_id_str(entry->id.id));
-		return;
+	list_for_each_entry(entry, &stripe->lock_list, lock_list_entry) {
+		if (!memcmp(entry->id.id, key->id, DNET_ID_SIZE))
+			return entry;
 	}
 
-	if (entry) {
-		rb_erase(&entry->lock_tree_entry, root);
-		entry->lock_tree_entry.rb_parent_color = 0;
-	}
+	return NULL;
 }
 
-static struct dnet_locks_entry *dnet_oplock_ensure(struct dnet_node *n, struct dnet_id *id)
+static struct dnet_locks_entry *dnet_oplock_get_nolock(struct dnet_node *n, struct dnet_locks_stripe *stripe, struct dnet_id *key)
 {
-	struct dnet_locks_entry *entry = NULL;
-
-	pthread_mutex_lock(&n->locks->lock);
-
-	entry = dnet_oplock_search_nolock(n, id);
+	struct dnet_locks_entry *entry;
+	int err;
 
+	entry = dnet_oplock_search_nolock(stripe, key);
 	if (entry) {
-		atomic_inc(&entry->refcnt);
-	} else if (!list_empty(&n->locks->lock_list)) {
-		entry = list_first_entry(&n->locks->lock_list, struct dnet_locks_entry, lock_list_entry);
-		list_del(&entry->lock_list_entry);
-
-		entry->locked = 0;
-		atomic_init(&entry->refcnt, 1);
-
-		memcpy(entry->id.id, id->id, sizeof(entry->id.id));
+		entry->refcnt++;
+		return entry;
+	}
 
-		dnet_oplock_insert_nolock(n, entry);
+	if (!list_empty(&stripe->free_list)) {
+		entry = list_first_entry(&stripe->free_list, struct dnet_locks_entry, lock_list_entry);
+		list_del(&entry->lock_list_entry);
+		stripe->free_num--;
 	} else {
-		dnet_log(n, DNET_LOG_ERROR, "%s: oplock list is empty.\n", dnet_dump_id(id));
+		entry = malloc(sizeof(struct dnet_locks_entry));
+		if (!entry) {
+			dnet_log(n, DNET_LOG_ERROR, "%s: could not allocate oplock.\n", dnet_dump_id(key));
+			return NULL;
+		}
+
+		err = pthread_cond_init(&entry->wait, NULL);
+		if (err) {
+			dnet_log(n, DNET_LOG_ERROR, "%s: could not create oplock cond: %s [%d]\n",
+					dnet_dump_id(key), strerror(err), -err);
+			free(entry);
+			return NULL;
+		}
 	}
 
-	pthread_mutex_unlock(&n->locks->lock);
+	memcpy(entry->id.id, key->id, DNET_ID_SIZE);
+	entry->readers = 0;
+	entry->writer = 0;
+	entry->waiting_writers = 0;
+	entry->refcnt = 1;
+
+	list_add_tail(&entry->lock_list_entry, &stripe->lock_list);
 
 	return entry;
 }
 
-static struct dnet_locks_entry *dnet_oplock_take(struct dnet_node *n, struct dnet_id *id)
+static void dnet_oplock_put_nolock(struct dnet_locks_stripe *stripe, struct dnet_locks_entry *entry)
 {
-	struct dnet_locks_entry *entry = NULL;
-
-	pthread_mutex_lock(&n->locks->lock);
+	if (--entry->refcnt)
+		return;
 
-	entry = dnet_oplock_search_nolock(n, id);
+	list_del(&entry->lock_list_entry);
 
-	if (!entry) {
-		dnet_log(n, DNET_LOG_ERROR, "%s: lock not found.\n", dnet_dump_id(id));
-		goto err_out_complete;
+	if (stripe->free_num < DNET_LOCKS_STRIPE_CACHE) {
+		list_add(&entry->lock_list_entry, &stripe->free_list);
+		stripe->free_num++;
+	} else {
+		pthread_cond_destroy(&entry->wait);
+		free(entry);
 	}
+}
 
-	if (entry && atomic_dec_and_test(&entry->refcnt)) {
-		dnet_oplock_remove_nolock(n, entry);
-		list_add_tail(&entry->lock_list_entry, &n->locks->lock_list);
-
-		entry = NULL;
-		goto err_out_complete;
-	}
+/*
+ * Readers of the same key share the lock, writer excludes everybody.
+ * New readers wait while there is a waiting writer, so writers are not starved by stream of reads.
+ */
+void dnet_oplock_mode(struct dnet_node *n, struct dnet_id *key, int mode)
+{
+	struct dnet_locks_stripe *stripe = dnet_locks_stripe(n, key);
+	struct dnet_locks_entry *entry;
+	int waited = 0;
 
-err_out_complete:
-	pthread_mutex_unlock(&n->locks->lock);
+	dnet_locks_stripe_lock(stripe);
 
-	return entry;
-}
+	entry = dnet_oplock_get_nolock(n, stripe, key);
+	if (!entry)
+		goto err_out_unlock;
 
-void dnet_oplock(struct dnet_node *n, struct dnet_id *key)
-{
-	struct dnet_locks_entry *entry = dnet_oplock_ensure(n, key);
+	if (mode == DNET_OPLOCK_READ) {
+		while (entry->writer || entry->waiting_writers) {
+			pthread_cond_wait(&entry->wait, &stripe->lock);
+			waited = 1;
+		}
 
-	if (!entry) {
-		return;
-	}
+		if (entry->readers)
+			stripe->shared_concurrent++;
 
-	pthread_mutex_lock(&entry->lock);
+		entry->readers++;
+		stripe->shared++;
+	} else {
+		while (entry->writer || entry->readers) {
+			entry->waiting_writers++;
+			pthread_cond_wait(&entry->wait, &stripe->lock);
+			entry->waiting_writers--;
+			waited = 1;
+		}
 
-	while (entry->locked) {
-		pthread_cond_wait(&entry->wait, &entry->lock);
+		entry->writer = 1;
 	}
 
-	entry->locked = 1;
+	stripe->taken++;
+	stripe->waited += waited;
+
+err_out_unlock:
+	pthread_mutex_unlock(&stripe->lock);
+}
 
-	pthread_mutex_unlock(&entry->lock);
+void dnet_oplock(struct dnet_node *n, struct dnet_id *key)
+{
+	dnet_oplock_mode(n, key, DNET_OPLOCK_WRITE);
 }
 
 void dnet_opunlock(struct dnet_node *n, struct dnet_id *key)
 {
-	struct dnet_locks_entry *entry = dnet_oplock_take(n, key);
+	struct dnet_locks_stripe *stripe = dnet_locks_stripe(n, key);
+	struct dnet_locks_entry *entry;
 
+	dnet_locks_stripe_lock(stripe);
+
+	entry = dnet_oplock_search_nolock(stripe, key);
 	if (!entry) {
-		return;
+		dnet_log(n, DNET_LOG_ERROR, "%s: lock not found.\n", dnet_dump_id(key));
+		goto err_out_unlock;
 	}
 
-	pthread_mutex_lock(&entry->lock);
+	if (entry->writer)
+		entry->writer = 0;
+	else if (entry->readers)
+		entry->readers--;
 
-	entry->locked = 0;
+	/* somebody else waits for this key */
+	if (!entry->readers && entry->refcnt > 1)
+		pthread_cond_broadcast(&entry->wait);
 
-	pthread_cond_signal(&entry->wait);
+	dnet_oplock_put_nolock(stripe, entry);
 
-	pthread_mutex_unlock(&entry->lock);
+err_out_unlock:
+	pthread_mutex_unlock(&stripe->lock);
 }
 
 int dnet_optrylock(struct dnet_node *n, struct dnet_id *key)
 {
-	struct dnet_locks_entry *entry = dnet_oplock_ensure(n, key);
+	struct dnet_locks_stripe *stripe = dnet_locks_stripe(n, key);
+	struct dnet_locks_entry *entry;
 	int err = 0;
 
+	dnet_locks_stripe_lock(stripe);
+
+	entry = dnet_oplock_get_nolock(n, stripe, key);
 	if (!entry) {
-		return -ENOENT;
+		err = -ENOENT;
+		goto err_out_unlock;
 	}
 
-	pthread_mutex_lock(&entry->lock);
-
-	if (entry->locked)
+	if (entry->writer || entry->readers) {
+		dnet_oplock_put_nolock(stripe, entry);
 		err = -EBUSY;
-	else
-		entry->locked = 1;
+		goto err_out_unlock;
+	}
 
-	pthread_mutex_unlock(&entry->lock);
+	entry->writer = 1;
+	stripe->taken++;
 
+err_out_unlock:
+	pthread_mutex_unlock(&stripe->lock);
 	return err;
 }
 
+void dnet_locks_stat(struct dnet_node *n, struct dnet_stat_count *count)
+{
+	struct dnet_locks_stripe *stripe;
+	uint64_t taken = 0, waited = 0, shared = 0, shared_concurrent = 0, acquired = 0, contended = 0;
+	unsigned int i;
+
+	if (!n->locks)
+		return;
+
+	/* racy reads are fine, this is just statistics */
+	for (i = 0; i < n->locks->num; ++i) {
+		stripe = &n->locks->stripes[i];
+
+		taken += stripe->taken;
+		waited += stripe->waited;
+		shared += stripe->shared;
+		shared_concurrent += stripe->shared_concurrent;
+		acquired += stripe->acquired;
+		contended += stripe->contended;
+	}
+
+	count[DNET_CNTR_OPLOCK].count = taken;
+	count[DNET_CNTR_OPLOCK].err = waited;
+	count[DNET_CNTR_OPLOCK_SHARED].count = shared;
+	count[DNET_CNTR_OPLOCK_SHARED].err = shared_concurrent;
+	count[DNET_CNTR_OPLOCK_STRIPE].count = acquired;
+	count[DNET_CNTR_OPLOCK_STRIPE].err = contended;
+}
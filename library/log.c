@@ -44,19 +44,274 @@ int dnet_log_init(struct dnet_node *n, struct dnet_log *l)
 	return 0;
 }
 
+/*
+ * Single producer (owner thread), single consumer (writer thread) ring.
+ * @head and @tail are free-running byte counters, records never wrap,
+ * space at the end of the ring which is too small for a record is skipped by padding record.
+ */
+struct dnet_log_ring {
+	struct dnet_log_ring	*next;
+	volatile uint64_t	head;
+	volatile uint64_t	tail;
+	volatile int		dead;
+	char			data[DNET_LOG_RING_SIZE];
+};
+
+struct dnet_log_record {
+	struct dnet_log		*log;
+	int			level;
+	int			size;
+	char			msg[0];
+};
+
+#define DNET_LOG_RECORD_ALIGN(size)	(((size) + 7) & ~7)
+
+static pthread_mutex_t dnet_log_rings_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct dnet_log_ring *dnet_log_rings;
+static pthread_once_t dnet_log_once = PTHREAD_ONCE_INIT;
+static pthread_key_t dnet_log_ring_key;
+static volatile int dnet_log_writer_running;
+static volatile unsigned long dnet_log_writer_passes;
+static __thread struct dnet_log_ring *dnet_log_thread_ring;
+
+static void dnet_log_ring_release(void *data)
+{
+	struct dnet_log_ring *ring = data;
+
+	/* writer frees ring after it is drained */
+	__sync_synchronize();
+	ring->dead = 1;
+}
+
+static int dnet_log_ring_drain(struct dnet_log_ring *ring)
+{
+	struct dnet_log_record *rec;
+	uint64_t head = ring->head;
+	uint64_t tail = ring->tail;
+	int num = 0;
+
+	__sync_synchronize();
+
+	while (tail != head) {
+		rec = (struct dnet_log_record *)&ring->data[tail % DNET_LOG_RING_SIZE];
+
+		if (rec->log && rec->log->log)
+			rec->log->log(rec->log->log_private, rec->level, rec->msg);
+
+		tail += rec->size;
+		num++;
+	}
+
+	__sync_synchronize();
+	ring->tail = tail;
+
+	return num;
+}
+
+static void *dnet_log_writer(void *data __unused)
+{
+	struct dnet_log_ring *ring, *prev, *next;
+	int num;
+
+	dnet_set_name("log-writer");
+
+	while (1) {
+		num = 0;
+		prev = NULL;
+
+		pthread_mutex_lock(&dnet_log_rings_lock);
+		ring = dnet_log_rings;
+		pthread_mutex_unlock(&dnet_log_rings_lock);
+
+		/* new rings are only added to the list head, only writer removes them */
+		while (ring) {
+			num += dnet_log_ring_drain(ring);
+
+			pthread_mutex_lock(&dnet_log_rings_lock);
+			next = ring->next;
+			if (ring->dead && ring->head == ring->tail) {
+				if (prev)
+					prev->next = next;
+				else
+					dnet_log_rings = next;
+				free(ring);
+			} else {
+				prev = ring;
+			}
+			pthread_mutex_unlock(&dnet_log_rings_lock);
+
+			ring = next;
+		}
+
+		__sync_fetch_and_add(&dnet_log_writer_passes, 1);
+
+		if (!num)
+			usleep(DNET_LOG_WRITER_SLEEP_USEC);
+	}
+
+	return NULL;
+}
+
+static void dnet_log_async_init(void)
+{
+	pthread_t tid;
+	int err;
+
+	err = pthread_key_create(&dnet_log_ring_key, dnet_log_ring_release);
+	if (err)
+		return;
+
+	err = pthread_create(&tid, NULL, dnet_log_writer, NULL);
+	if (err) {
+		pthread_key_delete(dnet_log_ring_key);
+		return;
+	}
+
+	pthread_detach(tid);
+	dnet_log_writer_running = 1;
+}
+
+/*
+ * Writer thread is shared by all nodes in the process and lives until process exits
+ */
+int dnet_log_async_start(struct dnet_node *n)
+{
+	pthread_once(&dnet_log_once, dnet_log_async_init);
+
+	if (!dnet_log_writer_running) {
+		n->flags &= ~DNET_CFG_ASYNC_LOG;
+		dnet_log(n, DNET_LOG_ERROR, "Failed to start log writer thread, falling back to synchronous logging.\n");
+		return -ENOMEM;
+	}
+
+	return 0;
+}
+
+/*
+ * Waits until messages queued by now are written, used before node's logger goes away
+ */
+void dnet_log_flush(struct dnet_node *n)
+{
+	unsigned long passes;
+
+	if (!dnet_log_writer_running || !(n->flags & DNET_CFG_ASYNC_LOG))
+		return;
+
+	/* the second complete pass of the writer has started after this point and drained every ring */
+	passes = dnet_log_writer_passes;
+	while (dnet_log_writer_passes - passes < 2)
+		usleep(1000);
+}
+
+static struct dnet_log_ring *dnet_log_get_ring(void)
+{
+	struct dnet_log_ring *ring = dnet_log_thread_ring;
+
+	if (ring)
+		return ring;
+
+	ring = malloc(sizeof(struct dnet_log_ring));
+	if (!ring)
+		return NULL;
+
+	ring->head = ring->tail = 0;
+	ring->dead = 0;
+
+	pthread_setspecific(dnet_log_ring_key, ring);
+
+	pthread_mutex_lock(&dnet_log_rings_lock);
+	ring->next = dnet_log_rings;
+	dnet_log_rings = ring;
+	pthread_mutex_unlock(&dnet_log_rings_lock);
+
+	dnet_log_thread_ring = ring;
+	return ring;
+}
+
+/*
+ * Returns 0 if message was queued, -ENOMEM if there is no ring for this thread,
+ * -ENOSPC if ring is full and message was dropped
+ */
+static int dnet_log_queue(struct dnet_log *l, int level, const char *msg, int len)
+{
+	struct dnet_log_ring *ring;
+	struct dnet_log_record *rec;
+	uint64_t head, used, pos, tail_space;
+	int size;
+
+	ring = dnet_log_get_ring();
+	if (!ring)
+		return -ENOMEM;
+
+	size = DNET_LOG_RECORD_ALIGN(sizeof(struct dnet_log_record) + len + 1);
+
+	head = ring->head;
+	used = head - ring->tail;
+	pos = head % DNET_LOG_RING_SIZE;
+	tail_space = DNET_LOG_RING_SIZE - pos;
+
+	if (tail_space < (uint64_t)size) {
+		if (used + tail_space + size > DNET_LOG_RING_SIZE)
+			return -ENOSPC;
+
+		rec = (struct dnet_log_record *)&ring->data[pos];
+		rec->log = NULL;
+		rec->size = tail_space;
+
+		head += tail_space;
+		used += tail_space;
+		pos = 0;
+	}
+
+	if (used + size > DNET_LOG_RING_SIZE)
+		return -ENOSPC;
+
+	rec = (struct dnet_log_record *)&ring->data[pos];
+	rec->log = l;
+	rec->level = level;
+	rec->size = size;
+	memcpy(rec->msg, msg, len + 1);
+
+	__sync_synchronize();
+	ring->head = head + size;
+
+	return 0;
+}
+
 void dnet_log_raw(struct dnet_node *n, int level, const char *format, ...)
 {
 	va_list args;
 	char buf[1024];
 	struct dnet_log *l = n->log;
 	int buflen = sizeof(buf);
+	int len, err;
 
 	if (!l->log || ((l->log_level < level) && !(trace_id & DNET_TRACE_BIT)))
 		return;
 
 	va_start(args, format);
-	vsnprintf(buf, buflen, format, args);
+	len = vsnprintf(buf, buflen, format, args);
 	buf[buflen-1] = '\0';
-	l->log(l->log_private, level, buf);
 	va_end(args);
+
+	if ((n->flags & DNET_CFG_ASYNC_LOG) && dnet_log_writer_running) {
+		if (len >= buflen)
+			len = buflen - 1;
+		if (len < 0)
+			len = 0;
+
+		err = dnet_log_queue(l, level, buf, len);
+		if (!err)
+			return;
+
+		if (err == -ENOSPC) {
+			/* dnet_counter_inc() logs itself, so counter is updated directly */
+			dnet_lock_lock(&n->counters_lock);
+			n->counters[DNET_CNTR_LOG_DROPPED].count++;
+			dnet_lock_unlock(&n->counters_lock);
+			return;
+		}
+	}
+
+	l->log(l->log_private, level, buf);
 }
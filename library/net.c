@@ -16,6 +16,7 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -245,20 +246,22 @@ err_out_exit:
 
 void dnet_state_clean(struct dnet_net_state *st)
 {
-	struct rb_node *rb_node;
 	struct dnet_trans *t;
+	unsigned int pos = 0;
 	int num = 0;
 
 	while (1) {
-		t = NULL;
-
 		pthread_mutex_lock(&st->trans_lock);
-		rb_node = rb_first(&st->trans_root);
-		if (rb_node) {
-			t = rb_entry(rb_node, struct dnet_trans, trans_entry);
+		t = dnet_trans_next_nolock(&st->trans_table, &pos);
+		if (!t && pos) {
+			/* table could be resized under us, recheck it from the start */
+			pos = 0;
+			t = dnet_trans_next_nolock(&st->trans_table, &pos);
+		}
+		if (t) {
 			dnet_trans_get(t);
-			dnet_trans_remove_nolock(&st->trans_root, t);
-			list_del_init(&t->trans_list_entry);
+			dnet_trans_remove_nolock(&st->trans_table, t);
+			dnet_trans_timer_del(st->n, t);
 		}
 		pthread_mutex_unlock(&st->trans_lock);
 
@@ -273,21 +276,34 @@ void dnet_state_clean(struct dnet_net_state *st)
 	dnet_log(st->n, DNET_LOG_NOTICE, "Cleaned state %s, transactions freed: %d\n", dnet_state_dump_addr(st), num);
 }
 
+static void dnet_io_req_enqueue(struct dnet_net_state *st, struct dnet_io_req *r)
+{
+	pthread_mutex_lock(&st->send_lock);
+	list_add_tail(&r->req_entry, &st->send_list);
+
+	if (!st->need_exit)
+		dnet_schedule_send(st);
+	pthread_mutex_unlock(&st->send_lock);
+}
+
 /*
- * Eventually we may end up with proper reference counters here, but for now let's just copy the whole buf.
+ * Header and data are copied into request unless data is referenced via @data_put callback.
  * Large data blocks are being sent through sendfile anyway, so it should not be _that_ costly operation.
+ *
+ * Data reference is always consumed, even if request was not queued.
  */
 static int dnet_io_req_queue(struct dnet_net_state *st, struct dnet_io_req *orig)
 {
 	void *buf;
 	struct dnet_io_req *r;
+	size_t dsize = orig->data_put ? 0 : orig->dsize;
 	int offset = 0;
 	int err = 0;
 
-	buf = r = malloc(sizeof(struct dnet_io_req) + orig->dsize + orig->hsize);
+	buf = r = malloc(sizeof(struct dnet_io_req) + dsize + orig->hsize);
 	if (!r) {
 		err = -ENOMEM;
-		goto err_out_exit;
+		goto err_out_put;
 	}
 	memset(r, 0, sizeof(struct dnet_io_req));
 	r->fd = -1;
@@ -300,7 +316,12 @@ static int dnet_io_req_queue(struct dnet_net_state *st, struct dnet_io_req *orig
 		memcpy(r->header, orig->header, r->hsize);
 	}
 
-	if (orig->data && orig->dsize) {
+	if (orig->data_put) {
+		r->data = orig->data;
+		r->dsize = orig->dsize;
+		r->data_put = orig->data_put;
+		r->data_priv = orig->data_priv;
+	} else if (orig->data && orig->dsize) {
 		r->data = buf + sizeof(struct dnet_io_req) + offset;
 		r->dsize = orig->dsize;
 
@@ -315,14 +336,12 @@ static int dnet_io_req_queue(struct dnet_net_state *st, struct dnet_io_req *orig
 		r->fsize = orig->fsize;
 	}
 
-	pthread_mutex_lock(&st->send_lock);
-	list_add_tail(&r->req_entry, &st->send_list);
-
-	if (!st->need_exit)
-		dnet_schedule_send(st);
-	pthread_mutex_unlock(&st->send_lock);
+	dnet_io_req_enqueue(st, r);
+	return 0;
 
-err_out_exit:
+err_out_put:
+	if (orig->data_put)
+		orig->data_put(orig->data_priv);
 	return err;
 }
 
@@ -334,7 +353,13 @@ void dnet_io_req_free(struct dnet_io_req *r)
 		if (r->on_exit & DNET_IO_REQ_FLAGS_CLOSE)
 			close(r->fd);
 	}
-	free(r);
+	if (r->data_put)
+		r->data_put(r->data_priv);
+
+	if (r->pool)
+		dnet_io_req_pool_put(r);
+	else
+		free(r);
 }
 
 static int dnet_wait(struct dnet_net_state *st, unsigned int events, long timeout)
@@ -419,6 +444,38 @@ ssize_t dnet_send_nolock(struct dnet_net_state *st, void *data, uint64_t size)
 	return err;
 }
 
+/*
+ * Request with @size bytes of data placed right after it, data is filled by the caller
+ * and queued by dnet_send_commit() without copying
+ */
+void *dnet_send_alloc(uint64_t size)
+{
+	struct dnet_io_req *r;
+
+	r = malloc(sizeof(struct dnet_io_req) + size);
+	if (!r)
+		return NULL;
+
+	memset(r, 0, sizeof(struct dnet_io_req));
+	r->fd = -1;
+	r->data = r + 1;
+	r->dsize = size;
+
+	return r->data;
+}
+
+int dnet_send_commit(struct dnet_net_state *st, void *data)
+{
+	dnet_io_req_enqueue(st, (struct dnet_io_req *)data - 1);
+	return 0;
+}
+
+void dnet_send_free(void *data)
+{
+	if (data)
+		free((struct dnet_io_req *)data - 1);
+}
+
 ssize_t dnet_send(struct dnet_net_state *st, void *data, uint64_t size)
 {
 	struct dnet_io_req r;
@@ -445,6 +502,23 @@ ssize_t dnet_send_data(struct dnet_net_state *st, void *header, uint64_t hsize,
 	return dnet_io_req_queue(st, &r);
 }
 
+ssize_t dnet_send_data_ref(struct dnet_net_state *st, void *header, uint64_t hsize, void *data, uint64_t dsize,
+		void (*put)(void *priv), void *priv)
+{
+	struct dnet_io_req r;
+
+	memset(&r, 0, sizeof(r));
+	r.header = header;
+	r.hsize = hsize;
+	r.data = data;
+	r.dsize = dsize;
+	r.data_put = put;
+	r.data_priv = priv;
+	r.fd = -1;
+
+	return dnet_io_req_queue(st, &r);
+}
+
 static ssize_t dnet_send_fd_nolock(struct dnet_net_state *st, int fd, uint64_t offset, uint64_t dsize)
 {
 	ssize_t err;
@@ -484,16 +558,30 @@ ssize_t dnet_send_fd(struct dnet_net_state *st, void *header, uint64_t hsize,
 	return dnet_io_req_queue(st, &r);
 }
 
-static void dnet_trans_timestamp(struct dnet_net_state *st, struct dnet_trans *t)
+ssize_t dnet_send_fd_ref(struct dnet_net_state *st, void *header, uint64_t hsize,
+		int fd, uint64_t offset, uint64_t fsize, void (*put)(void *priv), void *priv)
 {
-	struct timespec *wait_ts = t->wait_ts.tv_sec ? &t->wait_ts : &st->n->wait_ts;
+	struct dnet_io_req r;
 
-	gettimeofday(&t->time, NULL);
+	memset(&r, 0, sizeof(r));
+	r.header = header;
+	r.hsize = hsize;
+	r.fd = fd;
+	r.local_offset = offset;
+	r.fsize = fsize;
+	r.data_put = put;
+	r.data_priv = priv;
+
+	return dnet_io_req_queue(st, &r);
+}
+
+static void dnet_trans_timestamp(struct dnet_net_state *st, struct dnet_trans *t)
+{
+	struct timespec *wait_ts = (t->wait_ts.tv_sec || t->wait_ts.tv_nsec) ? &t->wait_ts : &st->n->wait_ts;
 
-	t->time.tv_sec += wait_ts->tv_sec;
-	t->time.tv_usec += wait_ts->tv_nsec / 1000;
+	t->expires = dnet_time_ms() + wait_ts->tv_sec * 1000 + wait_ts->tv_nsec / 1000000;
 
-	list_move_tail(&t->trans_list_entry, &st->trans_list);
+	dnet_trans_timer_add(st->n, t);
 }
 
 int dnet_trans_send(struct dnet_trans *t, struct dnet_io_req *req)
@@ -504,7 +592,7 @@ int dnet_trans_send(struct dnet_trans *t, struct dnet_io_req *req)
 	dnet_trans_get(t);
 
 	pthread_mutex_lock(&st->trans_lock);
-	err = dnet_trans_insert_nolock(&st->trans_root, t);
+	err = dnet_trans_insert_nolock(&st->trans_table, t);
 	if (!err)
 		dnet_trans_timestamp(st, t);
 	pthread_mutex_unlock(&st->trans_lock);
@@ -688,20 +776,36 @@ int dnet_process_recv(struct dnet_net_state *st, struct dnet_io_req *r)
 		uint64_t tid = cmd->trans & ~DNET_TRANS_REPLY;
 
 		pthread_mutex_lock(&st->trans_lock);
-		t = dnet_trans_search(&st->trans_root, tid);
+		t = dnet_trans_search(&st->trans_table, tid);
 		if (t) {
 			if (!(cmd->flags & DNET_FLAGS_MORE)) {
-				dnet_trans_remove_nolock(&st->trans_root, t);
+				dnet_trans_remove_nolock(&st->trans_table, t);
 			} else {
 				dnet_trans_timestamp(st, t);
 			}
 
 			/*
-			 * Always remove transaction from 'timeout' list,
+			 * Always remove transaction from timer,
 			 * thus it will not be found by checker thread and
 			 * its callback will not be called under us
 			 */
-			list_del_init(&t->trans_list_entry);
+			dnet_trans_timer_del(n, t);
+
+			st->stall = 0;
+
+			/*
+			 * Timeouts halve state weight, replying state wins it back at most
+			 * once a second, otherwise state serving only writes would stay
+			 * down-weighted forever
+			 */
+			if (st->weight < DNET_STATE_MAX_WEIGHT) {
+				uint64_t now = dnet_time_ms();
+
+				if (now >= st->weight_time + 1000) {
+					st->weight_time = now;
+					st->weight *= 1.2;
+				}
+			}
 		}
 		pthread_mutex_unlock(&st->trans_lock);
 
@@ -798,6 +902,11 @@ void dnet_state_reset(struct dnet_net_state *st, int error)
 	if (!st->need_exit)
 		st->need_exit = error;
 
+	if (st->net_io) {
+		atomic_dec(&st->net_io->state_num);
+		st->net_io = NULL;
+	}
+
 	shutdown(st->read_s, 2);
 	shutdown(st->write_s, 2);
 
@@ -818,6 +927,10 @@ void dnet_set_sockopt(int s)
 	opt = 1;
 	setsockopt(s, SOL_SOCKET, SO_KEEPALIVE, &opt, 4);
 
+	/* Requests are sent with MSG_MORE when more data follows, so Nagle's algorithm is not needed */
+	opt = 1;
+	setsockopt(s, IPPROTO_TCP, TCP_NODELAY, &opt, 4);
+
 	opt = 3;
 	setsockopt(s, IPPROTO_TCP, TCP_KEEPCNT, &opt, 4);
 	opt = 10;
@@ -838,13 +951,23 @@ int dnet_setup_control_nolock(struct dnet_net_state *st)
 {
 	struct dnet_node *n = st->n;
 	struct dnet_io *io = n->io;
-	int err, pos;
+	struct dnet_net_io *nio;
+	int err, i;
 
 	if (st->epoll_fd == -1) {
-		pos = io->net_thread_pos;
-		if (++io->net_thread_pos >= io->net_thread_num)
-			io->net_thread_pos = 0;
-		st->epoll_fd = io->net[pos].epoll_fd;
+		/*
+		 * State is pinned to the network thread which handles the least number of connections,
+		 * all its events are processed by that thread only
+		 */
+		nio = &io->net[0];
+		for (i = 1; i < io->net_thread_num; ++i) {
+			if (atomic_read(&io->net[i].state_num) < atomic_read(&nio->state_num))
+				nio = &io->net[i];
+		}
+
+		atomic_inc(&nio->state_num);
+		st->net_io = nio;
+		st->epoll_fd = nio->epoll_fd;
 
 		err = dnet_schedule_recv(st);
 		if (err)
@@ -857,6 +980,8 @@ err_out_unschedule:
 	dnet_unschedule_send(st);
 	dnet_unschedule_recv(st);
 
+	atomic_dec(&st->net_io->state_num);
+	st->net_io = NULL;
 	st->epoll_fd = -1;
 	list_del_init(&st->storage_state_entry);
 	return err;
@@ -927,9 +1052,6 @@ int dnet_state_micro_init(struct dnet_net_state *st,
 	INIT_LIST_HEAD(&st->state_entry);
 	INIT_LIST_HEAD(&st->storage_state_entry);
 
-	st->trans_root = RB_ROOT;
-	INIT_LIST_HEAD(&st->trans_list);
-
 	st->epoll_fd = -1;
 
 	err = pthread_mutex_init(&st->trans_lock, NULL);
@@ -1136,6 +1258,11 @@ void dnet_state_destroy(struct dnet_net_state *st)
 
 	dnet_state_send_clean(st);
 
+	/* drops partially received request if any */
+	dnet_schedule_command(st);
+	free(st->rcv_buf);
+	dnet_trans_table_destroy(&st->trans_table);
+
 	pthread_mutex_destroy(&st->send_lock);
 	pthread_mutex_destroy(&st->trans_lock);
 
@@ -1183,23 +1310,14 @@ int dnet_send_reply_threshold(void *state, struct dnet_cmd *cmd,
 	return err;
 }
 
-int dnet_send_reply(void *state, struct dnet_cmd *cmd, void *odata, unsigned int size, int more)
+static struct dnet_cmd *dnet_send_reply_alloc_raw(struct dnet_cmd *cmd, uint64_t size, int more)
 {
-	struct dnet_net_state *st = state;
 	struct dnet_cmd *c;
-	void *data;
-	int err;
-
-	if (st == st->n->st)
-		return 0;
 
-	c = malloc(sizeof(struct dnet_cmd) + size);
+	c = dnet_send_alloc(sizeof(struct dnet_cmd) + size);
 	if (!c)
-		return -ENOMEM;
+		return NULL;
 
-	memset(c, 0, sizeof(struct dnet_cmd) + size);
-
-	data = c + 1;
 	*c = *cmd;
 
 	if ((cmd->flags & DNET_FLAGS_NEED_ACK) || more)
@@ -1208,113 +1326,235 @@ int dnet_send_reply(void *state, struct dnet_cmd *cmd, void *odata, unsigned int
 	c->size = size;
 	c->trans |= DNET_TRANS_REPLY;
 
-	if (size)
-		memcpy(data, odata, size);
+	return c;
+}
 
-	dnet_log(st->n, DNET_LOG_NOTICE, "%s: %s: reply -> %s: trans: %lld, size: %u, cflags: 0x%llx.\n",
-		dnet_dump_id(&cmd->id), dnet_cmd_string(cmd->cmd), dnet_server_convert_dnet_addr(&st->addr),
+static void dnet_send_reply_log(struct dnet_net_state *st, struct dnet_cmd *c)
+{
+	dnet_log(st->n, DNET_LOG_NOTICE, "%s: %s: reply -> %s: trans: %lld, size: %llu, cflags: 0x%llx.\n",
+		dnet_dump_id(&c->id), dnet_cmd_string(c->cmd), dnet_server_convert_dnet_addr(&st->addr),
 		(unsigned long long)(c->trans &~ DNET_TRANS_REPLY),
-		size, (unsigned long long)c->flags);
+		(unsigned long long)c->size, (unsigned long long)c->flags);
+}
 
-	dnet_convert_cmd(c);
+void *dnet_send_reply_alloc(struct dnet_cmd *cmd, uint64_t size, int more)
+{
+	struct dnet_cmd *c;
 
-	err = dnet_send(st, c, sizeof(struct dnet_cmd) + size);
-	free(c);
+	c = dnet_send_reply_alloc_raw(cmd, size, more);
+	if (!c)
+		return NULL;
 
-	return err;
+	memset(c + 1, 0, size);
+	return c + 1;
 }
 
-int dnet_send_request(struct dnet_net_state *st, struct dnet_io_req *r)
+int dnet_send_reply_commit(void *state, void *payload)
 {
-	int cork;
-	int err = 0;
-	size_t offset = st->send_offset;
-	size_t total_size = r->dsize + r->hsize + r->fsize;
+	struct dnet_net_state *st = state;
+	struct dnet_cmd *c = (struct dnet_cmd *)payload - 1;
 
-	if (total_size > sizeof(struct dnet_cmd)) {
-		/* Use TCP_CORK to send headers and packet body in one piece */
-		cork = 1;
-		setsockopt(st->write_s, IPPROTO_TCP, TCP_CORK, &cork, 4);
+	if (st == st->n->st) {
+		dnet_send_free(c);
+		return 0;
 	}
 
-	if (1) {
-		struct dnet_cmd *cmd = r->header;
-		if (!cmd)
-			cmd = r->data;
-		dnet_log(st->n, DNET_LOG_DEBUG, "%s: %s: sending -> %s: trans: %lld, size: %llu, cflags: 0x%llx, start-sent: %zd/%zd.\n",
-			dnet_dump_id(&cmd->id), dnet_cmd_string(cmd->cmd), dnet_server_convert_dnet_addr(&st->addr),
-			(unsigned long long)(cmd->trans &~ DNET_TRANS_REPLY),
-			(unsigned long long)cmd->size, (unsigned long long)cmd->flags,
-			st->send_offset, r->dsize + r->hsize + r->fsize);
-	}
+	dnet_send_reply_log(st, c);
+	dnet_convert_cmd(c);
 
-	if (r->hsize && r->header && st->send_offset < r->hsize) {
-		err = dnet_send_nolock(st, r->header + offset, r->hsize - offset);
-		if (err)
-			goto err_out_exit;
-	}
+	return dnet_send_commit(st, c);
+}
 
-	if (r->dsize && r->data && st->send_offset < (r->dsize + r->hsize)) {
-		offset = st->send_offset - r->hsize;
-		err = dnet_send_nolock(st, r->data + offset, r->dsize - offset);
-		if (err)
-			goto err_out_exit;
-	}
+void dnet_send_reply_free(void *payload)
+{
+	if (payload)
+		dnet_send_free((struct dnet_cmd *)payload - 1);
+}
 
-	if (r->fd >= 0 && r->fsize && st->send_offset < (r->dsize + r->hsize + r->fsize)) {
-		offset = st->send_offset - r->dsize - r->hsize;
-		err = dnet_send_fd_nolock(st, r->fd, r->local_offset + offset, r->fsize - offset);
-		if (err)
-			goto err_out_exit;
-	}
+int dnet_send_reply(void *state, struct dnet_cmd *cmd, void *odata, unsigned int size, int more)
+{
+	struct dnet_net_state *st = state;
+	struct dnet_cmd *c;
+
+	if (st == st->n->st)
+		return 0;
+
+	c = dnet_send_reply_alloc_raw(cmd, size, more);
+	if (!c)
+		return -ENOMEM;
 
-	if (r->hsize > sizeof(struct dnet_cmd)) {
-		struct dnet_cmd *cmd = r->header;
-		int nonblocking = !!(cmd->flags & DNET_FLAGS_NOLOCK);
+	if (size)
+		memcpy(c + 1, odata, size);
+
+	return dnet_send_reply_commit(st, c + 1);
+}
+
+int dnet_send_reply_ref(void *state, struct dnet_cmd *cmd, void *data, uint64_t size, int more,
+		void (*put)(void *priv), void *priv)
+{
+	struct dnet_net_state *st = state;
+	struct dnet_cmd c;
 
-		dnet_log(st->n, DNET_LOG_DEBUG, "%s: %s: SENT %s cmd: %s: cmd-size: %llu, nonblocking: %d\n",
-			dnet_state_dump_addr(st), dnet_dump_id(r->header),
-			nonblocking ? "nonblocking" : "blocking",
-			dnet_cmd_string(cmd->cmd),
-			(unsigned long long)cmd->size, nonblocking);
+	if (st == st->n->st) {
+		put(priv);
+		return 0;
 	}
 
-err_out_exit:
+	c = *cmd;
+
+	if ((cmd->flags & DNET_FLAGS_NEED_ACK) || more)
+		c.flags |= DNET_FLAGS_MORE;
+
+	c.size = size;
+	c.trans |= DNET_TRANS_REPLY;
+
+	dnet_send_reply_log(st, &c);
+	dnet_convert_cmd(&c);
 
-	if (1) {
-		struct dnet_cmd *cmd = r->header;
-		if (!cmd)
-			cmd = r->data;
-		dnet_log(st->n, DNET_LOG_DEBUG, "%s: %s: sending -> %s: trans: %lld, size: %llu, cflags: 0x%llx, finish-sent: %zd/%zd.\n",
-			dnet_dump_id(&cmd->id), dnet_cmd_string(cmd->cmd), dnet_server_convert_dnet_addr(&st->addr),
-			(unsigned long long)(cmd->trans &~ DNET_TRANS_REPLY),
-			(unsigned long long)cmd->size, (unsigned long long)cmd->flags,
-			st->send_offset, r->dsize + r->hsize + r->fsize);
+	return dnet_send_data_ref(st, &c, sizeof(struct dnet_cmd), data, size, put, priv);
+}
+
+static void dnet_send_request_log(struct dnet_net_state *st, struct dnet_io_req *r)
+{
+	struct dnet_cmd *cmd = r->header;
+	if (!cmd)
+		cmd = r->data;
+
+	dnet_log(st->n, DNET_LOG_DEBUG, "%s: %s: sent -> %s: trans: %lld, size: %llu, cflags: 0x%llx, total-size: %zd.\n",
+		dnet_dump_id(&cmd->id), dnet_cmd_string(cmd->cmd), dnet_server_convert_dnet_addr(&st->addr),
+		(unsigned long long)(cmd->trans &~ DNET_TRANS_REPLY),
+		(unsigned long long)cmd->size, (unsigned long long)cmd->flags,
+		r->dsize + r->hsize + r->fsize);
+}
+
+/*
+ * Sends @num requests starting from st->send_offset of the first one.
+ *
+ * Header and data parts of consecutive requests are gathered into single iovec and sent by one sendmsg() call,
+ * file parts are sent by sendfile() after everything preceding them has been sent.
+ * MSG_MORE is set when more data is known to follow immediately, so that TCP does not push partial frames.
+ *
+ * Number of completely sent requests is returned in @completed, st->send_offset points into the next one.
+ * Requests are not destroyed here, it is postponed to caller.
+ */
+int dnet_send_request(struct dnet_net_state *st, struct dnet_io_req **reqs, int num, int *completed)
+{
+	struct iovec iov[DNET_SEND_IOV_MAX];
+	struct msghdr msg;
+	struct dnet_io_req *r;
+	int idx = 0, pos, iov_num, more;
+	size_t offset;
+	ssize_t sent;
+	int err = 0;
+
+	while (idx < num) {
+		iov_num = 0;
+		more = 0;
+		offset = st->send_offset;
+
+		for (pos = idx; pos < num; ++pos) {
+			r = reqs[pos];
+
+			if (iov_num + 2 > DNET_SEND_IOV_MAX) {
+				more = 1;
+				break;
+			}
+
+			if (r->header && offset < r->hsize) {
+				iov[iov_num].iov_base = r->header + offset;
+				iov[iov_num].iov_len = r->hsize - offset;
+				iov_num++;
+				offset = 0;
+			} else {
+				offset -= r->hsize;
+			}
+
+			if (r->data && offset < r->dsize) {
+				iov[iov_num].iov_base = r->data + offset;
+				iov[iov_num].iov_len = r->dsize - offset;
+				iov_num++;
+			}
+			offset = 0;
+
+			if (r->fd >= 0 && r->fsize) {
+				more = 1;
+				break;
+			}
+		}
+
+		if (iov_num) {
+			memset(&msg, 0, sizeof(msg));
+			msg.msg_iov = iov;
+			msg.msg_iovlen = iov_num;
+
+			sent = sendmsg(st->write_s, &msg, more ? MSG_MORE : 0);
+			if (sent < 0) {
+				err = -errno;
+				if (err != -EAGAIN)
+					dnet_log_err(st->n, "%s: failed to send %d requests, socket: %d",
+							dnet_state_dump_addr(st), num - idx, st->write_s);
+				goto err_out_exit;
+			}
+
+			if (sent == 0) {
+				dnet_log(st->n, DNET_LOG_ERROR, "Peer %s has dropped the connection: socket: %d.\n",
+						dnet_state_dump_addr(st), st->write_s);
+				err = -ECONNRESET;
+				goto err_out_exit;
+			}
+
+			/* Account sent bytes, requests without file part are completed here */
+			while (sent && idx < num) {
+				size_t mem_size;
+
+				r = reqs[idx];
+				mem_size = r->hsize + r->dsize;
+
+				if (st->send_offset + sent < mem_size) {
+					st->send_offset += sent;
+					break;
+				}
+
+				sent -= mem_size - st->send_offset;
+				st->send_offset = mem_size;
+
+				if (r->fd >= 0 && r->fsize)
+					break;
+
+				dnet_send_request_log(st, r);
+				st->send_offset = 0;
+				idx++;
+			}
+		}
+
+		if (idx == num)
+			break;
+
+		r = reqs[idx];
+
+		if (st->send_offset < r->hsize + r->dsize)
+			continue;
+
+		if (r->fd >= 0 && r->fsize) {
+			offset = st->send_offset - r->dsize - r->hsize;
+			err = dnet_send_fd_nolock(st, r->fd, r->local_offset + offset, r->fsize - offset);
+			if (err)
+				goto err_out_exit;
+		}
+
+		dnet_send_request_log(st, r);
+		st->send_offset = 0;
+		idx++;
 	}
 
+err_out_exit:
+	*completed = idx;
+
 	if (err && err != -EAGAIN) {
 		dnet_log(st->n, DNET_LOG_ERROR, "%s: setting send need_exit to %d\n", dnet_state_dump_addr(st), err);
 		st->need_exit = err;
 	}
 
-	if (total_size > sizeof(struct dnet_cmd)) {
-		cork = 0;
-		setsockopt(st->write_s, IPPROTO_TCP, TCP_CORK, &cork, 4);
-	}
-
-	/*
-	 * Flush TCP output pipeline if we've sent whole request.
-	 *
-	 * We do not destroy request here, it is postponed to caller.
-	 * Function can be called without lock - default call path from network processing thread and dnet_process_send_single()
-	 * or under st->send_lock, if queue was empty and dnet_send*() caller directly invoked this function from dnet_io_req_queue()
-	 * instead of queueing.
-	 */
-	if (st->send_offset == r->dsize + r->hsize + r->fsize) {
-		int nodelay = 1;
-		setsockopt(st->write_s, IPPROTO_TCP, TCP_NODELAY, &nodelay, 4);
-	}
-
 	return err;
 }
 
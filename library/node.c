@@ -19,6 +19,7 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <sched.h>
 #include <signal.h>
 
 #include "elliptics.h"
@@ -47,10 +48,16 @@ static struct dnet_node *dnet_node_alloc(struct dnet_config *cfg)
 		goto err_out_free;
 	}
 
+	err = pthread_mutex_init(&n->route_lock, NULL);
+	if (err) {
+		dnet_log_err(n, "Failed to initialize route lock: err: %d", err);
+		goto err_out_destroy_state;
+	}
+
 	n->wait = dnet_wait_alloc(0);
 	if (!n->wait) {
 		dnet_log(n, DNET_LOG_ERROR, "Failed to allocate wait structure.\n");
-		goto err_out_destroy_state;
+		goto err_out_destroy_route;
 	}
 
 	err = dnet_counter_init(n);
@@ -74,6 +81,12 @@ static struct dnet_node *dnet_node_alloc(struct dnet_config *cfg)
 	}
 	pthread_attr_setdetachstate(&n->attr, PTHREAD_CREATE_DETACHED);
 
+	err = dnet_trans_timer_init(n);
+	if (err) {
+		dnet_log_err(n, "Failed to initialize transaction timer: err: %d", err);
+		goto err_out_destroy_attr;
+	}
+
 	n->autodiscovery_socket = -1;
 
 	INIT_LIST_HEAD(&n->group_list);
@@ -88,12 +101,16 @@ static struct dnet_node *dnet_node_alloc(struct dnet_config *cfg)
 
 	return n;
 
+err_out_destroy_attr:
+	pthread_attr_destroy(&n->attr);
 err_out_destroy_reconnect_lock:
 	pthread_mutex_destroy(&n->reconnect_lock);
 err_out_destroy_counter:
 	dnet_counter_destroy(n);
 err_out_destroy_wait:
 	dnet_wait_put(n->wait);
+err_out_destroy_route:
+	pthread_mutex_destroy(&n->route_lock);
 err_out_destroy_state:
 	pthread_mutex_destroy(&n->state_lock);
 err_out_free:
@@ -155,6 +172,216 @@ static int dnet_idc_compare(const void *k1, const void *k2)
 	return dnet_id_cmp_str(id1->raw.id, id2->raw.id);
 }
 
+static inline uint64_t dnet_route_key(const unsigned char *id)
+{
+	uint64_t key = 0;
+	int i;
+
+	for (i = 0; i < 8; ++i)
+		key = (key << 8) | id[i];
+
+	return key;
+}
+
+static int dnet_route_group_compare(const void *k1, const void *k2)
+{
+	const struct dnet_route_group *g1 = k1;
+	const struct dnet_route_group *g2 = k2;
+
+	if (g1->group_id < g2->group_id)
+		return -1;
+	if (g1->group_id > g2->group_id)
+		return 1;
+	return 0;
+}
+
+/*
+ * Waits until all readers which could see previous snapshot have left,
+ * epoch is flipped twice since reader could sample epoch before the first flip
+ * and increment its counter after we have found it empty.
+ */
+static void dnet_route_synchronize(struct dnet_node *n)
+{
+	int i, idx;
+
+	for (i = 0; i < 2; ++i) {
+		idx = n->route_epoch & 1;
+
+		__sync_synchronize();
+		n->route_epoch++;
+		__sync_synchronize();
+
+		while (atomic_read(&n->route_readers[idx]))
+			sched_yield();
+	}
+}
+
+/*
+ * Unpublishes current snapshot after groups have changed, readers fall back to
+ * locked search until dnet_route_update() publishes a new one. Only the first change
+ * after a rebuild waits for readers of the old snapshot, a burst of changes costs
+ * a single rebuild. Must be called under @n->state_lock.
+ */
+static void dnet_route_invalidate_nolock(struct dnet_node *n)
+{
+	struct dnet_route_table *old;
+
+	n->route_dirty = 1;
+
+	pthread_mutex_lock(&n->route_lock);
+	old = n->route;
+	if (old) {
+		__sync_synchronize();
+		n->route = NULL;
+
+		dnet_route_synchronize(n);
+	}
+	pthread_mutex_unlock(&n->route_lock);
+
+	free(old);
+}
+
+/*
+ * Builds new routing table snapshot from groups and publishes it,
+ * must be called under @n->state_lock
+ */
+static int dnet_route_update_nolock(struct dnet_node *n)
+{
+	struct dnet_route_table *route, *old;
+	struct dnet_route_entry *entries;
+	struct dnet_route_group *rg;
+	struct dnet_group *g;
+	uint64_t *keys;
+	int group_num = 0, id_num = 0, i;
+
+	list_for_each_entry(g, &n->group_list, group_entry) {
+		if (g->id_num > 0) {
+			group_num++;
+			id_num += g->id_num;
+		}
+	}
+
+	route = malloc(sizeof(struct dnet_route_table) + group_num * sizeof(struct dnet_route_group) +
+			id_num * (sizeof(uint64_t) + sizeof(struct dnet_route_entry)));
+	if (!route) {
+		dnet_log(n, DNET_LOG_ERROR, "Failed to allocate route table: groups: %d, ids: %d\n", group_num, id_num);
+		return -ENOMEM;
+	}
+
+	route->group_num = group_num;
+
+	keys = (uint64_t *)&route->groups[group_num];
+	entries = (struct dnet_route_entry *)&keys[id_num];
+
+	rg = route->groups;
+	list_for_each_entry(g, &n->group_list, group_entry) {
+		if (g->id_num <= 0)
+			continue;
+
+		rg->group_id = g->group_id;
+		rg->id_num = g->id_num;
+		rg->keys = keys;
+		rg->entries = entries;
+
+		for (i = 0; i < g->id_num; ++i) {
+			keys[i] = dnet_route_key(g->ids[i].raw.id);
+			entries[i].id = g->ids[i].raw;
+			entries[i].st = g->ids[i].idc->st;
+		}
+
+		keys += g->id_num;
+		entries += g->id_num;
+		rg++;
+	}
+
+	qsort(route->groups, group_num, sizeof(struct dnet_route_group), dnet_route_group_compare);
+
+	pthread_mutex_lock(&n->route_lock);
+	route->version = ++n->route_version;
+
+	old = n->route;
+
+	__sync_synchronize();
+	n->route = route;
+
+	if (old)
+		dnet_route_synchronize(n);
+	pthread_mutex_unlock(&n->route_lock);
+
+	free(old);
+
+	dnet_log(n, DNET_LOG_NOTICE, "Route table updated: version: %llu, groups: %d, ids: %d\n",
+			(unsigned long long)route->version, group_num, id_num);
+	return 0;
+}
+
+/*
+ * Rebuilds routing table snapshot if groups have changed since the last rebuild,
+ * checking thread calls it every timer tick
+ */
+void dnet_route_update(struct dnet_node *n)
+{
+	if (!*(volatile int *)&n->route_dirty)
+		return;
+
+	pthread_mutex_lock(&n->state_lock);
+	if (n->route_dirty && !dnet_route_update_nolock(n))
+		n->route_dirty = 0;
+	pthread_mutex_unlock(&n->state_lock);
+}
+
+/*
+ * Returns state which serves @id in snapshot @route, state is not referenced
+ */
+struct dnet_net_state *dnet_route_search(struct dnet_route_table *route, struct dnet_id *id)
+{
+	struct dnet_route_group *g = NULL;
+	uint64_t key;
+	int low, high, i, cmp;
+
+	for (low = 0, high = route->group_num; low < high; ) {
+		i = low + (high - low) / 2;
+
+		if (route->groups[i].group_id < id->group_id) {
+			low = i + 1;
+		} else if (route->groups[i].group_id > id->group_id) {
+			high = i;
+		} else {
+			g = &route->groups[i];
+			break;
+		}
+	}
+
+	if (!g)
+		return NULL;
+
+	/* the same lookup as __dnet_idc_search(): the last id not greater than @id, or the last one at all */
+	key = dnet_route_key(id->id);
+	for (low = -1, high = g->id_num; high - low > 1; ) {
+		i = low + (high - low) / 2;
+
+		if (g->keys[i] < key)
+			cmp = -1;
+		else if (g->keys[i] > key)
+			cmp = 1;
+		else
+			cmp = dnet_id_cmp_str(g->entries[i].id.id, id->id);
+
+		if (cmp < 0)
+			low = i;
+		else if (cmp > 0)
+			high = i;
+		else
+			return g->entries[i].st;
+	}
+
+	i = high - 1;
+	if (i == -1)
+		i = g->id_num - 1;
+
+	return g->entries[i].st;
+}
+
 static void dnet_idc_remove_ids(struct dnet_net_state *st, struct dnet_group *g)
 {
 	int i, pos;
@@ -170,6 +397,8 @@ static void dnet_idc_remove_ids(struct dnet_net_state *st, struct dnet_group *g)
 
 	qsort(g->ids,  g->id_num, sizeof(struct dnet_state_id), dnet_idc_compare);
 	st->idc = NULL;
+
+	dnet_route_invalidate_nolock(st->n);
 }
 
 int dnet_idc_create(struct dnet_net_state *st, int group_id, struct dnet_raw_id *ids, int id_num)
@@ -209,6 +438,7 @@ int dnet_idc_create(struct dnet_net_state *st, int group_id, struct dnet_raw_id
 	g->ids = realloc(g->ids, (g->id_num + id_num) * sizeof(struct dnet_state_id));
 	if (!g->ids) {
 		g->id_num = 0;
+		dnet_route_invalidate_nolock(n);
 		goto err_out_unlock_put;
 	}
 
@@ -237,6 +467,8 @@ int dnet_idc_create(struct dnet_net_state *st, int group_id, struct dnet_raw_id
 
 	st->idc = idc;
 
+	dnet_route_invalidate_nolock(n);
+
 	if (n->log->log_level >= DNET_LOG_DEBUG) {
 		for (i=0; i<g->id_num; ++i) {
 			struct dnet_state_id *id = &g->ids[i];
@@ -445,17 +677,30 @@ err_out_exit:
 
 struct dnet_net_state *dnet_state_get_first(struct dnet_node *n, struct dnet_id *id)
 {
-	struct dnet_net_state *found;
+	struct dnet_net_state *found = NULL;
+	struct dnet_route_table *route;
+	int idx;
+
+	idx = dnet_route_read_lock(n);
+	route = dnet_route_get(n);
+	if (route) {
+		found = dnet_route_search(route, id);
+		if (found)
+			dnet_state_get(found);
+	}
+	dnet_route_read_unlock(n, idx);
+
+	if (!route) {
+		pthread_mutex_lock(&n->state_lock);
+		found = dnet_state_search_nolock(n, id);
+		pthread_mutex_unlock(&n->state_lock);
+	}
 
-	pthread_mutex_lock(&n->state_lock);
-	found = dnet_state_search_nolock(n, id);
 	if (found == n->st) {
 		dnet_state_put(found);
 		found = NULL;
 	}
 
-	pthread_mutex_unlock(&n->state_lock);
-
 	return found;
 }
 void dnet_state_put(struct dnet_net_state *st)
@@ -553,11 +798,19 @@ struct dnet_node *dnet_node_create(struct dnet_config *cfg)
 	n->removal_delay = cfg->removal_delay;
 	n->flags = cfg->flags;
 	n->cache_size = cfg->cache_size;
+	n->cache_shards = cfg->cache_shards;
+	n->cache_policy = cfg->cache_policy;
+	n->cache_sync_timeout = cfg->cache_sync_timeout;
+	n->cache_sync_threads = cfg->cache_sync_threads;
+	n->cache_sync_rate = cfg->cache_sync_rate;
 	n->indexes_shard_count = cfg->indexes_shard_count;
 
 	if (!n->log)
 		dnet_log_init(n, cfg->log);
 
+	if (n->flags & DNET_CFG_ASYNC_LOG)
+		dnet_log_async_start(n);
+
 	dnet_log(n, DNET_LOG_INFO, "Elliptics starts\n");
 
 	if (!n->wait_ts.tv_sec) {
@@ -578,6 +831,20 @@ struct dnet_node *dnet_node_create(struct dnet_config *cfg)
 				n->cache_sync_timeout);
 	}
 
+	if (n->cache_shards <= 0) {
+		long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+		n->cache_shards = (cpus > 0) ? cpus : DNET_DEFAULT_CACHE_SHARDS;
+		dnet_log(n, DNET_LOG_NOTICE, "Using default cache shard number (%d shards).\n",
+				n->cache_shards);
+	}
+
+	if (n->cache_sync_threads <= 0) {
+		n->cache_sync_threads = DNET_DEFAULT_CACHE_SYNC_THREADS;
+		dnet_log(n, DNET_LOG_NOTICE, "Using default cache sync thread number (%d threads).\n",
+				n->cache_sync_threads);
+	}
+
 	if (!n->stall_count) {
 		n->stall_count = DNET_DEFAULT_STALL_TRANSACTIONS;
 		dnet_log(n, DNET_LOG_NOTICE, "Using default stall count (%ld transactions).\n",
@@ -649,16 +916,24 @@ void dnet_node_cleanup_common_resources(struct dnet_node *n)
 	pthread_attr_destroy(&n->attr);
 
 	pthread_mutex_destroy(&n->state_lock);
+	free(n->route);
+	pthread_mutex_destroy(&n->route_lock);
 	dnet_crypto_cleanup(n);
 
 	list_for_each_entry_safe(it, atmp, &n->reconnect_list, reconnect_entry) {
 		list_del(&it->reconnect_entry);
 		free(it);
 	}
+
+	/* messages still queued refer to node's logger, the rest is logged synchronously */
+	dnet_log_flush(n);
+	n->flags &= ~DNET_CFG_ASYNC_LOG;
+
 	dnet_counter_destroy(n);
 	pthread_mutex_destroy(&n->reconnect_lock);
 
 	dnet_wait_put(n->wait);
+	dnet_trans_timer_destroy(n);
 
 	close(n->autodiscovery_socket);
 }
@@ -818,11 +1093,36 @@ uint64_t dnet_session_get_user_flags(struct dnet_session *s)
 void dnet_session_set_timeout(struct dnet_session *s, unsigned int wait_timeout)
 {
 	s->wait_ts.tv_sec = wait_timeout;
+	s->wait_ts.tv_nsec = 0;
+}
+
+void dnet_session_set_timeout_ms(struct dnet_session *s, unsigned long wait_timeout_ms)
+{
+	s->wait_ts.tv_sec = wait_timeout_ms / 1000;
+	s->wait_ts.tv_nsec = (wait_timeout_ms % 1000) * 1000000;
 }
 
 struct timespec *dnet_session_get_timeout(struct dnet_session *s)
 {
-	return s->wait_ts.tv_sec ? &s->wait_ts : &s->node->wait_ts;
+	return (s->wait_ts.tv_sec || s->wait_ts.tv_nsec) ? &s->wait_ts : &s->node->wait_ts;
+}
+
+void dnet_node_get_counter(struct dnet_node *n, int counter, struct dnet_stat_count *st)
+{
+	if (counter < 0 || counter >= __DNET_CNTR_MAX)
+		counter = DNET_CNTR_UNKNOWN;
+
+	dnet_lock_lock(&n->counters_lock);
+	*st = n->counters[counter];
+	dnet_lock_unlock(&n->counters_lock);
+}
+
+void dnet_node_counter_inc(struct dnet_node *n, int counter, int err)
+{
+	if (counter < 0)
+		counter = DNET_CNTR_UNKNOWN;
+
+	dnet_counter_inc(n, counter, err);
 }
 
 void dnet_set_timeouts(struct dnet_node *n, int wait_timeout, int check_timeout)
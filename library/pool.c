@@ -31,6 +31,9 @@ static char *dnet_work_io_mode_string[] = {
 
 __thread uint32_t trace_id = 0;
 
+/* io pool thread which runs current thread, NULL for any other thread */
+static __thread struct dnet_work_io *dnet_thread_wio;
+
 static char *dnet_work_io_mode_str(int mode)
 {
 	if (mode < 0 || mode >= (int)ARRAY_SIZE(dnet_work_io_mode_string))
@@ -39,37 +42,67 @@ static char *dnet_work_io_mode_str(int mode)
 	return dnet_work_io_mode_string[mode];
 }
 
-static void dnet_work_pool_cleanup(struct dnet_work_pool *pool)
+static void dnet_work_io_free(struct dnet_work_io *wio)
 {
 	struct dnet_io_req *r, *tmp;
+	int i;
+
+	for (i = 0; i < __DNET_IO_PRIO_MAX; ++i) {
+		list_for_each_entry_safe(r, tmp, &wio->pinned_list[i], req_entry) {
+			list_del(&r->req_entry);
+			dnet_io_req_free(r);
+		}
+
+		list_for_each_entry_safe(r, tmp, &wio->list[i], req_entry) {
+			list_del(&r->req_entry);
+			dnet_io_req_free(r);
+		}
+	}
+
+	pthread_cond_destroy(&wio->wait);
+	pthread_mutex_destroy(&wio->lock);
+	free(wio);
+}
+
+static void dnet_work_pool_cleanup(struct dnet_work_pool *pool)
+{
 	struct dnet_work_io *wio, *wio_tmp;
+	struct dnet_work_trans *t, *t_tmp;
+	int i;
 
 	list_for_each_entry_safe(wio, wio_tmp, &pool->wio_list, wio_entry) {
 		pthread_join(wio->tid, NULL);
 		list_del(&wio->wio_entry);
-		free(wio);
+		dnet_work_io_free(wio);
 	}
 
+	for (i = 0; i < DNET_WORK_TRANS_HASH_SIZE; ++i) {
+		list_for_each_entry_safe(t, t_tmp, &pool->trans_hash[i].list, trans_entry) {
+			list_del(&t->trans_entry);
+			free(t);
+		}
 
-	list_for_each_entry_safe(r, tmp, &pool->list, req_entry) {
-		list_del(&r->req_entry);
-		dnet_io_req_free(r);
+		pthread_mutex_destroy(&pool->trans_hash[i].lock);
 	}
 
-	pthread_cond_destroy(&pool->wait);
 	pthread_mutex_destroy(&pool->lock);
-	free(pool->trans);
+	free(pool->wio);
 	free(pool);
 }
 
 static int dnet_work_pool_grow(struct dnet_node *n, struct dnet_work_pool *pool, int num, void *(* process)(void *))
 {
-	int i, err;
-	struct dnet_work_io *wio, *tmp;
+	int i, j, err;
+	struct dnet_work_io *wio, *tmp, **wios;
 
 	pthread_mutex_lock(&pool->lock);
 
-	pool->trans = realloc(pool->trans, sizeof(uint64_t) * (pool->num + num));
+	wios = realloc(pool->wio, sizeof(struct dnet_work_io *) * (pool->num + num));
+	if (!wios) {
+		err = -ENOMEM;
+		goto err_out_unlock;
+	}
+	pool->wio = wios;
 
 	for (i = 0; i < num; ++i) {
 		wio = malloc(sizeof(struct dnet_work_io));
@@ -78,13 +111,37 @@ static int dnet_work_pool_grow(struct dnet_node *n, struct dnet_work_pool *pool,
 			goto err_out_io_threads;
 		}
 
-		wio->thread_index = i;
+		memset(wio, 0, sizeof(struct dnet_work_io));
+
+		wio->thread_index = pool->num + i;
 		wio->pool = pool;
+		for (j = 0; j < __DNET_IO_PRIO_MAX; ++j) {
+			INIT_LIST_HEAD(&wio->pinned_list[j]);
+			INIT_LIST_HEAD(&wio->list[j]);
+		}
+		list_stat_init(&wio->list_stats);
 
-		pool->trans[pool->num + i] = ~0ULL;
+		err = pthread_mutex_init(&wio->lock, NULL);
+		if (err) {
+			free(wio);
+			err = -err;
+			goto err_out_io_threads;
+		}
+
+		err = pthread_cond_init(&wio->wait, NULL);
+		if (err) {
+			pthread_mutex_destroy(&wio->lock);
+			free(wio);
+			err = -err;
+			goto err_out_io_threads;
+		}
+
+		pool->wio[pool->num + i] = wio;
 
 		err = pthread_create(&wio->tid, NULL, process, wio);
 		if (err) {
+			pthread_cond_destroy(&wio->wait);
+			pthread_mutex_destroy(&wio->lock);
 			free(wio);
 			err = -err;
 			dnet_log(n, DNET_LOG_ERROR, "Failed to create IO thread: %d\n", err);
@@ -94,8 +151,8 @@ static int dnet_work_pool_grow(struct dnet_node *n, struct dnet_work_pool *pool,
 		list_add_tail(&wio->wio_entry, &pool->wio_list);
 	}
 
-	dnet_log(n, DNET_LOG_INFO, "Grew %s pool by: %d -> %d IO threads\n",
-			dnet_work_io_mode_str(pool->mode), pool->num, pool->num + num);
+	dnet_log(n, DNET_LOG_INFO, "Grew %s pool by: %d -> %d IO threads, key affinity: %d\n",
+			dnet_work_io_mode_str(pool->mode), pool->num, pool->num + num, pool->key_affinity);
 
 	pool->num += num;
 	pthread_mutex_unlock(&pool->lock);
@@ -106,18 +163,19 @@ err_out_io_threads:
 	list_for_each_entry_safe(wio, tmp, &pool->wio_list, wio_entry) {
 		pthread_join(wio->tid, NULL);
 		list_del(&wio->wio_entry);
-		free(wio);
+		dnet_work_io_free(wio);
 	}
-
+err_out_unlock:
 	pthread_mutex_unlock(&pool->lock);
 
 	return err;
 }
 
-static struct dnet_work_pool *dnet_work_pool_alloc(struct dnet_node *n, int num, int mode, void *(* process)(void *))
+static struct dnet_work_pool *dnet_work_pool_alloc(struct dnet_node *n, int num, int mode, int key_affinity,
+		void *(* process)(void *))
 {
 	struct dnet_work_pool *pool;
-	int err;
+	int err, i;
 
 	pool = malloc(sizeof(struct dnet_work_pool));
 	if (!pool) {
@@ -129,34 +187,38 @@ static struct dnet_work_pool *dnet_work_pool_alloc(struct dnet_node *n, int num,
 
 	pool->num = 0;
 	pool->mode = mode;
+	pool->key_affinity = key_affinity;
 	pool->n = n;
-	INIT_LIST_HEAD(&pool->list);
-	list_stat_init(&pool->list_stats);
 	INIT_LIST_HEAD(&pool->wio_list);
 
-	err = pthread_mutex_init(&pool->lock, NULL);
-	if (err) {
-		err = -err;
-		goto err_out_free;
+	for (i = 0; i < DNET_WORK_TRANS_HASH_SIZE; ++i) {
+		INIT_LIST_HEAD(&pool->trans_hash[i].list);
+
+		err = pthread_mutex_init(&pool->trans_hash[i].lock, NULL);
+		if (err) {
+			err = -err;
+			goto err_out_trans_destroy;
+		}
 	}
 
-	err = pthread_cond_init(&pool->wait, NULL);
+	err = pthread_mutex_init(&pool->lock, NULL);
 	if (err) {
 		err = -err;
-		goto err_out_mutex_destroy;
+		goto err_out_trans_destroy;
 	}
 
 	err = dnet_work_pool_grow(n, pool, num, process);
 	if (err)
-		goto err_out_cond_destroy;
+		goto err_out_mutex_destroy;
 
 	return pool;
 
-err_out_cond_destroy:
-	pthread_cond_destroy(&pool->wait);
 err_out_mutex_destroy:
 	pthread_mutex_destroy(&pool->lock);
-err_out_free:
+err_out_trans_destroy:
+	while (--i >= 0)
+		pthread_mutex_destroy(&pool->trans_hash[i].lock);
+	free(pool->wio);
 	free(pool);
 err_out_exit:
 	return NULL;
@@ -178,13 +240,140 @@ static inline void list_stat_log(struct list_stat *st, struct dnet_node *node, c
 }
 
 
-static void *dnet_io_process(void *data_);
+/*
+ * Returns thread which will process all replies of transaction @tid,
+ * transaction is claimed by the least loaded thread when its first reply
+ * which is not the last one is received, and released with the last reply.
+ * Returns NULL if reply may be processed by any thread.
+ */
+static struct dnet_work_io *dnet_work_trans_thread(struct dnet_work_pool *pool, struct dnet_cmd *cmd)
+{
+	uint64_t tid = cmd->trans & ~DNET_TRANS_REPLY;
+	struct dnet_work_trans_bucket *bucket = &pool->trans_hash[dnet_trans_hash(tid, DNET_WORK_TRANS_HASH_BITS)];
+	struct dnet_work_trans *t;
+	struct dnet_work_io *wio = NULL;
+	time_t now = time(NULL);
+	int i;
+
+	pthread_mutex_lock(&bucket->lock);
+
+	list_for_each_entry(t, &bucket->list, trans_entry) {
+		if (t->tid == tid) {
+			wio = pool->wio[t->thread_index];
+
+			if (cmd->flags & DNET_FLAGS_MORE) {
+				t->time = now;
+			} else {
+				list_del(&t->trans_entry);
+				free(t);
+			}
+			goto out_unlock;
+		}
+	}
+
+	if (!(cmd->flags & DNET_FLAGS_MORE))
+		goto out_unlock;
+
+	t = malloc(sizeof(struct dnet_work_trans));
+	if (!t)
+		goto out_unlock;
+
+	/* thread array does not change after pool is allocated, queue sizes are only a hint */
+	wio = pool->wio[0];
+	for (i = 1; i < pool->num; ++i) {
+		if (pool->wio[i]->list_stats.list_size < wio->list_stats.list_size)
+			wio = pool->wio[i];
+	}
+
+	t->tid = tid;
+	t->thread_index = wio->thread_index;
+	t->time = now;
+	list_add_tail(&t->trans_entry, &bucket->list);
+
+out_unlock:
+	pthread_mutex_unlock(&bucket->lock);
+	return wio;
+}
+
+/*
+ * Transactions whose last reply has never been received (for example because
+ * connection was reset) are dropped after transaction timeout
+ */
+static void dnet_work_pool_trans_sweep(struct dnet_work_pool *pool, time_t now)
+{
+	struct dnet_work_trans_bucket *bucket;
+	struct dnet_work_trans *t, *tmp;
+	int i;
+
+	for (i = 0; i < DNET_WORK_TRANS_HASH_SIZE; ++i) {
+		bucket = &pool->trans_hash[i];
+
+		pthread_mutex_lock(&bucket->lock);
+		list_for_each_entry_safe(t, tmp, &bucket->list, trans_entry) {
+			if (now - t->time > pool->n->check_timeout) {
+				list_del(&t->trans_entry);
+				free(t);
+			}
+		}
+		pthread_mutex_unlock(&bucket->lock);
+	}
+
+	pool->trans_sweep_time = now;
+}
+
+/*
+ * Called by checking thread every timer tick, sweeps claimed transactions once per transaction timeout
+ */
+void dnet_io_trans_sweep(struct dnet_node *n)
+{
+	struct dnet_io *io = n->io;
+	time_t now = time(NULL);
+
+	if (now - io->recv_pool->trans_sweep_time > n->check_timeout)
+		dnet_work_pool_trans_sweep(io->recv_pool, now);
+	if (now - io->recv_pool_nb->trans_sweep_time > n->check_timeout)
+		dnet_work_pool_trans_sweep(io->recv_pool_nb, now);
+}
+
+static int dnet_io_req_prio(struct dnet_cmd *cmd)
+{
+	if (cmd->flags & DNET_FLAGS_PRIO_HIGH)
+		return DNET_IO_PRIO_HIGH;
+	if (cmd->flags & DNET_FLAGS_PRIO_BACKGROUND)
+		return DNET_IO_PRIO_BACKGROUND;
+	if (cmd->trans & DNET_TRANS_REPLY)
+		return DNET_IO_PRIO_NORMAL;
+
+	switch (cmd->cmd) {
+	case DNET_CMD_ITERATOR:
+	case DNET_CMD_BULK_READ:
+	case DNET_CMD_READ_RANGE:
+	case DNET_CMD_DEL_RANGE:
+	case DNET_CMD_DEFRAG:
+		return DNET_IO_PRIO_BACKGROUND;
+	default:
+		return DNET_IO_PRIO_NORMAL;
+	}
+}
+
+static void dnet_work_io_wakeup(struct dnet_work_io *wio)
+{
+	pthread_mutex_lock(&wio->lock);
+	wio->wakeup = 1;
+	pthread_cond_signal(&wio->wait);
+	pthread_mutex_unlock(&wio->lock);
+}
+
 static void dnet_schedule_io(struct dnet_node *n, struct dnet_io_req *r)
 {
 	struct dnet_io *io = n->io;
 	struct dnet_work_pool *pool = io->recv_pool;
+	struct dnet_work_io *wio = NULL, *idle;
 	struct dnet_cmd *cmd = r->header;
 	int nonblocking = !!(cmd->flags & DNET_FLAGS_NOLOCK);
+	int pinned = 1;
+	struct timeval tv;
+	int i;
 
 	if (cmd->size > 0) {
 		dnet_log(r->st->n, DNET_LOG_DEBUG, "%s: %s: RECV cmd: %s: cmd-size: %llu, nonblocking: %d\n",
@@ -205,14 +394,177 @@ static void dnet_schedule_io(struct dnet_node *n, struct dnet_io_req *r)
 	if (nonblocking)
 		pool = io->recv_pool_nb;
 
+	gettimeofday(&tv, NULL);
+	r->queue_time = tv.tv_sec * 1000000ULL + tv.tv_usec;
+	r->prio = dnet_io_req_prio(cmd);
+	__sync_add_and_fetch(&pool->prio_stat[r->prio].queued, 1);
+
+	if (cmd->trans & DNET_TRANS_REPLY) {
+		wio = dnet_work_trans_thread(pool, cmd);
+	} else if (pool->key_affinity) {
+		wio = pool->wio[dnet_id_hash(cmd->id.id) % pool->num];
+	}
+
+	if (!wio) {
+		/* prefer idle thread, otherwise spread requests round-robin */
+		pinned = 0;
+		for (i = 0; i < pool->num; ++i) {
+			idle = pool->wio[(pool->next + i) % pool->num];
+			if (idle->idle) {
+				wio = idle;
+				break;
+			}
+		}
+
+		if (!wio)
+			wio = pool->wio[__sync_fetch_and_add(&pool->next, 1) % pool->num];
+	}
+
+	pthread_mutex_lock(&wio->lock);
+	list_add_tail(&r->req_entry, pinned ? &wio->pinned_list[r->prio] : &wio->list[r->prio]);
+	list_stat_size_increase(&wio->list_stats, 1);
+	list_stat_log(&wio->list_stats, r->st->n, "input io queue");
+	pthread_cond_signal(&wio->wait);
+	pthread_mutex_unlock(&wio->lock);
+
+	if (pinned || wio->idle)
+		return;
+
+	/*
+	 * Selected thread is busy, wake up any idle one to steal the request,
+	 * it may have become idle after we have checked above
+	 */
+	for (i = 0; i < pool->num; ++i) {
+		idle = pool->wio[i];
+		if (idle != wio && idle->idle) {
+			dnet_work_io_wakeup(idle);
+			break;
+		}
+	}
+}
+
+
+/*
+ * Received requests are allocated together with command and body.
+ * Requests with small bodies are taken from size-class pools shared by all nodes
+ * in the process, only large bodies get their own allocation.
+ * Every pool keeps at most @DNET_RECV_POOL_CACHE bytes of freed requests.
+ */
+#define DNET_RECV_POOL_CACHE		(4 * 1024 * 1024)
+
+struct dnet_io_req_pool {
+	pthread_mutex_t		lock;
+	size_t			size;
+	struct list_head	free_list;
+	int			free_num;
+
+	uint64_t		reused, allocated;
+};
+
+#define DNET_IO_REQ_POOL_INIT(pool, sz) {					\
+	.lock = PTHREAD_MUTEX_INITIALIZER,					\
+	.size = sz,								\
+	.free_list = LIST_HEAD_INIT(pool.free_list),				\
+}
+
+static struct dnet_io_req_pool dnet_io_req_pools[] = {
+	DNET_IO_REQ_POOL_INIT(dnet_io_req_pools[0], 256),
+	DNET_IO_REQ_POOL_INIT(dnet_io_req_pools[1], 1024),
+	DNET_IO_REQ_POOL_INIT(dnet_io_req_pools[2], 4096),
+	DNET_IO_REQ_POOL_INIT(dnet_io_req_pools[3], 16384),
+	DNET_IO_REQ_POOL_INIT(dnet_io_req_pools[4], 65536),
+};
+
+static struct dnet_io_req *dnet_io_req_recv_alloc(struct dnet_node *n, uint64_t size)
+{
+	struct dnet_io_req_pool *pool = NULL;
+	struct dnet_io_req *r = NULL;
+	unsigned int i;
+
+	for (i = 0; i < ARRAY_SIZE(dnet_io_req_pools); ++i) {
+		if (size <= dnet_io_req_pools[i].size) {
+			pool = &dnet_io_req_pools[i];
+			break;
+		}
+	}
+
+	if (!pool) {
+		__sync_add_and_fetch(&n->io->recv_large, 1);
+
+		r = malloc(size + sizeof(struct dnet_cmd) + sizeof(struct dnet_io_req));
+		if (r)
+			memset(r, 0, sizeof(struct dnet_io_req));
+		return r;
+	}
+
 	pthread_mutex_lock(&pool->lock);
-	list_add_tail(&r->req_entry, &pool->list);
-	list_stat_size_increase(&pool->list_stats, 1);
-	list_stat_log(&pool->list_stats, r->st->n, "input io queue");
-	pthread_cond_signal(&pool->wait);
+	if (!list_empty(&pool->free_list)) {
+		r = list_first_entry(&pool->free_list, struct dnet_io_req, req_entry);
+		list_del(&r->req_entry);
+		pool->free_num--;
+		pool->reused++;
+	} else {
+		pool->allocated++;
+	}
 	pthread_mutex_unlock(&pool->lock);
+
+	if (!r) {
+		r = malloc(pool->size + sizeof(struct dnet_cmd) + sizeof(struct dnet_io_req));
+		if (!r)
+			return NULL;
+	}
+
+	memset(r, 0, sizeof(struct dnet_io_req));
+	r->pool = pool;
+	return r;
 }
 
+void dnet_io_req_pool_put(struct dnet_io_req *r)
+{
+	struct dnet_io_req_pool *pool = r->pool;
+
+	pthread_mutex_lock(&pool->lock);
+	if ((pool->free_num + 1) * pool->size <= DNET_RECV_POOL_CACHE) {
+		list_add(&r->req_entry, &pool->free_list);
+		pool->free_num++;
+		r = NULL;
+	}
+	pthread_mutex_unlock(&pool->lock);
+
+	free(r);
+}
+
+void dnet_io_stat(struct dnet_node *n, struct dnet_stat_count *count)
+{
+	struct dnet_io_req_pool *pool;
+	uint64_t reused = 0, allocated = 0, cached = 0;
+	unsigned int i;
+
+	for (i = 0; i < ARRAY_SIZE(dnet_io_req_pools); ++i) {
+		pool = &dnet_io_req_pools[i];
+
+		pthread_mutex_lock(&pool->lock);
+		reused += pool->reused;
+		allocated += pool->allocated;
+		cached += pool->free_num * pool->size;
+		pthread_mutex_unlock(&pool->lock);
+	}
+
+	count[DNET_CNTR_RECV_CALLS].count = n->io->recv_calls;
+	count[DNET_CNTR_RECV_CALLS].err = n->io->recv_commands;
+	count[DNET_CNTR_RECV_POOL].count = reused;
+	count[DNET_CNTR_RECV_POOL].err = allocated;
+	count[DNET_CNTR_RECV_LARGE].count = n->io->recv_large;
+	count[DNET_CNTR_RECV_LARGE].err = cached;
+
+	for (i = 0; i < __DNET_IO_PRIO_MAX; ++i) {
+		struct dnet_io_prio_stat *st = &n->io->recv_pool->prio_stat[i];
+		struct dnet_io_prio_stat *st_nb = &n->io->recv_pool_nb->prio_stat[i];
+
+		count[DNET_CNTR_IO_PRIO_HIGH + i].count = st->queued + st_nb->queued;
+		count[DNET_CNTR_IO_PRIO_HIGH + i].err = (st->wait_time > st_nb->wait_time) ? st->wait_time : st_nb->wait_time;
+	}
+}
 
 void dnet_schedule_command(struct dnet_net_state *st)
 {
@@ -225,7 +577,7 @@ void dnet_schedule_command(struct dnet_net_state *st)
 		dnet_log(st->n, DNET_LOG_DEBUG, "freed: size: %llu, trans: %llu, reply: %d, ptr: %p.\n",
 						(unsigned long long)c->size, tid, tid != c->trans, st->rcv_data);
 #endif
-		free(st->rcv_data);
+		dnet_io_req_free(st->rcv_data);
 		st->rcv_data = NULL;
 	}
 
@@ -233,55 +585,87 @@ void dnet_schedule_command(struct dnet_net_state *st)
 	st->rcv_offset = 0;
 }
 
+static int dnet_recv_raw(struct dnet_net_state *st, void *data, uint64_t size)
+{
+	struct dnet_node *n = st->n;
+	int err;
+
+	err = recv(st->read_s, data, size, 0);
+	if (err < 0) {
+		err = -EAGAIN;
+		if (errno != EAGAIN && errno != EINTR) {
+			err = -errno;
+			dnet_log_err(n, "failed to receive data, socket: %d", st->read_s);
+		}
+
+		return err;
+	}
+
+	if (err == 0) {
+		dnet_log(n, DNET_LOG_ERROR, "Peer %s has disconnected.\n",
+			dnet_server_convert_dnet_addr(&st->addr));
+		return -ECONNRESET;
+	}
+
+	__sync_add_and_fetch(&n->io->recv_calls, 1);
+	return err;
+}
+
+/*
+ * Socket is read into per-connection buffer as much as fits,
+ * commands are parsed out of it one by one, only when there is
+ * no complete command header in the buffer we go to the socket again.
+ * Big bodies bypass the buffer and are received directly into request.
+ */
 static int dnet_process_recv_single(struct dnet_net_state *st)
 {
 	struct dnet_node *n = st->n;
 	struct dnet_io_req *r;
-	void *data;
-	uint64_t size;
+	uint64_t size, avail;
 	int err;
 
-again:
-	/*
-	 * Reading command first.
-	 */
-	if (st->rcv_flags & DNET_IO_CMD)
-		data = &st->rcv_cmd;
-	else
-		data = st->rcv_data;
-	data += st->rcv_offset;
-	size = st->rcv_end - st->rcv_offset;
-
-	if (size) {
-		err = recv(st->read_s, data, size, 0);
-		if (err < 0) {
-			err = -EAGAIN;
-			if (errno != EAGAIN && errno != EINTR) {
-				err = -errno;
-				dnet_log_err(n, "failed to receive data, socket: %d", st->read_s);
-				goto out;
-			}
-
+	if (!st->rcv_buf) {
+		st->rcv_buf = malloc(DNET_RECV_BUFFER_SIZE);
+		if (!st->rcv_buf) {
+			err = -ENOMEM;
 			goto out;
 		}
+	}
 
-		if (err == 0) {
-			dnet_log(n, DNET_LOG_ERROR, "Peer %s has disconnected.\n",
-				dnet_server_convert_dnet_addr(&st->addr));
-			err = -ECONNRESET;
-			goto out;
-		}
+again:
+	avail = st->rcv_buf_tail - st->rcv_buf_head;
 
-		st->rcv_offset += err;
-	}
+	if (!(st->rcv_flags & DNET_IO_CMD)) {
+		/*
+		 * Reading data, first take what is already buffered.
+		 */
+		size = st->rcv_end - st->rcv_offset;
+		if (avail > size)
+			avail = size;
 
-	if (st->rcv_offset != st->rcv_end)
-		goto again;
+		memcpy(st->rcv_data + st->rcv_offset, st->rcv_buf + st->rcv_buf_head, avail);
+		st->rcv_buf_head += avail;
+		st->rcv_offset += avail;
+		size -= avail;
+
+		if (!size)
+			goto out_complete;
+
+		if (size >= DNET_RECV_DIRECT_SIZE) {
+			err = dnet_recv_raw(st, st->rcv_data + st->rcv_offset, size);
+			if (err < 0)
+				goto out;
 
-	if (st->rcv_flags & DNET_IO_CMD) {
+			st->rcv_offset += err;
+			goto again;
+		}
+	} else if (avail >= sizeof(struct dnet_cmd)) {
 		unsigned long long tid;
 		struct dnet_cmd *c = &st->rcv_cmd;
 
+		memcpy(c, st->rcv_buf + st->rcv_buf_head, sizeof(struct dnet_cmd));
+		st->rcv_buf_head += sizeof(struct dnet_cmd);
+
 		dnet_convert_cmd(c);
 
 		tid = c->trans & ~DNET_TRANS_REPLY;
@@ -292,12 +676,11 @@ again:
 				!!(c->trans & DNET_TRANS_REPLY),
 				(unsigned long long)c->size, (unsigned long long)c->flags, c->status);
 
-		r = malloc(c->size + sizeof(struct dnet_cmd) + sizeof(struct dnet_io_req));
+		r = dnet_io_req_recv_alloc(n, c->size);
 		if (!r) {
 			err = -ENOMEM;
 			goto out;
 		}
-		memset(r, 0, sizeof(struct dnet_io_req));
 
 		r->header = r + 1;
 		r->hsize = sizeof(struct dnet_cmd);
@@ -311,27 +694,49 @@ again:
 		if (c->size) {
 			r->data = r->header + sizeof(struct dnet_cmd);
 			r->dsize = c->size;
-
-			/*
-			 * We read the command header, now get the data.
-			 */
-			goto again;
 		}
+
+		/*
+		 * We parsed the command header, now get the data.
+		 */
+		goto again;
 	}
 
+	/*
+	 * Not enough buffered data, move the tail to the beginning of the buffer
+	 * (it is always smaller than command header) and read as much as fits.
+	 */
+	avail = st->rcv_buf_tail - st->rcv_buf_head;
+	if (avail)
+		memmove(st->rcv_buf, st->rcv_buf + st->rcv_buf_head, avail);
+	st->rcv_buf_head = 0;
+	st->rcv_buf_tail = avail;
+
+	err = dnet_recv_raw(st, st->rcv_buf + st->rcv_buf_tail, DNET_RECV_BUFFER_SIZE - st->rcv_buf_tail);
+	if (err < 0)
+		goto out;
+
+	st->rcv_buf_tail += err;
+	goto again;
+
+out_complete:
 	r = st->rcv_data;
 	st->rcv_data = NULL;
 
 	dnet_schedule_command(st);
 
+	__sync_add_and_fetch(&n->io->recv_commands, 1);
+
 	r->st = dnet_state_get(st);
 
 	dnet_schedule_io(n, r);
 	return 0;
 
 out:
-	if (err != -EAGAIN && err != -EINTR)
+	if (err != -EAGAIN && err != -EINTR) {
 		dnet_schedule_command(st);
+		st->rcv_buf_head = st->rcv_buf_tail = 0;
+	}
 
 	return err;
 }
@@ -452,31 +857,46 @@ void dnet_unschedule_recv(struct dnet_net_state *st)
 
 static int dnet_process_send_single(struct dnet_net_state *st)
 {
-	struct dnet_io_req *r = NULL;
+	struct dnet_io_req *reqs[DNET_SEND_BATCH];
+	struct dnet_io_req *r;
+	int num, completed, i;
 	int err;
 
 	while (1) {
-		r = NULL;
+		num = 0;
 
+		/*
+		 * Only this thread removes requests from the send list,
+		 * so they can be sent without the lock while others are queueing new ones
+		 */
 		pthread_mutex_lock(&st->send_lock);
 		if (!list_empty(&st->send_list)) {
-			r = list_first_entry(&st->send_list, struct dnet_io_req, req_entry);
+			list_for_each_entry(r, &st->send_list, req_entry) {
+				reqs[num++] = r;
+				if (num == DNET_SEND_BATCH)
+					break;
+			}
 		} else {
 			dnet_unschedule_send(st);
 		}
 		pthread_mutex_unlock(&st->send_lock);
 
-		if (!r) {
+		if (!num) {
 			err = -EAGAIN;
 			goto err_out_exit;
 		}
 
-		err = dnet_send_request(st, r);
-		if (st->send_offset == (r->dsize + r->hsize + r->fsize)) {
+		completed = 0;
+		err = dnet_send_request(st, reqs, num, &completed);
+
+		if (completed) {
 			pthread_mutex_lock(&st->send_lock);
-			list_del(&r->req_entry);
+			for (i = 0; i < completed; ++i)
+				list_del(&reqs[i]->req_entry);
 			pthread_mutex_unlock(&st->send_lock);
+		}
 
+		for (i = 0; i < completed; ++i) {
 			if (atomic_read(&st->send_queue_size) > 0)
 				if (atomic_dec(&st->send_queue_size) == DNET_SEND_WATERMARK_LOW) {
 					dnet_log(st->n, DNET_LOG_DEBUG,
@@ -486,8 +906,7 @@ static int dnet_process_send_single(struct dnet_net_state *st)
 					pthread_cond_broadcast(&st->send_wait);
 				}
 
-			dnet_io_req_free(r);
-			st->send_offset = 0;
+			dnet_io_req_free(reqs[i]);
 		}
 
 		if (err)
@@ -559,22 +978,65 @@ err_out_exit:
 	return err;
 }
 
+/*
+ * Processes events of the single state at most @DNET_NET_PROCESS_BUDGET times.
+ * Returns 0 if state still has work to do, -EAGAIN if it is idle
+ * and 1 if state has been reset and dropped.
+ */
+static int dnet_process_state_events(struct dnet_net_state *st, struct epoll_event *ev)
+{
+	int err, i;
+
+	for (i = 0; i < DNET_NET_PROCESS_BUDGET; ++i) {
+		err = st->process(st, ev);
+		if (err == 0)
+			continue;
+
+		if (err == -EAGAIN && st->stall < DNET_DEFAULT_STALL_TRANSACTIONS)
+			return -EAGAIN;
+
+		if (err < 0 || st->stall >= DNET_DEFAULT_STALL_TRANSACTIONS) {
+			if (!err)
+				err = -ETIMEDOUT;
+
+			dnet_state_reset(st, err);
+
+			pthread_mutex_lock(&st->send_lock);
+			dnet_unschedule_send(st);
+			dnet_unschedule_recv(st);
+			pthread_mutex_unlock(&st->send_lock);
+
+			// state still contains a fair number of transactions in its queue
+			// they will not be cleaned up here - dnet_state_put() will only drop refctn by 1,
+			// while every transaction holds a reference
+			//
+			// IO thread could remove transaction, it is the only place allowed to do so.
+			// transactions may live in the tree and be accessed without locks in IO thread,
+			// IO thread is kind of 'owner' of the transaction processing
+			dnet_state_put(st);
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
 static void *dnet_io_process_network(void *data_)
 {
 	struct dnet_net_io *nio = data_;
 	struct dnet_node *n = nio->n;
 	struct dnet_net_state *st;
-	struct epoll_event ev;
-	int err = 0;
+	struct epoll_event *ev = nio->events;
+	int err = 0, num, active, i, j;
 
 	dnet_set_name("net_pool");
 
 	while (!n->need_exit) {
-		err = epoll_wait(nio->epoll_fd, &ev, 1, 1000);
-		if (err == 0)
+		num = epoll_wait(nio->epoll_fd, ev, nio->max_events, 1000);
+		if (num == 0)
 			continue;
 
-		if (err < 0) {
+		if (num < 0) {
 			err = -errno;
 
 			if (err == -EAGAIN || err == -EINTR)
@@ -585,37 +1047,42 @@ static void *dnet_io_process_network(void *data_)
 			break;
 		}
 
-		st = ev.data.ptr;
-		st->epoll_fd = nio->epoll_fd;
-
-		while (1) {
-			err = st->process(st, &ev);
-			if (err == 0)
-				continue;
-
-			if (err == -EAGAIN && st->stall < DNET_DEFAULT_STALL_TRANSACTIONS)
-				break;
+		for (i = 0; i < num; ++i) {
+			st = ev[i].data.ptr;
+			st->epoll_fd = nio->epoll_fd;
+		}
 
-			if (err < 0 || st->stall >= DNET_DEFAULT_STALL_TRANSACTIONS) {
-				if (!err)
-					err = -ETIMEDOUT;
-
-				dnet_state_reset(st, err);
-
-				pthread_mutex_lock(&st->send_lock);
-				dnet_unschedule_send(st);
-				dnet_unschedule_recv(st);
-				pthread_mutex_unlock(&st->send_lock);
-
-				// state still contains a fair number of transactions in its queue
-				// they will not be cleaned up here - dnet_state_put() will only drop refctn by 1,
-				// while every transaction holds a reference
-				//
-				// IO thread could remove transaction, it is the only place allowed to do so.
-				// transactions may live in the tree and be accessed without locks in IO thread,
-				// IO thread is kind of 'owner' of the transaction processing
-				dnet_state_put(st);
-				break;
+		/*
+		 * Ready states are served round-robin, each one gets a budget per pass,
+		 * so that a single busy connection can not starve others.
+		 * Event is dropped from the set when its state runs out of work.
+		 */
+		active = num;
+		while (active && !n->need_exit) {
+			for (i = 0; i < num; ++i) {
+				st = ev[i].data.ptr;
+				if (!st)
+					continue;
+
+				err = dnet_process_state_events(st, &ev[i]);
+				if (err == 0)
+					continue;
+
+				ev[i].data.ptr = NULL;
+				active--;
+
+				/*
+				 * State has been freed, its read and write sockets may both be in the set,
+				 * and the other one may sit before current event and still be busy
+				 */
+				if (err == 1) {
+					for (j = 0; j < num; ++j) {
+						if (j != i && ev[j].data.ptr == st) {
+							ev[j].data.ptr = NULL;
+							active--;
+						}
+					}
+				}
 			}
 		}
 	}
@@ -643,58 +1110,171 @@ struct dnet_io_process_data {
 	int thread_number;
 };
 
-static struct dnet_io_req *take_request(struct dnet_work_pool *pool, int thread_index)
+/*
+ * Share of io thread time every scheduling class gets when all classes have queued requests
+ */
+static const int dnet_io_prio_weight[__DNET_IO_PRIO_MAX] = {
+	[DNET_IO_PRIO_HIGH] = 16,
+	[DNET_IO_PRIO_NORMAL] = 4,
+	[DNET_IO_PRIO_BACKGROUND] = 1,
+};
+
+#define DNET_IO_PRIO_VTIME_SCALE	1024
+
+static int dnet_work_io_empty(struct dnet_work_io *wio, int steal)
 {
-	struct dnet_io_req *it = NULL;
-	struct dnet_cmd *cmd;
-	uint64_t tid;
 	int i;
-	int ok;
 
-	list_for_each_entry(it, &pool->list, req_entry) {
-		cmd = it->header;
-		tid = cmd->trans & ~DNET_TRANS_REPLY;
-		ok = 1;
+	for (i = 0; i < __DNET_IO_PRIO_MAX; ++i) {
+		if (!list_empty(&wio->list[i]))
+			return 0;
+		if (!steal && !list_empty(&wio->pinned_list[i]))
+			return 0;
+	}
 
-		/* This is not a transaction reply, process it right now */
-		if (!(cmd->trans & DNET_TRANS_REPLY))
-			return it;
+	return 1;
+}
 
-		for (i = 0; i < pool->num; ++i) {
-			 /* Someone claimed transaction @tid */
-			if (pool->trans[i] == tid) {
-				 /* Its our transaction, let's handle it */
-				if (i == thread_index) {
-					/* its the last transaction in given set, clear 'claim' flag for current thread */
-					if (!(cmd->flags & DNET_FLAGS_MORE))
-						pool->trans[thread_index] = ~0ULL;
-
-					return it;
-				}
+/*
+ * Takes request from the class with the smallest virtual time (start-time fair queueing),
+ * class which has been idle can not accumulate credit, its virtual time is moved to the current one.
+ * Stealing threads only look into queues of requests which are not pinned to @wio.
+ */
+static struct dnet_io_req *dnet_work_io_pop(struct dnet_work_io *wio, int steal)
+{
+	struct dnet_io_req *r = NULL;
+	struct list_head *head = NULL;
+	uint64_t vtime, min_vtime = 0;
+	int i, prio = -1;
 
-				/* we should not touch it */
-				ok = 0;
-				break;
-			}
-		}
+	if (dnet_work_io_empty(wio, steal))
+		return NULL;
 
-		/*
-		 * 'ok' here means no one claimed given transaction, we can process it,
-		 * but only if 'we' do not wait for another transaction already.
-		 */
-		if (ok) {
-			if (pool->trans[thread_index] == ~0ULL) {
-				/* only claim this transaction if there will be others */
-				if (cmd->flags & DNET_FLAGS_MORE)
-					pool->trans[thread_index] = tid;
-				return it;
-			}
+	pthread_mutex_lock(&wio->lock);
+	for (i = 0; i < __DNET_IO_PRIO_MAX; ++i) {
+		if (list_empty(&wio->list[i]) && (steal || list_empty(&wio->pinned_list[i])))
+			continue;
+
+		vtime = wio->vtime[i];
+		if (vtime < wio->vclock)
+			vtime = wio->vclock;
+
+		if (prio < 0 || vtime < min_vtime) {
+			prio = i;
+			min_vtime = vtime;
 		}
 	}
 
+	if (prio >= 0) {
+		head = &wio->list[prio];
+		if (!steal && !list_empty(&wio->pinned_list[prio]))
+			head = &wio->pinned_list[prio];
+
+		r = list_first_entry(head, struct dnet_io_req, req_entry);
+		list_del_init(&r->req_entry);
+		list_stat_size_decrease(&wio->list_stats, 1);
+
+		wio->vclock = min_vtime;
+		wio->vtime[prio] = min_vtime + DNET_IO_PRIO_VTIME_SCALE / dnet_io_prio_weight[prio];
+	}
+	pthread_mutex_unlock(&wio->lock);
+
+	return r;
+}
+
+static struct dnet_io_req *dnet_work_io_steal(struct dnet_work_io *wio)
+{
+	struct dnet_work_pool *pool = wio->pool;
+	struct dnet_io_req *r;
+	int i;
+
+	for (i = 1; i < pool->num; ++i) {
+		r = dnet_work_io_pop(pool->wio[(wio->thread_index + i) % pool->num], 1);
+		if (r)
+			return r;
+	}
+
 	return NULL;
 }
 
+static void dnet_work_io_prio_stat(struct dnet_work_pool *pool, struct dnet_io_req *r)
+{
+	struct dnet_io_prio_stat *st = &pool->prio_stat[r->prio];
+	struct timeval tv;
+	uint64_t wait;
+
+	gettimeofday(&tv, NULL);
+	wait = tv.tv_sec * 1000000ULL + tv.tv_usec - r->queue_time;
+
+	__sync_sub_and_fetch(&st->queued, 1);
+
+	/* racy update is fine, this is just statistics */
+	st->wait_time = (st->wait_time * 15 + wait) / 16;
+}
+
+void dnet_io_latency_record(struct dnet_node *n, int type, int cmd, uint64_t usecs)
+{
+	struct dnet_work_io *wio = dnet_thread_wio;
+	struct dnet_latency_hist *h;
+	int idx = dnet_latency_hist_index(usecs);
+	uint64_t max;
+
+	if (cmd < 0 || cmd >= __DNET_CMD_MAX)
+		cmd = DNET_CMD_UNKNOWN;
+
+	if (wio && wio->pool->n == n) {
+		h = &wio->latency[type * __DNET_CMD_MAX + cmd];
+
+		h->count++;
+		h->sum += usecs;
+		h->buckets[idx]++;
+		if (usecs > h->max)
+			h->max = usecs;
+		return;
+	}
+
+	if (!n->io)
+		return;
+
+	h = &n->io->latency[type * __DNET_CMD_MAX + cmd];
+
+	__sync_fetch_and_add(&h->count, 1);
+	__sync_fetch_and_add(&h->sum, usecs);
+	__sync_fetch_and_add(&h->buckets[idx], 1);
+
+	max = h->max;
+	while (usecs > max && !__sync_bool_compare_and_swap(&h->max, max, usecs))
+		max = h->max;
+}
+
+static void dnet_work_pool_latency_stat(struct dnet_work_pool *pool, struct dnet_latency_hist *hist)
+{
+	struct dnet_work_io *wio;
+	int i;
+
+	pthread_mutex_lock(&pool->lock);
+	list_for_each_entry(wio, &pool->wio_list, wio_entry) {
+		for (i = 0; i < __DNET_LATENCY_HIST_MAX * __DNET_CMD_MAX; ++i)
+			dnet_latency_hist_merge(&hist[i], &wio->latency[i]);
+	}
+	pthread_mutex_unlock(&pool->lock);
+}
+
+/*
+ * Merges per-thread histograms into @hist, which must hold __DNET_LATENCY_HIST_MAX * __DNET_CMD_MAX zeroed entries.
+ * Owner threads keep updating them, so merged snapshot is not exactly consistent.
+ */
+void dnet_io_latency_stat(struct dnet_node *n, struct dnet_latency_hist *hist)
+{
+	int i;
+
+	for (i = 0; i < __DNET_LATENCY_HIST_MAX * __DNET_CMD_MAX; ++i)
+		dnet_latency_hist_merge(&hist[i], &n->io->latency[i]);
+
+	dnet_work_pool_latency_stat(n->io->recv_pool, hist);
+	dnet_work_pool_latency_stat(n->io->recv_pool_nb, hist);
+}
+
 static void *dnet_io_process(void *data_)
 {
 	struct dnet_work_io *wio = data_;
@@ -704,46 +1284,53 @@ static void *dnet_io_process(void *data_)
 	struct timespec ts;
 	struct timeval tv;
 	struct dnet_io_req *r;
-	int err;
 	struct dnet_cmd *cmd;
 
 	dnet_set_name("io_pool");
 
+	dnet_thread_wio = wio;
+
 	while (!n->need_exit) {
-		r = NULL;
-		err = 0;
+		r = dnet_work_io_pop(wio, 0);
 
-		gettimeofday(&tv, NULL);
-		ts.tv_sec = tv.tv_sec + 1;
-		ts.tv_nsec = tv.tv_usec * 1000;
+		if (!r) {
+			/*
+			 * Thread is marked idle before it looks into other queues,
+			 * so either it finds new request there or scheduler wakes it up
+			 */
+			pthread_mutex_lock(&wio->lock);
+			wio->idle = 1;
+			pthread_mutex_unlock(&wio->lock);
 
-		pthread_mutex_lock(&pool->lock);
+			r = dnet_work_io_steal(wio);
 
-		pool->trans[wio->thread_index] = -1;
+			pthread_mutex_lock(&wio->lock);
+			if (!r && !wio->wakeup && dnet_work_io_empty(wio, 0)) {
+				gettimeofday(&tv, NULL);
+				ts.tv_sec = tv.tv_sec + 1;
+				ts.tv_nsec = tv.tv_usec * 1000;
 
-		if (!(r = take_request(pool, wio->thread_index))) {
-			err = pthread_cond_timedwait(&pool->wait, &pool->lock, &ts);
-			if ((r = take_request(pool, wio->thread_index)))
-				err = 0;
-		}
+				pthread_cond_timedwait(&wio->wait, &wio->lock, &ts);
+			}
+			wio->idle = 0;
+			wio->wakeup = 0;
+			pthread_mutex_unlock(&wio->lock);
 
-		if (r) {
-			list_del_init(&r->req_entry);
-			list_stat_size_decrease(&pool->list_stats, 1);
+			if (!r)
+				continue;
 		}
-		pthread_mutex_unlock(&pool->lock);
 
-		if (!r || err)
-			continue;
+		dnet_work_io_prio_stat(pool, r);
 
 		st = r->st;
 		cmd = r->header;
 		trace_id = cmd->id.trace_id;
 
-		dnet_log(n, DNET_LOG_DEBUG, "%s: %s: got IO event: %p: hsize: %zu, dsize: %zu, mode: %s\n",
-			dnet_state_dump_addr(st), dnet_dump_id(r->header), r, r->hsize, r->dsize, dnet_work_io_mode_str(pool->mode));
+		dnet_log(n, DNET_LOG_DEBUG, "%s: %s: got IO event: %p: hsize: %zu, dsize: %zu, mode: %s, thread: %d\n",
+			dnet_state_dump_addr(st), dnet_dump_id(r->header), r, r->hsize, r->dsize,
+			dnet_work_io_mode_str(pool->mode), wio->thread_index);
 
-		err = dnet_process_recv(st, r);
+		dnet_process_recv(st, r);
 		trace_id = 0;
 
 		dnet_io_req_free(r);
@@ -753,6 +1340,20 @@ static void *dnet_io_process(void *data_)
 	return NULL;
 }
 
+static void dnet_io_set_affinity(struct dnet_node *n, pthread_t tid, const char *name, int cpu)
+{
+	int err;
+
+	err = dnet_thread_set_affinity(tid, cpu);
+	if (err) {
+		dnet_log(n, DNET_LOG_ERROR, "Failed to bind %s thread to CPU %d: %s [%d]\n",
+				name, cpu, strerror(-err), err);
+		return;
+	}
+
+	dnet_log(n, DNET_LOG_INFO, "Bound %s thread to CPU %d\n", name, cpu);
+}
+
 int dnet_io_init(struct dnet_node *n, struct dnet_config *cfg)
 {
 	int err, i;
@@ -767,16 +1368,17 @@ int dnet_io_init(struct dnet_node *n, struct dnet_config *cfg)
 	memset(n->io, 0, io_size);
 
 	n->io->net_thread_num = cfg->net_thread_num;
-	n->io->net_thread_pos = 0;
 	n->io->net = (struct dnet_net_io *)(n->io + 1);
 
-	n->io->recv_pool = dnet_work_pool_alloc(n, cfg->io_thread_num, DNET_WORK_IO_MODE_BLOCKING, dnet_io_process);
+	n->io->recv_pool = dnet_work_pool_alloc(n, cfg->io_thread_num, DNET_WORK_IO_MODE_BLOCKING,
+			cfg->io_key_affinity, dnet_io_process);
 	if (!n->io->recv_pool) {
 		err = -ENOMEM;
 		goto err_out_free;
 	}
 
-	n->io->recv_pool_nb = dnet_work_pool_alloc(n, cfg->nonblocking_io_thread_num, DNET_WORK_IO_MODE_NONBLOCKING, dnet_io_process);
+	n->io->recv_pool_nb = dnet_work_pool_alloc(n, cfg->nonblocking_io_thread_num, DNET_WORK_IO_MODE_NONBLOCKING,
+			cfg->io_key_affinity, dnet_io_process);
 	if (!n->io->recv_pool_nb) {
 		err = -ENOMEM;
 		goto err_out_free_recv_pool;
@@ -786,10 +1388,22 @@ int dnet_io_init(struct dnet_node *n, struct dnet_config *cfg)
 		struct dnet_net_io *nio = &n->io->net[i];
 
 		nio->n = n;
+		atomic_init(&nio->state_num, 0);
+
+		nio->max_events = cfg->net_max_events;
+		if (nio->max_events <= 0)
+			nio->max_events = DNET_DEFAULT_NET_MAX_EVENTS;
+
+		nio->events = malloc(nio->max_events * sizeof(struct epoll_event));
+		if (!nio->events) {
+			err = -ENOMEM;
+			goto err_out_net_destroy;
+		}
 
 		nio->epoll_fd = epoll_create(10000);
 		if (nio->epoll_fd < 0) {
 			err = -errno;
+			free(nio->events);
 			dnet_log_err(n, "Failed to create epoll fd");
 			goto err_out_net_destroy;
 		}
@@ -800,18 +1414,52 @@ int dnet_io_init(struct dnet_node *n, struct dnet_config *cfg)
 		err = pthread_create(&nio->tid, NULL, dnet_io_process_network, nio);
 		if (err) {
 			close(nio->epoll_fd);
+			free(nio->events);
 			err = -err;
 			dnet_log(n, DNET_LOG_ERROR, "Failed to create network processing thread: %d\n", err);
 			goto err_out_net_destroy;
 		}
+
+		if (cfg->net_cpu_affinity)
+			dnet_io_set_affinity(n, nio->tid, "network", i);
 	}
 
+	if (cfg->net_cpu_affinity || cfg->io_cpu_affinity) {
+		long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+		int bound = 0;
+
+		if (cfg->net_cpu_affinity)
+			bound += n->io->net_thread_num;
+		if (cfg->io_cpu_affinity)
+			bound += n->io->recv_pool->num + n->io->recv_pool_nb->num;
+
+		/* dnet_thread_set_affinity() wraps CPU number, extra threads share CPUs starting from the first */
+		if (cpus > 0 && bound > cpus)
+			dnet_log(n, DNET_LOG_ERROR, "Warning: %d threads are bound to %ld online CPUs, "
+					"threads after CPU %ld share CPUs starting from the first one\n",
+					bound, cpus, cpus - 1);
+	}
+
+	if (cfg->io_cpu_affinity) {
+		struct dnet_work_io *wio;
+		int cpu = cfg->net_cpu_affinity ? n->io->net_thread_num : 0;
+
+		list_for_each_entry(wio, &n->io->recv_pool->wio_list, wio_entry)
+			dnet_io_set_affinity(n, wio->tid, "io", cpu++);
+		list_for_each_entry(wio, &n->io->recv_pool_nb->wio_list, wio_entry)
+			dnet_io_set_affinity(n, wio->tid, "nonblocking io", cpu++);
+	}
+
+	dnet_log(n, DNET_LOG_INFO, "Started %d network threads, max events per wait: %d\n",
+			n->io->net_thread_num, n->io->net[0].max_events);
+
 	return 0;
 
 err_out_net_destroy:
 	while (--i >= 0) {
 		pthread_join(n->io->net[i].tid, NULL);
 		close(n->io->net[i].epoll_fd);
+		free(n->io->net[i].events);
 	}
 
 	dnet_work_pool_cleanup(n->io->recv_pool_nb);
@@ -834,6 +1482,7 @@ void dnet_io_exit(struct dnet_node *n)
 	for (i=0; i<io->net_thread_num; ++i) {
 		pthread_join(io->net[i].tid, NULL);
 		close(io->net[i].epoll_fd);
+		free(io->net[i].events);
 	}
 
 	dnet_work_pool_cleanup(io->recv_pool_nb);
@@ -229,7 +229,7 @@ struct dnet_node *dnet_server_node_create(struct dnet_config_data *cfg_data, str
 				n->notify_hash_size);
 	}
 
-	err = dnet_cache_init(n);
+	err = dnet_cache_init(n, cfg);
 	if (err)
 		goto err_out_notify_exit;
 
@@ -241,7 +241,8 @@ struct dnet_node *dnet_server_node_create(struct dnet_config_data *cfg_data, str
 		struct dnet_addr la;
 		int s;
 
-		err = dnet_locks_init(n, 1024);
+		/* number of lock stripes is derived from number of CPUs */
+		err = dnet_locks_init(n, 0);
 		if (err)
 			goto err_out_addr_cleanup;
 
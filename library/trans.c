@@ -17,6 +17,7 @@
 #include <sys/stat.h>
 
 #include <assert.h>
+#include <time.h>
 #include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -26,53 +27,237 @@
 #include "elliptics/packet.h"
 #include "elliptics/interface.h"
 
-static inline int dnet_trans_cmp(uint64_t old, uint64_t new)
+uint64_t dnet_time_ms(void)
 {
-	if (old > new)
-		return 1;
-	if (old < new)
-		return -1;
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000ULL + ts.tv_nsec / 1000000;
+}
+
+int dnet_trans_timer_init(struct dnet_node *n)
+{
+	struct dnet_trans_timer *timer = &n->trans_timer;
+	int i, j, err;
+
+	err = pthread_mutex_init(&timer->lock, NULL);
+	if (err)
+		return -err;
+
+	for (i = 0; i < DNET_TIMER_ROOT_SIZE; ++i)
+		INIT_LIST_HEAD(&timer->root[i]);
+
+	for (i = 0; i < DNET_TIMER_LEVELS; ++i)
+		for (j = 0; j < DNET_TIMER_LEVEL_SIZE; ++j)
+			INIT_LIST_HEAD(&timer->level[i][j]);
+
+	timer->time = dnet_time_ms();
 	return 0;
 }
 
-struct dnet_trans *dnet_trans_search(struct rb_root *root, uint64_t trans)
+void dnet_trans_timer_destroy(struct dnet_node *n)
 {
-	struct rb_node *n = root->rb_node;
-	struct dnet_trans *t = NULL;
-	int cmp = 1;
+	pthread_mutex_destroy(&n->trans_timer.lock);
+}
 
-	while (n) {
-		t = rb_entry(n, struct dnet_trans, trans_entry);
+static void dnet_trans_timer_add_nolock(struct dnet_trans_timer *timer, struct dnet_trans *t)
+{
+	uint64_t expires = t->expires;
+	uint64_t delta;
+	struct list_head *head;
+	int i, shift;
+
+	/* already expired transaction is processed with the next tick */
+	if (expires < timer->time)
+		expires = timer->time;
+
+	delta = expires - timer->time;
+	if (delta < DNET_TIMER_ROOT_SIZE) {
+		head = &timer->root[expires & (DNET_TIMER_ROOT_SIZE - 1)];
+		goto out_add;
+	}
 
-		cmp = dnet_trans_cmp(t->trans, trans);
-		if (cmp < 0)
-			n = n->rb_left;
-		else if (cmp > 0)
-			n = n->rb_right;
-		else
+	for (i = 0; i < DNET_TIMER_LEVELS; ++i) {
+		shift = DNET_TIMER_ROOT_BITS + i * DNET_TIMER_LEVEL_BITS;
+
+		if (delta < (1ULL << (shift + DNET_TIMER_LEVEL_BITS)) || i == DNET_TIMER_LEVELS - 1) {
+			/* too far timeouts are put into the last slot, they will be requeued when it is cascaded */
+			if (delta >= (1ULL << (shift + DNET_TIMER_LEVEL_BITS)))
+				expires = timer->time + (1ULL << (shift + DNET_TIMER_LEVEL_BITS)) - 1;
+
+			head = &timer->level[i][(expires >> shift) & (DNET_TIMER_LEVEL_SIZE - 1)];
+			break;
+		}
+	}
+
+out_add:
+	list_add_tail(&t->trans_list_entry, head);
+}
+
+/*
+ * (Re)arms transaction timer at @t->expires, must be called under @t->st->trans_lock
+ */
+void dnet_trans_timer_add(struct dnet_node *n, struct dnet_trans *t)
+{
+	struct dnet_trans_timer *timer = &n->trans_timer;
+
+	pthread_mutex_lock(&timer->lock);
+	list_del_init(&t->trans_list_entry);
+	dnet_trans_timer_add_nolock(timer, t);
+	pthread_mutex_unlock(&timer->lock);
+}
+
+/*
+ * Must be called under @t->st->trans_lock
+ */
+void dnet_trans_timer_del(struct dnet_node *n, struct dnet_trans *t)
+{
+	struct dnet_trans_timer *timer = &n->trans_timer;
+
+	pthread_mutex_lock(&timer->lock);
+	list_del_init(&t->trans_list_entry);
+	pthread_mutex_unlock(&timer->lock);
+}
+
+static void dnet_trans_timer_cascade(struct dnet_trans_timer *timer, struct list_head *slot)
+{
+	struct dnet_trans *t, *tmp;
+	LIST_HEAD(head);
+
+	list_splice_init(slot, &head);
+
+	list_for_each_entry_safe(t, tmp, &head, trans_list_entry) {
+		list_del(&t->trans_list_entry);
+		dnet_trans_timer_add_nolock(timer, t);
+	}
+}
+
+/*
+ * Moves transactions expired up to @now into @expired list (linked via @expire_entry),
+ * every returned transaction is referenced and detached from timer.
+ */
+static void dnet_trans_timer_expire(struct dnet_node *n, uint64_t now, struct list_head *expired)
+{
+	struct dnet_trans_timer *timer = &n->trans_timer;
+	struct dnet_trans *t, *tmp;
+	int idx, i;
+
+	pthread_mutex_lock(&timer->lock);
+	while (timer->time <= now) {
+		idx = timer->time & (DNET_TIMER_ROOT_SIZE - 1);
+
+		if (!idx) {
+			for (i = 0; i < DNET_TIMER_LEVELS; ++i) {
+				int shift = DNET_TIMER_ROOT_BITS + i * DNET_TIMER_LEVEL_BITS;
+				int lidx = (timer->time >> shift) & (DNET_TIMER_LEVEL_SIZE - 1);
+
+				dnet_trans_timer_cascade(timer, &timer->level[i][lidx]);
+				if (lidx)
+					break;
+			}
+		}
+
+		list_for_each_entry_safe(t, tmp, &timer->root[idx], trans_list_entry) {
+			list_del_init(&t->trans_list_entry);
+			list_add_tail(&t->expire_entry, expired);
+			dnet_trans_get(t);
+		}
+
+		timer->time++;
+	}
+	pthread_mutex_unlock(&timer->lock);
+}
+
+static inline struct list_head *dnet_trans_bucket(struct dnet_trans_table *table, uint64_t trans)
+{
+	return &table->buckets[dnet_trans_hash(trans, __builtin_ctz(table->size))];
+}
+
+/*
+ * Rehashes all transactions into @size buckets, table is left intact if allocation fails
+ */
+static int dnet_trans_table_resize(struct dnet_trans_table *table, unsigned int size)
+{
+	struct list_head *buckets, *old = table->buckets;
+	unsigned int old_size = table->size, i;
+	struct dnet_trans *t, *tmp;
+
+	buckets = malloc(size * sizeof(struct list_head));
+	if (!buckets)
+		return -ENOMEM;
+
+	for (i = 0; i < size; ++i)
+		INIT_LIST_HEAD(&buckets[i]);
+
+	table->buckets = buckets;
+	table->size = size;
+
+	for (i = 0; i < old_size; ++i) {
+		list_for_each_entry_safe(t, tmp, &old[i], trans_entry) {
+			list_move_tail(&t->trans_entry, dnet_trans_bucket(table, t->trans));
+		}
+	}
+
+	free(old);
+	return 0;
+}
+
+void dnet_trans_table_destroy(struct dnet_trans_table *table)
+{
+	free(table->buckets);
+	table->buckets = NULL;
+	table->size = table->num = 0;
+}
+
+struct dnet_trans *dnet_trans_search(struct dnet_trans_table *table, uint64_t trans)
+{
+	struct dnet_trans *t;
+
+	if (!table->num)
+		return NULL;
+
+	list_for_each_entry(t, dnet_trans_bucket(table, trans), trans_entry) {
+		if (t->trans == trans)
 			return dnet_trans_get(t);
 	}
 
 	return NULL;
 }
 
-int dnet_trans_insert_nolock(struct rb_root *root, struct dnet_trans *a)
+/*
+ * Returns transaction from the first non-empty bucket starting at @pos,
+ * @pos is updated to point to that bucket.
+ */
+struct dnet_trans *dnet_trans_next_nolock(struct dnet_trans_table *table, unsigned int *pos)
 {
-	struct rb_node **n = &root->rb_node, *parent = NULL;
-	struct dnet_trans *t;
-	int cmp;
+	unsigned int i;
 
-	while (*n) {
-		parent = *n;
+	for (i = *pos; i < table->size; ++i) {
+		if (!list_empty(&table->buckets[i])) {
+			*pos = i;
+			return list_first_entry(&table->buckets[i], struct dnet_trans, trans_entry);
+		}
+	}
 
-		t = rb_entry(parent, struct dnet_trans, trans_entry);
+	*pos = table->size;
+	return NULL;
+}
 
-		cmp = dnet_trans_cmp(t->trans, a->trans);
-		if (cmp < 0)
-			n = &parent->rb_left;
-		else if (cmp > 0)
-			n = &parent->rb_right;
-		else
+int dnet_trans_insert_nolock(struct dnet_trans_table *table, struct dnet_trans *a)
+{
+	struct list_head *head;
+	struct dnet_trans *t;
+	int err;
+
+	if (!table->buckets) {
+		err = dnet_trans_table_resize(table, DNET_TRANS_TABLE_MIN_SIZE);
+		if (err)
+			return err;
+	}
+
+	head = dnet_trans_bucket(table, a->trans);
+	list_for_each_entry(t, head, trans_entry) {
+		if (t->trans == a->trans)
 			return -EEXIST;
 	}
 
@@ -81,24 +266,31 @@ int dnet_trans_insert_nolock(struct rb_root *root, struct dnet_trans *a)
 			dnet_dump_id(&a->cmd.id), (unsigned long long)a->trans,
 			dnet_server_convert_dnet_addr(&a->st->addr));
 
-	rb_link_node(&a->trans_entry, parent, n);
-	rb_insert_color(&a->trans_entry, root);
+	list_add_tail(&a->trans_entry, head);
+	table->num++;
+
+	/* failed growth only makes chains longer */
+	if (table->num > table->size)
+		dnet_trans_table_resize(table, table->size * 2);
+
 	return 0;
 }
 
-void dnet_trans_remove_nolock(struct rb_root *root, struct dnet_trans *t)
+void dnet_trans_remove_nolock(struct dnet_trans_table *table, struct dnet_trans *t)
 {
-	if (!t->trans_entry.rb_parent_color) {
+	if (list_empty(&t->trans_entry)) {
 		if (t->st && t->st->n)
 			dnet_log(t->st->n, DNET_LOG_ERROR, "%s: trying to remove standalone transaction %llu.\n",
 				dnet_dump_id(&t->cmd.id), (unsigned long long)t->trans);
 		return;
 	}
 
-	if (t) {
-		rb_erase(&t->trans_entry, root);
-		t->trans_entry.rb_parent_color = 0;
-	}
+	list_del_init(&t->trans_entry);
+	table->num--;
+
+	/* give memory back after large fan-outs like bulk reads */
+	if (table->size > DNET_TRANS_TABLE_MIN_SIZE && table->num < table->size / 8)
+		dnet_trans_table_resize(table, table->size / 2);
 }
 
 void dnet_trans_remove(struct dnet_trans *t)
@@ -106,8 +298,8 @@ void dnet_trans_remove(struct dnet_trans *t)
 	struct dnet_net_state *st = t->st;
 
 	pthread_mutex_lock(&st->trans_lock);
-	dnet_trans_remove_nolock(&st->trans_root, t);
-	list_del_init(&t->trans_list_entry);
+	dnet_trans_remove_nolock(&st->trans_table, t);
+	dnet_trans_timer_del(st->n, t);
 	pthread_mutex_unlock(&st->trans_lock);
 }
 
@@ -122,7 +314,9 @@ struct dnet_trans *dnet_trans_alloc(struct dnet_node *n __unused, uint64_t size)
 	memset(t, 0, sizeof(struct dnet_trans) + size);
 
 	atomic_init(&t->refcnt, 1);
+	INIT_LIST_HEAD(&t->trans_entry);
 	INIT_LIST_HEAD(&t->trans_list_entry);
+	INIT_LIST_HEAD(&t->expire_entry);
 
 	gettimeofday(&t->start, NULL);
 
@@ -132,6 +326,101 @@ err_out_exit:
 	return NULL;
 }
 
+static int dnet_latency_class(int cmd)
+{
+	switch (cmd) {
+	case DNET_CMD_READ:
+	case DNET_CMD_LOOKUP:
+	case DNET_CMD_BULK_READ:
+	case DNET_CMD_READ_RANGE:
+		return DNET_LATENCY_READ;
+	case DNET_CMD_WRITE:
+	case DNET_CMD_BULK_WRITE:
+	case DNET_CMD_DEL:
+	case DNET_CMD_DEL_RANGE:
+		return DNET_LATENCY_WRITE;
+	default:
+		return DNET_LATENCY_OTHER;
+	}
+}
+
+static void dnet_latency_update(struct dnet_latency *l, long usecs)
+{
+	uint64_t val = usecs > 0 ? usecs : 0;
+	int i, bucket = 0;
+
+	if (!l->count && !l->ewma)
+		l->ewma = val;
+	else
+		l->ewma = l->ewma - l->ewma / 8 + val / 8;
+
+	while (bucket < DNET_LATENCY_BUCKETS - 1 && val >= (2ULL << bucket))
+		bucket++;
+
+	l->hist[bucket]++;
+	l->count++;
+
+	if (l->count >= DNET_LATENCY_DECAY_COUNT) {
+		l->count = 0;
+		for (i = 0; i < DNET_LATENCY_BUCKETS; ++i) {
+			l->hist[i] /= 2;
+			l->count += l->hist[i];
+		}
+	}
+}
+
+/*
+ * Returns upper bound of the histogram bucket where @percent of samples fall below
+ */
+uint64_t dnet_latency_percentile(struct dnet_latency *l, int percent)
+{
+	uint64_t need, sum = 0;
+	int i;
+
+	if (!l->count)
+		return 0;
+
+	need = (l->count * percent + 99) / 100;
+
+	for (i = 0; i < DNET_LATENCY_BUCKETS; ++i) {
+		sum += l->hist[i];
+		if (sum >= need)
+			break;
+	}
+
+	if (i == DNET_LATENCY_BUCKETS)
+		i--;
+
+	return (2ULL << i) - 1;
+}
+
+int dnet_state_latency_stat(struct dnet_session *s, struct dnet_id *id, int latency_class, struct dnet_latency_stat *stat)
+{
+	struct dnet_net_state *st;
+	struct dnet_latency *l;
+
+	if (latency_class < 0 || latency_class >= __DNET_LATENCY_MAX)
+		return -EINVAL;
+
+	st = dnet_state_get_first(s->node, id);
+	if (!st)
+		return -ENXIO;
+
+	l = &st->latency[latency_class];
+
+	pthread_mutex_lock(&st->trans_lock);
+	stat->ewma = l->ewma;
+	stat->p50 = dnet_latency_percentile(l, 50);
+	stat->p95 = dnet_latency_percentile(l, 95);
+	stat->p99 = dnet_latency_percentile(l, 99);
+	stat->count = l->count;
+	stat->inflight = st->trans_table.num;
+	pthread_mutex_unlock(&st->trans_lock);
+
+	dnet_state_put(st);
+	return 0;
+}
+
 void dnet_trans_destroy(struct dnet_trans *t)
 {
 	struct dnet_net_state *st = NULL;
@@ -148,10 +437,10 @@ void dnet_trans_destroy(struct dnet_trans *t)
 		st = t->st;
 
 		pthread_mutex_lock(&st->trans_lock);
-		list_del_init(&t->trans_list_entry);
+		dnet_trans_timer_del(st->n, t);
 		pthread_mutex_unlock(&st->trans_lock);
 
-		if (t->trans_entry.rb_parent_color)
+		if (!list_empty(&t->trans_entry))
 			dnet_trans_remove(t);
 	} else if (!list_empty(&t->trans_list_entry)) {
 		assert(0);
@@ -162,6 +451,13 @@ void dnet_trans_destroy(struct dnet_trans *t)
 		t->complete(t->st, &t->cmd, t->priv);
 	}
 
+	/* only transactions which were really sent have expiration time */
+	if (st && t->command && t->expires) {
+		pthread_mutex_lock(&st->trans_lock);
+		dnet_latency_update(&st->latency[dnet_latency_class(t->command)], diff);
+		pthread_mutex_unlock(&st->trans_lock);
+	}
+
 	if (st && (t->cmd.status == 0) &&
 			((t->command == DNET_CMD_READ) || (t->command == DNET_CMD_LOOKUP))) {
 
@@ -173,7 +469,7 @@ void dnet_trans_destroy(struct dnet_trans *t)
 		st->median_read_time = (st->median_read_time + diff) / 2;
 	}
 
-	if (st && st->n && t->command != 0) {
+	if (st && st->n && t->command != 0 && dnet_log_enabled(st->n, DNET_LOG_INFO)) {
 		char str[64];
 		struct tm tm;
 
@@ -284,94 +580,136 @@ err_out_exit:
 	return err;
 }
 
-static void dnet_trans_clean_list(struct list_head *head)
+/*
+ * Transaction could have been completed or rearmed by reply received after timer has fired,
+ * it is only timed out if it is still in the state's tree and not in the timer wheel.
+ */
+static int dnet_trans_timeout(struct dnet_trans *t, uint64_t now)
 {
-	struct dnet_trans *t, *tmp;
+	struct dnet_net_state *st = t->st;
+	int expired = 0;
+	char str[64];
+	struct tm tm;
 
-	list_for_each_entry_safe(t, tmp, head, trans_list_entry) {
-		list_del_init(&t->trans_list_entry);
+	pthread_mutex_lock(&st->trans_lock);
+	if (list_empty(&t->trans_list_entry) && !list_empty(&t->trans_entry)) {
+		dnet_trans_remove_nolock(&st->trans_table, t);
+		expired = 1;
+	}
+	pthread_mutex_unlock(&st->trans_lock);
 
-		t->cmd.size = 0;
-		t->cmd.flags = 0;
-		t->cmd.status = -ETIMEDOUT;
+	if (!expired)
+		return 0;
 
-		if (t->complete)
-			t->complete(t->st, &t->cmd, t->priv);
+	localtime_r((time_t *)&t->start.tv_sec, &tm);
+	strftime(str, sizeof(str), "%F %R:%S", &tm);
 
-		dnet_trans_put(t);
+	dnet_log(st->n, DNET_LOG_ERROR, "%s: trans: %llu TIMEOUT: stall-check wait-ts: %ld.%03ld, cmd: %s [%d], started: %s.%06lu\n",
+			dnet_state_dump_addr(st), (unsigned long long)t->trans,
+			(unsigned long)t->wait_ts.tv_sec, t->wait_ts.tv_nsec / 1000000,
+			dnet_cmd_string(t->cmd.cmd), t->cmd.cmd,
+			str, t->start.tv_usec);
+
+	/*
+	 * Stall counter is increased once per timer run, so that a burst of transactions
+	 * sent at the same time does not reset connection at once
+	 */
+	if (st->stall_time != now) {
+		st->stall_time = now;
+		st->stall++;
+
+		if (st->weight >= 2)
+			st->weight /= 2;
+
+		dnet_log(st->n, DNET_LOG_ERROR, "%s: TIMEOUT: stall counter: %d/%ld, weight: %f\n",
+				dnet_state_dump_addr(st), st->stall, st->n->stall_count, st->weight);
+
+		if (st->stall >= st->n->stall_count)
+			dnet_state_reset(st, -ETIMEDOUT);
 	}
+
+	t->cmd.size = 0;
+	t->cmd.flags = 0;
+	t->cmd.status = -ETIMEDOUT;
+
+	if (t->complete)
+		t->complete(t->st, &t->cmd, t->priv);
+
+	dnet_trans_put(t);
+	return 1;
 }
 
-static void dnet_trans_check_stall(struct dnet_net_state *st, struct list_head *head)
+void *dnet_timer_start(struct dnet_node *n, unsigned long timeout_ms,
+		int (* complete)(struct dnet_net_state *st, struct dnet_cmd *cmd, void *priv), void *priv)
 {
-	struct dnet_trans *t, *tmp;
-	struct timeval tv;
-	int trans_timeout = 0;
-	char str[64];
-	struct tm tm;
+	struct dnet_trans *t;
 
-	gettimeofday(&tv, NULL);
+	t = dnet_trans_alloc(n, 0);
+	if (!t)
+		return NULL;
 
-	pthread_mutex_lock(&st->trans_lock);
-	list_for_each_entry_safe(t, tmp, &st->trans_list, trans_list_entry) {
-		if (t->time.tv_sec >= tv.tv_sec)
-			break;
+	t->complete = complete;
+	t->priv = priv;
+	t->expires = dnet_time_ms() + timeout_ms;
 
-		localtime_r((time_t *)&t->start.tv_sec, &tm);
-		strftime(str, sizeof(str), "%F %R:%S", &tm);
+	/* reference dropped when timer leaves the wheel */
+	dnet_trans_get(t);
+	dnet_trans_timer_add(n, t);
 
-		dnet_log(st->n, DNET_LOG_ERROR, "%s: trans: %llu TIMEOUT: stall-check wait-ts: %ld, cmd: %s [%d], started: %s.%06lu\n",
-				dnet_state_dump_addr(st), (unsigned long long)t->trans,
-				(unsigned long)t->wait_ts.tv_sec,
-				dnet_cmd_string(t->cmd.cmd), t->cmd.cmd,
-				str, t->start.tv_usec);
-		trans_timeout++;
+	return t;
+}
 
-		dnet_trans_remove_nolock(&st->trans_root, t);
-		list_move(&t->trans_list_entry, head);
-	}
-	pthread_mutex_unlock(&st->trans_lock);
+int dnet_timer_cancel(struct dnet_node *n, void *timer)
+{
+	struct dnet_trans_timer *wheel = &n->trans_timer;
+	struct dnet_trans *t = timer;
+	int cancelled = 0;
 
-	if (trans_timeout) {
-		st->stall++;
+	if (!t)
+		return 0;
 
-		if (st->weight >= 2)
-			st->weight /= 2;
+	pthread_mutex_lock(&wheel->lock);
+	if (!list_empty(&t->trans_list_entry)) {
+		list_del_init(&t->trans_list_entry);
+		cancelled = 1;
+	}
+	pthread_mutex_unlock(&wheel->lock);
 
-		dnet_log(st->n, DNET_LOG_ERROR, "%s: TIMEOUT: transactions: %d, stall counter: %d/%u, weight: %f\n",
-				dnet_state_dump_addr(st), trans_timeout, st->stall, DNET_DEFAULT_STALL_TRANSACTIONS, st->weight);
+	if (cancelled)
+		dnet_trans_put(t);
 
-		if (st->stall >= st->n->stall_count) {
-			dnet_state_reset(st, -ETIMEDOUT);
-		}
-	} else {
-		st->stall = 0;
+	dnet_trans_put(t);
+	return cancelled;
+}
+
+static void dnet_timer_fire(struct dnet_trans *t)
+{
+	t->cmd.status = -ETIMEDOUT;
 
-		if (st->weight < DNET_STATE_MAX_WEIGHT)
-			st->weight *= 1.2;
+	if (t->complete)
+		t->complete(NULL, &t->cmd, t->priv);
 
-		if (st->stall) {
-			dnet_log(st->n, DNET_LOG_INFO, "%s: reseting state stall counter: weight: %f\n",
-					dnet_state_dump_addr(st), st->weight);
-		}
-	}
+	dnet_trans_put(t);
 }
 
-static void dnet_check_all_states(struct dnet_node *n)
+static void dnet_check_expired_trans(struct dnet_node *n)
 {
-	struct dnet_net_state *st, *tmp;
-	struct dnet_group *g, *gtmp;
+	struct dnet_trans *t, *tmp;
+	uint64_t now = dnet_time_ms();
 	LIST_HEAD(head);
 
-	pthread_mutex_lock(&n->state_lock);
-	list_for_each_entry_safe(g, gtmp, &n->group_list, group_entry) {
-		list_for_each_entry_safe(st, tmp, &g->state_list, state_entry) {
-			dnet_trans_check_stall(st, &head);
-		}
-	}
-	pthread_mutex_unlock(&n->state_lock);
+	dnet_trans_timer_expire(n, now, &head);
+
+	list_for_each_entry_safe(t, tmp, &head, expire_entry) {
+		list_del_init(&t->expire_entry);
 
-	dnet_trans_clean_list(&head);
+		/* timers started by dnet_timer_start() are not bound to any state */
+		if (!t->st)
+			dnet_timer_fire(t);
+		else
+			dnet_trans_timeout(t, now);
+		dnet_trans_put(t);
+	}
 }
 
 static int dnet_check_route_table(struct dnet_node *n)
@@ -458,8 +796,10 @@ static void *dnet_check_process(void *data)
 	dnet_set_name("stall-check");
 
 	while (!n->need_exit) {
-		dnet_check_all_states(n);
-		sleep(1);
+		dnet_check_expired_trans(n);
+		dnet_route_update(n);
+		dnet_io_trans_sweep(n);
+		usleep(DNET_TIMER_INTERVAL_MS * 1000);
 	}
 
 	return NULL;